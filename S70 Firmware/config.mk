@@ -98,6 +98,7 @@ C_SRCS = \
 	src/system/drivers/eeprom/m24c08.c \
 	src/system/drivers/eeprom/25lc1024.c \
 	src/system/drivers/usb_slave/usb_slave.c \
+	src/system/drivers/usb_slave/apt_frame.c \
 	src/system/drivers/usb_slave/ftdi/ftdi.c \
 	src/system/drivers/usb_host/*.c \
 	src/system/drivers/encoder/encoder.c \
@@ -121,6 +122,7 @@ C_SRCS = \
 	src/system/drivers/usart/user_usart.c \
 	src/system/drivers/io/mcp23s09.c \
 	src/system/helper/helper.c \
+	src/spi_bridge_crc.c \
 	src/system/sync/gate/gate.c \
 	src/system/boards/hexapod/hexapod.c \
 	src/system/boards/hexapod/hex_kins.c \
@@ -163,9 +165,12 @@ CXX_OPT_SRC = \
 	src/system/drivers/usb_host/hid-mapping-service.cc \
 	src/system/drivers/usb_host/hid_item_parser.cc \
 	src/system/drivers/usb_host/hid_report.cc \
+	src/system/drivers/usb_host/rt_bridge.cc \
 	src/system/drivers/usb_host/usb-device/*.cc \
 	src/system/services/hid-mapping/*.cc \
 	src/system/services/itc-service/*.cc \
+	src/system/services/profiler/*.cc \
+	src/system/services/spi-scheduler/*.cc \
 	src/system/slots/slot_nums.cc \
 	src/system/sync/lock_guard/*.cc \
 	src/system/sync/rw-lock/*.cc \
@@ -300,6 +305,8 @@ INC_PATH = \
 	src/system/services/ \
 	src/system/services/hid-mapping \
 	src/system/services/itc-service \
+	src/system/services/profiler \
+	src/system/services/spi-scheduler \
 	src/system/sync \
 	src/system/sync/gate \
 	src/system/sync/lock_guard \
@@ -52,7 +52,7 @@
  * constant can be increased, but the current value is the smallest possible one
  * that will be compatible with all existing projects.
  */
-#define MAX_INTERRUPT_SOURCES      14 // PR 7
+#define MAX_INTERRUPT_SOURCES      15 // PR 7, +1 for the MAX3421E INT pin
 
 /**
  * Describes a PIO interrupt source, including the PIO instance triggering the
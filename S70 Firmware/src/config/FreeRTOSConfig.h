@@ -156,6 +156,7 @@ to exclude the API function. */
 #define INCLUDE_eTaskGetState 1
 #define INCLUDE_xTimerPendFunctionCall 1
 #define INCLUDE_uxTaskGetStackHighWaterMark 1
+#define INCLUDE_xSemaphoreGetMutexHolder 1
 // #define INCLUDE_xTaskGetIdleTaskHandle 0
 // added for Segger SystemView
 #define INCLUDE_xTaskGetIdleTaskHandle 1
@@ -209,23 +210,24 @@ standard names. */
 #include "tc2.h"
 #define NameQueueObject(obj, name) vQueueAddToRegistry(obj, name)
 #define configUSE_TRACE_FAILITY 1
-#define configGENERATE_RUN_TIME_STATS 1
-#define configGENERATE_RUN_TIME_STATS_USE_TICKS 1
 #define configUSE_STATS_FORMATTING_FUNCTIONS 1
 #define configRECORD_STACK_HIGH_ADDRESS 1
 #define configQUEUE_REGISTRY_SIZE 32
-extern void vConfigureTimerForRunTimeStats(void);
-#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()                               \
-    vConfigureTimerForRunTimeStats()
-#define portGET_RUN_TIME_COUNTER_VALUE() (uint16_t) REG_TC2_CV2
 // #define INCLUDE_xSemaphoreGetMutexHolder        1
 //  You can cast the mutex to xQUEUE in debugger, then pcTail will be the task
 //  that hold it.
 #else
 #define NameQueueObject(obj, name)
-#define configGENERATE_RUN_TIME_STATS 0
 #endif
 
+/* Run time statistics are always kept for the profiler service.  They count
+CPU cycles so a context switch only reads the DWT cycle counter. */
+#define configGENERATE_RUN_TIME_STATS 1
+extern void profiler_configure_cycle_counter(void);
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()                               \
+    profiler_configure_cycle_counter()
+#define portGET_RUN_TIME_COUNTER_VALUE() (DWT->CYCCNT)
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,10 +32,6 @@
 
 #include "FreeRTOS.h"
 
-#ifdef USE_RTOS_DEBUGGING
-#include "tc2.h"
-#endif
-
 /**
  * \brief Macro1
  */
@@ -137,19 +133,6 @@ extern "C" void vApplicationMallocFailedHook(void)
 
  */
 
-//Add timer ticks variable if using rtos debugging.
-#ifdef USE_RTOS_DEBUGGING
-extern "C" void vConfigureTimerForRunTimeStats(void)
-{
-	REG_TC2_CCR2 = TC_CCR_CLKDIS;
-	REG_TC2_CMR2 = TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_LDRA_RISING;
-
-
-	REG_TC2_CCR2 = TC_CCR_CLKEN;
-}
-#endif
-
-
 int main(void)
 {
 	system_init();
@@ -3,11 +3,78 @@
 
 #include <stdint.h>
 
+/* Bridge command byte: OP in bits 7:6, logical endpoint (EN) in bits 5:0. */
+#define SPI_BRIDGE_CMD_OP_SHIFT       6U
+#define SPI_BRIDGE_CMD_EN_MASK        0x3FU
+
+#define SPI_BRIDGE_OP_READ_HEADER     0x00U
+#define SPI_BRIDGE_OP_READ_BLOCK      0x01U
+#define SPI_BRIDGE_OP_WRITE_BLOCK     0x02U
+#define SPI_BRIDGE_OP_UPDATE          0x03U
+
+#define SPI_BRIDGE_COMMAND(op, en) \
+    ((uint8_t)(((op) << SPI_BRIDGE_CMD_OP_SHIFT) | ((en) & SPI_BRIDGE_CMD_EN_MASK)))
+
+/* Logical endpoints: hub status, one IN/OUT pair per device slot, then CDC. */
+#define SPI_BRIDGE_EN_HUB_STATUS      0U
+#define SPI_BRIDGE_EN_FIRST_DEVICE    1U
+#define SPI_BRIDGE_DEVICE_SLOTS       4U
+#define SPI_BRIDGE_EN_CDC             (SPI_BRIDGE_EN_FIRST_DEVICE + SPI_BRIDGE_DEVICE_SLOTS)
+
+/* Block header: DIRTY, TYPE (0 report, 1 descriptor) and the payload LEN. */
+#define SPI_BRIDGE_HEADER_DIRTY       0x01U
+#define SPI_BRIDGE_HEADER_TYPE        0x02U
+#define SPI_BRIDGE_HEADER_LEN_MASK    0xFCU
+#define SPI_BRIDGE_HEADER_LEN_SHIFT   2U
+
+#define SPI_BRIDGE_MAX_PAYLOAD        63U
+#define SPI_BRIDGE_HUB_STATUS_LENGTH  (SPI_BRIDGE_DEVICE_SLOTS + 1U)
+
+/* Hub status carries the protocol version after the connected table, firmware
+ * that predates it sends a shorter block and reads as version 0. */
+#define SPI_BRIDGE_HUB_VERSION_INDEX  (SPI_BRIDGE_DEVICE_SLOTS + 1U)
+
+/* Multi-endpoint commands, sent as READ_BLOCK / WRITE_BLOCK to a reserved EN.
+ * The master only uses them once the hub status block reports a protocol
+ * version of at least SPI_BRIDGE_VERSION_SET_COMMANDS.  From
+ * SPI_BRIDGE_VERSION_FAST_SETS the slave sends the whole READ_DIRTY_SET answer
+ * as one DMA transfer, so the master only waits for it after the mask and may
+ * clock set commands faster. */
+#define SPI_BRIDGE_EN_SET               0x3FU
+#define SPI_BRIDGE_PROTOCOL_VERSION     3U
+#define SPI_BRIDGE_VERSION_SET_COMMANDS 1U
+#define SPI_BRIDGE_VERSION_STREAM_UPDATE 2U
+#define SPI_BRIDGE_VERSION_FAST_SETS    3U
+
+/* CRC-16/CCITT over the header and LEN payload bytes, sent low byte first. */
+#define SPI_BRIDGE_CRC_POLY           0x1021U
+#define SPI_BRIDGE_CRC_INIT           0xFFFFU
+
 #define RT_UPDATE_CMD_ENTER_UPDATE_MODE   0x01U
 #define RT_UPDATE_CMD_ERASE_SECTOR        0x02U
 #define RT_UPDATE_CMD_PROGRAM_PAGE        0x03U
 #define RT_UPDATE_CMD_READ_BACK           0x04U
 #define RT_UPDATE_CMD_FINALIZE_AND_REBOOT 0x05U
+#define RT_UPDATE_CMD_WRITE_SECTOR       0x06U
+#define RT_UPDATE_CMD_QUERY               0x07U
+
+/* Update commands are sent after SPI_BRIDGE_OP_UPDATE as the command, a
+ * payload length, the payload, then a status byte clocked back from the
+ * RT1064 (plus any reply bytes).
+ *
+ * WRITE_SECTOR carries the sector header (address, data length, CRC-32 of the
+ * data; little endian) as its payload, and the data follows the payload
+ * before the status byte.  The RT1064 answers OK once the sector is queued,
+ * or ERR_BUSY while both of its sector buffers are in use.  Each queued sector
+ * is erased, programmed and read back against the CRC-32 while the next one
+ * is being clocked in.
+ *
+ * QUERY replies with the free sector buffers, the sectors finished (u16) and
+ * the address of the first sector that failed (u32).  Its status is the
+ * first failure, or OK. */
+#define RT_UPDATE_SECTOR_SIZE             4096U
+#define RT_UPDATE_SECTOR_HEADER_LENGTH    10U
+#define RT_UPDATE_QUERY_REPLY_LENGTH      7U
 
 #define RT_UPDATE_STATUS_OK           0x00U
 #define RT_UPDATE_STATUS_ERR_BAD_ADDR 0x01U
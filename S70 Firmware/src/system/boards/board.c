@@ -208,7 +208,7 @@ void set_board_type(uint16_t type)
 	}
 
 	eeprom_25LC1024_write(EEPROM_BOARD_INFO_ADDRESS, 2, (uint8_t*) &board_type);
-	delay_ms(20);
+	eeprom_25LC1024_flush();
 }
 
 /**
@@ -229,11 +229,30 @@ void set_board_serial_number(char * const p_sn)
 
     // Write to board, wait for write, then restart the board.
     eeprom_25LC1024_write(EEPROM_BOARD_INFO_ADDRESS + 2, USB_DEVICE_GET_SERIAL_NAME_LENGTH, (uint8_t*)usb_serial_number);
-    delay_ms(30);
+    eeprom_25LC1024_flush();
 }
 
+/**
+ * Writes back the EEPROM cache, then resets the processor.
+ * May be called with or without xSPI_Semaphore held.
+ */
 void restart_board(void)
 {
+	/* the reset loses any page still in the EEPROM write-back cache*/
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING && xSPI_Semaphore != NULL)
+	{
+		const bool HOLDS_SPI =
+				xSemaphoreGetMutexHolder(xSPI_Semaphore) == xTaskGetCurrentTaskHandle();
+		if (HOLDS_SPI || xSemaphoreTake(xSPI_Semaphore, RESTART_FLUSH_TIMEOUT) == pdTRUE)
+		{
+			eeprom_25LC1024_flush();
+			if (!HOLDS_SPI)
+			{
+				xSemaphoreGive(xSPI_Semaphore);
+			}
+		}
+	}
+
 	/* reset the processor*/
 #define 	RSTC_KEY		0xA5000001
 	((Rstc *) RSTC)->RSTC_CR = RSTC_KEY;
@@ -100,6 +100,8 @@ extern enum board_types board_type;
 #define WDT_PERIOD                        3000
 /** Watchdog restart 2000ms */
 #define WDT_RESTART_PERIOD                2000
+/** Longest restart_board() waits for the SPI bus to write back the EEPROM cache */
+#define RESTART_FLUSH_TIMEOUT             pdMS_TO_TICKS(500)
 
 /****************************************************************************
  * Public Data
@@ -20,6 +20,7 @@
 #include "Debugging.h"
 #include <pins.h>
 #include "usb_slave.h"
+#include "apt_parse.h"
 #include "user_spi.h"
 #include <cpld.h>
 #include "../drivers/supervisor/supervisor.h"
@@ -33,6 +34,7 @@
 #include "helper.h"
 #include "lut_manager.h"
 #include "efs.h"
+#include "log.h"
 #include "service-inits.h"
 
 
@@ -218,6 +220,10 @@ void system_init(void)
 #endif
 
 	user_spi_init();
+	spi_scheduler_service_init();
+	profiler_service_init();
+	eeprom_25LC1024_cache_init();
+	log_init();
 	init_interrupts();
 
 	//TODO fix the case for hexapod needing to power up specially
@@ -232,6 +238,9 @@ void system_init(void)
 	// Initialize slot synchronization objects to prevent system hang (even when programming cpld).
 	init_slots_synchronization();
 
+	// Before the FTDI and USB tasks can parse a file-data command.
+	apt_parse_init();
+
 	// Initialize supervisor with the cpld status.
 	// This is needed to periodically reset the WDT.
 	supervisor_init(cpld_programmed);
@@ -8,6 +8,8 @@
 #include "task.h"
 
 #include "gate.h"
+#include "profiler.hh"
+#include "supervisor.h"
 
 namespace cards {
 
@@ -81,7 +83,7 @@ void card_thread(typename Card::initial_parameter_type *const owned_params) {
             while (!xGatePass(card.get_gate(), 0)) {
                 const TickType_t NOW = xTaskGetTickCount();
                 card.service_idle(NOW);
-                service_wakeup(NOW, PERIOD);
+                service_wakeup(NOW, supervisor_idle_period(PERIOD));
             }
         } else {
             xGatePass(card.get_gate(), portMAX_DELAY);
@@ -92,10 +94,14 @@ void card_thread(typename Card::initial_parameter_type *const owned_params) {
         }
 
         const TickType_t PERIOD = card.get_service_period();
+        service::profiler::loop profile =
+            service::profiler::register_loop(PERIOD);
         periodic_service_time = xTaskGetTickCount();
         while (xGatePass(card.get_gate(), 0)) {
             const TickType_t NOW = xTaskGetTickCount();
+            profile.begin();
             card.service(NOW);
+            profile.end();
             service_wakeup(NOW, PERIOD);
         }
 
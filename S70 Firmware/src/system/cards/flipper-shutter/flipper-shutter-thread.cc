@@ -207,8 +207,7 @@ class thread_local_object {
     interlock_servicing_states_e _interlock_state;
     ::service::itc::queue_handle<::service::itc::message::hid_in_message>
         _joystick_in_queue;
-    ::service::itc::queue_handle<::service::itc::message::cdc_message>
-        _cdc_queue;
+    ::service::itc::pipeline_cdc_t::unique_queue _cdc_queue;
     TickType_t _service_period;
     TickType_t _watchdog_service_timeout;
     TickType_t _watchdog_configuring_timeout;
@@ -1290,11 +1289,9 @@ bool thread_local_object::parse_usb_cmd(
     return send_response;
 }
 void thread_local_object::service_apt(drivers::spi::handle_factory& factory) {
-    // (sbenish):  The USB_Slave_Message and response buffer
-    // are both 440 bytes.
-    USB_Slave_Message msg_elem;
+    ::service::itc::pipeline_cdc_t::message msg_elem;
     while (_cdc_queue.try_pop(msg_elem)) {
-        drivers::usb::apt_basic_command cmd = (msg_elem);
+        drivers::usb::apt_basic_command cmd = (*msg_elem);
         const bool HAS_MSG                  = parse_usb_cmd(factory, cmd);
         if (HAS_MSG) {
             drivers::usb::apt_command_factory::commit(cmd, _response);
@@ -15,6 +15,7 @@
 #include "mcm_speed_limit.hh"
 #include "pins.h"
 #include "stepper.details.hh"
+#include "stepper.telemetry.hh"
 #include "stepper_control.h"
 #include "stepper_log.h"
 #include "supervisor.h"
@@ -39,7 +40,9 @@
 #include "lock_guard.hh"
 #include "lut_manager.hh"
 #include "pnp_status.hh"
+#include "profiler.hh"
 #include "save_constructor.hh"
+#include "spi-scheduler.hh"
 // #include "synchronized_motion.h"
 #include <save_util.hh>
 
@@ -80,8 +83,8 @@ static void handle_save_command(Stepper_info *const p_info,
 static void service_joystick(Stepper_info *info,
                              service::itc::pipeline_hid_in_t::unique_queue& queue,
                              USB_Slave_Message *slave_message, bool active);
-static bool service_cdc(Stepper_info *info, USB_Slave_Message *slave_message,
-                        bool active, service::itc::pipeline_cdc_t::unique_queue& queue);
+static bool service_cdc(Stepper_info *info, bool active,
+                        service::itc::pipeline_cdc_t::unique_queue& queue);
 static void service_encoder(Stepper_info *info);
 // static void service_synchronized_motion(Stepper_info *info,
 //                                         stepper_sm_Rx_data *sm_rx,
@@ -343,23 +346,32 @@ static void set_position_stepper(Stepper_info *info) {
     }
 
     set_parameter(info->slot, ABS_POS, 3, position);
+    cards::stepper::telemetry::invalidate(info->slot);
 }
 
 /**
  * @brief Get the position value from the stepper drive, this is in 2's
  * complement
+ *
+ * Uses this period's telemetry snapshot when there is one, otherwise reads
+ * the drive directly.
  * @param info
  */
 // MARK:  SPI Mutex Required
 static void get_position_stepper(Stepper_info *info) {
-    uint8_t spi_tx_data[4];
     int32_t delta_counts;
     int32_t pre_step_pos_raw = info->counter.step_pos;
 
-    get_parameter(info->slot, (ABS_POS | 0x20), 3, spi_tx_data);
-
-    uint32_t temp =
-        (spi_tx_data[1] << 16) + (spi_tx_data[2] << 8) + (spi_tx_data[3]);
+    uint32_t temp;
+    cards::stepper::telemetry::sample snapshot;
+    if (cards::stepper::telemetry::read(info->slot, snapshot)) {
+        temp = snapshot.abs_pos;
+    } else {
+        uint8_t spi_tx_data[4];
+        get_parameter(info->slot, (ABS_POS | 0x20), 3, spi_tx_data);
+        temp =
+            (spi_tx_data[1] << 16) + (spi_tx_data[2] << 8) + (spi_tx_data[3]);
+    }
 
     /* convert the previous step_pos to signed value and use this to calculate
      * the delta between the previous value and this one */
@@ -1638,11 +1650,13 @@ static void service_joystick(Stepper_info *info,
 }
 
 // MARK:  SPI Mutex Required
-static bool service_cdc(Stepper_info *info, USB_Slave_Message *slave_message,
-                        bool active, service::itc::pipeline_cdc_t::unique_queue& queue) {
+static bool service_cdc(Stepper_info *info, bool active,
+                        service::itc::pipeline_cdc_t::unique_queue& queue) {
     std::size_t counter = 0;
-    while (queue.try_pop(*slave_message)) {
-        parse(info, slave_message, active);
+    service::itc::pipeline_cdc_t::message message;
+    while (queue.try_pop(message)) {
+        // Parsed in place from the pooled buffer.
+        parse(info, message.get(), active);
         ++counter;
     }
     return counter != 0;
@@ -2070,6 +2084,7 @@ void goto_mark_stepper(uint8_t slot) {
 // MARK:  SPI Mutex Required
 void reset_pos_stepper(uint8_t slot) {
     set_parameter(slot, RESET_POS_STEPPER, 0, 0);
+    cards::stepper::telemetry::invalidate(static_cast<slot_nums>(slot));
 }
 
 /**
@@ -2080,6 +2095,7 @@ void reset_pos_stepper(uint8_t slot) {
 // MARK:  SPI Mutex Required
 void reset_device_stepper(uint8_t slot) {
     set_parameter(slot, RESET_DEVICE_STEPPER, 0, 0);
+    cards::stepper::telemetry::invalidate(static_cast<slot_nums>(slot));
 }
 
 /**
@@ -2527,6 +2543,10 @@ static void task_stepper(Stepper_info *const p_info) {
     //
     // supervisor_add_watchdog(&watchdog);
 
+    // Lets the supervisor see the operation loop slipping.
+    period_monitor monitor(xFrequency, p_info->slot);
+    supervisor_add_monitor(&monitor);
+
     // END      Task Initialization
     for (;;) {
         xLastWakeTime = xTaskGetTickCount();
@@ -2535,15 +2555,15 @@ static void task_stepper(Stepper_info *const p_info) {
                pdFAIL) {
             // Perform routine tasks.
             {
-                lock_guard lg(xSPI_Semaphore);
+                service::spi_scheduler::bus_guard lg;
                 update_status_bits(p_info);
 
-                service_cdc(p_info, &slave_message, false, cdc_queue);
+                service_cdc(p_info, false, cdc_queue);
                 service_joystick(p_info, hid_in_queue, &slave_message, false);
             }
 
             watchdog.beat();
-            vTaskDelayUntil(&xLastWakeTime, xFrequency);
+            vTaskDelayUntil(&xLastWakeTime, supervisor_idle_period(xFrequency));
         }
 
         // BEGIN    Device Initalization
@@ -2772,14 +2792,19 @@ static void task_stepper(Stepper_info *const p_info) {
         watchdog.beat();
         watchdog.set_heartbeat_interval(STEPPER_HEARTBEAT_INTERVAL);
         xLastWakeTime = xTaskGetTickCount();
+        cards::stepper::telemetry::subscribe(p_info->slot);
+        service::profiler::loop profile =
+            service::profiler::register_loop(xFrequency);
         // END      Device Initialzation
 
         // Run while the gate is open (device is connected)
         while (xGatePass(slots[p_info->slot].device.connection_gate, 0) ==
                pdPASS) {
             // BEGIN    Operation Loop
+            monitor.start();
+            profile.begin();
             {
-                lock_guard lg(xSPI_Semaphore);
+                service::spi_scheduler::bus_guard lg;
 
                 /*Read the emergency stop flag from the CPLD, if it is high it
                  * means to uC locked up, had an error or was halted by
@@ -2813,7 +2838,7 @@ static void task_stepper(Stepper_info *const p_info) {
             }
 
 #endif
-                service_cdc(p_info, &slave_message, true, cdc_queue);
+                service_cdc(p_info, true, cdc_queue);
                 service_joystick(p_info, hid_in_queue, &slave_message, true);
                 // service_synchronized_motion(p_info, &sm_rx, &sm_tx);
                 // service_piezo_synchronized_motion(p_info, &psm_rx, &psm_tx);
@@ -2827,6 +2852,7 @@ static void task_stepper(Stepper_info *const p_info) {
 
 #if ENABLE_STEPPER_LOG_STATUS_FLAGS
                 if (!p_info->stepper_status_read) {
+                    // GetStatus, which clears the latched flags once logged.
                     p_info->stepper_status = get_status_stepper(p_info->slot);
                     p_info->stepper_status_read = true;
                 }
@@ -2844,14 +2870,19 @@ static void task_stepper(Stepper_info *const p_info) {
             }
 
             update_status_bits(p_info);
+            profile.end();
+            monitor.stop();
 
-            /* Wait for the next cycle.*/
+            /* Wait for the next telemetry sample (at most one cycle).*/
             watchdog.beat();
-            vTaskDelayUntil(&xLastWakeTime, xFrequency);
+            cards::stepper::telemetry::wait_for_sample(xLastWakeTime,
+                                                       xFrequency);
             // END      Operation Loop
         }
 
         // BEGIN    Device Cleanup
+        monitor.idle();
+        cards::stepper::telemetry::unsubscribe(p_info->slot);
 
         {
             lock_guard lg(xSPI_Semaphore);
@@ -2879,6 +2910,8 @@ static void task_stepper(Stepper_info *const p_info) {
 extern "C" void stepper_init(uint8_t slot, uint8_t type) {
     Stepper_info *pxStepper_info;
 
+    cards::stepper::telemetry::init();
+
     /* Allocate a stepper structure for each task.*/
     pxStepper_info = new Stepper_info(
         static_cast<slot_nums>(slot)); // Uses cppmem.hh's new callback.
@@ -0,0 +1,272 @@
+#include "./stepper.telemetry.hh"
+
+#include <array>
+#include <atomic>
+#include <span>
+
+#include "slots.h"
+#include "spi-scheduler.hh"
+#include "stepper.h"
+#include "sys_task.h"
+#include "task.h"
+
+using namespace cards::stepper;
+namespace sched = service::spi_scheduler;
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+/// \brief OR'd with a register address to form the GetParam command.
+static constexpr uint8_t GET_PARAM = 0x20;
+
+
+/*****************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+struct slot_record {
+    /// Odd while the sampler is writing the snapshot.
+    std::atomic<uint32_t> sequence;
+
+    /// Incremented by invalidate().
+    std::atomic<uint32_t> epoch;
+
+    TaskHandle_t subscriber;
+
+    // Guarded by sequence.
+    telemetry::sample snapshot;
+    uint32_t snapshot_epoch;
+    bool snapshot_valid;
+};
+
+/// \brief The command/response bytes of one slot in a bus pass.
+struct slot_buffers {
+    std::array<std::byte, 4> abs_pos;
+
+    /// The slot's epoch when the pass was built.
+    uint32_t epoch;
+};
+
+/*****************************************************************************
+ * Private Function Prototypes
+ *****************************************************************************/
+static void task_stepper_telemetry(void*);
+
+static void sample_subscribed(sched::client& client, uint32_t mask);
+static void publish(slot_record& rec, const telemetry::sample& smp,
+                    uint32_t epoch);
+
+static sched::segment make_segment(slot_nums slot, std::span<std::byte> buffer);
+static uint32_t decode(std::span<const std::byte> response);
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+static std::array<slot_record, NUMBER_OF_BOARD_SLOTS> s_slots;
+
+/// \brief Bit n set means slot n is in the bus pass.
+static std::atomic<uint32_t> s_subscribed{0};
+
+static TaskHandle_t s_sampler = nullptr;
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void telemetry::subscribe(slot_nums slot) {
+    if (slot >= NUMBER_OF_BOARD_SLOTS) {
+        return;
+    }
+
+    s_slots[slot].subscriber = xTaskGetCurrentTaskHandle();
+    invalidate(slot);
+    s_subscribed.fetch_or(1U << slot, std::memory_order_release);
+}
+
+void telemetry::unsubscribe(slot_nums slot) {
+    if (slot >= NUMBER_OF_BOARD_SLOTS) {
+        return;
+    }
+
+    s_subscribed.fetch_and(~(1U << slot), std::memory_order_release);
+    invalidate(slot);
+}
+
+void telemetry::invalidate(slot_nums slot) {
+    if (slot >= NUMBER_OF_BOARD_SLOTS) {
+        return;
+    }
+
+    s_slots[slot].epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool telemetry::read(slot_nums slot, sample& out) {
+    if (slot >= NUMBER_OF_BOARD_SLOTS) {
+        return false;
+    }
+
+    slot_record& rec = s_slots[slot];
+    uint32_t before;
+    uint32_t after;
+    uint32_t epoch;
+    bool valid;
+    do {
+        before = rec.sequence.load(std::memory_order_acquire);
+        out = rec.snapshot;
+        epoch = rec.snapshot_epoch;
+        valid = rec.snapshot_valid;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = rec.sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+
+    return valid && epoch == rec.epoch.load(std::memory_order_acquire) &&
+           (xTaskGetTickCount() - out.timestamp) <= STEPPER_UPDATE_INTERVAL;
+}
+
+bool telemetry::wait_for_sample(TickType_t& last_wake, TickType_t period) {
+    const TickType_t ELAPSED = xTaskGetTickCount() - last_wake;
+    TickType_t remaining = ELAPSED < period ? period - ELAPSED : 0;
+
+    TimeOut_t time_out;
+    vTaskSetTimeOutState(&time_out);
+    bool notified = false;
+    for (;;) {
+        // Only the sample bit is cleared; other notifications stay pending
+        // for whoever waits on them.
+        uint32_t value = 0;
+        xTaskNotifyWait(0, NOTIFY_BIT, &value, remaining);
+        if ((value & NOTIFY_BIT) != 0) {
+            notified = true;
+            break;
+        }
+        if (xTaskCheckForTimeOut(&time_out, &remaining) != pdFALSE) {
+            break;
+        }
+    }
+
+    last_wake = xTaskGetTickCount();
+    return notified;
+}
+
+void telemetry::init() {
+    if (s_sampler != nullptr) {
+        return;
+    }
+
+    if (xTaskCreate(task_stepper_telemetry, "StepTlm",
+                    TASK_STEPPER_TELEMETRY_STACK_SIZE, nullptr,
+                    TASK_STEPPER_TELEMETRY_STACK_PRIORITY,
+                    &s_sampler) != pdPASS) {
+        s_sampler = nullptr;
+    }
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+static void task_stepper_telemetry(void*) {
+    sched::client client =
+        sched::register_client("StepTlm", sched::priority::CONTROL);
+
+    TickType_t last_wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&last_wake, STEPPER_UPDATE_INTERVAL);
+
+        const uint32_t MASK = s_subscribed.load(std::memory_order_acquire);
+        if (MASK != 0) {
+            sample_subscribed(client, MASK);
+        }
+    }
+}
+
+static void sample_subscribed(sched::client& client, const uint32_t mask) {
+    static std::array<slot_buffers, NUMBER_OF_BOARD_SLOTS> buffers;
+    static std::array<sched::segment, NUMBER_OF_BOARD_SLOTS> segments;
+
+    // Build one transaction covering every subscribed drive.
+    std::size_t count = 0;
+    for (uint8_t i = 0; i < NUMBER_OF_BOARD_SLOTS; ++i) {
+        if ((mask & (1U << i)) == 0) {
+            continue;
+        }
+        const slot_nums SLOT = static_cast<slot_nums>(i);
+        slot_buffers& buf = buffers[i];
+
+        buf.epoch = s_slots[i].epoch.load(std::memory_order_acquire);
+        buf.abs_pos = {std::byte{GET_PARAM | ABS_POS}};
+
+        segments[count++] = make_segment(SLOT, buf.abs_pos);
+    }
+
+    // One lease for the whole pass:  the transaction then runs inline,
+    // without a round trip through the bus owner.
+    bool ok;
+    {
+        sched::bus_guard lg;
+        ok = client.transfer(
+            std::span<const sched::segment>(segments.data(), count));
+    }
+    const TickType_t NOW = xTaskGetTickCount();
+
+    for (uint8_t i = 0; i < NUMBER_OF_BOARD_SLOTS; ++i) {
+        if ((mask & (1U << i)) == 0) {
+            continue;
+        }
+        slot_record& rec = s_slots[i];
+        const slot_buffers& buf = buffers[i];
+
+        // A pass that raced a write of ABS_POS is stale; drop it.
+        if (ok && buf.epoch == rec.epoch.load(std::memory_order_acquire)) {
+            publish(rec,
+                    telemetry::sample{
+                        .timestamp = NOW,
+                        .abs_pos = decode(buf.abs_pos) & 0x3FFFFF,
+                    },
+                    buf.epoch);
+        }
+
+        // Wake the slot's control loop even without a sample so it keeps its
+        // period; it falls back to reading the drive directly.
+        if (rec.subscriber != nullptr) {
+            xTaskNotify(rec.subscriber, telemetry::NOTIFY_BIT, eSetBits);
+        }
+    }
+}
+
+static void publish(slot_record& rec, const telemetry::sample& smp,
+                    const uint32_t epoch) {
+    const uint32_t SEQUENCE = rec.sequence.load(std::memory_order_relaxed);
+    rec.sequence.store(SEQUENCE + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    rec.snapshot = smp;
+    rec.snapshot_epoch = epoch;
+    rec.snapshot_valid = true;
+
+    rec.sequence.store(SEQUENCE + 2, std::memory_order_release);
+}
+
+static sched::segment make_segment(const slot_nums slot,
+                                   std::span<std::byte> buffer) {
+    return sched::segment{
+        .mode = ST_STEPPER_SPI_MODE,
+        .toggle = CS_TOGGLE,
+        .chip_select = static_cast<uint8_t>(SLOT_CS(slot)),
+        .tx = buffer.data(),
+        .rx = buffer.data(),
+        .size = buffer.size(),
+    };
+}
+
+/// \brief Assembles the big-endian value following the command byte.
+static uint32_t decode(std::span<const std::byte> response) {
+    uint32_t value = 0;
+    for (std::size_t i = 1; i < response.size(); ++i) {
+        value = (value << 8) | static_cast<uint8_t>(response[i]);
+    }
+    return value;
+}
+
+// EOF
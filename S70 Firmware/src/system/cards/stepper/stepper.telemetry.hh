@@ -0,0 +1,87 @@
+/**
+ * \file stepper.telemetry.hh
+ * \brief Batched L6470/L6480 telemetry sampling.
+ *
+ * Once per STEPPER_UPDATE_INTERVAL, a sampler task reads ABS_POS from every
+ * subscribed stepper drive in a single SPI scheduler lease and publishes one
+ * snapshot per slot.
+ * Because every drive is read in the same bus pass, the snapshots of
+ * different slots are coherent with each other.
+ *
+ * Snapshots are published through a per-slot sequence counter, so readers
+ * never block and never take the SPI bus.
+ *
+ * STATUS is not sampled:  reading it with GetStatus clears the drive's
+ * latched flags, so it stays with the code that acts on them
+ * (get_status_stepper()).
+ */
+#pragma once
+
+#include <cstdint>
+
+#include "FreeRTOS.h"
+#include "slot_nums.h"
+
+namespace cards::stepper::telemetry {
+
+/**
+ * The notification bit set on a subscriber after each pass.
+ * Not bit 0:  rw_lock counts its notifications and gives back the ones it
+ * consumes, so a higher bit survives a lock wait that overlaps a pass.
+ */
+static constexpr uint32_t NOTIFY_BIT = 1U << 1;
+
+/**
+ * One sample of a drive's registers.
+ * Values are the raw register contents.
+ */
+struct sample {
+    /// The tick the bus pass completed on.
+    TickType_t timestamp;
+
+    /// ABS_POS, 22-bit two's complement.
+    uint32_t abs_pos;
+};
+
+/**
+ * Adds the slot to the sampler's bus pass.
+ * The calling task's NOTIFY_BIT is set after every pass.
+ * \param[in]       slot The slot of the stepper card.
+ */
+void subscribe(slot_nums slot);
+
+/// \brief Removes the slot from the sampler's bus pass.
+void unsubscribe(slot_nums slot);
+
+/**
+ * Discards the slot's snapshot, including any bus pass in flight.
+ * Must be called after anything that writes ABS_POS.
+ */
+void invalidate(slot_nums slot);
+
+/**
+ * Copies the slot's latest snapshot without blocking.
+ * \param[in]       slot The slot to read.
+ * \param[out]      out The snapshot.
+ * \return If a snapshot from the current period was available.
+ */
+bool read(slot_nums slot, sample& out);
+
+/**
+ * Blocks the calling (subscribed) task until the next snapshot is published
+ * or until one period after last_wake, whichever comes first.
+ * Used in place of vTaskDelayUntil so the control loop runs right after the
+ * bus pass.  Only NOTIFY_BIT is consumed; other notifications to the task
+ * stay pending.
+ * \param[in,out]   last_wake The tick the previous wait returned on.
+ * \param[in]       period The maximum time between returns.
+ * \return If a snapshot was published.
+ */
+bool wait_for_sample(TickType_t& last_wake, TickType_t period);
+
+/// \brief Creates the sampler task.  Safe to call more than once.
+void init();
+
+}  // namespace cards::stepper::telemetry
+
+// EOF
@@ -0,0 +1,91 @@
+/**
+ * \file apt-local.h
+ * \brief APT message identifiers that are not (yet) in the shared apt.h.
+ *
+ * Each identifier is guarded so the definition in apt.h takes precedence once
+ * it is added there.
+ * The identifiers are taken from the 0x4F00 block, which apt.h does not use.
+ */
+#ifndef SRC_SYSTEM_DRIVERS_APT_APT_LOCAL_H_
+#define SRC_SYSTEM_DRIVERS_APT_APT_LOCAL_H_
+
+#include "apt.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+// EFS directory index statistics.
+#ifndef MGMSG_MCM_EFS_REQ_STATS
+#define MGMSG_MCM_EFS_REQ_STATS     0x4F00
+#endif
+#ifndef MGMSG_MCM_EFS_GET_STATS
+#define MGMSG_MCM_EFS_GET_STATS     0x4F01
+#endif
+
+// EFS compaction.
+#ifndef MGMSG_MCM_EFS_SET_COMPACT
+#define MGMSG_MCM_EFS_SET_COMPACT   0x4F02
+#endif
+#ifndef MGMSG_MCM_EFS_REQ_COMPACT
+#define MGMSG_MCM_EFS_REQ_COMPACT   0x4F03
+#endif
+#ifndef MGMSG_MCM_EFS_GET_COMPACT
+#define MGMSG_MCM_EFS_GET_COMPACT   0x4F04
+#endif
+
+// Runtime profiler.  The REQ messages take the index of the task, loop, or
+// SPI client in param1; each GET reply carries the index and the count.
+#ifndef MGMSG_MCM_PROF_REQ_TASK
+#define MGMSG_MCM_PROF_REQ_TASK     0x4F05
+#endif
+#ifndef MGMSG_MCM_PROF_GET_TASK
+#define MGMSG_MCM_PROF_GET_TASK     0x4F06
+#endif
+#ifndef MGMSG_MCM_PROF_REQ_LOOP
+#define MGMSG_MCM_PROF_REQ_LOOP     0x4F07
+#endif
+#ifndef MGMSG_MCM_PROF_GET_LOOP
+#define MGMSG_MCM_PROF_GET_LOOP     0x4F08
+#endif
+#ifndef MGMSG_MCM_PROF_REQ_SPI
+#define MGMSG_MCM_PROF_REQ_SPI      0x4F09
+#endif
+#ifndef MGMSG_MCM_PROF_GET_SPI
+#define MGMSG_MCM_PROF_GET_SPI      0x4F0A
+#endif
+#ifndef MGMSG_MCM_PROF_SET_RESET
+#define MGMSG_MCM_PROF_SET_RESET    0x4F0B
+#endif
+
+// Device detection time.  The REQ message takes the slot in param1; the GET
+// reply carries the slot and the last and longest time-to-detect in ms.
+#ifndef MGMSG_MCM_REQ_DETECT_TIME
+#define MGMSG_MCM_REQ_DETECT_TIME   0x4F0C
+#endif
+#ifndef MGMSG_MCM_GET_DETECT_TIME
+#define MGMSG_MCM_GET_DETECT_TIME   0x4F0D
+#endif
+
+// Motherboard APT routes.  The REQ message takes the index of the route in
+// param1; the GET reply carries the index, the route count, the command, its
+// hits, and the longest and total handler run times in us.
+#ifndef MGMSG_MCM_PROF_REQ_APT
+#define MGMSG_MCM_PROF_REQ_APT      0x4F0E
+#endif
+#ifndef MGMSG_MCM_PROF_GET_APT
+#define MGMSG_MCM_PROF_GET_APT      0x4F0F
+#endif
+
+// APT framing throughput.  The REQ message takes the port in param1 (0 USB,
+// 1 FTDI); the GET reply carries the port, the frame, long-form frame,
+// long-form byte and dropped byte counts, the ms since the counters were
+// reset, the time spent handling long-form frames in us, and the long-form
+// commands per second received and that the handling time would allow.
+#ifndef MGMSG_MCM_PROF_REQ_FRAMES
+#define MGMSG_MCM_PROF_REQ_FRAMES   0x4F10
+#endif
+#ifndef MGMSG_MCM_PROF_GET_FRAMES
+#define MGMSG_MCM_PROF_GET_FRAMES   0x4F11
+#endif
+
+#endif /* SRC_SYSTEM_DRIVERS_APT_APT_LOCAL_H_ */
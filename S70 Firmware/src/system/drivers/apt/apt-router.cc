@@ -0,0 +1,69 @@
+/**
+ * \file apt-router.cc
+ */
+#include "apt-router.hh"
+
+#include "FreeRTOS.h"
+#include "asf.h"
+#include "task.h"
+
+using namespace drivers::apt;
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Private Function Prototypes
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+
+/******************************************************************************
+ * Interrupt Handlers
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+uint32_t drivers::apt::router_cycles() { return DWT->CYCCNT; }
+
+/// The USB slave and FTDI tasks dispatch through the same routers.
+void drivers::apt::router_record(route_statistics& stats, uint32_t cycles) {
+    taskENTER_CRITICAL();
+    ++stats.hits;
+    stats.total_cycles += cycles;
+    if (cycles > stats.max_cycles) {
+        stats.max_cycles = cycles;
+    }
+    taskEXIT_CRITICAL();
+}
+
+route_statistics drivers::apt::router_read(const route_statistics& stats) {
+    taskENTER_CRITICAL();
+    const route_statistics RT = stats;
+    taskEXIT_CRITICAL();
+    return RT;
+}
+
+void drivers::apt::router_clear(route_statistics& stats) {
+    taskENTER_CRITICAL();
+    stats = {};
+    taskEXIT_CRITICAL();
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+// EOF
@@ -0,0 +1,199 @@
+/**
+ * \file apt-router.hh
+ * \brief Table dispatch of APT commands to handler functions.
+ *
+ * A module lists the commands it handles as an array of routes, each a
+ * message ID and a handler, and dispatches through a router built on that
+ * array.  The router finds a perfect hash of the message IDs at compile time,
+ * so a command is routed with one multiply, one table read and one compare,
+ * however many commands are registered.  Registering a command twice fails to
+ * compile.
+ *
+ * Route arrays can be built per group of commands and joined with
+ * join_routes(), so a module adds its commands without editing the other
+ * groups.
+ *
+ * Every route counts its hits and the CPU cycles its handler ran for.
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace drivers::apt {
+
+/// \brief One registered command.
+template <typename Handler>
+struct route {
+    uint16_t command;
+    Handler handler;
+};
+
+/// \brief Counters kept per route.
+struct route_statistics {
+    uint32_t hits;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+};
+
+/// \brief Reads the CPU cycle counter enabled by the profiler.
+uint32_t router_cycles();
+
+/// \brief Adds a handler run to the counters.  Safe from any task.
+void router_record(route_statistics& stats, uint32_t cycles);
+
+/// \brief Copies the counters of a route.  Safe from any task.
+route_statistics router_read(const route_statistics& stats);
+
+/// \brief Clears the counters of a route.  Safe from any task.
+void router_clear(route_statistics& stats);
+
+/// \brief Concatenates route groups into one array for a router.
+template <typename Handler, std::size_t... SIZES>
+consteval auto join_routes(const std::array<route<Handler>, SIZES>&... groups) {
+    std::array<route<Handler>, (SIZES + ...)> joined{};
+    std::size_t next = 0;
+    (
+        [&] {
+            for (const route<Handler>& r : groups) {
+                joined[next++] = r;
+            }
+        }(),
+        ...);
+    return joined;
+}
+
+namespace detail {
+
+/// Reaching this in a constant expression fails the build.
+void apt_command_routed_twice();
+void apt_routes_have_no_perfect_hash();
+
+struct hash_parameters {
+    uint32_t multiplier;
+    uint8_t bits;
+};
+
+static constexpr uint8_t MAX_HASH_BITS = 10;
+static constexpr uint8_t NO_ROUTE      = 0xFF;
+
+constexpr std::size_t slot_of(uint16_t command, hash_parameters hash) {
+    return (static_cast<uint32_t>(command) * hash.multiplier) >>
+           (32 - hash.bits);
+}
+
+/**
+ * Searches odd multipliers for one that maps every command to its own slot,
+ * starting with a table four times the route count and doubling it when no
+ * multiplier is found.
+ */
+template <typename Handler, std::size_t N>
+consteval hash_parameters find_hash(const std::array<route<Handler>, N>& routes) {
+    static_assert(N < NO_ROUTE, "Too many routes for one router.");
+
+    for (std::size_t i = 0; i < N; ++i) {
+        for (std::size_t j = i + 1; j < N; ++j) {
+            if (routes[i].command == routes[j].command) {
+                apt_command_routed_twice();
+            }
+        }
+    }
+
+    uint8_t bits = 1;
+    while ((std::size_t{1} << bits) < 4 * N) {
+        ++bits;
+    }
+
+    for (; bits <= MAX_HASH_BITS; ++bits) {
+        for (uint32_t k = 0; k < 4096; ++k) {
+            const hash_parameters HASH = {0x9E3779B1u + 2 * k, bits};
+            std::array<bool, 1u << MAX_HASH_BITS> used{};
+            bool collision = false;
+
+            for (std::size_t i = 0; i < N && !collision; ++i) {
+                const std::size_t SLOT = slot_of(routes[i].command, HASH);
+                collision              = used[SLOT];
+                used[SLOT]             = true;
+            }
+
+            if (!collision) {
+                return HASH;
+            }
+        }
+    }
+
+    apt_routes_have_no_perfect_hash();
+    return {};
+}
+
+template <hash_parameters HASH, typename Handler, std::size_t N>
+consteval auto build_slots(const std::array<route<Handler>, N>& routes) {
+    std::array<uint8_t, std::size_t{1} << HASH.bits> slots{};
+    for (uint8_t& slot : slots) {
+        slot = NO_ROUTE;
+    }
+    for (std::size_t i = 0; i < N; ++i) {
+        slots[slot_of(routes[i].command, HASH)] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+}  // namespace detail
+
+/**
+ * Routes commands to the handlers of ROUTES, a constexpr array of routes with
+ * static storage.  The handlers are called with the arguments given to
+ * dispatch().
+ */
+template <const auto& ROUTES>
+class router {
+    using routes_type = std::remove_cvref_t<decltype(ROUTES)>;
+
+    static constexpr std::size_t SIZE = std::tuple_size_v<routes_type>;
+    static constexpr detail::hash_parameters HASH = detail::find_hash(ROUTES);
+    static constexpr auto SLOTS = detail::build_slots<HASH>(ROUTES);
+
+    std::array<route_statistics, SIZE> _stats{};
+
+   public:
+    /**
+     * Calls the handler of the command.
+     * \return false if no route handles the command.
+     */
+    template <typename... Args>
+    bool dispatch(uint16_t command, Args&&... args) {
+        const uint8_t INDEX = SLOTS[detail::slot_of(command, HASH)];
+        if (INDEX == detail::NO_ROUTE || ROUTES[INDEX].command != command) {
+            return false;
+        }
+
+        const uint32_t START = router_cycles();
+        ROUTES[INDEX].handler(std::forward<Args>(args)...);
+        router_record(_stats[INDEX], router_cycles() - START);
+        return true;
+    }
+
+    static constexpr std::size_t size() { return SIZE; }
+
+    /// \return The command of the route at index (in registration order).
+    static constexpr uint16_t command(std::size_t index) {
+        return ROUTES[index].command;
+    }
+
+    route_statistics statistics(std::size_t index) const {
+        return router_read(_stats[index]);
+    }
+
+    void reset_statistics() {
+        for (route_statistics& stats : _stats) {
+            router_clear(stats);
+        }
+    }
+};
+
+}  // namespace drivers::apt
+
+// EOF
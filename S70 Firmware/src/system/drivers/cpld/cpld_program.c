@@ -1,7 +1,16 @@
 /**
  * @file cpld_program.c
  *
- * @brief Functions for CPLD programming jed file.
+ * @brief Functions for CPLD programming jed file.  The USB slave task copies
+ * each configuration page into a pool and queues it for the CPLD program task,
+ * which writes the pages while the next ones are being received.  Pages are
+ * acknowledged to the host once queued; the flash is read back and checked
+ * against a CRC of every page written before the DONE bit is programmed.
+ *
+ * The CPLD decodes the SPI chip selects, so no other device may be clocked
+ * while it is erased or in ISC mode.  The program task holds xSPI_Semaphore
+ * from the erase until the update ends, which stalls every other SPI client,
+ * the SPI scheduler included, for the whole update.
  *
  */
 
@@ -16,9 +25,31 @@
 #include "string.h"
 #include "board.h"
 #include "user_spi.h"
+#include "usb_slave.h"
+#include "spi_bridge_crc.h"
+#include "sys_task.h"
+#include "semphr.h"
 
 bool load_lattice_jed;
 
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+/* Pages the USB slave task can receive ahead of the program task.*/
+#define CPLD_PAGE_POOL_SIZE		8
+
+/* Page program time of the part, 200 us, rounded up to whole ticks.*/
+#define CPLD_PAGE_PROGRAM_TICKS	((configTICK_RATE_HZ * 200 + 999999) / 1000000)
+
+/* Configuration flash erase time.*/
+#define CPLD_ERASE_TIME			pdMS_TO_TICKS(500)
+
+/* Longest the part may stay busy after the expected time.*/
+#define CPLD_BUSY_TIMEOUT		pdMS_TO_TICKS(1000)
+
+/* Longest the program task holds the bus waiting for the host's next line.*/
+#define CPLD_JOB_TIMEOUT		pdMS_TO_TICKS(5000)
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -32,18 +63,47 @@ typedef struct
 } CPLD;
 CPLD *pcpld;
 
+typedef enum
+{
+	CPLD_JOB_ERASE,		/* take the bus, enter ISC mode and erase*/
+	CPLD_JOB_START,		/* reset the configuration flash address*/
+	CPLD_JOB_PAGE,		/* program a page from the pool*/
+	CPLD_JOB_FINISH,	/* verify, program DONE and refresh*/
+} CPLD_job_type;
+
+typedef struct
+{
+	uint8_t type;
+	uint8_t page;
+} CPLD_job;
+
+static uint8_t cpld_pages[CPLD_PAGE_POOL_SIZE][BYTES_PER_LINE];
+static QueueHandle_t cpld_free_pages = NULL;	/* indices into cpld_pages*/
+static QueueHandle_t cpld_jobs = NULL;
+static QueueHandle_t cpld_erased = NULL;	/* result of CPLD_JOB_ERASE*/
+static TaskHandle_t cpld_program_task = NULL;
+
+/* The program task holds xSPI_Semaphore.*/
+static bool cpld_holds_bus;
+
+/* Set by the program task, stops the USB slave task queueing pages.*/
+static volatile bool cpld_failed;
+
 /****************************************************************************
  * Function Prototypes
  ****************************************************************************/
 static void toggle_program_pin(void);
 //static bool check_device_id(void);
-static void check_busy(void);
+static bool wait_while_busy(TickType_t expected);
+static bool erase_flash(void);
+static void release_bus(bool disable);
 static void transmit(uint8_t command, uint8_t opcode_1, uint8_t opcode_2,
 		uint8_t opcode_3);
 static void set_line_address(uint8_t mem, uint16_t line);
 static void _do_write_page(const uint8_t *buf);
 static void read_page(uint8_t *buf);
-bool verify_data(const uint8_t * buffer);
+static bool program_page(const uint8_t *buf);
+static bool verify_flash(uint16_t pages, uint32_t crc);
 static uint8_t read_status_reg(void);
 static void program_flash_exit(bool error);
 static void respond_to_host(uint8_t status);
@@ -52,6 +112,8 @@ static size_t write_page(const uint8_t * buffer, size_t length);
 static size_t write_feature_row(const uint8_t * buffer, size_t length);
 static size_t write_fea_bits(const uint8_t * buffer, size_t length);
 static void flash_program_done(void);
+static bool queue_job(uint8_t type, uint8_t page);
+static void task_cpld_program(void *pvParameters);
 
 /****************************************************************************
  * Interrupt Handler
@@ -94,26 +156,37 @@ static bool check_device_id(void)
 }
 #endif
 
+/**
+ * @brief Sleeps for the expected busy time, then polls the busy flag once
+ * per tick.  The bus stays held, so nothing else is clocked meanwhile.
+ *
+ * @return false if the part was still busy after CPLD_BUSY_TIMEOUT.
+ */
 // Mark:  SPI(Programming) Mutex Required
-static void check_busy(void)
+static bool wait_while_busy(TickType_t expected)
 {
-	uint8_t i = 0;
 	uint8_t opcode[4] =
 	{ LSC_CHECK_BUSY };
 	uint8_t spi_tx_data[5];
+	TickType_t waited = 0;
+
+	vTaskDelay(expected);
 
-	do
+	for (;;)
 	{
-		i = 0;
-		spi_tx_data[i++] = opcode[0];
-		spi_tx_data[i++] = opcode[1];
-		spi_tx_data[i++] = opcode[2];
-		spi_tx_data[i++] = opcode[3];
-		spi_tx_data[i++] = DUMMY_HIGH;
-
-		spi_transfer(CPLD_PROGRAM_READ, spi_tx_data, i);
-		delay_us(10);
-	} while (spi_tx_data[4] != 0);  // TODO make while loop expire
+		memcpy(spi_tx_data, opcode, 4);
+		spi_tx_data[4] = DUMMY_HIGH;
+
+		spi_transfer(CPLD_PROGRAM_READ, spi_tx_data, 5);
+
+		if (spi_tx_data[4] == 0)
+			return true;
+
+		if (waited++ >= CPLD_BUSY_TIMEOUT)
+			return false;
+
+		vTaskDelay(1);
+	}
 }
 
 // Mark:  SPI(Programming) Mutex Required
@@ -218,25 +291,122 @@ static void read_page(uint8_t *buf)
 	memcpy(buf, &spi_tx_data[4], BYTES_PER_LINE);
 }
 
-bool verify_data(const uint8_t* buffer)
+/**
+ * @brief Reads the configuration flash back from the first page and compares
+ * its CRC with the CRC of the pages written.
+ */
+// Mark:  SPI(Programming) Mutex Required
+static bool verify_flash(uint16_t pages, uint32_t crc)
 {
+	uint32_t read_crc = SPI_BRIDGE_CRC32_INIT;
 	uint8_t read_buf[BYTES_PER_LINE];
 
-	read_page(&read_buf[0]);
+	transmit(LSC_INIT_ADDRESS);
+
+	for (uint16_t line = 0; line < pages; ++line)
+	{
+		/* Each read moves the page address on.*/
+		read_page(&read_buf[0]);
+
+		read_crc = spi_bridge_crc32(read_crc, read_buf, BYTES_PER_LINE);
+	}
+
+	return read_crc == crc;
+}
+
+/**
+ * @brief Programs a page at the current address, which the program command
+ * then increments.
+ *
+ * @return false if the part failed or stayed busy.
+ */
+// Mark:  SPI(Programming) Mutex Required
+static bool program_page(const uint8_t *buf)
+{
+	_do_write_page(buf);
+
+	if (!wait_while_busy(CPLD_PAGE_PROGRAM_TICKS))
+		return false;
+
+	const uint8_t STATUS = read_status_reg();
+
+	return !Tst_bits(STATUS, REG_FAIL);
+}
+
+/**
+ * @brief Takes the bus for the update, slows the SPI clock and erases the
+ * configuration flash.  Runs in the program task, which keeps the bus until
+ * release_bus().
+ *
+ * @return false if the erase failed, in which case the bus is released.
+ */
+static bool erase_flash(void)
+{
+	xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+	cpld_holds_bus = true;
+
+	cpld_reset();
+
+	// TODO cpld_disable_interrupts();
+
+	/*If it's the first time we program the cpld we need to slow the speed down*/
+//	if(cpld_programmed == false)
+//	{
+	spi_set_baudrate_div(SPI0, 0,
+			(sysclk_get_peripheral_hz() / SPI_SLOW_SPEED));
+//	}
 
-	/*Compare the data read with the data we just wrote to this page*/
+	toggle_program_pin();
+	delay_us(50);
 
-	/* if verify fails return 1*/
-	for (int i = 0; i < BYTES_PER_LINE; i++)
+#if 0	/* not needed*/
+	if (check_device_id())
 	{
-		if (buffer[i] != read_buf[i])
-			return 1;
+		release_bus(true);
+		return false;
 	}
-	return 0;
+#endif
+
+	transmit(ISC_ENABLE_X);
+	delay_us(50);
+
+	/*earse_flash*/
+	transmit(ISC_ERASE_CF_UFM_FR(EARSE_CONFIG_ONLY));
+
+	/*Wait while erasing*/
+	if (!wait_while_busy(CPLD_ERASE_TIME))
+	{
+		release_bus(true);
+		return false;
+	}
+
+	/* Read Status Register*/
+	uint8_t status = read_status_reg();
+	if ((Tst_bits(status, REG_BUSY)) || (Tst_bits(status, REG_FAIL)))
+	{
+		/* exit*/
+		release_bus(true);
+		return false;
+	}
+
+	return true;
 }
 
-static void program_flash_exit(bool error)
+/**
+ * @brief Sets the SPI speed back to normal and gives the bus back to the
+ * other SPI clients.
+ *
+ * @param disable Leave ISC mode first, for an update that failed.
+ */
+// Mark:  SPI(Programming) Mutex Required
+static void release_bus(bool disable)
 {
+	if (!cpld_holds_bus)
+		return;
+
+	if (disable)
+		transmit(ISC_DISABLE);
+
 	/*Set the SPI speed back to normal if this was changed because it was the first time
 	 * programming the CPLD*/
 //	if(cpld_programmed == false)
@@ -244,6 +414,16 @@ static void program_flash_exit(bool error)
 	spi_set_baudrate_div(SPI0, 0, (sysclk_get_peripheral_hz() / SPI_SPEED));
 //	}
 
+	cpld_holds_bus = false;
+	xSemaphoreGive(xSPI_Semaphore);
+}
+
+/**
+ * @brief Reports the end of the update.  Does not touch the bus, which the
+ * program task has already given back, so it runs from either task.
+ */
+static void program_flash_exit(bool error)
+{
 	if (error)
 	{
 		load_lattice_jed = false;
@@ -279,29 +459,48 @@ static void respond_to_host(uint8_t status)
 	response_buffer[4] = HOST_ID; 	// destination
 	response_buffer[5] = MOTHERBOARD_ID;	// source
 
+	xSemaphoreTake(xUSB_Slave_TxSemaphore, portMAX_DELAY);
 	udi_cdc_write_buf(response_buffer, 6);
+	xSemaphoreGive(xUSB_Slave_TxSemaphore);
+}
+
+/**
+ * @brief Queues a job for the program task.  Called from the USB slave task,
+ * which owns pcpld until the FINISH job is queued, so it is the one to call
+ * program_flash_exit() when a page has failed.
+ *
+ * @return false if a page has failed to program.
+ */
+static bool queue_job(uint8_t type, uint8_t page)
+{
+	const CPLD_job JOB =
+	{ .type = type, .page = page };
+
+	if (cpld_failed)
+		return false;
+
+	xQueueSend(cpld_jobs, &JOB, portMAX_DELAY);
+	return true;
 }
 
-// Mark:  SPI(Programming) Mutex Required
 static size_t configuration_start(const uint8_t * buffer, size_t length)
 {
     if (length < 2) {
         return 0;
     }
 
-    uint8_t opcode[8] = {LSC_INIT_ADDRESS};
-	uint8_t spi_tx_data[4];
-
 	/* get the number of lines for the configuration flash
 	 * Because their is no header the line count is stored in the first
 	 * 2 bytes of the structure which happens to be ucMessageID*/
 	pcpld->line_count = buffer[0]
 			+ (buffer[1] << 8);
 
-	// Transmit Reset Configuration Address
-    memcpy(spi_tx_data, opcode, 4);
-
-	spi_transfer(CPLD_PROGRAM_NO_READ, spi_tx_data, 4);
+	// Reset Configuration Address
+	if (!queue_job(CPLD_JOB_START, 0))
+	{
+		program_flash_exit(CPLD_PROG_ERROR);
+		return 2;
+	}
 
 	// setup next portion
 	pcpld->jed_file_portion = CONFIGURATION_FLASH_PROGRAM;
@@ -312,6 +511,11 @@ static size_t configuration_start(const uint8_t * buffer, size_t length)
     return 2;
 }
 
+/**
+ * @brief Copies a line into the page pool and acknowledges it, so the host
+ * sends the next line while this one is programmed.  Waits for a free page
+ * when the program task is behind.
+ */
 static size_t write_page(const uint8_t* buffer, size_t length)
 {
 	// grab the line of data
@@ -321,31 +525,25 @@ static size_t write_page(const uint8_t* buffer, size_t length)
         return 0;
 	}
 
-	set_line_address(CONFIGURATION_FLASH_MEM, pcpld->line_position);
-	delay_us(10);
-
-	// write it to the Lattice flash
-	// Transmit PROGRAM command and 128 Bits of Data (line 16 bytes)
-	_do_write_page(buffer);
-	delay_us(200);
-
-	set_line_address(CONFIGURATION_FLASH_MEM, pcpld->line_position);
-	delay_us(10);
+	uint8_t page;
+	xQueueReceive(cpld_free_pages, &page, portMAX_DELAY);
+	memcpy(cpld_pages[page], buffer, BYTES_PER_LINE);
 
-	if (verify_data(buffer))
+	if (!queue_job(CPLD_JOB_PAGE, page))
 	{
+		/* A page already queued failed to program*/
+		xQueueSend(cpld_free_pages, &page, 0);
 		program_flash_exit(CPLD_PROG_ERROR);
+		return 16;
 	}
-	else
-	{
-		pcpld->line_position++;
 
-		if (pcpld->line_position == pcpld->line_count)
-		{
-			pcpld->jed_file_portion = WRITE_FEATURE_ROW;
-		}
-		respond_to_host(CPLD_PROG_OK);
+	pcpld->line_position++;
+
+	if (pcpld->line_position == pcpld->line_count)
+	{
+		pcpld->jed_file_portion = WRITE_FEATURE_ROW;
 	}
+	respond_to_host(CPLD_PROG_OK);
 
     return 16;
 }
@@ -408,23 +606,18 @@ static size_t write_feature_row(const uint8_t * buffer, size_t length)
     return 8;
 }
 
-// Mark:  SPI(Programming) Mutex Required
 static size_t write_fea_bits(const uint8_t * buffer, size_t length)
 {
     if (length < 2) { return 0; }
 #if 1 /* Don't program Feature row */
-    uint8_t opcode[8] = {LSC_READ_FEABITS};
-	uint8_t spi_tx_data[4 + 2];
-
-	/* Read the FEABITS*/
-    memcpy(spi_tx_data, opcode, 4);
-	spi_tx_data[4] = DUMMY_HIGH;
-	spi_tx_data[5] = DUMMY_HIGH;
-
-	spi_transfer(CPLD_PROGRAM_READ, spi_tx_data, 6);
-
-	respond_to_host(CPLD_PROG_OK);
-	flash_program_done();
+	/* The program task verifies the pages, reads the FEABITS and finishes,
+	 * nothing more comes from the host*/
+	if (!queue_job(CPLD_JOB_FINISH, 0))
+	{
+		program_flash_exit(CPLD_PROG_ERROR);
+		return 2;
+	}
+	load_lattice_jed = false;
 
 #else
 	uint8_t tries = 0;
@@ -481,8 +674,20 @@ static size_t write_fea_bits(const uint8_t * buffer, size_t length)
     return 2;
 }
 
+// Mark:  SPI(Programming) Mutex Required
 static void flash_program_done(void)
 {
+	uint8_t opcode[8] =
+	{ LSC_READ_FEABITS };
+	uint8_t spi_tx_data[4 + 2];
+
+	/* Read the FEABITS*/
+	memcpy(spi_tx_data, opcode, 4);
+	spi_tx_data[4] = DUMMY_HIGH;
+	spi_tx_data[5] = DUMMY_HIGH;
+
+	spi_transfer(CPLD_PROGRAM_READ, spi_tx_data, 6);
+
 	/*Program DONE*/
 	transmit(ISC_PROGRAM_DONE);
 	delay_us(200);
@@ -498,8 +703,90 @@ static void flash_program_done(void)
 
 	/* refresh*/
 	transmit(LSC_REFRESH);
+}
 
-	program_flash_exit(CPLD_PROG_OK);
+/****************************************************************************
+ * Task
+ ****************************************************************************/
+/**
+ * @brief Erases the flash and programs the queued pages, sleeping through
+ * each page's program time so the USB slave task can receive the next ones.
+ * Holds the bus from the erase to the end of the update.  Keeps a CRC of the
+ * pages written for the readback at the end.
+ */
+static void task_cpld_program(void *pvParameters)
+{
+	UNUSED(pvParameters);
+
+	uint32_t crc = SPI_BRIDGE_CRC32_INIT;
+	uint16_t pages_written = 0;
+
+	for (;;)
+	{
+		CPLD_job job;
+
+		/* Don't keep the other SPI clients stalled if the host goes away*/
+		if (xQueueReceive(cpld_jobs, &job,
+				cpld_holds_bus ? CPLD_JOB_TIMEOUT : portMAX_DELAY) != pdTRUE)
+		{
+			debug_print("ERROR: CPLD update timed out.\r\n");
+			release_bus(true);
+			cpld_failed = true;
+			continue;
+		}
+		wdt_restart(WDT);
+
+		switch (job.type)
+		{
+		case CPLD_JOB_ERASE:
+		{
+			const bool ERASED = erase_flash();
+			xQueueSend(cpld_erased, &ERASED, 0);
+			break;
+		}
+
+		case CPLD_JOB_START:
+			crc = SPI_BRIDGE_CRC32_INIT;
+			pages_written = 0;
+
+			if (!cpld_failed)
+				transmit(LSC_INIT_ADDRESS);
+			break;
+
+		case CPLD_JOB_PAGE:
+			if (!cpld_failed)
+			{
+				crc = spi_bridge_crc32(crc, cpld_pages[job.page], BYTES_PER_LINE);
+				++pages_written;
+
+				/* Reported by the USB slave task on its next line*/
+				if (!program_page(cpld_pages[job.page]))
+				{
+					release_bus(true);
+					cpld_failed = true;
+				}
+			}
+			xQueueSend(cpld_free_pages, &job.page, 0);
+			break;
+
+		case CPLD_JOB_FINISH:
+			/* The USB slave task is done, so failures are reported here*/
+			if (cpld_failed || !verify_flash(pages_written, crc))
+			{
+				release_bus(true);
+				cpld_failed = true;
+				program_flash_exit(CPLD_PROG_ERROR);
+				break;
+			}
+
+			flash_program_done();
+			release_bus(false);
+
+			respond_to_host(CPLD_PROG_OK);
+			program_flash_exit(CPLD_PROG_OK);
+			break;
+		}
+	}
 }
 
 /****************************************************************************
@@ -529,16 +816,35 @@ void lattice_firmware_update(void)
 	/* Wait until we can grab the USB slave & SPI bus*/
 	suspend_all_task();
 	wdt_restart(WDT);
-	cpld_reset();
 
-	// TODO cpld_disable_interrupts();
+	/*The page pool and program task are kept for later updates*/
+	if (cpld_program_task == NULL)
+	{
+		cpld_free_pages = xQueueCreate(CPLD_PAGE_POOL_SIZE, sizeof(uint8_t));
+		cpld_jobs = xQueueCreate(CPLD_PAGE_POOL_SIZE + 2, sizeof(CPLD_job));
+		cpld_erased = xQueueCreate(1, sizeof(bool));
+
+		if (cpld_free_pages == NULL || cpld_jobs == NULL || cpld_erased == NULL
+				|| xTaskCreate(task_cpld_program, "CPLD Prog",
+						TASK_CPLD_PROGRAM_STACK_SIZE, NULL,
+						TASK_CPLD_PROGRAM_STACK_PRIORITY,
+						&cpld_program_task) != pdPASS)
+		{
+			debug_print("ERROR: Failed to create CPLD program task.\r\n");
+			cpld_program_task = NULL;
+			return;
+		}
+	}
 
-	/*If it's the first time we program the cpld we need to slow the speed down*/
-//	if(cpld_programmed == false)
-//	{
-	spi_set_baudrate_div(SPI0, 0,
-			(sysclk_get_peripheral_hz() / SPI_SLOW_SPEED));
-//	}
+	/*Every page is free and nothing is left queued from a failed update*/
+	xQueueReset(cpld_jobs);
+	xQueueReset(cpld_free_pages);
+	for (uint8_t page = 0; page < CPLD_PAGE_POOL_SIZE; ++page)
+	{
+		xQueueSend(cpld_free_pages, &page, 0);
+	}
+	xQueueReset(cpld_erased);
+	cpld_failed = false;
 
 	/*Allocate memory for CPLD programming structure, this is freed in program_flash_exit*/
 	pcpld = (CPLD*) malloc(sizeof(CPLD));
@@ -549,40 +855,19 @@ void lattice_firmware_update(void)
 		return;
 	}
 
-	toggle_program_pin();
-	delay_us(50);
-
-#if 0	/* not needed*/
-	if (check_device_id())
-		goto stop;
-#endif
-
-	transmit(ISC_ENABLE_X);
-	delay_us(50);
-
-	/*earse_flash*/
-	transmit(ISC_ERASE_CF_UFM_FR(EARSE_CONFIG_ONLY));
-	delay_ms(500);
-
-	/*Wait while erasing*/
-	check_busy();
-	delay_us(50);
-
-	/* Read Status Register*/
-	uint8_t status = read_status_reg();
-	if ((Tst_bits(status, REG_BUSY)) || (Tst_bits(status, REG_FAIL)))
+	/*The program task takes the bus here and keeps it for the update*/
+	bool erased = false;
+	queue_job(CPLD_JOB_ERASE, 0);
+	xQueueReceive(cpld_erased, &erased, portMAX_DELAY);
+	if (!erased)
 	{
-		/* exit*/
-		transmit(ISC_DISABLE);
-		goto stop;
+		program_flash_exit(CPLD_PROG_ERROR);
+		return;
 	}
 
 	load_lattice_jed = 1; /* let USB sof know all data coming in is for jed files uploading*/
 
 	pcpld->jed_file_portion = CONFIGURATION_FLASH_START; /*Setup the state machine*/
 	respond_to_host(CPLD_PROG_OK);
-	return;
-
-	stop: program_flash_exit(CPLD_PROG_ERROR);
 }
 
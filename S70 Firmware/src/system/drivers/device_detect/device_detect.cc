@@ -18,6 +18,7 @@
 #include "sys_task.h"
 #include "string.h"
 #include "supervisor.h"
+#include "../log/log.h"
 
 #include "defs.hh"
 #include "heartbeat_watchdog.hh"
@@ -33,6 +34,9 @@
 // Source: Programming Time, t_{PROG} (https://datasheets.maximintegrated.com/en/ds/DS28E07.pdf)
 #define DEVICE_DETECT_COPY_SCRATCHPAD_DELAY_TIME                pdMS_TO_TICKS(12)
 
+// Bytes in front of the data of a read memory or write scratchpad.
+#define OW_MEMORY_COMMAND_SIZE                                  4
+
 #define DEVICE_EEPROM_ADDRESS_VERSION                           0
 #define DEVICE_EEPROM_ADDRESS_CHECKSUM                          1
 
@@ -107,6 +111,12 @@ typedef struct __attribute__((packed)){
 
 constexpr uint64_t NO_DEVICE_SERIAL_NUMBER = 0xFFFFFFFFFFFFFFFF;
 
+// Set while a copy scratchpad is programming the EEPROM of a slot.  UART0 has
+// to stay on that slot, idling high, until the programming time is up, so no
+// slot uses one-wire until then.  Only used by the device detect task.
+static bool ow_hold = false;
+static TickType_t ow_hold_start;
+
 /****************************************************************************
  * Function Prototypes
  ****************************************************************************/
@@ -118,6 +128,8 @@ static bool read_scratch_pad(uint8_t slot);
 static void copy_srcatch_pad(uint8_t slot);
 static void read_memory_device(uint8_t slot);
 static bool read_device(uint8_t slot);
+static bool ow_holding(void);
+static void record_detect_time(const slot_nums slot, Device * const p_device);
 
 static void task_device_detect(void * p_params);
 
@@ -216,17 +228,17 @@ static uint8_t reset_response(uint8_t slot)
 
 static void write_srcatch_pad(uint8_t slot)
 {
-    ow_byte_wr(OW_SKIP_ROM);
-    ow_byte_wr(OW_WR_SCRATCHPAD);
-
-    ow_byte_wr((uint8_t)slots[slot].device._address);    // address low
-    ow_byte_wr((uint8_t)(slots[slot].device._address >> 8));    // address high
+    uint8_t command[OW_MEMORY_COMMAND_SIZE + SCRATCHPAD_SIZE] = {
+        OW_SKIP_ROM,
+        OW_WR_SCRATCHPAD,
+        (uint8_t)slots[slot].device._address,           // address low
+        (uint8_t)(slots[slot].device._address >> 8),    // address high
+    };
 
     /* now write to the scratch pad*/
-    for (uint8_t i = 0; i < SCRATCHPAD_SIZE; i++)
-    {
-        ow_byte_wr(slots[slot].device._p_ow_buffer[i]);
-    }
+    memcpy(command + OW_MEMORY_COMMAND_SIZE, slots[slot].device._p_ow_buffer, SCRATCHPAD_SIZE);
+    ow_transfer(command, sizeof(command), NULL, 0);
+
     slots[slot].device._ow_state = OW_SEND_RESET_SIGNAL;
     slots[slot].device._ow_next_state = OW_READ_SRCATCH_PAD;
     device_print("Writing scratch pad on slot %d\r\n", slot);
@@ -234,22 +246,18 @@ static void write_srcatch_pad(uint8_t slot)
 
 static bool read_scratch_pad(uint8_t slot)
 {
-    uint8_t rd_val[SCRATCHPAD_SIZE];
+    static const uint8_t COMMAND[] = { OW_SKIP_ROM, OW_RD_SCRATCHPAD };
+
+    // TA1, TA2, and ES come before the scratchpad.
+    uint8_t rd_val[3 + SCRATCHPAD_SIZE];
     uint8_t PFFlag;
     bool matches = true;
 
-    ow_byte_wr(OW_SKIP_ROM);
-    ow_byte_wr(OW_RD_SCRATCHPAD);
-
-    bool timed_out = false;
-
-    slots[slot].device._TA1 = ow_byte_rd(&timed_out);
-    if (timed_out) { return 0; }
-    slots[slot].device._TA2 = ow_byte_rd(&timed_out);
-    if (timed_out) { return 0; }
+    if (! ow_transfer(COMMAND, sizeof(COMMAND), rd_val, sizeof(rd_val))) { return 0; }
 
-    slots[slot].device._ES = ow_byte_rd(&timed_out);
-    if (timed_out) { return 0; }
+    slots[slot].device._TA1 = rd_val[0];
+    slots[slot].device._TA2 = rd_val[1];
+    slots[slot].device._ES = rd_val[2];
     PFFlag = (slots[slot].device._ES & 0x20) >> 5;
 
     /* See if Write to Data to Scratch pad was written correctly*/
@@ -261,9 +269,7 @@ static bool read_scratch_pad(uint8_t slot)
 
     for (uint8_t i = 0; i < SCRATCHPAD_SIZE; i++)
     {
-        rd_val[i] = ow_byte_rd(&timed_out);
-        if (timed_out) { return 0; }
-        matches = matches && (rd_val[i] == slots[slot].device._p_ow_buffer[i]);
+        matches = matches && (rd_val[3 + i] == slots[slot].device._p_ow_buffer[i]);
     }
 
     /*Compare it to the value written*/
@@ -282,16 +288,20 @@ static bool read_scratch_pad(uint8_t slot)
 
 static void copy_srcatch_pad(uint8_t slot)
 {
-    ow_byte_wr(OW_SKIP_ROM);
-    ow_byte_wr(OW_COPY_SCRATCHPAD);
-
-    ow_byte_wr(slots[slot].device._TA1);
-    ow_byte_wr(slots[slot].device._TA2);
-    ow_byte_wr(slots[slot].device._ES);
+    const uint8_t COMMAND[] = {
+        OW_SKIP_ROM,
+        OW_COPY_SCRATCHPAD,
+        slots[slot].device._TA1,
+        slots[slot].device._TA2,
+        slots[slot].device._ES,
+    };
+    ow_transfer(COMMAND, sizeof(COMMAND), NULL, 0);
 
     // We need to set UART0 high to give power to the device.
     // Exact timing is unknown, so this is experimentally determined.
-    vTaskDelay(DEVICE_DETECT_COPY_SCRATCHPAD_DELAY_TIME);
+    // The task keeps going without one-wire until the time is up (see ow_holding()).
+    ow_hold = true;
+    ow_hold_start = xTaskGetTickCount();
 }
 
 static void read_memory_device(uint8_t slot)
@@ -300,18 +310,8 @@ static void read_memory_device(uint8_t slot)
     //uint8_t crc;
 
     /*Read the serial number of the IC*/
-    uint8_t * p_buffer = slots[slot].device._p_ow_buffer;
-
-    ow_byte_wr(OW_RD_ROM);
-    //ow_byte_wr(0);    // address low
-    //ow_byte_wr(0);    // address high
-
-    bool timed_out = false;
-    for (uint8_t i = 0; i < sizeof(uint64_t); i++)
-    {
-        p_buffer[i] = ow_byte_rd(&timed_out);
-        if (timed_out) { break; }
-    }
+    static const uint8_t COMMAND = OW_RD_ROM;
+    ow_transfer(&COMMAND, 1, slots[slot].device._p_ow_buffer, sizeof(uint64_t));
 
     // save 1 byte family_code
     //family_code = rd_val[0];
@@ -345,22 +345,49 @@ static bool read_device(uint8_t slot)
 
     // device_print("slot %d type: %d\r\n", slot,
     //         slots[slot].device.info.device_id);
-    uint8_t * p_buffer = slots[slot].device._p_ow_buffer;
-    uint16_t bytes_to_read = slots[slot].device._bytes_to_read;
+    const uint8_t COMMAND[OW_MEMORY_COMMAND_SIZE] = {
+        OW_SKIP_ROM,
+        OW_RD_MEMORY,
+        (uint8_t)slots[slot].device._address,           // address low
+        (uint8_t)(slots[slot].device._address >> 8),    // address high
+    };
+
+    // The whole read is one DMA block.
+    return ! ow_transfer(COMMAND, sizeof(COMMAND),
+            slots[slot].device._p_ow_buffer, slots[slot].device._bytes_to_read);
+}
 
+/**
+ * If a copy scratchpad is still programming the EEPROM, no slot may use one-wire.
+ */
+static bool ow_holding(void)
+{
+    if (ow_hold && xTaskGetTickCount() - ow_hold_start >= DEVICE_DETECT_COPY_SCRATCHPAD_DELAY_TIME)
+    {
+        ow_hold = false;
+    }
+    return ow_hold;
+}
 
-    ow_byte_wr(OW_SKIP_ROM);
-    ow_byte_wr(OW_RD_MEMORY);
-    ow_byte_wr((uint8_t)slots[slot].device._address);
-    ow_byte_wr((uint8_t)(slots[slot].device._address << 8));
+/**
+ * Saves and logs the time from the device being plugged in to device detection
+ * finishing with it.
+ */
+static void record_detect_time(const slot_nums slot, Device * const p_device)
+{
+    const uint32_t DETECT_MS = (xTaskGetTickCount() - p_device->_dd_detect_start) * portTICK_PERIOD_MS;
+    p_device->_dd_timing = false;
 
-    bool timed_out = false;
-    for(uint8_t i = 0; i < bytes_to_read; ++i) {
-        *(p_buffer++) = ow_byte_rd(&timed_out);
-        if (timed_out) { break; }
+    xSemaphoreTake(slots[slot].xSlot_Mutex, portMAX_DELAY);
+    p_device->detect_time_ms = DETECT_MS;
+    if (DETECT_MS > p_device->worst_detect_time_ms)
+    {
+        p_device->worst_detect_time_ms = DETECT_MS;
     }
+    xSemaphoreGive(slots[slot].xSlot_Mutex);
 
-    return timed_out;
+    log_event(slot, SYSTEM_LOG_TYPE, SYSTEM_DEVICE_DETECT_TIME_LOG, DETECT_MS, p_device->_dd_state, 0);
+    device_print("slot %d detected in %d ms\r\n", slot, DETECT_MS);
 }
 
 static bool service_ow(uint8_t slot)
@@ -770,14 +797,20 @@ static void task_device_detect(void * p_params)
     heartbeat_watchdog watchdog(DEVICE_DETECT_HEARTBEAT_INTERVAL);
     supervisor_add_watchdog(&watchdog);
 
+    // False on the passes woken early for the end of an EEPROM programming time.
+    bool check_connections = true;
+
     for (;;)
     {
 
         // Handle the command queues for each device.
+        // A programming buffer is written over several passes, so the next
+        // command waits until it has been written.
         for (slot_nums slot = SLOT_1; slot < NUMBER_OF_BOARD_SLOTS; ++slot) {
             Device * const p_device = &slots[slot].device;
             _device_detect_command_t cmd;
-            while (xQueueReceive(p_device->_dd_command_queue, &cmd, 0))
+            while (p_device->_dd_data_in_buffer == 0 &&
+                   xQueueReceive(p_device->_dd_command_queue, &cmd, 0))
             {
                 OW_Programming_Error_t err = OWPE_OKAY;
                 switch (cmd.operation)
@@ -859,6 +892,7 @@ static void task_device_detect(void * p_params)
                         // Copy data into programming buffer.
                         memcpy(p_device->_dd_p_programming_buffer, cmd.parameter1.ptr, cmd.parameter2);
                         p_device->_dd_data_in_buffer = cmd.parameter2;
+                        p_device->_dd_programming_index = 0;
 
                         // Pad additional bytes with empty bytes (0xFF).
                         const uint8_t ADDITIONAL_EMPTY_BYTES =
@@ -901,8 +935,9 @@ static void task_device_detect(void * p_params)
 
         
         // Check for device connections, unless told not to.
+        // Between the passes of a programming buffer, the last results are kept.
         xSemaphoreTake(xUART0_Semaphore, portMAX_DELAY);
-        for(slot_nums slot = SLOT_1; slot < NUMBER_OF_BOARD_SLOTS; ++slot)
+        for(slot_nums slot = SLOT_1; check_connections && slot < NUMBER_OF_BOARD_SLOTS; ++slot)
         {
             if (slots[slot].device._dd_abort_device_detection) {
                 slots[slot].device._dd_abort_device_detection = false;
@@ -932,6 +967,11 @@ static void task_device_detect(void * p_params)
         // Handle device-detection tasks for all slot cards.
         for(slot_nums slot = SLOT_1; slot < NUMBER_OF_BOARD_SLOTS; ++slot)
         {
+            // The rest wait for the slot programming its EEPROM.
+            if (ow_holding()) {
+                break;
+            }
+
             pnp_status_t status_flags = 0;
 
             Device * const p_device = &slots[slot].device;
@@ -942,7 +982,6 @@ static void task_device_detect(void * p_params)
             _device_eeprom_header_t header;
             uint64_t read_serial_number;
             uint8_t scratchpad_used = 0;
-            uint16_t programming_buffer_index = 0;
 
             // Handle generic states
             do
@@ -955,6 +994,10 @@ static void task_device_detect(void * p_params)
                     if (DEVICE_DETECTED) {
                         p_device->_dd_delay_counter = DEVICE_DETECT_DELAY_LOOPS;
                         p_device->_dd_state = _DDS_CONNECTION_DELAY;
+
+                        // Time-to-detect starts with the first presence pulse.
+                        p_device->_dd_detect_start = xTaskGetTickCount();
+                        p_device->_dd_timing = true;
                     }
                     if (p_device->info.serial_num != NO_DEVICE_SERIAL_NUMBER)
                     {
@@ -997,6 +1040,8 @@ static void task_device_detect(void * p_params)
                         break;
                         }
 
+                        // Programming is not counted as detection.
+                        p_device->_dd_timing = false;
                         p_device->_dd_state = _DDS_PROGRAMMING;
                     } else {
                         // Read in one-wire serial number.
@@ -1028,10 +1073,12 @@ static void task_device_detect(void * p_params)
                     if (! DEVICE_DETECTED) {
                         p_device->_dd_programming = _NOT_PROGRAMMING;
                         p_device->_dd_state = _DDS_NO_DEVICE;
+                        p_device->_dd_data_in_buffer = 0;
                         vPortFree(p_device->_dd_p_programming_buffer);
                     } else if (p_device->_dd_programming == _NOT_PROGRAMMING) {
                         // No longer programming.  Continue with device-detect.
                         p_device->_dd_state = _DDS_UNKNOWN_DEVICE;
+                        p_device->_dd_data_in_buffer = 0;
                         vPortFree(p_device->_dd_p_programming_buffer);
                     } else if (p_device->_dd_data_in_buffer > 0) {
                         // Data is available to be written.
@@ -1041,7 +1088,7 @@ static void task_device_detect(void * p_params)
                         p_device->_ow_state = OW_SEND_RESET_SIGNAL;
                         p_device->_ow_next_state = OW_WRITE_SRCATCH_PAD;
                         p_device->_address = p_device->_dd_programming_address;
-                        p_device->_p_ow_buffer = p_device->_dd_p_programming_buffer + programming_buffer_index;
+                        p_device->_p_ow_buffer = p_device->_dd_p_programming_buffer + p_device->_dd_programming_index;
                         p_device->_dd_state = _DDS_PROGRAMMING_VERIFY;
                         handle_ow = true;
                     }
@@ -1050,7 +1097,7 @@ static void task_device_detect(void * p_params)
                 case _DDS_PROGRAMMING_VERIFY:
                     // Check to see if the state made it to copy (write to flash).
                     if (p_device->_ow_state == OW_COPY_SRCATCH_PAD) {
-                        programming_buffer_index += 8;
+                        p_device->_dd_programming_index += 8;
 
                         p_device->_dd_data_in_buffer -= scratchpad_used;
                         p_device->_dd_programming_address += scratchpad_used;
@@ -1105,7 +1152,7 @@ static void task_device_detect(void * p_params)
 #endif
             } while (p_device->_dd_state == _DDS_UNKNOWN_DEVICE ||
                     p_device->_dd_state == _DDS_READ_HEADER ||
-                     (p_device->_dd_state == _DDS_PROGRAMMING && p_device->_dd_data_in_buffer > 0) ||
+                     (p_device->_dd_state == _DDS_PROGRAMMING && p_device->_dd_data_in_buffer > 0 && ! ow_holding()) ||
                      p_device->_dd_state == _DDS_PROGRAMMING_VERIFY
                     );
 
@@ -1132,6 +1179,14 @@ static void task_device_detect(void * p_params)
                 status_flags |= sb;
             }
 
+            if (p_device->_dd_timing &&
+                (p_device->_dd_state == _DDS_PASSED ||
+                 p_device->_dd_state == _DDS_BAD_DEVICE ||
+                 p_device->_dd_state == _DDS_STATIC_DEVICE))
+            {
+                record_detect_time(slot, p_device);
+            }
+
             // Update the status bits.
             if (status_flags & pnp_status::GENERAL_OW_ERROR) {
                 // If a general ow error status is reported, save the status flags.
@@ -1162,7 +1217,14 @@ static void task_device_detect(void * p_params)
 
         // Schedule next time to run
         watchdog.beat();
-        vTaskDelayUntil(&now, DEVICE_DETECT_UPDATE_INTERVAL);
+        check_connections = ! ow_holding();
+        if (check_connections) {
+            vTaskDelayUntil(&now, DEVICE_DETECT_UPDATE_INTERVAL);
+        } else {
+            // Come back as soon as the EEPROM is programmed, instead of
+            // sleeping through the programming time in copy_srcatch_pad().
+            vTaskDelay(DEVICE_DETECT_COPY_SCRATCHPAD_DELAY_TIME - (xTaskGetTickCount() - ow_hold_start));
+        }
     }
 }
 
@@ -1211,6 +1273,11 @@ void device_detect_init(void)
         slots[slot].device._dd_abort_device_detection = false;
         slots[slot].device._dd_programming = _NOT_PROGRAMMING;
         slots[slot].device._dd_previous_status_flags = static_cast<uint8_t>(pnp_status::NO_ERRORS);
+        slots[slot].device._dd_data_in_buffer = 0;
+        slots[slot].device._dd_programming_index = 0;
+        slots[slot].device._dd_timing = false;
+        slots[slot].device.detect_time_ms = 0;
+        slots[slot].device.worst_detect_time_ms = 0;
 
         slots[slot].device._dd_command_queue = xQueueCreate(2, sizeof(_device_detect_command_t));
         configASSERT(slots[slot].device._dd_command_queue);
@@ -157,6 +157,9 @@ typedef struct
     uint16_t p_slot_config_size;                ///> Size of p_slot_config in bytes.  Can be used to determine if a config is out-of-date.
     uint8_t * p_config_entries;                 ///> Custom LUT entries for the device.
     uint16_t p_config_entries_size;             ///> Size of p_config_entries in bytes.
+    uint32_t detect_time_ms;                    ///> Time from the device being plugged in to device detection
+                                                ///  finishing with it, for the last device.
+    uint32_t worst_detect_time_ms;              ///> The longest detect_time_ms since power up.
     
 
     // One-Wire Fields (managed by device detect task, so no mux is needed)
@@ -181,7 +184,10 @@ typedef struct
     uint8_t * _dd_p_programming_buffer;
     uint16_t _dd_data_in_buffer;
     uint16_t _dd_programming_address;
+    uint16_t _dd_programming_index;             // Offset into _dd_p_programming_buffer of the next scratchpad.
     uint8_t _dd_previous_status_flags;
+    TickType_t _dd_detect_start;                // When the device was plugged in.
+    bool _dd_timing;                            // Set until detect_time_ms is saved for the device.
 
     // Device-Detect Command Queue (interfaced with public device-detect calls)
     QueueHandle_t _dd_command_queue;            // Mailbox handling DD commands from public interfaces.
@@ -37,10 +37,30 @@ static unsigned char CRC_LUT[256] = {
     0x82,0xB3,0xE0,0xD1,0x46,0x77,0x24,0x15,0x3B,0x0A,0x59,0x68,0xFF,0xCE,0x9D,0xAC,
 };
 
+/// If a page write was started by eeprom_25LC1024_write_page_nowait()
+/// and may still be in its write cycle.
+static bool write_cycle_pending = false;
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
+static bool eeprom_25LC1024_wait_for_write(void);
+
+/**
+ * Waits out the write cycle of a page started without waiting, as the
+ * device ignores every other instruction until it completes.
+ */
+// MARK:  SPI Mutex Required
+static void eeprom_25LC1024_sync(void)
+{
+	if (write_cycle_pending)
+	{
+		eeprom_25LC1024_wait_for_write();
+		write_cycle_pending = false;
+	}
+}
+
 /**
  * This instruction must be set before any write operation will be completed internally.
  */
@@ -110,8 +130,9 @@ static bool eeprom_25LC1024_wait_for_write(void)
 }
 
 // MARK:  SPI Mutex Required
-static bool eeprom_25LC1024_write_page(uint32_t startAdr, uint32_t len, const uint8_t *data)
+static void eeprom_25LC1024_start_write_page(uint32_t startAdr, uint32_t len, const uint8_t *data)
 {
+	eeprom_25LC1024_sync();
 	eeprom_25LC1024_write_enable();
 
 	uint8_t header[4];
@@ -135,6 +156,12 @@ static bool eeprom_25LC1024_write_page(uint32_t startAdr, uint32_t len, const ui
     }
 
     spi_end_transfer();
+}
+
+// MARK:  SPI Mutex Required
+static bool eeprom_25LC1024_write_page(uint32_t startAdr, uint32_t len, const uint8_t *data)
+{
+	eeprom_25LC1024_start_write_page(startAdr, len, data);
 	if (eeprom_25LC1024_wait_for_write())
 		return 1;
 	return 0;
@@ -189,6 +216,8 @@ bool eeprom_25LC1024_clear_mem(void)
 	char sn[USB_DEVICE_GET_SERIAL_NAME_LENGTH];
 	memcpy(sn, usb_serial_number, USB_DEVICE_GET_SERIAL_NAME_LENGTH);
 
+	eeprom_25LC1024_cache_discard(EEPROM_START_ADDRESS, EEPROM_25LC1024_SIZE);
+	eeprom_25LC1024_sync();
 	eeprom_25LC1024_write_enable();
 
 	uint8_t spi_tx_data[1];
@@ -207,6 +236,9 @@ bool eeprom_25LC1024_clear_mem(void)
 // MARK:  SPI Mutex Required
 bool eeprom_25LC1024_clear_page(uint32_t startAdr)
 {
+	eeprom_25LC1024_cache_discard(startAdr - startAdr % EEPROM_25LC1024_PAGE_SIZE,
+			startAdr - startAdr % EEPROM_25LC1024_PAGE_SIZE + EEPROM_25LC1024_PAGE_SIZE);
+	eeprom_25LC1024_sync();
 	eeprom_25LC1024_write_enable();
 	uint8_t spi_tx_data[4];
 
@@ -226,12 +258,14 @@ bool eeprom_25LC1024_clear_page(uint32_t startAdr)
 }
 
 // MARK:  SPI Mutex Required
-void eeprom_25LC1024_read(uint32_t startAdr, uint32_t len, uint8_t* rx_data)
+void eeprom_25LC1024_read_direct(uint32_t startAdr, uint32_t len, uint8_t* rx_data)
 {
 	// assertion
 	if (startAdr + len > EEPROM_25LC1024_SIZE)
 		return;
 
+	eeprom_25LC1024_sync();
+
 	uint8_t header[4];
 
 	// setup send read command
@@ -257,7 +291,7 @@ void eeprom_25LC1024_read(uint32_t startAdr, uint32_t len, uint8_t* rx_data)
 }
 
 // MARK:  SPI Mutex Required
-bool eeprom_25LC1024_write(uint32_t startAdr, uint32_t len, const uint8_t *data)
+bool eeprom_25LC1024_write_direct(uint32_t startAdr, uint32_t len, const uint8_t *data)
 {
 	/* Entire page is automatically erased before write and data is saved in other cells*/
 	if (startAdr + len > EEPROM_25LC1024_SIZE)
@@ -280,16 +314,37 @@ bool eeprom_25LC1024_write(uint32_t startAdr, uint32_t len, const uint8_t *data)
             startAdr + ofs,
             pageLen,
             data + ofs);
-		if (!b)
+		if (b)
 		{
+			/* keep the data cached so the cache retries it*/
+			eeprom_25LC1024_cache_update(startAdr + ofs, len - ofs, data + ofs, false);
 			return 1;
 		}
+		/* a cached copy of the page must not overwrite this later*/
+		eeprom_25LC1024_cache_update(startAdr + ofs, pageLen, data + ofs, true);
 		/* and switch to next page*/
 		ofs += pageLen;
 	}
 	return 0;
 }
 
+// MARK:  SPI Mutex Required
+void eeprom_25LC1024_write_page_nowait(uint32_t startAdr, uint32_t len, const uint8_t *data)
+{
+	eeprom_25LC1024_start_write_page(startAdr, len, data);
+	write_cycle_pending = true;
+}
+
+// MARK:  SPI Mutex Required
+bool eeprom_25LC1024_write_in_progress(void)
+{
+	if (write_cycle_pending && 0 == (eeprom_25LC1024_read_status() & 1))
+	{
+		write_cycle_pending = false;
+	}
+	return write_cycle_pending;
+}
+
 // MARK:  SPI Mutex Required
 void test_25lc1024(void)
 {
@@ -312,11 +367,15 @@ void test_25lc1024(void)
 // MARK:  SPI Mutex Required
 bool eeprom_25LC1024_clear_sector(uint32_t sector)
 {
+    uint32_t sector_start_address = EEPROM_SECTOR_START_ADDRESS(sector);
+
+    eeprom_25LC1024_cache_discard(sector_start_address,
+            sector_start_address + EEPROM_25LC1024_SECTOR_SIZE);
+    eeprom_25LC1024_sync();
+
     eeprom_25LC1024_write_enable();
     uint8_t spi_tx_data[4];
 
-    uint32_t sector_start_address = EEPROM_SECTOR_START_ADDRESS(sector);
-
     /* send write command*/
     spi_tx_data[0] = EEPROM_25LC1024_SE;
     /* setup send address*/
@@ -335,6 +394,8 @@ bool eeprom_25LC1024_set_write_protect(uint8_t protection)
 {
     uint8_t spi_tx_data[2];
 
+    eeprom_25LC1024_sync();
+
     // Setup and read status register.
     spi_tx_data[0] = protection;
     spi_tx_data[1] = DUMMY_HIGH;
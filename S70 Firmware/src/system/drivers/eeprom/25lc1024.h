@@ -24,6 +24,13 @@ extern "C" {
 /** Time-out value (number of attempts). */
 #define EEPROM_25LC1024_TIMEOUT       15000
 
+/** Write-back cache */
+#define EEPROM_CACHE_PAGES            8
+/** Dirty pages are written once no writes have occurred for this long. */
+#define EEPROM_CACHE_IDLE_TIME        pdMS_TO_TICKS(50)
+/** Dirty pages are written at the latest this long after becoming dirty. */
+#define EEPROM_CACHE_DEADLINE         pdMS_TO_TICKS(1000)
+
 //#define HIGH_BYTE(x) ((x&0xff00)>>8)
 //#define LOW_BYTE(x) (x&0xff)
 
@@ -199,6 +206,9 @@ bool eeprom_25LC1024_clear_page(uint32_t startAdr);
 bool eeprom_25LC1024_clear_sector(uint32_t sector); /// \todo Implement.
 bool eeprom_25LC1024_set_write_protect(uint8_t protection); /// \todo Implement
 
+/**
+ * Reads from EEPROM, including writes still held by the write-back cache.
+ */
 void eeprom_25LC1024_read(uint32_t startAdr, uint32_t len, uint8_t* rx_data);
 /**
  * Thread-safe reading from EEPROM.
@@ -210,6 +220,12 @@ inline void eeprom_25LC1024_read_safe(uint32_t startAdr, uint32_t len, uint8_t*
 	xSemaphoreGive(xSPI_Semaphore);
 }
 
+/**
+ * Writes to EEPROM through the write-back cache.
+ * The data reaches the device when the cache is idle, when the data has been
+ * held for EEPROM_CACHE_DEADLINE, or on eeprom_25LC1024_flush().
+ * Only blocks on the device when a cache page must be evicted.
+ */
 bool eeprom_25LC1024_write(uint32_t startAdr, uint32_t len, const uint8_t *data);
 /**
  * Thread-safe reading from EEPROM.
@@ -222,6 +238,57 @@ inline bool eeprom_25LC1024_write_safe(uint32_t startAdr, uint32_t len, const ui
 	return RT;
 }
 
+
+/**
+ * Reads from the device, bypassing the write-back cache.
+ */
+void eeprom_25LC1024_read_direct(uint32_t startAdr, uint32_t len, uint8_t* rx_data);
+
+/**
+ * Writes to the device and waits for each page's write cycle, bypassing the
+ * write-back cache.
+ * Cached copies of the pages are updated with the data.
+ */
+bool eeprom_25LC1024_write_direct(uint32_t startAdr, uint32_t len, const uint8_t *data);
+
+/**
+ * Starts writing data within one page without waiting for the write cycle.
+ * The next operation on the device waits for the cycle to finish.
+ */
+void eeprom_25LC1024_write_page_nowait(uint32_t startAdr, uint32_t len, const uint8_t *data);
+
+/**
+ * \return If a write started by eeprom_25LC1024_write_page_nowait() is still
+ *         in its write cycle.
+ */
+bool eeprom_25LC1024_write_in_progress(void);
+
+/**
+ * Writes every dirty page of the write-back cache to the device and waits
+ * for the last write cycle to finish.
+ * \return 0 if no error, 1 if a write timed out.
+ */
+bool eeprom_25LC1024_flush(void);
+
+/**
+ * Copies data written to the device around the cache into any cached copy
+ * of its pages.
+ * \param written false if the device write failed; the bytes are then left
+ *                dirty in cached pages so the cache writes them again.
+ */
+void eeprom_25LC1024_cache_update(uint32_t startAdr, uint32_t len, const uint8_t *data, bool written);
+
+/**
+ * Drops cached data in [startAdr, endAdr) without writing it,
+ * e.g. because the range is being erased.
+ */
+void eeprom_25LC1024_cache_discard(uint32_t startAdr, uint32_t endAdr);
+
+/**
+ * Creates the write-back cache's flushing task.
+ */
+void eeprom_25LC1024_cache_init(void);
+
 void test_25lc1024(void);
 CRC8_t CRC(const char* p_data, uint32_t length);
 CRC8_t CRC_split(const char* p_data, uint32_t length, uint8_t crc);
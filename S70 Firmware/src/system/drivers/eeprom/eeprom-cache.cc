@@ -0,0 +1,430 @@
+/**
+ * \file eeprom-cache.cc
+ * \brief Write-back page cache in front of the 25LC1024.
+ *
+ * Writes land in one of EEPROM_CACHE_PAGES cached pages, where a per-byte
+ * dirty bitmap records what still has to reach the device, so adjacent and
+ * repeated writes to a page coalesce into one page write.
+ * A background task writes dirty pages once the cache is idle or a page has
+ * been held for EEPROM_CACHE_DEADLINE.
+ * Before a page is written, the device's copy is read back and bytes that did
+ * not change are dropped; a page whose contents are unchanged is not written.
+ *
+ * Like the rest of the 25LC1024 driver, the cache is protected by
+ * xSPI_Semaphore: every public function requires the caller to hold it.
+ */
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cstring>
+
+#include "25lc1024.h"
+#include "FreeRTOS.h"
+#include "spi-scheduler.hh"
+#include "sys_task.h"
+#include "task.h"
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+static constexpr uint32_t PAGE_SIZE = EEPROM_25LC1024_PAGE_SIZE;
+static constexpr uint32_t NO_PAGE   = UINT32_MAX;
+
+/// \brief The 25LC1024's maximum write-cycle time.
+static constexpr TickType_t WRITE_CYCLE_TIME = pdMS_TO_TICKS(6);
+
+/*****************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+struct cached_page {
+    uint32_t head_address = NO_PAGE;
+
+    /// If data holds the device's whole page, not just the dirty bytes.
+    bool complete = false;
+
+    /// The tick the page went from clean to dirty.
+    TickType_t dirty_since = 0;
+
+    /// For least-recently-used replacement.
+    uint32_t last_use = 0;
+
+    /// The bytes that have not been written to the device yet.
+    std::bitset<PAGE_SIZE> dirty;
+
+    std::array<uint8_t, PAGE_SIZE> data;
+};
+
+/*****************************************************************************
+ * Private Function Prototypes
+ *****************************************************************************/
+static void task_eeprom_cache(void*);
+static TickType_t time_until_due();
+
+static cached_page* find(uint32_t head_address);
+static cached_page* allocate(uint32_t head_address);
+static cached_page* oldest_dirty();
+
+static bool flush_page(cached_page& page, bool wait_for_write);
+static void mark_dirty(cached_page& page);
+static void mark_clean(cached_page& page);
+static void update_dirty_since();
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+static std::array<cached_page, EEPROM_CACHE_PAGES> s_pages;
+static uint32_t s_use_counter = 0;
+
+/// \brief Holds the device's copy of a page during a flush.
+static std::array<uint8_t, PAGE_SIZE> s_scratch;
+
+// Read by the flushing task without holding xSPI_Semaphore.
+static std::atomic<uint32_t> s_dirty_pages{0};
+
+/// The tick the oldest page still dirty became dirty.
+static std::atomic<TickType_t> s_dirty_since{0};
+static std::atomic<TickType_t> s_last_write{0};
+
+static TaskHandle_t s_flusher = nullptr;
+
+/*****************************************************************************
+ * Interrupt Handlers
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+// MARK:  SPI Mutex Required
+extern "C" void eeprom_25LC1024_read(uint32_t startAdr, uint32_t len,
+                                     uint8_t* rx_data) {
+    if (startAdr + len > EEPROM_25LC1024_SIZE) {
+        return;
+    }
+
+    while (len > 0) {
+        const uint32_t OFFSET = startAdr % PAGE_SIZE;
+        const uint32_t SIZE   = std::min(len, PAGE_SIZE - OFFSET);
+
+        cached_page* const page = find(startAdr - OFFSET);
+        if (page != nullptr && page->complete) {
+            std::memcpy(rx_data, page->data.data() + OFFSET, SIZE);
+            page->last_use = ++s_use_counter;
+        } else {
+            eeprom_25LC1024_read_direct(startAdr, SIZE, rx_data);
+            if (page != nullptr) {
+                for (uint32_t i = 0; i < SIZE; ++i) {
+                    if (page->dirty.test(OFFSET + i)) {
+                        rx_data[i] = page->data[OFFSET + i];
+                    }
+                }
+            }
+        }
+
+        startAdr += SIZE;
+        rx_data += SIZE;
+        len -= SIZE;
+    }
+}
+
+// MARK:  SPI Mutex Required
+extern "C" bool eeprom_25LC1024_write(uint32_t startAdr, uint32_t len,
+                                      const uint8_t* data) {
+    if (startAdr + len > EEPROM_25LC1024_SIZE) {
+        return 1;
+    }
+
+    while (len > 0) {
+        const uint32_t OFFSET = startAdr % PAGE_SIZE;
+        const uint32_t SIZE   = std::min(len, PAGE_SIZE - OFFSET);
+
+        cached_page* page = find(startAdr - OFFSET);
+        if (page == nullptr) {
+            page = allocate(startAdr - OFFSET);
+            if (page == nullptr) {
+                // Every page is dirty and the eviction failed.
+                return eeprom_25LC1024_write_direct(startAdr, len, data);
+            }
+        }
+
+        std::memcpy(page->data.data() + OFFSET, data, SIZE);
+        mark_dirty(*page);
+        for (uint32_t i = 0; i < SIZE; ++i) {
+            page->dirty.set(OFFSET + i);
+        }
+        page->last_use = ++s_use_counter;
+
+        startAdr += SIZE;
+        data += SIZE;
+        len -= SIZE;
+    }
+
+    s_last_write.store(xTaskGetTickCount(), std::memory_order_relaxed);
+    return 0;
+}
+
+// MARK:  SPI Mutex Required
+extern "C" bool eeprom_25LC1024_flush(void) {
+    bool error = 0;
+    for (cached_page& page : s_pages) {
+        if (page.dirty.any()) {
+            error |= flush_page(page, true);
+        }
+    }
+
+    // Finish a write the flushing task started, so the data is on the device
+    // when this returns.
+    for (uint32_t attempts = 0; eeprom_25LC1024_write_in_progress();
+         ++attempts) {
+        if (attempts == EEPROM_25LC1024_TIMEOUT) {
+            return 1;
+        }
+    }
+    return error;
+}
+
+// MARK:  SPI Mutex Required
+extern "C" void eeprom_25LC1024_cache_update(uint32_t startAdr, uint32_t len,
+                                             const uint8_t* data,
+                                             bool written) {
+    while (len > 0) {
+        const uint32_t OFFSET = startAdr % PAGE_SIZE;
+        const uint32_t SIZE   = std::min(len, PAGE_SIZE - OFFSET);
+
+        cached_page* const page = find(startAdr - OFFSET);
+        if (page != nullptr) {
+            // A flush passes the page's own data.
+            if (page->data.data() + OFFSET != data) {
+                std::memcpy(page->data.data() + OFFSET, data, SIZE);
+            }
+
+            // Bytes the device did not take stay dirty to be retried.
+            const bool WAS_DIRTY = page->dirty.any();
+            if (!written) {
+                mark_dirty(*page);
+            }
+            for (uint32_t i = 0; i < SIZE; ++i) {
+                page->dirty.set(OFFSET + i, !written);
+            }
+            if (WAS_DIRTY && page->dirty.none()) {
+                s_dirty_pages.fetch_sub(1, std::memory_order_acq_rel);
+                update_dirty_since();
+            }
+        }
+
+        startAdr += SIZE;
+        data += SIZE;
+        len -= SIZE;
+    }
+}
+
+// MARK:  SPI Mutex Required
+extern "C" void eeprom_25LC1024_cache_discard(uint32_t startAdr,
+                                              uint32_t endAdr) {
+    for (cached_page& page : s_pages) {
+        if (page.head_address == NO_PAGE ||
+            page.head_address + PAGE_SIZE <= startAdr ||
+            page.head_address >= endAdr) {
+            continue;
+        }
+
+        const uint32_t HEAD = std::max(page.head_address, startAdr);
+        const uint32_t TAIL = std::min(page.head_address + PAGE_SIZE, endAdr);
+        std::bitset<PAGE_SIZE> discarded;
+        for (uint32_t address = HEAD; address < TAIL; ++address) {
+            discarded.set(address - page.head_address);
+        }
+
+        if ((page.dirty & ~discarded).none()) {
+            mark_clean(page);
+            page.head_address = NO_PAGE;
+        } else {
+            page.dirty &= ~discarded;
+        }
+        page.complete = false;
+    }
+}
+
+extern "C" void eeprom_25LC1024_cache_init(void) {
+    if (xTaskCreate(task_eeprom_cache, "EE Cache",
+                    TASK_EEPROM_CACHE_STACK_SIZE, nullptr,
+                    TASK_EEPROM_CACHE_STACK_PRIORITY, &s_flusher) != pdPASS) {
+        s_flusher = nullptr;
+    }
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+static void task_eeprom_cache(void*) {
+    service::spi_scheduler::register_client(
+        "EE Cache", service::spi_scheduler::priority::BACKGROUND);
+
+    for (;;) {
+        const TickType_t WAIT = time_until_due();
+        if (WAIT != 0) {
+            // Woken early when a clean cache becomes dirty.
+            ulTaskNotifyTake(pdTRUE, WAIT);
+            continue;
+        }
+
+        // One page per bus acquisition; the write cycle runs with the bus
+        // released.
+        {
+            service::spi_scheduler::bus_guard lg;
+            cached_page* const page = oldest_dirty();
+            if (page != nullptr) {
+                flush_page(*page, false);
+            }
+        }
+        vTaskDelay(WRITE_CYCLE_TIME);
+    }
+}
+
+static TickType_t time_until_due() {
+    if (s_dirty_pages.load(std::memory_order_acquire) == 0) {
+        return portMAX_DELAY;
+    }
+
+    const TickType_t NOW = xTaskGetTickCount();
+    const TickType_t IDLE =
+        NOW - s_last_write.load(std::memory_order_relaxed);
+    const TickType_t HELD =
+        NOW - s_dirty_since.load(std::memory_order_relaxed);
+    if (IDLE >= EEPROM_CACHE_IDLE_TIME || HELD >= EEPROM_CACHE_DEADLINE) {
+        return 0;
+    }
+
+    return std::min<TickType_t>(EEPROM_CACHE_IDLE_TIME - IDLE,
+                                EEPROM_CACHE_DEADLINE - HELD);
+}
+
+static cached_page* find(const uint32_t head_address) {
+    for (cached_page& page : s_pages) {
+        if (page.head_address == head_address) {
+            return &page;
+        }
+    }
+    return nullptr;
+}
+
+/// \brief Replaces the least-recently-used page, preferring clean pages.
+static cached_page* allocate(const uint32_t head_address) {
+    cached_page* victim = nullptr;
+    for (cached_page& page : s_pages) {
+        if (victim == nullptr) {
+            victim = &page;
+            continue;
+        }
+
+        const bool VICTIM_DIRTY = victim->dirty.any();
+        const bool PAGE_DIRTY   = page.dirty.any();
+        if ((VICTIM_DIRTY && !PAGE_DIRTY) ||
+            (VICTIM_DIRTY == PAGE_DIRTY && page.last_use < victim->last_use)) {
+            victim = &page;
+        }
+    }
+
+    if (victim->dirty.any() && flush_page(*victim, true)) {
+        return nullptr;
+    }
+
+    victim->head_address = head_address;
+    victim->complete     = false;
+    victim->dirty.reset();
+    return victim;
+}
+
+static cached_page* oldest_dirty() {
+    cached_page* oldest = nullptr;
+    const TickType_t NOW = xTaskGetTickCount();
+    for (cached_page& page : s_pages) {
+        if (page.dirty.any() &&
+            (oldest == nullptr ||
+             NOW - page.dirty_since > NOW - oldest->dirty_since)) {
+            oldest = &page;
+        }
+    }
+    return oldest;
+}
+
+/**
+ * Writes the page's dirty bytes that differ from the device.
+ * The changed bytes are written as one run, filling the gaps between them
+ * with the device's data.
+ * Afterwards, the page holds the device's whole page.
+ * \return 0 if no error, 1 if the write timed out.
+ */
+static bool flush_page(cached_page& page, const bool wait_for_write) {
+    eeprom_25LC1024_read_direct(page.head_address, PAGE_SIZE,
+                                s_scratch.data());
+
+    uint32_t first = PAGE_SIZE;
+    uint32_t last  = 0;
+    for (uint32_t i = 0; i < PAGE_SIZE; ++i) {
+        if (!page.dirty.test(i)) {
+            page.data[i] = s_scratch[i];
+        } else if (page.data[i] != s_scratch[i]) {
+            first = std::min(first, i);
+            last  = i;
+        }
+    }
+    page.complete = true;
+    mark_clean(page);
+
+    if (first == PAGE_SIZE) {
+        // Unchanged: save the write cycle.
+        return 0;
+    }
+
+    const uint32_t SIZE = last - first + 1;
+    if (wait_for_write) {
+        return eeprom_25LC1024_write_direct(page.head_address + first, SIZE,
+                                            page.data.data() + first);
+    }
+
+    eeprom_25LC1024_write_page_nowait(page.head_address + first, SIZE,
+                                      page.data.data() + first);
+    return 0;
+}
+
+static void mark_dirty(cached_page& page) {
+    if (page.dirty.any()) {
+        return;
+    }
+
+    page.dirty_since = xTaskGetTickCount();
+    if (s_dirty_pages.fetch_add(1, std::memory_order_acq_rel) == 0) {
+        s_dirty_since.store(page.dirty_since, std::memory_order_relaxed);
+        if (s_flusher != nullptr) {
+            xTaskNotifyGive(s_flusher);
+        }
+    }
+}
+
+static void mark_clean(cached_page& page) {
+    if (page.dirty.none()) {
+        return;
+    }
+
+    page.dirty.reset();
+    s_dirty_pages.fetch_sub(1, std::memory_order_acq_rel);
+    update_dirty_since();
+}
+
+/**
+ * The deadline runs from the oldest page still dirty, so once that page is
+ * written the pages dirtied after it are not treated as overdue.
+ */
+static void update_dirty_since() {
+    const cached_page* const OLDEST = oldest_dirty();
+    if (OLDEST != nullptr) {
+        s_dirty_since.store(OLDEST->dirty_since, std::memory_order_relaxed);
+    }
+}
+
+// EOF
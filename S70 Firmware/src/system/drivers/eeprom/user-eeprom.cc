@@ -120,7 +120,13 @@ flush_guard::flush_guard(drivers::spi::handle_factory &factory,
                          page_cache &cache)
     : _factory(factory), _cache(cache) {}
 
-flush_guard::~flush_guard() { _cache.flush(_factory); }
+flush_guard::~flush_guard() {
+    _cache.flush(_factory);
+
+    // Push the page through the write-back cache as well.
+    _factory.acquire_lock();
+    eeprom_25LC1024_flush();
+}
 
 stream_descriptor::local_address_type
 stream_descriptor::seek(seek_begin_t, std::size_t from_head) {
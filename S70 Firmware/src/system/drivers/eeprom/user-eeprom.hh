@@ -216,6 +216,7 @@ class page_cache {
 
 /// RAII guard that guarantees that a flush occurs when this object goes
 /// out of scope.
+/// The flush goes through the 25LC1024 write-back cache to the device.
 class flush_guard {
    public:
     flush_guard(drivers::spi::handle_factory& factory, page_cache& cache);
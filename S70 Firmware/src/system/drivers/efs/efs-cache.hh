@@ -17,6 +17,7 @@ namespace efs
     bool erase();
     bool create_file( const file_identifier_t, const uint16_t,
         const file_attributes_t, const TickType_t);
+    bool compact(const TickType_t);
 }
 
 namespace efs
@@ -230,6 +231,7 @@ public:
     friend bool efs::erase();
     friend bool create_file( const file_identifier_t, const uint16_t,
         const file_attributes_t, const TickType_t);
+    friend bool efs::compact(const TickType_t);
 };
 
 /**
@@ -0,0 +1,216 @@
+// efs-extents.hh
+
+/**************************************************************************//**
+ * \file efs-extents.hh
+ * \brief Free-space bookkeeping for EFS data pages.
+ *
+ * Free pages are kept as runs ("extents") sorted by length, then by address,
+ * so the best-fitting run for an allocation is the first one long enough.
+ *****************************************************************************/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace efs
+{
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+/// \brief A run of contiguous EFS pages.
+struct extent
+{
+    uint16_t start;
+    uint16_t length;
+
+    constexpr uint16_t end() const
+    {
+        return start + length;
+    }
+};
+
+/**
+ * A fixed-capacity list of free extents.
+ * Adjacent extents are merged as they are released, so the list never holds
+ * more extents than there are gaps between allocated files.
+ * \tparam LEN The maximum number of free extents.
+ */
+template<std::size_t LEN>
+class free_extent_pool
+{
+private:
+    std::array<extent, LEN> _extents;
+    std::size_t _size = 0;
+
+    void erase_at(const std::size_t index)
+    {
+        for (std::size_t i = index + 1; i < _size; ++i)
+        {
+            _extents[i - 1] = _extents[i];
+        }
+        --_size;
+    }
+
+    void insert_sorted(const extent& to_insert)
+    {
+        std::size_t index = _size;
+        while (index > 0 && (
+            _extents[index - 1].length > to_insert.length ||
+            (_extents[index - 1].length == to_insert.length && _extents[index - 1].start > to_insert.start)
+        )) {
+            _extents[index] = _extents[index - 1];
+            --index;
+        }
+        _extents[index] = to_insert;
+        ++_size;
+    }
+
+public:
+    void clear()
+    {
+        _size = 0;
+    }
+
+    inline std::size_t size() const
+    {
+        return _size;
+    }
+
+    /**
+     * \return The length of the longest free extent.
+     */
+    inline uint16_t largest() const
+    {
+        return (_size == 0) ? 0 : _extents[_size - 1].length;
+    }
+
+    /**
+     * \return The free extent at the given rank in address order.
+     * \pre rank < size()
+     */
+    extent by_address(const std::size_t rank) const
+    {
+        // Small enough that a selection is cheaper than keeping a second order.
+        extent rt = {UINT16_MAX, 0};
+        uint16_t floor = 0;
+        for (std::size_t n = 0; n <= rank; ++n)
+        {
+            rt = {UINT16_MAX, 0};
+            for (std::size_t i = 0; i < _size; ++i)
+            {
+                if (_extents[i].start >= floor && _extents[i].start < rt.start)
+                {
+                    rt = _extents[i];
+                }
+            }
+            floor = rt.start + 1;
+        }
+        return rt;
+    }
+
+    /**
+     * Returns pages to the pool, merging with neighbouring extents.
+     * \return false The pool is full and the pages were not added.
+     */
+    bool release(extent to_release)
+    {
+        if (to_release.length == 0)
+        {
+            return true;
+        }
+
+        for (std::size_t i = 0; i < _size;)
+        {
+            if (_extents[i].end() == to_release.start)
+            {
+                to_release.start = _extents[i].start;
+                to_release.length += _extents[i].length;
+                erase_at(i);
+            }
+            else if (to_release.end() == _extents[i].start)
+            {
+                to_release.length += _extents[i].length;
+                erase_at(i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        if (_size == LEN)
+        {
+            return false;
+        }
+        insert_sorted(to_release);
+        return true;
+    }
+
+    /**
+     * Takes the smallest free extent that holds the requested pages,
+     * preferring the lowest address among equally sized extents.
+     * \param[in]       length The number of pages to take.
+     * \param[out]      r_start The first page taken.
+     * \return false No free extent is long enough.
+     */
+    bool take(const uint16_t length, uint16_t& r_start)
+    {
+        for (std::size_t i = 0; i < _size; ++i)
+        {
+            if (_extents[i].length >= length)
+            {
+                const extent REST = {
+                    static_cast<uint16_t>(_extents[i].start + length),
+                    static_cast<uint16_t>(_extents[i].length - length)
+                };
+                r_start = _extents[i].start;
+                erase_at(i);
+                if (REST.length > 0)
+                {
+                    insert_sorted(REST);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Takes specific pages from the pool.
+     * \return false The pages are not all free, or splitting the extent would overflow the pool.
+     */
+    bool take_at(const extent& to_take)
+    {
+        for (std::size_t i = 0; i < _size; ++i)
+        {
+            const extent FOUND = _extents[i];
+            if (FOUND.start <= to_take.start && to_take.end() <= FOUND.end())
+            {
+                const extent HEAD = {FOUND.start, static_cast<uint16_t>(to_take.start - FOUND.start)};
+                const extent TAIL = {to_take.end(), static_cast<uint16_t>(FOUND.end() - to_take.end())};
+                if (HEAD.length > 0 && TAIL.length > 0 && _size == LEN)
+                {
+                    return false;
+                }
+
+                erase_at(i);
+                if (HEAD.length > 0)
+                {
+                    insert_sorted(HEAD);
+                }
+                if (TAIL.length > 0)
+                {
+                    insert_sorted(TAIL);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+}
+
+// EOF
@@ -0,0 +1,142 @@
+// efs-stream.cc
+
+// clang-format off
+/**************************************************************************/ /**
+* \file efs-stream.cc
+*****************************************************************************/
+// clang-format on
+#include "efs-stream.hh"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace efs;
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+stream::stream(handle &&file) : _file(std::move(file)) {}
+
+stream::~stream() { flush(); }
+
+uint32_t stream::read(std::span<std::byte> dest) {
+    uint32_t rt = 0;
+    while (!dest.empty() && _cursor < size()) {
+        const uint32_t PAGE_ADDRESS = _cursor - (_cursor % EFS_PAGE_SIZE);
+        if ((PAGE_ADDRESS != _page_address || !_page_loaded) &&
+            !load(PAGE_ADDRESS)) {
+            break;
+        }
+
+        const uint32_t OFFSET = _cursor - PAGE_ADDRESS;
+        const uint32_t AMOUNT =
+            std::min<uint32_t>(dest.size(), EFS_PAGE_SIZE - OFFSET);
+        std::memcpy(dest.data(), _page.data() + OFFSET, AMOUNT);
+
+        dest = dest.subspan(AMOUNT);
+        _cursor += AMOUNT;
+        rt += AMOUNT;
+    }
+
+    return rt;
+}
+
+uint32_t stream::write(std::span<const std::byte> src) {
+    if (!_file.can_write()) {
+        return 0;
+    }
+
+    uint32_t rt = 0;
+    while (!src.empty() && _cursor < size()) {
+        const uint32_t PAGE_ADDRESS = _cursor - (_cursor % EFS_PAGE_SIZE);
+        const uint16_t OFFSET = static_cast<uint16_t>(_cursor - PAGE_ADDRESS);
+        const bool HAS_BATCH = _dirty_end > _dirty_begin;
+
+        // A batch is a single run on a single page.
+        if (PAGE_ADDRESS != _page_address ||
+            (HAS_BATCH && (OFFSET < _dirty_begin || OFFSET > _dirty_end))) {
+            if (!flush()) {
+                break;
+            }
+            if (PAGE_ADDRESS != _page_address) {
+                _page_address = PAGE_ADDRESS;
+                _page_loaded = false;
+            }
+        }
+
+        const uint16_t AMOUNT = static_cast<uint16_t>(
+            std::min<uint32_t>(src.size(), EFS_PAGE_SIZE - OFFSET));
+        std::memcpy(_page.data() + OFFSET, src.data(), AMOUNT);
+        if (_dirty_end > _dirty_begin) {
+            _dirty_end = std::max<uint16_t>(_dirty_end, OFFSET + AMOUNT);
+        } else {
+            _dirty_begin = OFFSET;
+            _dirty_end = OFFSET + AMOUNT;
+        }
+
+        src = src.subspan(AMOUNT);
+        _cursor += AMOUNT;
+        rt += AMOUNT;
+
+        // Program as soon as the page is complete.
+        if (_dirty_begin == 0 && _dirty_end == EFS_PAGE_SIZE && !flush()) {
+            break;
+        }
+    }
+
+    return rt;
+}
+
+void stream::prefetch() {
+    if (_cursor >= size()) {
+        return;
+    }
+
+    const uint32_t PAGE_ADDRESS = _cursor - (_cursor % EFS_PAGE_SIZE);
+    if (PAGE_ADDRESS != _page_address || !_page_loaded) {
+        load(PAGE_ADDRESS);
+    }
+}
+
+bool stream::flush() {
+    if (_dirty_end <= _dirty_begin) {
+        return true;
+    }
+
+    const uint32_t SIZE = _dirty_end - _dirty_begin;
+    drivers::spi::handle_factory factory;
+    const uint32_t WRITTEN = _file.write(
+        factory, _page_address + _dirty_begin,
+        std::span<const std::byte>(_page.data() + _dirty_begin, SIZE));
+
+    if (WRITTEN != SIZE) {
+        // Keep what was not programmed batched, for the caller to retry.
+        _dirty_begin += static_cast<uint16_t>(std::min(WRITTEN, SIZE));
+        return false;
+    }
+
+    // Bytes around the batch are stale unless the page was loaded.
+    _page_loaded = _page_loaded || SIZE == EFS_PAGE_SIZE;
+    _dirty_begin = 0;
+    _dirty_end = 0;
+
+    return true;
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+bool stream::load(const uint32_t page_address) {
+    if (!flush()) {
+        return false;
+    }
+
+    drivers::spi::handle_factory factory;
+    _page_address = page_address;
+    _page_loaded = _file.read(factory, page_address, std::span(_page)) ==
+                   EFS_PAGE_SIZE;
+
+    return _page_loaded;
+}
+
+// EOF
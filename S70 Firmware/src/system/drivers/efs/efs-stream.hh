@@ -0,0 +1,116 @@
+// efs-stream.hh
+
+// clang-format off
+/**************************************************************************/ /**
+* \file efs-stream.hh
+* \brief Sequential, page-buffered access to an EFS file.
+*
+* A stream owns a file handle and a one-page buffer.
+* Reads are served from the buffer, which is filled a whole EEPROM page at a
+* time; prefetch() fills it ahead of the next read so the EEPROM access can
+* overlap with other work (e.g. an APT response being sent).
+* Writes are collected in the buffer and programmed as one EEPROM write per
+* page.
+*****************************************************************************/
+// clang-format on
+#pragma once
+
+#include "efs-handle.hh"
+
+#include <array>
+#include <span>
+
+namespace efs {
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+class stream {
+  public:
+    /**
+     * Creates a stream over an open file.
+     * \param[in]       file The handle to take ownership of.  The stream is
+     *                       invalid if the handle is.
+     */
+    explicit stream(handle &&file);
+
+    stream(const stream &) = delete;
+    stream &operator=(const stream &) = delete;
+
+    /// \brief Writes any batched data and closes the file.
+    /// \warning A write that fails here is lost; flush() first to see it.
+    ~stream();
+
+    inline bool is_valid() const { return _file.is_valid(); }
+
+    inline file_identifier_t get_id() const { return _file.get_id(); }
+
+    /// \return The size of the file in bytes.
+    inline uint32_t size() const {
+        return static_cast<uint32_t>(_file.get_page_length()) * EFS_PAGE_SIZE;
+    }
+
+    /// \return The file address of the next read or write.
+    inline uint32_t tell() const { return _cursor; }
+
+    /// \brief Moves the cursor to a file address.
+    inline void seek(const uint32_t file_address) { _cursor = file_address; }
+
+    /**
+     * Reads from the cursor, advancing it.
+     * \param[out]      dest The region to write data to.
+     * \return The number of bytes read.
+     */
+    uint32_t read(std::span<std::byte> dest);
+
+    /**
+     * Writes at the cursor, advancing it.
+     * The data is programmed when the cursor leaves the page, when the page
+     * is filled, or on flush().
+     * \param[in]       src The data to write.
+     * \return The number of bytes accepted.
+     */
+    uint32_t write(std::span<const std::byte> src);
+
+    /**
+     * Fills the buffer with the page under the cursor if it is not already
+     * buffered.
+     */
+    void prefetch();
+
+    /**
+     * Programs any batched data.
+     * A partial write leaves the bytes not programmed batched, so a later
+     * flush() retries them; the destructor's flush drops them.
+     * \return false The file did not accept all of the data.
+     */
+    bool flush();
+
+    /// \return The number of batched bytes not yet programmed.
+    inline uint32_t pending() const { return _dirty_end - _dirty_begin; }
+
+  private:
+    static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
+    handle _file;
+    uint32_t _cursor = 0;
+
+    /// @brief The file address of the buffered page.
+    uint32_t _page_address = NO_PAGE;
+
+    /// @brief Set when the whole page was read from the file.
+    bool _page_loaded = false;
+
+    /// @brief The batched bytes, [_dirty_begin, _dirty_end) of the page.
+    uint16_t _dirty_begin = 0;
+    uint16_t _dirty_end = 0;
+
+    std::array<std::byte, EFS_PAGE_SIZE> _page;
+
+    /// @brief Flushes and reads the page at a (page-aligned) file address.
+    bool load(uint32_t page_address);
+};
+
+} // namespace efs
+
+// EOF
@@ -7,8 +7,10 @@
 #include "efs.hh"
 #include "efs.h"
 #include "efs-cache.hh"
+#include "efs-extents.hh"
 
-#include <span>
+#include <array>
+#include <bitset>
 #include <type_traits>
 #include <string.h>
 
@@ -32,6 +34,9 @@ constexpr uint8_t EFS_IPAGES = 1 + ((EFS_TOTAL_PAGES - 1) / 8 / EFS_PAGE_SIZE);
 // The number of pages for LUT data.
 constexpr uint16_t EFS_DATA_PAGES = EFS_TOTAL_PAGES - EFS_IPAGES - EFS_HEADER_PAGES;
 
+// The first page for LUT data.
+constexpr uint16_t EFS_FIRST_DATA_PAGE = EFS_HEADER_PAGES + EFS_IPAGES;
+
 constexpr std::size_t EFS_FILES_IN_SHARED_HEADER_PAGE = (EFS_PAGE_SIZE - sizeof(efs_header)) / sizeof(file_metadata);
 constexpr std::size_t EFS_FILES_IN_HEADER_PAGE = (EFS_PAGE_SIZE) / sizeof(file_metadata);
 
@@ -39,6 +44,9 @@ constexpr std::size_t EFS_MAX_FILES = (EFS_HEADER_PAGES == 0) ? 0 : (
     EFS_FILES_IN_SHARED_HEADER_PAGE + (EFS_HEADER_PAGES - 1)*EFS_FILES_IN_HEADER_PAGE
 );
 
+// The number of distinct file identifiers (the size of the directory index).
+constexpr std::size_t EFS_IDENTIFIERS = 256;
+
 constexpr char EFS_IDENTIFER[3] = {'E','F','S'};
 constexpr uint8_t EFS_VERSION = 0;
 
@@ -50,7 +58,6 @@ constexpr uint8_t EFS_VERSION = 0;
 #define PAGE_TO_IPAGE_BYTE(page)        (((page) % EFS_PAGE_SIZE) / 8)
 #define PAGE_TO_IPAGE_BIT(page)         ((page) % 8)
 
-#define IPAGE_TO_PAGE(ipage, byte, bit) (8*(EFS_PAGE_SIZE * (ipage) + (byte)) + (bit))
 
 /// Outputs the allocation mask
 /// It creates a mask offset from the start bit with "length" set bits.
@@ -73,401 +80,22 @@ constexpr efs_header EFS_STD_HEADER =
 };
 
 
-/// \brief Namespace implement ipage algorithmns.
-namespace ipage_span
+/// \brief A file in the directory index.
+struct directory_entry
 {
-    template<typename T>
-    concept trait = requires (T t, uint16_t efs_page, uint16_t pages_to_allocate, uint16_t offset, uint16_t size)
-    {
-        { t.is_allocated(efs_page) } -> std::convertible_to<bool>;
-        { t.begin() } -> std::same_as<uint16_t>;
-        { t.end() } -> std::same_as<uint16_t>;
-        { t.size() } -> std::same_as<std::size_t>;
-    };
-
-    template<typename T>
-    concept customization_point_subspan = trait<T> && requires (T t, uint16_t offset, uint16_t size)
-    {
-        { t.subspan(offset) } -> trait;
-        { t.subspan(offset, size) } -> trait;
-    };
-
-
-    template<typename T>
-    concept customization_point_find_next_unallocated_page = requires(T t, uint16_t efs_page)
-    {
-        { t.find_next_unallocated_page(efs_page) } -> std::same_as<uint16_t>;
-    };
-
-    template<typename T>
-    concept customization_point_find_next_allocated_page = requires(T t, uint16_t efs_page)
-    {
-        { t.find_next_allocated_page(efs_page) } -> std::same_as<uint16_t>;
-    };
-
-    template<trait T>
-    class subspan_adapter
-    {
-    public:
-        using parent_type = T;
-
-        constexpr uint16_t begin() const
-        { return _begin; }
-
-        constexpr uint16_t end() const
-        { return _end; }
-
-        constexpr std::size_t size() const
-        { return _end - _begin; }
-
-        constexpr bool is_allocated(uint16_t efs_page)
-        { return _parent.is_allocated(efs_page); }
-
-        constexpr bool is_allocated(uint16_t efs_page) const
-            requires requires (const T& cr, uint16_t efs_page) {{ cr.is_allocated(efs_page) } -> std::convertible_to<bool>;}
-        { return _parent.is_allocated(efs_page); }
-        
-        constexpr subspan_adapter<T> subspan(uint16_t offset) const & {
-            return subspan_adapter(_parent, _begin + offset, size());
-        }
-        constexpr subspan_adapter<T> subspan(uint16_t offset, uint16_t size) const & {
-            return subspan_adapter(_parent, _begin + offset, _begin + offset);
-        }
-        constexpr subspan_adapter<T>&& subspan(uint16_t offset) && {
-            _begin += offset;
-            return std::move(*this);
-        }
-        constexpr subspan_adapter<T>&& subspan(uint16_t offset, uint16_t size) && {
-            _begin += offset;
-            _end = _begin + size;
-            return std::move(*this);
-        }
-
-        constexpr subspan_adapter(T&& parent, uint16_t offset)
-            : _parent(std::forward<T>(parent))
-            , _begin(parent.begin() + offset)
-            , _end(parent.end())
-        {}
-
-        constexpr subspan_adapter(T&& parent, uint16_t offset, uint16_t size)
-            : _parent(std::forward<T>(parent))
-            , _begin(parent.begin() + offset)
-            , _end(_begin + size)
-        {}
-    private:
-        T _parent;
-        uint16_t _begin;
-        uint16_t _end;
-    };
-
-    template<typename T>
-    subspan_adapter(T&, uint16_t) -> subspan_adapter<T&>;
-    template<typename T>
-    subspan_adapter(T&, uint16_t, uint16_t) -> subspan_adapter<T&>;
-    template<typename T>
-    subspan_adapter(const T&, uint16_t) -> subspan_adapter<const T&>;
-    template<typename T>
-    subspan_adapter(const T&, uint16_t, uint16_t) -> subspan_adapter<const T&>;
-
-    /**
-     * Find the the EFS page starting from efs_page that is unallocated.
-     * \pre obj.begin() <= efs_page < obj.end()
-     * \return The leftmost, unallocated EFS page to \ref{efs_page}.
-     *         If none was found, end().
-     */
-    template<trait T>
-    constexpr uint16_t find_next_unallocated_page(T&& obj, uint16_t efs_page) {
-        if constexpr (customization_point_find_next_unallocated_page<T>) {
-            return obj.find_next_unallocated_page(efs_page);
-        } else {
-            for (; obj.is_allocated(efs_page); ++efs_page);
-            return efs_page;
-        }
-    }
-
-    /**
-     * Find the the EFS page starting from efs_page that is allocated.
-     * \pre obj.begin() <= efs_page < obj.end()
-     * \return The leftmost, allocated EFS page to \ref{efs_page}.
-     *         If none was found, end().
-     */
-    template<trait T>
-    constexpr uint16_t find_next_allocated_page(T&& obj, uint16_t efs_page) {
-        if constexpr (customization_point_find_next_allocated_page<T>) {
-            return obj.find_next_allocated_page(efs_page);
-        } else {
-            for (; !obj.is_allocated(efs_page); ++efs_page);
-            return efs_page;
-        }
-    }
-
-    template<trait T>
-    constexpr auto subspan(T&& obj, uint16_t offset) {
-        if constexpr (customization_point_subspan<T>) {
-            return obj.subspan(offset);
-        } else {
-            return subspan_adapter(std::forward<T>(obj), offset);
-        }
-    }
-
-    template<trait T>
-    constexpr auto subspan(T&& obj, uint16_t offset, uint16_t size) {
-        if constexpr (customization_point_subspan<T>) {
-            return obj.subspan(offset, size);
-        } else {
-            return subspan_adapter(std::forward<T>(obj), offset, size);
-        }
-    }
-
-    /**
-     * Attempts to allocate the pages specified within the span.
-     * \return The EFS page such that for all pages in range [return, return + pages_to_allocate)
-     *         are unallocated.
-     *         If non such subrange was found, then span.end();
-     */
-    constexpr uint16_t find_unallocated_region(trait auto&& span, uint16_t pages_to_allocate) {
-        uint16_t itr = span.begin();
-        const uint16_t END = span.end();
-        while (itr != END) {
-            // Step 1:  Skip allocated_pages
-            itr = find_next_unallocated_page(span, itr);
-
-            // Step 2:  Obtain subrange for allocation.
-            const uint16_t SUBRANGE_END = std::min<uint16_t>(itr + pages_to_allocate, END);
-
-            // Step 3:  Check the size of the allocation region.
-            const std::size_t ALLOCATION_REGION_SIZE = SUBRANGE_END - itr;
-            if (ALLOCATION_REGION_SIZE != pages_to_allocate)
-            { return span.end(); }
-
-            // Step 4:  Find the leftmost allocated page in the allocation region.
-            uint16_t allocated_page_in_allocation_region_or_end = find_next_allocated_page(subspan(span, itr - span.begin(), ALLOCATION_REGION_SIZE), itr);
-            static_assert(std::is_lvalue_reference_v<decltype(span)> == std::is_lvalue_reference_v<typename decltype(subspan(span, 0, 0))::parent_type>, "Subspan may be allocate a copy");
-            const std::size_t FREE_PAGES_IN_ALLOCATION_REGION = SUBRANGE_END - allocated_page_in_allocation_region_or_end;
-
-            if (FREE_PAGES_IN_ALLOCATION_REGION == pages_to_allocate) {
-                break;
-            } else {
-                itr = allocated_page_in_allocation_region_or_end;
-            }
-        }
-
-        return itr;
-    };
-};
-
-/// \brief IPage span over a single byte value.
-class ipage_span_byte
-{
-public:
-    /// \pre begin() <= efs_page < end()
-    constexpr bool is_allocated(uint16_t efs_page) const
-    { return (_value & (0x01 << (efs_page - _efs_page))) != 0; }
-
-    /// \pre begin() <= efs_page < end()
-    constexpr uint16_t find_next_unallocated_page (uint16_t efs_page) const {
-        uint8_t local = _value;
-        uint16_t rt = begin();
-        while ((local & 0x01) == 0) {
-            local >>= 1;
-            ++rt;
-        }
-        return rt;
-    }
-
-    /// \pre begin() <= efs_page < end()
-    constexpr uint16_t find_next_allocated_page (uint16_t efs_page) const {
-        uint8_t local = _value;
-        uint16_t rt = begin();
-        while ((local & 0x01) != 0) {
-            local >>= 1;
-            ++rt;
-        }
-        return rt;
-    }
-
-    static constexpr uint16_t size()
-    { return 8; }
-
-    constexpr uint16_t begin() const
-    { return _efs_page; }
-
-    constexpr uint16_t end() const
-    { return begin() + size(); }
-
-    constexpr ipage_span_byte(uint16_t efs_page, uint8_t ipage_byte)
-        : _efs_page(efs_page)
-        , _value(ipage_byte)
-    {}
-private:
-    uint16_t _efs_page;
-    uint8_t _value;
-};
-
-
-/**
- * Mixin for ipage_span::trait concepts.
- * Require the following methods to be implemented:
- * - ipage_span::trait::begin()
- * - ipage_span::trait::end()
- * - {this->select(efs_page)} -> ipage_span::trait;
- * \note The select() method is restricted to only allow
- *       one created object to be alive at a given time
- *       within the mixin methods.
- */
-template<typename Self>
-class subspan_operations_mixins
-{
-public:
-    /// \pre begin() <= efs_page < end()
-    constexpr bool is_allocated(uint16_t efs_page) {
-        return self().select(efs_page).is_allocated(efs_page);
-    }
-    constexpr bool is_allocated(uint16_t efs_page) const {
-        return self().select(efs_page).is_allocated(efs_page);
-    }
-
-    /// \pre begin() <= efs_page < end()
-    constexpr uint16_t find_next_unallocated_page (uint16_t efs_page) {
-        while (efs_page < self().end()) {
-            ipage_span::trait auto start = self().select(efs_page);
-            efs_page = ipage_span::find_next_unallocated_page(start, efs_page);
-
-            // If the page was found, break out of the loop.
-            if (efs_page != start.end()) {
-                break;
-            }
-        }
-
-        return efs_page;
-    }
-    constexpr uint16_t find_next_unallocated_page (uint16_t efs_page) const {
-        while (efs_page < self().end()) {
-            ipage_span::trait auto start = self().select(efs_page);
-            efs_page = ipage_span::find_next_unallocated_page(start, efs_page);
-
-            // If the page was found, break out of the loop.
-            if (efs_page != start.end()) {
-                break;
-            }
-        }
-
-        return efs_page;
-    }
-
-    /// \pre begin() <= efs_page < end()
-    constexpr uint16_t find_next_allocated_page (uint16_t efs_page) {
-        while (efs_page < self().end()) {
-            ipage_span::trait auto start = self().select(efs_page);
-            efs_page = ipage_span::find_next_allocated_page(start, efs_page);
-
-            // If the page was found, break out of the loop.
-            if (efs_page != start.end()) {
-                break;
-            }
-        }
-
-        return efs_page;
-    }
-    constexpr uint16_t find_next_allocated_page (uint16_t efs_page) const {
-        while (efs_page < self().end()) {
-            ipage_span::trait auto start = self().select(efs_page);
-            efs_page = ipage_span::find_next_allocated_page(start, efs_page);
-
-            // If the page was found, break out of the loop.
-            if (efs_page != start.end()) {
-                break;
-            }
-        }
-
-        return efs_page;
-    }
-
-    constexpr std::size_t size()
-    { return self().end() - self().begin(); }
-    constexpr std::size_t size() const
-    { return self().end() - self().begin(); }
-private:
-    constexpr Self& self()
-    { return *static_cast<Self*>(this); }
-    constexpr const Self& self() const
-    { return *static_cast<const Self*>(this); }
-};
-
-/// \brief An ipage span using the std::span of byte values.
-class ipage_span_of_byte_spans : public subspan_operations_mixins<ipage_span_of_byte_spans>
-{
-public:
-    /// \pre begin() <= efs_page < end()
-    constexpr ipage_span_byte select(uint16_t efs_page) const {
-        const uint16_t PAGE_OFFSET = efs_page - _efs_page;
-        const uint16_t BYTE_OFFSET = PAGE_OFFSET / 8;
-
-        return ipage_span_byte(begin() + 8 * BYTE_OFFSET, _serialized_ipages[BYTE_OFFSET]);
-    }
-    constexpr uint16_t begin() const
-    { return _efs_page; }
-
-    constexpr uint16_t end() const
-    { return _efs_page + _serialized_ipages.size() * ipage_span_byte::size(); }
-
-    constexpr ipage_span_of_byte_spans(uint16_t efs_page, std::span<uint8_t> ipages)
-        : _serialized_ipages(ipages)
-        , _efs_page(efs_page)
-    {}
-private:
-    std::span<uint8_t> _serialized_ipages;
-    uint16_t _efs_page;
-};
-
-/// \brief An ipage span of the entirety of EEPROM using a lazy internal page cache.
-class ipage_span_full_eeprom : public subspan_operations_mixins<ipage_span_full_eeprom>
-{
-public:
-    /// \pre begin() <= efs_page < end()
-    /// \warning The lifetime of the returned span must end before select is called again.
-    constexpr ipage_span_of_byte_spans select(uint16_t efs_page) {
-        const uint16_t IPAGE = PAGE_TO_IPAGE(efs_page);
-
-        // Recaches the buffer.
-        if (IPAGE != _page_in_buffer) {
-            if (IPAGE < EFS_IPAGES) {
-                const uint16_t EFS_PAGE = IPAGE + EFS_HEADER_PAGES;
-                // Read in IPage
-                eeprom_25LC1024_read_safe(
-                    EFS_EEPROM_START + (EFS_PAGE) * EFS_PAGE_SIZE,
-                    _buffer.size(),
-                    _buffer.data()
-                );
-                _page_in_buffer = EFS_PAGE;
-            } else {
-                _page_in_buffer = EFS_TOTAL_PAGES;
-            }
-        }
-        return ipage_span_of_byte_spans(
-            _page_in_buffer,
-            (_page_in_buffer == EFS_TOTAL_PAGES)
-            ? std::span<uint8_t>()
-            : std::span<uint8_t>(_buffer)
-        );
-    }
-
-    constexpr uint16_t begin() const
-    { return 0; }
-
-    constexpr uint16_t end() const
-    { return EFS_TOTAL_PAGES; }
+    file_metadata metadata;
 
-private:
-    std::array<uint8_t, EFS_PAGE_SIZE> _buffer;
-    uint16_t _page_in_buffer = EFS_TOTAL_PAGES;
+    /// The index of the metadata's slot in the header pages.
+    uint8_t header_slot;
 };
+static_assert(EFS_MAX_FILES <= UINT8_MAX, "header_slot cannot index every file");
 
 /*****************************************************************************
  * Private Function Prototypes
  *****************************************************************************/
 /**
  * If space is found, it will set the metadata's page start and allocate ipages.
+ * The smallest free extent that fits the file is used.
  * \warning Takes xSPI_Semaphore internally.
  * \param[in]       r_metadata Metadata object that needs its start page assigned.
  * \param[in]       p_buffer Buffer containing the EEPROM page size.
@@ -487,14 +115,13 @@ static bool take_file_ownership(const file_identifier_t id);
 static void release_file_ownership(const file_identifier_t id);
 
 /**
- * Searches EEPROM for the file data.
- * \warning Internally gets xSPI_Semaphore.
+ * Looks the file up in the directory index.
  * \warning External code needs to ensure mutual exclusion.
  * \param id 
  * \return true The file identifer was found.
  * \return false The metadata was not found.
  */
-static bool find_metadata(const file_identifier_t id, file_metadata& r_metadata, const TickType_t timeout);
+static bool find_metadata(const file_identifier_t id, file_metadata& r_metadata);
 
 /**
  * Sets all bits on an IPage starting at an EEPROM page.
@@ -507,6 +134,56 @@ static bool find_metadata(const file_identifier_t id, file_metadata& r_metadata,
 static void set_ipage_values(uint16_t start_page, const uint16_t number_of_pages, const bool bit_state,
     uint8_t * const p_existing_page = nullptr);
 
+/**
+ * \return The EEPROM address of a metadata slot in the header pages.
+ */
+static constexpr uint32_t header_slot_address(const std::size_t slot);
+
+/**
+ * Empties the directory index.
+ * \warning External code needs to ensure mutual exclusion.
+ */
+static void directory_clear();
+
+/**
+ * Adds a file to the directory index.
+ * \warning External code needs to ensure mutual exclusion.
+ */
+static void directory_insert(const file_metadata& metadata, const std::size_t slot);
+
+/**
+ * Removes a file from the directory index.
+ * \warning External code needs to ensure mutual exclusion.
+ */
+static void directory_remove(const file_identifier_t id);
+
+/**
+ * Rebuilds the free extents from the gaps between files in the directory index.
+ * \warning External code needs to ensure mutual exclusion.
+ */
+static void rebuild_free_extents();
+
+/// \brief A file move planned by efs::compact().
+struct relocation
+{
+    file_metadata from;
+    uint16_t to;
+
+    /// The cache that owned the file, if any.
+    file_cache * p_owner;
+};
+
+/**
+ * Finds the next file to move into a lower free extent.
+ * The largest file that fits the lowest free extent below it is chosen.
+ * Files are only moved into pages they do not occupy, so an interrupted move leaves the original intact.
+ * \warning External code needs to ensure mutual exclusion.
+ * \param[out]      r_plan The move to make.
+ * \param[in]       find_idle_owner Returns the cache that owns a file without a handle, or nullptr.
+ * \return false No file can be moved.
+ */
+static bool plan_relocation(relocation& r_plan, auto&& find_idle_owner);
+
 /*****************************************************************************
  * Static Data
  *****************************************************************************/
@@ -515,12 +192,20 @@ static SemaphoreHandle_t s_lock_files;
 // BEGIN    Locked Data (s_lock_files)
 static uint16_t s_remaining_pages;
 static uint16_t s_remaining_files;
-static uint16_t s_rightmost_contiguous_space; // Lowest-valued page to empty space.
 static uint8_t s_files_owned[32];
 static bool s_lockdown = true; ///> When set, no handles can be created.
 static metadata_cache_pool<EFS_EXTERNAL_CACHE_SIZE> s_external_caches;
 static file_cache * sp_file_caches;
 
+// The directory index mirrors the header pages so lookups never touch EEPROM.
+static std::array<directory_entry, EFS_IDENTIFIERS> s_directory;
+static std::bitset<EFS_MAX_FILES> s_header_slots_used;
+static directory_statistics s_directory_statistics;
+
+// A file splits at most one free extent in two.
+static free_extent_pool<EFS_MAX_FILES + 1> s_free_extents;
+static compaction_progress s_compaction_progress;
+
 // END      Locked Data (s_lock_files)
 
 /******************************************************************************
@@ -580,6 +265,8 @@ void efs::init()
     // Calculate remaining files
     s_remaining_files = EFS_MAX_FILES;
     s_remaining_pages = EFS_DATA_PAGES;
+    directory_clear();
+    s_directory_statistics = {};
 
     uint8_t * const p_buffer = new uint8_t[EFS_PAGE_SIZE];
     if (p_buffer == nullptr)
@@ -608,64 +295,19 @@ void efs::init()
             {
                 --s_remaining_files;
                 s_remaining_pages -= metadata.length;
-            }
-        }
-    }
-
-    // Calculate the rightmost contiguous space.
-    const uint16_t START_IPAGE_PAGE = PAGE_TO_IPAGE(EFS_TOTAL_PAGES - 1);
-    const uint16_t START_IPAGE_BYTE = PAGE_TO_IPAGE_BYTE(EFS_TOTAL_PAGES - 1);
-    const uint8_t START_IPAGE_BIT = PAGE_TO_IPAGE_BIT(EFS_TOTAL_PAGES - 1);
-
-    uint16_t ipage = START_IPAGE_PAGE;
-    while (s_rightmost_contiguous_space == 0)
-    {
-        // Read in page
-        eeprom_25LC1024_read(
-            EFS_EEPROM_START + (ipage + EFS_HEADER_PAGES) * EFS_PAGE_SIZE,
-            EFS_PAGE_SIZE,
-            reinterpret_cast<uint8_t *>(p_buffer)
-        );
-
-        uint16_t byte = (ipage == START_IPAGE_PAGE) ? START_IPAGE_BYTE : (EFS_PAGE_SIZE - 1);
-
-        if (ipage == START_IPAGE_BYTE)
-        {
-            // Mask out any page after the start page (so allocated pages after start page does not
-            // trigger the detection).
-            p_buffer[START_IPAGE_BYTE] |= (0xFF >> START_IPAGE_BIT);
-        }
 
-        while (s_rightmost_contiguous_space == 0)
-        {
-            // Seach each byte value to find a page with a reserved page.
-            const uint8_t VALUE = p_buffer[byte];
-            if (VALUE != 0xFF)
-            {
-                // Find the rightmost zero (allocated page)
-                for(int8_t i = 7; i >= 0 && s_rightmost_contiguous_space == 0; --i)
-                {
-                    if (((VALUE >> i) & 0x01) == 0)
-                    {
-                        s_rightmost_contiguous_space = IPAGE_TO_PAGE(ipage, byte, static_cast<uint8_t>(i)) + 1;
-                    }
-                }
-            }
-
-            if (byte == 0) {
-                break;
-            } else {
-                --byte;
+                const std::size_t SLOT = (header_page == 0) ? file :
+                    EFS_FILES_IN_SHARED_HEADER_PAGE + (header_page - 1)*EFS_FILES_IN_HEADER_PAGE + file;
+                directory_insert(metadata, SLOT);
             }
         }
-
-        if (ipage == 0) {
-            break;
-        } else {
-            --ipage;
-        }
     }
 
+    // Free space is whatever the files do not occupy.
+    // Pages of an interrupted allocation or move are reclaimed here.
+    rebuild_free_extents();
+    s_compaction_progress = {};
+
     delete[] p_buffer;
 
     // Initialize any lazy caches so far (statically created).
@@ -704,7 +346,11 @@ bool efs::erase()
         p_cleanup = p_cleanup->_p_next;
     }
 
-    s_external_caches.clear();
+    {
+        lock_guard lg(s_lock_files);
+        s_external_caches.clear();
+        directory_clear();
+    }
 
     // Wait until all files are free.
     for (std::size_t i = 0; i < sizeof(s_files_owned); ++i)
@@ -791,8 +437,11 @@ bool efs::erase()
 
     delete[] page_buffer;
 
+    lock_guard lg(s_lock_files);
     s_remaining_files = EFS_MAX_FILES;
     s_remaining_pages = EFS_DATA_PAGES;
+    s_free_extents.clear();
+    s_free_extents.release(extent{EFS_FIRST_DATA_PAGE, EFS_DATA_PAGES});
 
     return true;
 }
@@ -804,8 +453,7 @@ bool efs::create_file(
     const TickType_t timeout
 ) {
     bool rt = false;
-    uint16_t alloc_header_page = 0;
-    uint32_t alloc_header_offset = 0;
+    std::size_t alloc_header_slot = 0;
 
     file_metadata metadata = {id, attributes, 0, pages_to_occupy};
 
@@ -817,46 +465,23 @@ bool efs::create_file(
     }
 
     lock_guard lg(s_lock_files);
-    // Search for an existing file as well as an empty header space.
-    bool prevent_allocation = s_lockdown;
-    for (uint16_t header_page = 0; !prevent_allocation && header_page < EFS_HEADER_PAGES; ++header_page)
+    // Check for an existing file as well as an empty header space.
+    bool prevent_allocation = s_lockdown ||
+        (s_directory[id].metadata.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) == 0;
+    for (std::size_t slot = 0; !prevent_allocation && slot < EFS_MAX_FILES; ++slot)
     {
-        const std::size_t FILES_IN_PAGE = (header_page == 0) ? EFS_FILES_IN_SHARED_HEADER_PAGE : EFS_FILES_IN_HEADER_PAGE;
-        const std::size_t OFFSET = (header_page == 0) ? sizeof(efs_header) : 0;
-
-        // Read in EEPROM page.
-        eeprom_25LC1024_read_safe(
-            EFS_EEPROM_START + EFS_PAGE_SIZE*header_page,
-            EFS_PAGE_SIZE,
-            p_buffer
-        );
-
-        for (std::size_t file = 0; file < FILES_IN_PAGE; ++file)
+        if (!s_header_slots_used.test(slot))
         {
-            file_metadata metadata;
-            memcpy(&metadata, &p_buffer[OFFSET + file*sizeof(file_metadata)], sizeof(metadata));
-            const bool METADATA_IS_VALID = (metadata.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) == 0;
-
-            if (metadata.id == id && METADATA_IS_VALID)
-            {
-                prevent_allocation = true;
-                rt = false;
-                break;
-            }
-
-
-            if (!rt && !prevent_allocation && !METADATA_IS_VALID)
-            {
-                alloc_header_page = header_page;
-                alloc_header_offset = OFFSET + file*sizeof(file_metadata);
-                rt = true;
-            }
+            alloc_header_slot = slot;
+            rt = true;
+            break;
         }
     }
 
-    if (!prevent_allocation)
+    // Only allocate pages once a header slot was found.
+    if (!prevent_allocation && rt)
     {
-        // If true, s_remaining_pages, IPages, and s_rightmost_contiguous_space will be updated.
+        // If true, IPages and the free extents will be updated.
         rt = allocate_ipages(metadata, p_buffer);
     }
     delete[] p_buffer;
@@ -865,10 +490,11 @@ bool efs::create_file(
     {
         // Write to header.
         eeprom_25LC1024_write_safe(
-            EFS_EEPROM_START + EFS_PAGE_SIZE*alloc_header_page + alloc_header_offset,
+            header_slot_address(alloc_header_slot),
             sizeof(file_metadata),
             reinterpret_cast<uint8_t*>(&metadata)
         );
+        directory_insert(metadata, alloc_header_slot);
 
         file_cache * p_cache = sp_file_caches;
         while (p_cache != nullptr)
@@ -882,6 +508,7 @@ bool efs::create_file(
         }
 
         --s_remaining_files;
+        s_remaining_pages -= pages_to_occupy;
     }
 
 
@@ -893,9 +520,15 @@ bool efs::does_file_exist(
     const TickType_t timeout
 )
 {
-    lock_guard lg(s_lock_files);
+    if (xSemaphoreTake(s_lock_files, timeout) != pdTRUE)
+    {
+        return false;
+    }
+
     file_metadata _;
-    return find_metadata(id, _, timeout);
+    const bool RT = find_metadata(id, _);
+    xSemaphoreGive(s_lock_files);
+    return RT;
 }
 
 
@@ -921,11 +554,162 @@ efs_header efs::get_header_info()
     return EFS_STD_HEADER;
 }
 
+directory_statistics efs::get_directory_statistics()
+{
+    lock_guard lock (s_lock_files);
+    return s_directory_statistics;
+}
+
+compaction_progress efs::get_compaction_progress()
+{
+    lock_guard lock (s_lock_files);
+    compaction_progress rt = s_compaction_progress;
+    rt.free_extents = static_cast<uint16_t>(s_free_extents.size());
+    rt.largest_free_extent = s_free_extents.largest();
+    return rt;
+}
+
+bool efs::compact(const TickType_t timeout)
+{
+    const TickType_t START = xTaskGetTickCount();
+
+    uint8_t * const p_buffer = new uint8_t[EFS_PAGE_SIZE];
+    if (p_buffer == nullptr)
+    {
+        // TODO:  ERROR
+        return false;
+    }
+
+    bool finished = false;
+    while (!finished && xTaskGetTickCount() - START < timeout)
+    {
+        relocation plan;
+        {
+            lock_guard lg(s_lock_files);
+            if (s_compaction_progress.finished)
+            {
+                // Restart the counters for a new compaction.
+                s_compaction_progress = {};
+            }
+
+            finished = s_lockdown || !plan_relocation(plan, [](const file_identifier_t id) -> file_cache *
+            {
+                file_cache * p_cache = sp_file_caches;
+                while (p_cache != nullptr)
+                {
+                    if (p_cache->_owns_file && !p_cache->_has_handle && p_cache->_cache.get_metadata().id == id)
+                    {
+                        return p_cache;
+                    }
+                    p_cache = p_cache->_p_next;
+                }
+                return nullptr;
+            });
+            if (!finished)
+            {
+                // Keep the file from being opened while it moves.
+                if (plan.p_owner != nullptr)
+                {
+                    plan.p_owner->_has_handle = true;
+                }
+                else
+                {
+                    take_file_ownership(plan.from.id);
+                }
+
+                s_free_extents.take_at(extent{plan.to, plan.from.length});
+                set_ipage_values(plan.to, plan.from.length, false, p_buffer);
+            }
+        }
+
+        if (finished)
+        {
+            break;
+        }
+
+        // Copy the data.  Until the metadata is committed, the original is the file.
+        for (uint16_t page = 0; page < plan.from.length; ++page)
+        {
+            eeprom_25LC1024_read_safe(
+                EFS_EEPROM_START + EFS_PAGE_SIZE*(plan.from.start + page),
+                EFS_PAGE_SIZE,
+                p_buffer
+            );
+            eeprom_25LC1024_write_safe(
+                EFS_EEPROM_START + EFS_PAGE_SIZE*(plan.to + page),
+                EFS_PAGE_SIZE,
+                p_buffer
+            );
+        }
+
+        lock_guard lg(s_lock_files);
+
+        // The copy must be on the device before the metadata points to it.
+        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+        eeprom_25LC1024_flush();
+        xSemaphoreGive(xSPI_Semaphore);
+
+        // Commit
+        file_metadata metadata = plan.from;
+        metadata.start = plan.to;
+        const uint8_t SLOT = s_directory[metadata.id].header_slot;
+        eeprom_25LC1024_write_safe(
+            header_slot_address(SLOT),
+            sizeof(file_metadata),
+            reinterpret_cast<uint8_t*>(&metadata)
+        );
+        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+        eeprom_25LC1024_flush();
+        xSemaphoreGive(xSPI_Semaphore);
+        directory_insert(metadata, SLOT);
+
+        // Update the caches.
+        file_cache * p_cache = sp_file_caches;
+        while (p_cache != nullptr)
+        {
+            if (p_cache->_cache.get_metadata().id == metadata.id && p_cache->_cache.is_valid())
+            {
+                p_cache->_cache.cache(metadata);
+            }
+            p_cache = p_cache->_p_next;
+        }
+        file_metadata external;
+        if (s_external_caches.get_metadata(metadata.id, external))
+        {
+            s_external_caches.remove(metadata.id);
+            s_external_caches.add(metadata);
+        }
+
+        if (plan.p_owner != nullptr)
+        {
+            plan.p_owner->_has_handle = false;
+        }
+        else
+        {
+            release_file_ownership(metadata.id);
+        }
+
+        // Free the original.
+        const extent ORIGINAL = {plan.from.start, plan.from.length};
+        set_ipage_values(ORIGINAL.start, ORIGINAL.length, true, p_buffer);
+        s_free_extents.release(ORIGINAL);
+
+        ++s_compaction_progress.files_moved;
+        s_compaction_progress.pages_moved += metadata.length;
+    }
+
+    delete[] p_buffer;
+
+    lock_guard lg(s_lock_files);
+    s_compaction_progress.finished = finished;
+    return finished;
+}
+
 void efs::add_to_external_cache(const file_identifier_t id_to_cache, const TickType_t timeout)
 {
     lock_guard lg(s_lock_files);
     file_metadata metadata;
-    if (find_metadata(id_to_cache, metadata, timeout))
+    if (find_metadata(id_to_cache, metadata))
     {
         s_external_caches.add(metadata);
     }
@@ -938,7 +722,7 @@ void efs::add_to_external_cache(const file_identifier_t id_to_cache, const TickT
 file_metadata efs::get_file_metadata(const file_identifier_t id)
 {
     file_metadata rt;
-    find_metadata(id, rt, portMAX_DELAY);
+    find_metadata(id, rt);
     return rt;
 }
 
@@ -971,7 +755,7 @@ handle handle::create_handle(
 
     if (!got_metadata)
     {
-        got_metadata = find_metadata(id, metadata, timeout);
+        got_metadata = find_metadata(id, metadata);
     }
 
 
@@ -1021,53 +805,24 @@ bool handle::delete_file()
 
     // Free Ipages
     set_ipage_values(_metadata.start, _metadata.length, true, p_buffer);
+
     // Mark as unallocated
-    bool finished = false;
-    for (uint16_t header_page = 0; !finished && header_page < EFS_HEADER_PAGES; ++header_page)
+    const directory_entry& entry = s_directory[_metadata.id];
+    if ((entry.metadata.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) == 0)
     {
-        const std::size_t FILES_IN_PAGE = (header_page == 0) ? EFS_FILES_IN_SHARED_HEADER_PAGE : EFS_FILES_IN_HEADER_PAGE;
-        const std::size_t OFFSET = (header_page == 0) ? sizeof(efs_header) : 0;
+        file_metadata metadata = entry.metadata;
+        metadata.attr |= FILE_ATTRIBUTES_MASK_NOT_ALLOCATED;
 
-        // Read in EEPROM page.
-        eeprom_25LC1024_read_safe(
-            EFS_EEPROM_START + EFS_PAGE_SIZE*header_page,
-            EFS_PAGE_SIZE,
-            p_buffer
+        // Writeback
+        eeprom_25LC1024_write_safe(
+            header_slot_address(entry.header_slot),
+            sizeof(file_metadata),
+            reinterpret_cast<uint8_t*>(&metadata)
         );
-
-        for (std::size_t file = 0; file < FILES_IN_PAGE; ++file)
-        {
-            file_metadata metadata;
-            memcpy(&metadata, &p_buffer[OFFSET + file*sizeof(file_metadata)], sizeof(metadata));
-
-            if (metadata.id == _metadata.id)
-            {
-                finished = true;
-
-                // Mark file as unallocated and write to buffer.
-                metadata.attr |= FILE_ATTRIBUTES_MASK_NOT_ALLOCATED;
-                memcpy(&p_buffer[OFFSET + file*sizeof(file_metadata)], &metadata, sizeof(metadata));
-
-                break;
-            }
-        }
-
-        if (finished)
-        {
-            // Writeback
-            eeprom_25LC1024_write_safe(
-                EFS_EEPROM_START + EFS_PAGE_SIZE*header_page,
-                EFS_PAGE_SIZE,
-                p_buffer
-            );
-        }
+        directory_remove(_metadata.id);
     }
 
-    // Update contiguous space if this was the rightmost file.
-    if (_metadata.start + _metadata.length == s_rightmost_contiguous_space)
-    {
-        s_rightmost_contiguous_space -= _metadata.length;
-    }
+    s_free_extents.release(extent{_metadata.start, _metadata.length});
     ++s_remaining_files;
     s_remaining_pages += _metadata.length;
 
@@ -1198,26 +953,9 @@ void init_file_cache::release_ownership_init()
  *****************************************************************************/
 static bool allocate_ipages(file_metadata& r_metadata, uint8_t * p_buffer)
 {
-    bool rt = false;
     bool allocated = false;
 
-    if (s_rightmost_contiguous_space + r_metadata.length <= EFS_TOTAL_PAGES)
-    {
-        // Fast solver, using the next page pointer.
-        r_metadata.start = s_rightmost_contiguous_space;
-        s_rightmost_contiguous_space += r_metadata.length;
-        rt = true;
-    } else if (s_remaining_pages >= r_metadata.length) {
-        // The subspan operates on data pages that are not in the rightmost contiguous space.
-        // This is because any pages at the rightmost contiguous space or later will be guaranteed to be unallocated.
-        // Since the fast solver did not use this region, however, it will be ignored for the slow solver.
-        constexpr uint16_t OFFSET = EFS_HEADER_PAGES + EFS_IPAGES;
-        ipage_span_full_eeprom page_cache;
-        ipage_span::trait auto subspan = ipage_span::subspan(page_cache, OFFSET, static_cast<uint16_t>(s_rightmost_contiguous_space - OFFSET));
-
-        r_metadata.start = ipage_span::find_unallocated_region(subspan, r_metadata.length);
-        rt = r_metadata.start != subspan.end();
-    }
+    const bool rt = r_metadata.length > 0 && s_free_extents.take(r_metadata.length, r_metadata.start);
 
     if (rt)
     {
@@ -1264,44 +1002,117 @@ static void release_file_ownership(const file_identifier_t id)
 }
 
 
-static bool find_metadata(const file_identifier_t id, file_metadata& r_metadata, const TickType_t timeout)
+static bool find_metadata(const file_identifier_t id, file_metadata& r_metadata)
 {
-    bool rt = false;
+    const file_metadata& entry = s_directory[id].metadata;
+    const bool RT = (entry.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) == 0;
+    if (RT)
+    {
+        r_metadata = entry;
+        ++s_directory_statistics.hits;
+    }
+    else
+    {
+        ++s_directory_statistics.misses;
+    }
 
-    uint8_t * const p_buffer = new uint8_t[EFS_PAGE_SIZE];
-    if (p_buffer == nullptr)
+    return RT;
+}
+
+static constexpr uint32_t header_slot_address(const std::size_t slot)
+{
+    return (slot < EFS_FILES_IN_SHARED_HEADER_PAGE)
+        ? EFS_EEPROM_START + sizeof(efs_header) + slot*sizeof(file_metadata)
+        : EFS_EEPROM_START + EFS_PAGE_SIZE*(1 + (slot - EFS_FILES_IN_SHARED_HEADER_PAGE) / EFS_FILES_IN_HEADER_PAGE)
+            + ((slot - EFS_FILES_IN_SHARED_HEADER_PAGE) % EFS_FILES_IN_HEADER_PAGE)*sizeof(file_metadata);
+}
+
+static void directory_clear()
+{
+    for (directory_entry& entry : s_directory)
     {
-        // TODO:  ERROR
-        return false;
+        entry.metadata = file_metadata{0, FILE_ATTRIBUTES_MASK_NOT_ALLOCATED, 0, 0};
+        entry.header_slot = 0;
     }
+    s_header_slots_used.reset();
+}
+
+static void directory_insert(const file_metadata& metadata, const std::size_t slot)
+{
+    s_directory[metadata.id] = directory_entry{metadata, static_cast<uint8_t>(slot)};
+    s_header_slots_used.set(slot);
+}
 
-    // Search for an existing file as well as an empty header space.
-    for (uint16_t header_page = 0; !rt && header_page < EFS_HEADER_PAGES; ++header_page)
+static void directory_remove(const file_identifier_t id)
+{
+    directory_entry& entry = s_directory[id];
+    s_header_slots_used.reset(entry.header_slot);
+    entry.metadata.attr |= FILE_ATTRIBUTES_MASK_NOT_ALLOCATED;
+}
+
+static void rebuild_free_extents()
+{
+    s_free_extents.clear();
+
+    // Walk the files in address order, freeing the gap before each.
+    uint16_t free_start = EFS_FIRST_DATA_PAGE;
+    for (;;)
     {
-        const std::size_t FILES_IN_PAGE = (header_page == 0) ? EFS_FILES_IN_SHARED_HEADER_PAGE : EFS_FILES_IN_HEADER_PAGE;
-        const std::size_t OFFSET = (header_page == 0) ? sizeof(efs_header) : 0;
+        const file_metadata * p_next = nullptr;
+        for (const directory_entry& entry : s_directory)
+        {
+            const file_metadata& md = entry.metadata;
+            if ((md.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) == 0 &&
+                md.start >= free_start && (p_next == nullptr || md.start < p_next->start))
+            {
+                p_next = &md;
+            }
+        }
 
-        // Read in EEPROM page.
-        eeprom_25LC1024_read_safe(
-            EFS_EEPROM_START + EFS_PAGE_SIZE*header_page,
-            EFS_PAGE_SIZE,
-            p_buffer
-        );
+        const uint16_t FREE_END = (p_next == nullptr) ? EFS_TOTAL_PAGES : p_next->start;
+        s_free_extents.release(extent{free_start, static_cast<uint16_t>(FREE_END - free_start)});
+        if (p_next == nullptr)
+        {
+            break;
+        }
+        free_start = p_next->start + p_next->length;
+    }
+}
 
-        for (std::size_t file = 0; file < FILES_IN_PAGE; ++file)
+static bool plan_relocation(relocation& r_plan, auto&& find_idle_owner)
+{
+    for (std::size_t rank = 0; rank < s_free_extents.size(); ++rank)
+    {
+        const extent FREE = s_free_extents.by_address(rank);
+        const file_metadata * p_best = nullptr;
+        file_cache * p_best_owner = nullptr;
+        for (const directory_entry& entry : s_directory)
         {
-            memcpy(&r_metadata, &p_buffer[OFFSET + file*sizeof(file_metadata)], sizeof(r_metadata));
+            const file_metadata& md = entry.metadata;
+            if ((md.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) != 0 ||
+                md.start < FREE.end() || md.length > FREE.length ||
+                (p_best != nullptr && md.length <= p_best->length))
+            {
+                continue;
+            }
 
-            if (r_metadata.id == id && (r_metadata.attr & FILE_ATTRIBUTES_MASK_NOT_ALLOCATED) == 0)
+            // Open files stay where they are.
+            file_cache * const P_OWNER = find_idle_owner(md.id);
+            const bool OWNED = (s_files_owned[md.id / 8] & (1 << (md.id % 8))) != 0;
+            if (!OWNED || P_OWNER != nullptr)
             {
-                rt = true;
-                break;
+                p_best = &md;
+                p_best_owner = P_OWNER;
             }
         }
-    }
 
-    delete[] p_buffer;
-    return rt;
+        if (p_best != nullptr)
+        {
+            r_plan = relocation{*p_best, FREE.start, p_best_owner};
+            return true;
+        }
+    }
+    return false;
 }
 
 static void set_ipage_values(uint16_t start_page, const uint16_t number_of_pages, const bool bit_state,
@@ -1400,7 +1211,7 @@ void file_cache::init(const file_identifier_t id_to_cache)
 {
     file_metadata metadata;
     xSemaphoreTake(s_lock_files, portMAX_DELAY);
-    const bool valid = find_metadata(id_to_cache, metadata, portMAX_DELAY);
+    const bool valid = find_metadata(id_to_cache, metadata);
     _p_next = sp_file_caches;
     sp_file_caches = this;
     _cache_updated = true;
@@ -1420,7 +1231,7 @@ void file_cache::init_from_isr(const file_identifier_t id_to_cache)
     BaseType_t _;
     if (xSemaphoreTakeFromISR(s_lock_files, &_) == pdPASS)
     {
-        valid = find_metadata(id_to_cache, metadata, portMAX_DELAY);
+        valid = find_metadata(id_to_cache, metadata);
         _p_next = sp_file_caches;
         sp_file_caches = this;
         xSemaphoreGiveFromISR(s_lock_files, &_);
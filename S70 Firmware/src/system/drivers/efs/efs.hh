@@ -86,9 +86,9 @@ bool create_file(
 
 /**
  * Checks to see if a file exists in the file system.
- * \note This is inefficient so use it sparingly.
+ * \note A lookup in the directory held in RAM, so it does not read the EEPROM.
  * \param[in]       id The identifier of the file to look for.
- * \param[in]       timeout The amount of time to wait for a file.  If not defined, then wait forever.
+ * \param[in]       timeout The amount of time to wait for the file system lock.  If not defined, then wait forever.
  * \return true The file was found within the given timeout.
  * \return false The files does not exists or the timeout was reached.
  */
@@ -136,6 +136,56 @@ uint16_t get_free_pages();
  */
 efs_header get_header_info();
 
+/// \brief Counters of the in-RAM directory index.
+struct directory_statistics
+{
+    /// Lookups of a file that exists.
+    uint32_t hits;
+
+    /// Lookups of a file that does not exist.
+    uint32_t misses;
+};
+
+/**
+ * \return The directory index's lookup counters since init().
+ */
+directory_statistics get_directory_statistics();
+
+/// \brief Progress of efs::compact().
+struct compaction_progress
+{
+    /// Files moved by the current (or last) compaction.
+    uint16_t files_moved;
+
+    /// Pages copied by the current (or last) compaction.
+    uint16_t pages_moved;
+
+    /// The number of free extents; 1 when all free pages are contiguous.
+    uint16_t free_extents;
+
+    /// The largest file that can be created, in pages.
+    uint16_t largest_free_extent;
+
+    /// Set when the last call to compact() found no more files to move.
+    bool finished;
+};
+
+/**
+ * Moves files into lower free extents so free pages coalesce.
+ * Each file is copied to free pages and then its metadata is rewritten, so a
+ * power loss during a move leaves either the original or the copy in place.
+ * Files with open handles are not moved.
+ * Compaction can be resumed by calling this again.
+ * \param[in]       timeout No new file moves are started after this long.
+ * \return true No more files can be moved.
+ */
+bool compact(const TickType_t timeout);
+
+/**
+ * \return The progress of the current (or last) compaction.
+ */
+compaction_progress get_compaction_progress();
+
 /**
  * Adds the passed identifier to the external cache.
  * \param[in]       id_to_cache The file identifier to be added to the user cache.
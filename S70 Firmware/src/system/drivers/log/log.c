@@ -1,7 +1,13 @@
 /**
  * @file log.c
  *
- * @brief Functions for ???
+ * @brief Binary event trace.  Producers claim a ring index with one atomic
+ * increment and publish the record by writing its sequence number last, so
+ * tasks and interrupts log without locks.  The drain task copies committed
+ * records out and sends them on the port the PC started the logger from, once
+ * it has.  The ring is kept in .noinit RAM and each record is cleaned from the
+ * data cache as it is written, so records from before a watchdog or software
+ * reset are still there to be sent after it.
  *
  */
 
@@ -10,11 +16,47 @@
 #include "apt.h"
 #include <asf.h>
 #include <string.h>
+#include "board.h"
 #include "Debugging.h"
+#include "sys_task.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+#define LOG_RING_MAGIC			0x4C4F4752	/* "LOGR"*/
+#define LOG_RING_MASK			(LOG_RING_RECORDS - 1)
+
+/* One MGMSG_MCM_POST_LOG message per record.*/
+#define LOG_PACKET_SIZE			(6 + sizeof(Log))
+
+#if (LOG_RING_RECORDS & LOG_RING_MASK) != 0
+#error "LOG_RING_RECORDS must be a power of 2"
+#endif
 
 /****************************************************************************
  * Private Data
  ****************************************************************************/
+typedef struct __attribute__((aligned(32)))
+{
+	uint32_t magic;
+	uint32_t magic_inverse;
+	uint32_t tail;		/* records drained, ever*/
+	uint32_t dropped;	/* records overwritten before they were drained*/
+	uint8_t boot;
+} Log_ring_header;
+
+typedef struct
+{
+	Log_ring_header header;
+	uint32_t head;		/* records claimed, ever; rebuilt from seq after a reset*/
+	Log_record records[LOG_RING_RECORDS];
+} Log_ring;
+
+static Log_ring log_ring __attribute__((section(".noinit")));
+
+/* Port of the PC that started the logger, see log_set_port.*/
+static iram_size_t (*log_write)(const void*, iram_size_t);
+static SemaphoreHandle_t log_tx_semaphore;
 
 uint8_t slot_prev_type[NUMBER_OF_BOARD_SLOTS + 5];
 uint8_t slot_prev_id[NUMBER_OF_BOARD_SLOTS + 5];
@@ -22,7 +64,12 @@ uint8_t slot_prev_id[NUMBER_OF_BOARD_SLOTS + 5];
 /****************************************************************************
  * Function Prototypes
  ****************************************************************************/
-// static void send_log(Log log, uint8_t slot, USB_Slave_Message *slave_message);
+static uint8_t log_slot_index(uint8_t slot);
+static void log_clean(const void *p_data, uint32_t size);
+static uint32_t log_recover(void);
+static bool log_pop(Log_record *p_record);
+static uint8_t log_encode(uint8_t *p_buffer, const Log_record *p_record);
+static void task_log_drain(void *pvParameters);
 
 /****************************************************************************
  * Interrupt Handler
@@ -31,76 +78,301 @@ uint8_t slot_prev_id[NUMBER_OF_BOARD_SLOTS + 5];
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
-// static void send_log(Log log, uint8_t slot, USB_Slave_Message *slave_message)
-// {
-// 	uint8_t response_buffer[6 + sizeof(Log)] =
-// 	{ 0 };
-
-// 	/* Header */
-// 	response_buffer[0] = MGMSG_MCM_POST_LOG;
-// 	response_buffer[1] = MGMSG_MCM_POST_LOG >> 8;
-// 	response_buffer[2] = sizeof(Log);
-// 	response_buffer[3] = 0x00;
-// 	response_buffer[4] = HOST_ID | 0x80; /* destination & has extended data*/
-// 	response_buffer[5] = SLOT_1_ID + slot; /* source*/
-
-// 	/*error type*/
-// //	response_buffer[6] = log.type;
-// //	response_buffer[7] = log.id;
-// 	memcpy(&response_buffer[6], &log, sizeof(Log));
-
-// 	xSemaphoreTake(slave_message->xUSB_Slave_TxSemaphore, portMAX_DELAY);
-// 	slave_message->write((uint8_t*) response_buffer, 6 + sizeof(Log));
-// 	xSemaphoreGive(slave_message->xUSB_Slave_TxSemaphore);
-// }
+/**
+ * @brief Maps an APT source to its index in the per slot tables, the board
+ * level sources follow the card slots.
+ */
+static uint8_t log_slot_index(uint8_t slot)
+{
+	if (slot == SYNC_MOTION_ID)
+		return NUMBER_OF_BOARD_SLOTS + 1;
+	else if (slot == MOTHERBOARD_ID)
+		return NUMBER_OF_BOARD_SLOTS + 2;
+	else if (slot == MOTHERBOARD_ID_STANDALONE)
+		return NUMBER_OF_BOARD_SLOTS + 3;
+	return slot;
+}
+
+/**
+ * @brief Writes cached ring data back to RAM so a reset does not lose it.
+ */
+static void log_clean(const void *p_data, uint32_t size)
+{
+	SCB_CleanDCache_by_Addr((uint32_t *) p_data, size);
+}
+
+/**
+ * @brief Validates the ring left by the previous boot.  Records claimed but
+ * never finished before the reset are turned into empty records so the drain
+ * does not wait on them.
+ *
+ * @return The number of undrained records kept.
+ */
+static uint32_t log_recover(void)
+{
+	const uint32_t RESET_TYPE = RSTC->RSTC_SR & RSTC_SR_RSTTYP_Msk;
+	const bool VALID = log_ring.header.magic == LOG_RING_MAGIC
+			&& log_ring.header.magic_inverse == (uint32_t) ~LOG_RING_MAGIC;
+
+	if (!VALID || RESET_TYPE == RSTC_SR_RSTTYP_GENERAL_RST
+			|| RESET_TYPE == RSTC_SR_RSTTYP_BACKUP_RST)
+	{
+		/* Power was lost, the RAM content means nothing.*/
+		memset(&log_ring, 0, sizeof(log_ring));
+		log_ring.header.magic = LOG_RING_MAGIC;
+		log_ring.header.magic_inverse = (uint32_t) ~LOG_RING_MAGIC;
+		log_clean(&log_ring, sizeof(log_ring));
+		return 0;
+	}
+
+	/* The newest committed record gives the head.*/
+	uint32_t head = log_ring.header.tail;
+	for (uint32_t i = 0; i < LOG_RING_RECORDS; ++i)
+	{
+		const uint32_t SEQ = log_ring.records[i].seq;
+		if (SEQ != 0 && (int32_t) (SEQ - head) > 0)
+			head = SEQ;
+	}
+
+	uint32_t tail = log_ring.header.tail;
+	if (head - tail > LOG_RING_RECORDS)
+		tail = head - LOG_RING_RECORDS;
+
+	for (uint32_t index = tail; index != head; ++index)
+	{
+		Log_record *p_record = &log_ring.records[index & LOG_RING_MASK];
+		if (p_record->seq != index + 1)
+		{
+			memset(p_record, 0, sizeof(Log_record));
+			p_record->seq = index + 1;
+		}
+	}
+
+	log_ring.head = head;
+	log_ring.header.tail = tail;
+	log_ring.header.boot++;
+	log_clean(&log_ring, sizeof(log_ring));
+	return head - tail;
+}
+
+/**
+ * @brief Takes the oldest committed record off the ring.  Records overwritten
+ * before they could be read are counted and skipped.
+ *
+ * @return false if there is nothing committed to read.
+ */
+static bool log_pop(Log_record *p_record)
+{
+	for (;;)
+	{
+		const uint32_t HEAD = __atomic_load_n(&log_ring.head, __ATOMIC_ACQUIRE);
+		uint32_t tail = log_ring.header.tail;
+
+		if (HEAD - tail > LOG_RING_RECORDS)
+		{
+			log_ring.header.dropped += HEAD - tail - LOG_RING_RECORDS;
+			tail = HEAD - LOG_RING_RECORDS;
+			log_ring.header.tail = tail;
+		}
+		if (tail == HEAD)
+			return false;
+
+		Log_record *p_slot = &log_ring.records[tail & LOG_RING_MASK];
+		const uint32_t SEQ = __atomic_load_n(&p_slot->seq, __ATOMIC_ACQUIRE);
+
+		if (SEQ == tail + 1)
+		{
+			*p_record = *p_slot;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			/* Still the same record once copied?*/
+			if (__atomic_load_n(&p_slot->seq, __ATOMIC_RELAXED) == SEQ)
+			{
+				log_ring.header.tail = tail + 1;
+				return true;
+			}
+		}
+		else if (SEQ == 0 || (int32_t) (SEQ - (tail + 1)) < 0)
+		{
+			/* Claimed but not finished yet, its writer was preempted.*/
+			return false;
+		}
+
+		/* A producer lapped the drain and reused the record.*/
+		log_ring.header.dropped++;
+		log_ring.header.tail = tail + 1;
+	}
+}
+
+/**
+ * @brief Builds the MGMSG_MCM_POST_LOG message for a record.
+ *
+ * @return Bytes written to p_buffer.
+ */
+static uint8_t log_encode(uint8_t *p_buffer, const Log_record *p_record)
+{
+	const Log LOG =
+	{ .type = p_record->type, .id = p_record->id, .var1 = p_record->var1,
+			.var2 = p_record->var2, .var3 = p_record->var3 };
+
+	/* Header */
+	p_buffer[0] = (uint8_t) MGMSG_MCM_POST_LOG;
+	p_buffer[1] = (uint8_t) (MGMSG_MCM_POST_LOG >> 8);
+	p_buffer[2] = sizeof(Log);
+	p_buffer[3] = 0x00;
+	p_buffer[4] = HOST_ID | 0x80; /* destination & has extended data*/
+	p_buffer[5] = SLOT_1_ID + p_record->slot; /* source*/
+	memcpy(&p_buffer[6], &LOG, sizeof(Log));
+
+	return LOG_PACKET_SIZE;
+}
+
+/****************************************************************************
+ * Task
+ ****************************************************************************/
+/**
+ * @brief Sends committed records to the PC.  Records keep accumulating, the
+ * oldest being overwritten, until the PC starts the logger.
+ *
+ * @param pvParameters : Not used.
+ */
+static void task_log_drain(void *pvParameters)
+{
+	UNUSED(pvParameters);
+
+	uint8_t packet[LOG_DRAIN_BATCH * LOG_PACKET_SIZE];
+
+	for (;;)
+	{
+		vTaskDelay(LOG_DRAIN_PERIOD);
+
+		if (!board.send_log_ready || !board.save.enable_log
+				|| log_write == NULL)
+			continue;
+
+		bool more = true;
+		while (more)
+		{
+			uint16_t length = 0;
+			Log_record record;
+
+			while (length < sizeof(packet) && (more = log_pop(&record)))
+			{
+				/* Records left empty by a reset carry nothing to send.*/
+				if (record.type != NO_LOG_TYPE)
+					length += log_encode(&packet[length], &record);
+			}
+			log_clean(&log_ring.header, sizeof(log_ring.header));
+
+			if (length != 0)
+			{
+				taskENTER_CRITICAL();
+				iram_size_t (*const WRITE)(const void*, iram_size_t) = log_write;
+				const SemaphoreHandle_t TX_SEMAPHORE = log_tx_semaphore;
+				taskEXIT_CRITICAL();
+
+				xSemaphoreTake(TX_SEMAPHORE, portMAX_DELAY);
+				WRITE(packet, length);
+				xSemaphoreGive(TX_SEMAPHORE);
+			}
+		}
+	}
+}
 
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
+/**
+ * @brief Recovers the ring left by a warm reset, logs the reset and starts
+ * the drain task.  Call before anything logs.
+ */
+void log_init(void)
+{
+	const uint32_t KEPT = log_recover();
+
+	log_event(MOTHERBOARD_ID, SYSTEM_LOG_TYPE, SYSTEM_RESET_LOG,
+			(RSTC->RSTC_SR & RSTC_SR_RSTTYP_Msk) >> RSTC_SR_RSTTYP_Pos, KEPT, 0);
+
+#if ENABLE_SYSTEM_LOGGING
+	if (xTaskCreate(task_log_drain, "Log Drain", TASK_LOG_DRAIN_STACK_SIZE, NULL,
+			TASK_LOG_DRAIN_STACK_PRIORITY, NULL) != pdPASS)
+	{
+		debug_print("ERROR: Failed to create log drain task\r\n");
+	}
+#endif
+}
+
+/**
+ * @brief Sends the drained records to the port a message came in on, the USB
+ * CDC or the FTDI port.  Called when the PC starts the logger.
+ */
+void log_set_port(const USB_Slave_Message *slave_message)
+{
+	taskENTER_CRITICAL();
+	log_write = slave_message->write;
+	log_tx_semaphore = slave_message->xUSB_Slave_TxSemaphore;
+	taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Writes a record to the trace ring.  Never blocks and may be called
+ * from an interrupt.  When the ring is full the oldest record is overwritten.
+ *
+ * @param slot : APT source of the event, a slot or one of the board IDs.
+ */
+void log_event(uint8_t slot, uint8_t type, uint8_t id, uint32_t var1,
+		uint32_t var2, uint32_t var3)
+{
+	const uint32_t INDEX = __atomic_fetch_add(&log_ring.head, 1,
+			__ATOMIC_RELAXED);
+	Log_record *p_record = &log_ring.records[INDEX & LOG_RING_MASK];
+
+	/* Readers see 0 while the record is incomplete.*/
+	__atomic_store_n(&p_record->seq, 0, __ATOMIC_RELEASE);
+
+	p_record->timestamp = xTaskGetTickCountFromISR();
+	p_record->boot = log_ring.header.boot;
+	p_record->slot = log_slot_index(slot);
+	p_record->type = type;
+	p_record->id = id;
+	p_record->var1 = var1;
+	p_record->var2 = var2;
+	p_record->var3 = var3;
+
+	__atomic_store_n(&p_record->seq, INDEX + 1, __ATOMIC_RELEASE);
+	log_clean(p_record, sizeof(Log_record));
+}
+
+/**
+ * @brief Logs an event for the PC, see log_event.
+ *
+ * @param slave_message : Not used, the drain task owns the writes to the PC.
+ * @param no_repeat : LOG_NO_REPEAT to skip the event if it matches the last
+ * one logged for this slot.
+ */
 void setup_and_send_log(USB_Slave_Message *slave_message, uint8_t slot,
 bool no_repeat, uint8_t type, uint8_t id, uint32_t var1, uint32_t var2,
 		uint32_t var3)
 {
+	UNUSED(slave_message);
 #if ENABLE_SYSTEM_LOGGING
 	if (board.save.enable_log)
 	{
-		Log log;
-
-		// wait for the PC to start the logger
-		if (board.send_log_ready == false)
-			return;
-
-//		log.slot = slot;
-		log.type = type;
-		log.id = id;
-		log.var1 = var1;
-		log.var2 = var2;
-		log.var3 = var3;
+		const uint8_t INDEX = log_slot_index(slot);
 
 		// if this command is the same as the previous, don't send it
-		// We need to change the slot number so that i
-
-		if (slot == SYNC_MOTION_ID)
-			slot = NUMBER_OF_BOARD_SLOTS + 1;
-		else if (slot == MOTHERBOARD_ID)
-			slot = NUMBER_OF_BOARD_SLOTS + 2;
-		else if (slot == MOTHERBOARD_ID_STANDALONE)
-			slot = NUMBER_OF_BOARD_SLOTS + 3;
-
 		if (no_repeat)
 		{
-			if (type == slot_prev_type[slot])
-				if (id == slot_prev_id[slot])
+			if (type == slot_prev_type[INDEX])
+				if (id == slot_prev_id[INDEX])
 					return;
 		}
-		error_print("no_repeat %d type %d id %d\n", no_repeat, type, id);
 
 		// save the sent command to compare next time
-		slot_prev_type[slot] = type;
-		slot_prev_id[slot] = id;
+		slot_prev_type[INDEX] = type;
+		slot_prev_id[INDEX] = id;
 
-		send_log(log, slot, slave_message);
+		log_event(slot, type, id, var1, var2, var3);
 	}
 #endif
 }
-
@@ -1,7 +1,9 @@
 /**
  * @file log.h
  *
- * @brief Functions for ???
+ * @brief Binary event trace.  Events are written without blocking, from tasks
+ * or interrupts, into a RAM ring that survives warm resets, and a low priority
+ * task drains them to the PC in batches of MGMSG_MCM_POST_LOG messages.
  *
  */
 
@@ -30,6 +32,31 @@ typedef struct __attribute__((packed))
 	uint32_t var3;
 } Log;
 
+/* Records held in the trace ring, must be a power of 2.*/
+#define LOG_RING_RECORDS		128
+
+/* The drain task wakes this often and sends at most LOG_DRAIN_BATCH records
+ * per USB write.*/
+#define LOG_DRAIN_PERIOD		pdMS_TO_TICKS(50)
+#define LOG_DRAIN_BATCH			16
+
+/**
+ * One trace record, sized to a cache line so each write can be cleaned to
+ * RAM on its own.
+ */
+typedef struct __attribute__((aligned(32)))
+{
+	uint32_t seq;		/* index + 1 once written, 0 while being written*/
+	uint32_t timestamp;	/* RTOS ticks since boot*/
+	uint8_t boot;		/* boot count the record was written in*/
+	uint8_t slot;		/* APT source offset from SLOT_1_ID*/
+	uint8_t type;
+	uint8_t id;
+	uint32_t var1;
+	uint32_t var2;
+	uint32_t var3;
+} Log_record;
+
 // use to n=make sure we don't send the same type repetitively
 // +5 for the MOTHERBOARD_ID and other as sources
 extern uint8_t slot_prev_type[NUMBER_OF_BOARD_SLOTS + 5];
@@ -71,6 +98,9 @@ typedef enum
 	SYSTEM_UPDATE_CPLD_LOG = 11,
 	SYSTEM_UPDATE_FIRMWARE_LOG = 12,
 	SYSTEM_ENABLE_LOG = 13,
+	SYSTEM_RESET_LOG = 14,	/* var1 reset type, var2 records kept from before the reset*/
+	SYSTEM_DEADLINE_MISS_LOG = 15,	/* var1 slot, var2 worst lateness in ticks, var3 overruns*/
+	SYSTEM_DEVICE_DETECT_TIME_LOG = 16,	/* var1 time-to-detect in ms, var2 device detect state reached*/
 
 	SYSTEM_END_LOG_IDS = 0xff	// make this enum 8bit
 } system_log_ids;
@@ -82,6 +112,10 @@ typedef enum
 /************************************************************************************
  * Public Function Prototypes
  ************************************************************************************/
+void log_init(void);
+void log_set_port(const USB_Slave_Message *slave_message);
+void log_event(uint8_t slot, uint8_t type, uint8_t id, uint32_t var1,
+		uint32_t var2, uint32_t var3);
 void setup_and_send_log(USB_Slave_Message *slave_message, uint8_t slot,
 		bool no_repeat, uint8_t type, uint8_t id, uint32_t var1, uint32_t var2,
 		uint32_t var3);
@@ -39,6 +39,8 @@ class IndirectLUT
 
     uint32_t (* const _get_payload_size) (const STRUCTURE_KEY);     ///> Pointer to size translation function.
 
+    LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY> _lut;                     ///> The inner LUTs.  Kept for its location cache.
+
 public:
     IndirectLUT(const LUT_ID id, uint32_t (*payload_size_func) (const STRUCTURE_KEY));
 
@@ -55,6 +57,17 @@ public:
     LUT_ERROR load_data (const efs::handle& r_handle, INDIRECTION_KEY indr_key, const STRUCTURE_KEY str_key,
         const DISCRIMINATOR_KEY disc_key, char * const p_payload);
 
+    /**
+     * Forgets the entry locations remembered from previous loads.
+     * Must be called when the LUT file changes.
+     */
+    inline void invalidate_cache()
+    {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        _lut.invalidate_cache();
+        xSemaphoreGive(_lock);
+    }
+
     const LUT_ID ID;
 };
 
@@ -71,6 +84,7 @@ IndirectLUT<INDIRECTION_KEY, STRUCTURE_KEY, DISCRIMINATOR_KEY>::IndirectLUT(
     const LUT_ID id, uint32_t (*payload_size_func) (const STRUCTURE_KEY))
     :
     _get_payload_size(payload_size_func),
+    _lut(LUT_ID::RECURSIVE, payload_size_func),
     ID(id)
 {
     _lock = xSemaphoreCreateMutex();
@@ -90,33 +104,32 @@ LUT_ERROR IndirectLUT<INDIRECTION_KEY, STRUCTURE_KEY, DISCRIMINATOR_KEY>::load_d
     
     // * Assumption:  The handle is valid.
 
+    // Read in header data.
+    LUT_Header<1> header;
+    r_handle.read(0, &header, sizeof(header));
+
+    const uint16_t PAGE_SIZE = header.lut_page_size;
+
+    if (!lut_version_supported(header.lut_version))
+    {
+        return LUT_ERROR::UNSUPPORTED_VERSION;
+    }
+    if (header.indirection_count != 1)
+    {
+        return LUT_ERROR::INDIRECTION_MISMATCH;
+    }
+    if (header.keys[0] != sizeof(INDIRECTION_KEY))
+    {
+        return LUT_ERROR::KEY_SIZE_MISMATCH;
+    }
+
     xSemaphoreTake(_lock, portMAX_DELAY);
     
     // Create enough memory to store the page.
     char * const p_page_buffer = static_cast<char*>(pvPortMalloc(EFS_PAGE_SIZE));
 
     if (p_page_buffer != NULL) {
-        // Read in header data.
-        LUT_Header<1> header;
-        r_handle.read(0, &header, sizeof(header));
-
-        const uint16_t PAGE_SIZE = header.lut_page_size;
-
         // Get the number of indirect LUTs.
-
-        if (header.lut_version != LUT_LATEST_FW_VERSION)
-        {
-            return LUT_ERROR::UNSUPPORTED_VERSION;
-        }
-        if (header.indirection_count != 1)
-        {
-            return LUT_ERROR::INDIRECTION_MISMATCH;
-        }
-        if (header.keys[0] != sizeof(INDIRECTION_KEY))
-        {
-            return LUT_ERROR::KEY_SIZE_MISMATCH;
-        }
-
         r_handle.read(PAGE_SIZE*1, p_page_buffer, PAGE_SIZE);
         INDIRECTION_KEY in_header = static_cast<INDIRECTION_KEY>(p_page_buffer[0] | (static_cast<uint16_t>(p_page_buffer[1]) << 8));
         
@@ -172,16 +185,10 @@ LUT_ERROR IndirectLUT<INDIRECTION_KEY, STRUCTURE_KEY, DISCRIMINATOR_KEY>::load_d
         if (key_offset == static_cast<uint16_t>(SEARCH_INVALID)) {
             rt = LUT_ERROR::MISSING_KEY;
         } else {
-            // Instantiate a virtual LUT.
-            LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY> lut(
-                LUT_ID::RECURSIVE,
-                _get_payload_size
-            );
-
             const CRC8_t CRC_PART = CRC(reinterpret_cast<const char*>(&indr_key), sizeof(indr_key));
 
             // Load a smaller LUT starting at the current LUT's offset plus the page pointer to by the key.
-            rt = lut.load_data(r_handle, str_key, disc_key, p_payload, CRC_PART, PAGE_SIZE*(1 + key_offset), step_down_lut_header(header));
+            rt = _lut.load_data(r_handle, str_key, disc_key, p_payload, CRC_PART, PAGE_SIZE*(1 + key_offset), step_down_lut_header(header));
         }
 
         vPortFree(p_page_buffer);
@@ -50,6 +50,17 @@ public:
         return rt;
     }
 
+    /**
+     * Forgets the entry locations remembered from previous loads.
+     * Must be called when the LUT file changes.
+     */
+    inline void invalidate_cache()
+    {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        _lut.invalidate_cache();
+        xSemaphoreGive(_lock);
+    }
+
     inline LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY> * _get_lut()
     {
         return &_lut;
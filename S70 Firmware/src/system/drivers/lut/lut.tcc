@@ -27,8 +27,28 @@
 
 /**
  * The latest version of LUT files that the firmware supports.
+ *
+ * Version 2 adds a fence page in front of each structure key's entry pages.
+ * The fence page holds the first discriminator key of every entry page, so a
+ * lookup reads the fence page and then only the entry page that can hold the key.
  */
-constexpr uint8_t LUT_LATEST_FW_VERSION = 1;
+constexpr uint8_t LUT_LATEST_FW_VERSION = 2;
+
+/**
+ * The oldest version of LUT files that the firmware supports.
+ */
+constexpr uint8_t LUT_OLDEST_FW_VERSION = 1;
+
+/**
+ * The number of resolved entry locations each LUT remembers.
+ */
+constexpr std::size_t LUT_LOCATION_CACHE_SIZE = 8;
+
+/// \return If the LUT file version can be read.
+constexpr bool lut_version_supported(const uint8_t version)
+{
+    return version >= LUT_OLDEST_FW_VERSION && version <= LUT_LATEST_FW_VERSION;
+}
 
 /*****************************************************************************
  * Data Types
@@ -61,14 +81,124 @@ struct __attribute__((packed)) LUT_Header
      */
 };
 
+/**
+ * Remembers where recently loaded entries are in a LUT file.
+ * Locations are only hints:  the entry's key and CRC are still checked.
+ */
+template<typename STRUCTURE_KEY, typename DISCRIMINATOR_KEY, std::size_t LEN>
+class LUTLocationCache
+{
+private:
+    struct location
+    {
+        bool valid;
+        uint32_t start_address;     ///> The start address of the (sub-)LUT.
+        STRUCTURE_KEY str_key;
+        DISCRIMINATOR_KEY disc_key;
+        uint32_t entry_address;     ///> The file address of the entry.
+    };
+
+    std::size_t _oldest = 0;
+    location _locations[LEN] = {};
+
+    location * find_location(const uint32_t start_address, const STRUCTURE_KEY str_key,
+        const DISCRIMINATOR_KEY disc_key)
+    {
+        for (std::size_t i = 0; i < LEN; ++i)
+        {
+            if (_locations[i].valid && _locations[i].start_address == start_address &&
+                _locations[i].str_key == str_key && _locations[i].disc_key == disc_key)
+            {
+                return &_locations[i];
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    bool find(const uint32_t start_address, const STRUCTURE_KEY str_key,
+        const DISCRIMINATOR_KEY disc_key, uint32_t& r_entry_address)
+    {
+        const location * const p_location = find_location(start_address, str_key, disc_key);
+        if (p_location != nullptr)
+        {
+            r_entry_address = p_location->entry_address;
+        }
+        return p_location != nullptr;
+    }
+
+    void remember(const uint32_t start_address, const STRUCTURE_KEY str_key,
+        const DISCRIMINATOR_KEY disc_key, const uint32_t entry_address)
+    {
+        location * p_location = find_location(start_address, str_key, disc_key);
+        if (p_location == nullptr)
+        {
+            p_location = &_locations[_oldest];
+            if (++_oldest == LEN)
+            {
+                _oldest = 0;
+            }
+        }
+        *p_location = location{true, start_address, str_key, disc_key, entry_address};
+    }
+
+    void forget(const uint32_t start_address, const STRUCTURE_KEY str_key,
+        const DISCRIMINATOR_KEY disc_key)
+    {
+        location * const p_location = find_location(start_address, str_key, disc_key);
+        if (p_location != nullptr)
+        {
+            p_location->valid = false;
+        }
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < LEN; ++i)
+        {
+            _locations[i].valid = false;
+        }
+    }
+};
+
 template<typename STRUCTURE_KEY, typename DISCRIMINATOR_KEY>
 class LUT
 {
 private:
     uint32_t (* const _get_payload_size) (const STRUCTURE_KEY);
 
+    LUTLocationCache<STRUCTURE_KEY, DISCRIMINATOR_KEY, LUT_LOCATION_CACHE_SIZE> _locations;
+
     template<typename, typename, typename> friend class IndirectLUT;
 
+    static constexpr uint32_t NO_ENTRY = UINT32_MAX;
+
+    /**
+     * Finds the pages of a structure key.
+     * \param[out]      r_key_offset The first page of the structure key.
+     * \param[out]      r_next_offset The first page of the next structure key.
+     * \return false The structure key is not in the LUT.
+     */
+    static bool find_structure(const efs::handle& r_handle, const STRUCTURE_KEY str_key,
+        const uint32_t start_address, const uint16_t page_size, char * const p_page_buffer,
+        uint16_t& r_key_offset, uint16_t& r_next_offset);
+
+    /**
+     * Binary searches the entry pages of a version 1 LUT.
+     * \return The file address of the entry, or NO_ENTRY.
+     */
+    static uint32_t find_entry_v1(const efs::handle& r_handle, const DISCRIMINATOR_KEY disc_key,
+        const uint32_t start_address, const uint16_t page_size, const uint32_t entry_size,
+        const uint16_t key_offset, const uint16_t next_offset, char * const p_page_buffer);
+
+    /**
+     * Searches the fence page of a version 2 LUT, then the one entry page that can hold the key.
+     * \return The file address of the entry, or NO_ENTRY.
+     */
+    static uint32_t find_entry_v2(const efs::handle& r_handle, const DISCRIMINATOR_KEY disc_key,
+        const uint32_t start_address, const uint16_t page_size, const uint32_t entry_size,
+        const uint16_t key_offset, const uint16_t next_offset, char * const p_page_buffer);
+
 public:
 
     LUT(const LUT_ID id, uint32_t (*payload_size_func) (const STRUCTURE_KEY));
@@ -94,6 +224,15 @@ public:
         char * const p_payload, const uint8_t crc_init,
         const uint32_t start_address, const LUT_Header<0>& r_header);
 
+    /**
+     * Forgets the entry locations remembered from previous loads.
+     * Must be called when the LUT file changes.
+     */
+    inline void invalidate_cache()
+    {
+        _locations.clear();
+    }
+
     const LUT_ID ID;
 };
 
@@ -111,7 +250,7 @@ uint16_t search_page(const char * const p_data, const uint16_t entires_on_page,
     const KEY key)
 {
     int32_t start = 0;
-    int32_t end = entires_on_page;
+    int32_t end = static_cast<int32_t>(entires_on_page) - 1;
 
     while (start <= end)
     {
@@ -183,193 +322,304 @@ LUT_ERROR LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY>::load_data(const efs::handle& r_
         char * const p_payload, const uint8_t init_crc, const uint32_t start_address,
         const LUT_Header<0>& r_header)
 {
-    LUT_ERROR rt = LUT_ERROR::OKAY;
-
     // * Assumption:  The handle is valid.
 
-    // Check if the structure has no saved data, and allocate the page buffer
+    // Verify supported LUT version
+    if (!lut_version_supported(r_header.lut_version))
+    {
+        return LUT_ERROR::UNSUPPORTED_VERSION;
+    }
+
+    // Verify correct indirection
+    if (r_header.indirection_count != 0)
+    {
+        return LUT_ERROR::INDIRECTION_MISMATCH;
+    }
+
+    // Verify correct size
+    if (r_header.keys[1] != sizeof(DISCRIMINATOR_KEY) || r_header.keys[0] != sizeof(STRUCTURE_KEY))
+    {
+        return LUT_ERROR::KEY_SIZE_MISMATCH;
+    }
 
     // Size of the structure (in bytes).
     const uint32_t PAYLOAD_SIZE = _get_payload_size(str_key);
+    if (PAYLOAD_SIZE == INVALID_PAYLOAD_SIZE)
+    {
+        return LUT_ERROR::BAD_STRUCTURE_KEY;
+    }
+
     char * const p_page_buffer = static_cast<char*>(pvPortMalloc(EFS_PAGE_SIZE));
+    if (p_page_buffer == nullptr)
+    {
+        return LUT_ERROR::OUT_OF_MEMORY;
+    }
 
-    if (PAYLOAD_SIZE == INVALID_PAYLOAD_SIZE)
+    const uint16_t PAGE_SIZE = r_header.lut_page_size;
+    const uint32_t ENTRY_SIZE = PAYLOAD_SIZE + sizeof(DISCRIMINATOR_KEY) + sizeof(CRC8_t);
+
+    // Finds the entry's address, or returns the reason it could not.
+    auto search = [&](uint32_t& r_entry_address)
     {
-        rt = LUT_ERROR::BAD_STRUCTURE_KEY;
-        if (p_page_buffer != nullptr)
+        uint16_t key_offset;
+        uint16_t next_offset;
+        if (!find_structure(r_handle, str_key, start_address, PAGE_SIZE, p_page_buffer, key_offset, next_offset))
         {
-            vPortFree(p_page_buffer);
+            return LUT_ERROR::MISSING_KEY;
         }
-    } else if (p_page_buffer == nullptr) {
-        rt = LUT_ERROR::OUT_OF_MEMORY;
-    }
 
-    if (rt == LUT_ERROR::OKAY)
-    {
-        // Read in header data.
-        const uint16_t PAGE_SIZE = r_header.lut_page_size;
+        r_entry_address = (r_header.lut_version == 1)
+            ? find_entry_v1(r_handle, disc_key, start_address, PAGE_SIZE, ENTRY_SIZE, key_offset, next_offset, p_page_buffer)
+            : find_entry_v2(r_handle, disc_key, start_address, PAGE_SIZE, ENTRY_SIZE, key_offset, next_offset, p_page_buffer);
 
+        // The discrimator key could not be found.
+        return (r_entry_address == NO_ENTRY) ? LUT_ERROR::BAD_DISCRIMINATOR_KEY : LUT_ERROR::OKAY;
+    };
 
-        // Verify supported LUT version
-        if (r_header.lut_version != LUT_LATEST_FW_VERSION)
+    // Reads the entry and checks it against the keys and its CRC.
+    auto load_entry = [&](const uint32_t entry_address)
+    {
+        if (r_handle.read(entry_address, p_page_buffer, ENTRY_SIZE) != ENTRY_SIZE)
         {
-            return LUT_ERROR::UNSUPPORTED_VERSION;
+            return LUT_ERROR::INVALID_ENTRY;
         }
 
-        // Verify correct indirection
-        if (r_header.indirection_count != 0)
+        DISCRIMINATOR_KEY key;
+        memcpy(&key, p_page_buffer, sizeof(DISCRIMINATOR_KEY));
+        if (key != disc_key)
         {
-            return LUT_ERROR::INDIRECTION_MISMATCH;
+            return LUT_ERROR::BAD_DISCRIMINATOR_KEY;
         }
 
-        // Verify correct size
-        if (r_header.keys[1] != sizeof(DISCRIMINATOR_KEY) || r_header.keys[0] != sizeof(STRUCTURE_KEY))
+        const CRC8_t CRC = CRC_split(
+            p_page_buffer,
+            ENTRY_SIZE - sizeof(CRC8_t),
+            CRC_split(
+                reinterpret_cast<const char*>(&str_key),
+                sizeof(STRUCTURE_KEY),
+                init_crc
+            )
+        );
+
+        // Cross reference computed CRC with the one saved.
+        CRC8_t SAVED_CRC;
+        memcpy(&SAVED_CRC, p_page_buffer + ENTRY_SIZE - sizeof(CRC8_t), sizeof(CRC8_t));
+        if (CRC != SAVED_CRC)
+        {
+            return LUT_ERROR::INVALID_ENTRY;
+        }
+
+        // CRC was valid, so load configuration into memory.
+        memcpy(p_payload, p_page_buffer + sizeof(DISCRIMINATOR_KEY), PAYLOAD_SIZE);
+        return LUT_ERROR::OKAY;
+    };
+
+    uint32_t entry_address;
+    const bool CACHED = _locations.find(start_address, str_key, disc_key, entry_address);
+    LUT_ERROR rt = CACHED ? LUT_ERROR::OKAY : search(entry_address);
+    if (rt == LUT_ERROR::OKAY)
+    {
+        rt = load_entry(entry_address);
+    }
+    if (rt != LUT_ERROR::OKAY && CACHED)
+    {
+        // The remembered location went stale, so look again.
+        _locations.forget(start_address, str_key, disc_key);
+        rt = search(entry_address);
+        if (rt == LUT_ERROR::OKAY)
         {
-            return LUT_ERROR::KEY_SIZE_MISMATCH;
+            rt = load_entry(entry_address);
         }
-        // Read in how many structure ids are used.
-        r_handle.read(start_address, p_page_buffer, PAGE_SIZE);
-        STRUCTURE_KEY in_header = static_cast<STRUCTURE_KEY>(p_page_buffer[0] | (static_cast<uint16_t>(p_page_buffer[1]) << 8));
-        
+    }
+
+    if (rt == LUT_ERROR::OKAY)
+    {
+        _locations.remember(start_address, str_key, disc_key, entry_address);
+    }
+
+    vPortFree(p_page_buffer);
+
+    return rt;
+}
+
+template<typename STRUCTURE_KEY, typename DISCRIMINATOR_KEY>
+bool LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY>::find_structure(const efs::handle& r_handle,
+    const STRUCTURE_KEY str_key, const uint32_t start_address, const uint16_t PAGE_SIZE,
+    char * const p_page_buffer, uint16_t& r_key_offset, uint16_t& r_next_offset)
+{
+    // Read in how many structure ids are used.
+    r_handle.read(start_address, p_page_buffer, PAGE_SIZE);
+    STRUCTURE_KEY in_header = static_cast<STRUCTURE_KEY>(p_page_buffer[0] | (static_cast<uint16_t>(p_page_buffer[1]) << 8));
+
+
+    const uint32_t HEADER_SIZE = (static_cast<uint32_t>(in_header + 1) * sizeof(LUTHeaderEntry<STRUCTURE_KEY>)) + sizeof(STRUCTURE_KEY);
+    const uint16_t HEADER_PAGES = (HEADER_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+    const uint16_t ENTIRES_IN_FIRST_HEADER_PAGE = (PAGE_SIZE - sizeof(STRUCTURE_KEY)) / sizeof(LUTHeaderEntry<STRUCTURE_KEY>);
+    const uint16_t ENTRIES_IN_OTHER_HEADER_PAGE = PAGE_SIZE / sizeof(LUTHeaderEntry<STRUCTURE_KEY>);
+
+    uint16_t key_offset = static_cast<uint16_t>(SEARCH_INVALID);
+    uint16_t next_offset = static_cast<uint16_t>(SEARCH_INVALID);
 
-        const uint32_t HEADER_SIZE = (static_cast<uint32_t>(in_header + 1) * sizeof(LUTHeaderEntry<STRUCTURE_KEY>)) + sizeof(STRUCTURE_KEY);
-        const uint16_t HEADER_PAGES = (HEADER_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
-        const uint16_t ENTIRES_IN_FIRST_HEADER_PAGE = (PAGE_SIZE - sizeof(STRUCTURE_KEY)) / sizeof(LUTHeaderEntry<STRUCTURE_KEY>);
-        const uint16_t ENTRIES_IN_OTHER_HEADER_PAGE = PAGE_SIZE / sizeof(LUTHeaderEntry<STRUCTURE_KEY>);
 
-        uint16_t key_offset = static_cast<uint16_t>(SEARCH_INVALID);
-        uint16_t next_offset = static_cast<uint16_t>(SEARCH_INVALID);
+    // Search in each header page for the structure key.
+    for (uint16_t header_page = 0; header_page < HEADER_PAGES && key_offset == static_cast<uint16_t>(SEARCH_INVALID); ++header_page)
+    {
+        const uint16_t ENTRIES_ON_THIS_PAGE = (header_page == HEADER_PAGES - 1) ? (in_header % ENTRIES_IN_OTHER_HEADER_PAGE) :
+            ((header_page == 0) ? ENTIRES_IN_FIRST_HEADER_PAGE : ENTRIES_IN_OTHER_HEADER_PAGE);
 
+        char * const p_start = p_page_buffer + ((header_page == 0) ? sizeof(STRUCTURE_KEY) : 0);
 
-        // Search in each header page for the structure key.
-        for (uint16_t header_page = 0; header_page < HEADER_PAGES && key_offset == static_cast<uint16_t>(SEARCH_INVALID); ++header_page)
+        if (header_page != 0)
         {
-            const uint16_t ENTRIES_ON_THIS_PAGE = (header_page == HEADER_PAGES - 1) ? (in_header % ENTRIES_IN_OTHER_HEADER_PAGE) :
-                ((header_page == 0) ? ENTIRES_IN_FIRST_HEADER_PAGE : ENTRIES_IN_OTHER_HEADER_PAGE);
+            r_handle.read(start_address + PAGE_SIZE*header_page, p_page_buffer, PAGE_SIZE);
+        }
 
-            char * const p_start = p_page_buffer + ((header_page == 0) ? sizeof(STRUCTURE_KEY) : 0);
+        // Binary search for entry between the two offsets.
+        uint16_t key_index = search_page<STRUCTURE_KEY>(p_start, ENTRIES_ON_THIS_PAGE, sizeof(LUTHeaderEntry<STRUCTURE_KEY>), str_key);
+        if (key_index != static_cast<uint16_t>(SEARCH_INVALID))
+        {
+            // Save the starting page for the key.
+            LUTHeaderEntry<STRUCTURE_KEY> entry;
+            memcpy(&entry, p_start + key_index * sizeof(LUTHeaderEntry<STRUCTURE_KEY>), sizeof(LUTHeaderEntry<STRUCTURE_KEY>));
+            key_offset = entry.starting_offset;
 
-            if (header_page != 0)
+            if (key_index == ENTRIES_ON_THIS_PAGE - 1 && header_page != HEADER_PAGES - 1)
             {
-                r_handle.read(start_address + PAGE_SIZE*header_page, p_page_buffer, PAGE_SIZE);
-            }
+                // End of this page.  Read first entry on the next page.
+                r_handle.read(start_address + PAGE_SIZE*(header_page + 1), p_start, sizeof(LUTHeaderEntry<STRUCTURE_KEY>));
 
-            // Binary search for entry between the two offsets.
-            uint16_t key_index = search_page<STRUCTURE_KEY>(p_start, ENTRIES_ON_THIS_PAGE, sizeof(LUTHeaderEntry<STRUCTURE_KEY>), str_key);
-            if (key_index != static_cast<uint16_t>(SEARCH_INVALID))
-            {
-                // Save the starting page for the key.
-                LUTHeaderEntry<STRUCTURE_KEY> entry;
-                memcpy(&entry, p_start + key_index * sizeof(LUTHeaderEntry<STRUCTURE_KEY>), sizeof(LUTHeaderEntry<STRUCTURE_KEY>));
-                key_offset = entry.starting_offset;
-
-                if (key_index == ENTRIES_ON_THIS_PAGE - 1 && header_page != HEADER_PAGES - 1)
-                {
-                    // End of this page.  Read first entry on the next page.
-                    r_handle.read(start_address + PAGE_SIZE*(header_page + 1), p_start, sizeof(LUTHeaderEntry<STRUCTURE_KEY>));
-
-                    key_index = 0;
-                } else {
-                    ++key_index;
-                }
-
-                // Save the ending page for the key.
-                memcpy(&entry, p_start + key_index * sizeof(LUTHeaderEntry<STRUCTURE_KEY>), sizeof(LUTHeaderEntry<STRUCTURE_KEY>));
-                next_offset = entry.starting_offset;
+                key_index = 0;
+            } else {
+                ++key_index;
             }
 
-            in_header -= static_cast<STRUCTURE_KEY>(ENTRIES_ON_THIS_PAGE);
+            // Save the ending page for the key.
+            memcpy(&entry, p_start + key_index * sizeof(LUTHeaderEntry<STRUCTURE_KEY>), sizeof(LUTHeaderEntry<STRUCTURE_KEY>));
+            next_offset = entry.starting_offset;
         }
 
-        if (key_offset == static_cast<uint16_t>(SEARCH_INVALID))
-        {
-            rt = LUT_ERROR::MISSING_KEY;
+        in_header -= static_cast<STRUCTURE_KEY>(ENTRIES_ON_THIS_PAGE);
+    }
+
+    r_key_offset = key_offset;
+    r_next_offset = next_offset;
+    return key_offset != static_cast<uint16_t>(SEARCH_INVALID);
+}
+
+template<typename STRUCTURE_KEY, typename DISCRIMINATOR_KEY>
+uint32_t LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY>::find_entry_v1(const efs::handle& r_handle,
+    const DISCRIMINATOR_KEY disc_key, const uint32_t start_address, const uint16_t PAGE_SIZE,
+    const uint32_t ENTRY_SIZE, const uint16_t key_offset, const uint16_t next_offset,
+    char * const p_page_buffer)
+{
+    // Get the page number needed.
+    const uint32_t ENTIRES_PER_PAGE = PAGE_SIZE / ENTRY_SIZE;
+
+    uint16_t start_page = key_offset;
+    uint16_t end_page = next_offset - 2;
+    uint16_t located_page = static_cast<uint16_t>(SEARCH_INVALID);
+
+    uint16_t entry = static_cast<uint16_t>(SEARCH_INVALID);
+
+    // For all but the last page (searching completely filled pages), do a binary search.
+    while (start_page <= end_page)
+    {
+        // Read in the current page.
+        const uint16_t current = (start_page + end_page) / 2;
+        r_handle.read(start_address + PAGE_SIZE*current, p_page_buffer, PAGE_SIZE);
+
+        // Get the lowest and highest keys from the page.
+        DISCRIMINATOR_KEY lowest_key, highest_key;
+
+        memcpy(&lowest_key, p_page_buffer, sizeof(DISCRIMINATOR_KEY));
+        memcpy(&highest_key, p_page_buffer + ENTRY_SIZE*(ENTIRES_PER_PAGE - 1), sizeof(DISCRIMINATOR_KEY));
+
+        if (disc_key < lowest_key) {
+            end_page = current - 1;
+        } else if (disc_key > highest_key) {
+            start_page = current + 1;
         } else {
-            // Get the page number needed.
-            const uint32_t ENTRY_SIZE = PAYLOAD_SIZE + sizeof(DISCRIMINATOR_KEY) + sizeof(CRC8_t);
-            const uint32_t ENTIRES_PER_PAGE = PAGE_SIZE / ENTRY_SIZE;
-
-            uint16_t start_page = key_offset;
-            uint16_t end_page = next_offset - 2;
-            uint16_t located_page = static_cast<uint16_t>(SEARCH_INVALID);
-
-            uint16_t entry = static_cast<uint16_t>(SEARCH_INVALID);
-            
-            // For all but the last page (searching completely filled pages), do a binary search.
-            while (start_page <= end_page)
-            {
-                // Read in the current page.
-                const uint16_t current = (start_page + end_page) / 2;
-                r_handle.read(start_address + PAGE_SIZE*current, p_page_buffer, PAGE_SIZE);
-
-                // Get the lowest and highest keys from the page.
-                DISCRIMINATOR_KEY lowest_key, highest_key;
-
-                memcpy(&lowest_key, p_page_buffer, sizeof(DISCRIMINATOR_KEY));
-                memcpy(&highest_key, p_page_buffer + ENTRY_SIZE*(ENTIRES_PER_PAGE - 1), sizeof(DISCRIMINATOR_KEY));
-
-                if (disc_key < lowest_key) {
-                    end_page = current - 1;
-                } else if (disc_key > highest_key) {
-                    start_page = current + 1;
-                } else {
-                    located_page = current;
-                    entry = search_page<DISCRIMINATOR_KEY>(p_page_buffer, ENTIRES_PER_PAGE, ENTRY_SIZE, disc_key);
-                    break;
-                }
-            }
-            
-            if (located_page == static_cast<uint16_t>(SEARCH_INVALID))
-            {
-                // Need to check the last page before giving up.
-                r_handle.read(start_address + PAGE_SIZE*(next_offset - 1), p_page_buffer, PAGE_SIZE);
-                for (uint16_t i = 0; i < ENTIRES_PER_PAGE; ++i)
-                {
-                    DISCRIMINATOR_KEY key;
-                    memcpy(&key, p_page_buffer + i * ENTRY_SIZE, sizeof(DISCRIMINATOR_KEY));
-                    if (disc_key == key) {
-                        entry = i;
-                        break;
-                    } else if (key == static_cast<DISCRIMINATOR_KEY>(INVALID_KEY)) {
-                        break;
-                    }
-                }
-            }
+            located_page = current;
+            entry = search_page<DISCRIMINATOR_KEY>(p_page_buffer, ENTIRES_PER_PAGE, ENTRY_SIZE, disc_key);
+            break;
+        }
+    }
 
-            if (entry == static_cast<uint16_t>(SEARCH_INVALID)) {
-                // The discrimator key could not be found.
-                rt = LUT_ERROR::BAD_DISCRIMINATOR_KEY;
-            } else {
-                const CRC8_t CRC = CRC_split(
-                    p_page_buffer + entry*ENTRY_SIZE,
-                    ENTRY_SIZE - sizeof(CRC8_t),
-                    CRC_split(
-                        reinterpret_cast<const char*>(&str_key),
-                        sizeof(STRUCTURE_KEY),
-                        init_crc
-                    )
-                );
-
-                // Cross reference computed CRC with the one saved.
-                CRC8_t SAVED_CRC;
-                memcpy(&SAVED_CRC, p_page_buffer + (entry + 1)*ENTRY_SIZE - sizeof(CRC8_t), sizeof(CRC8_t));
-
-                if (CRC != SAVED_CRC) {
-                    rt = LUT_ERROR::INVALID_ENTRY;
-                } else {
-                    // CRC was valid, so load configuration into memory.
-
-                    memcpy(p_payload, p_page_buffer + entry*ENTRY_SIZE + sizeof(DISCRIMINATOR_KEY),
-                        PAYLOAD_SIZE);
-                }
+    if (located_page == static_cast<uint16_t>(SEARCH_INVALID))
+    {
+        // Need to check the last page before giving up.
+        located_page = next_offset - 1;
+        r_handle.read(start_address + PAGE_SIZE*located_page, p_page_buffer, PAGE_SIZE);
+        for (uint16_t i = 0; i < ENTIRES_PER_PAGE; ++i)
+        {
+            DISCRIMINATOR_KEY key;
+            memcpy(&key, p_page_buffer + i * ENTRY_SIZE, sizeof(DISCRIMINATOR_KEY));
+            if (disc_key == key) {
+                entry = i;
+                break;
+            } else if (key == static_cast<DISCRIMINATOR_KEY>(INVALID_KEY)) {
+                break;
             }
         }
     }
 
-    vPortFree(p_page_buffer);
+    return (entry == static_cast<uint16_t>(SEARCH_INVALID)) ? NO_ENTRY
+        : start_address + PAGE_SIZE*located_page + ENTRY_SIZE*entry;
+}
 
-    return rt;
+template<typename STRUCTURE_KEY, typename DISCRIMINATOR_KEY>
+uint32_t LUT<STRUCTURE_KEY, DISCRIMINATOR_KEY>::find_entry_v2(const efs::handle& r_handle,
+    const DISCRIMINATOR_KEY disc_key, const uint32_t start_address, const uint16_t PAGE_SIZE,
+    const uint32_t ENTRY_SIZE, const uint16_t key_offset, const uint16_t next_offset,
+    char * const p_page_buffer)
+{
+    // The first page of the structure key is the fence page; the rest hold entries.
+    const uint16_t ENTRY_PAGES = next_offset - key_offset - 1;
+    const uint16_t FENCES_PER_PAGE = PAGE_SIZE / sizeof(DISCRIMINATOR_KEY);
+    if (next_offset <= key_offset + 1 || ENTRY_PAGES > FENCES_PER_PAGE)
+    {
+        return NO_ENTRY;
+    }
+
+    const uint32_t FENCE_BYTES = static_cast<uint32_t>(ENTRY_PAGES) * sizeof(DISCRIMINATOR_KEY);
+    if (r_handle.read(start_address + PAGE_SIZE*key_offset, p_page_buffer, FENCE_BYTES) != FENCE_BYTES)
+    {
+        return NO_ENTRY;
+    }
+
+    // Find the last entry page whose first key is not above the key.
+    int32_t start = 0;
+    int32_t end = static_cast<int32_t>(ENTRY_PAGES) - 1;
+    int32_t located = -1;
+    while (start <= end)
+    {
+        const int32_t current = (start + end) / 2;
+        DISCRIMINATOR_KEY fence;
+        memcpy(&fence, p_page_buffer + current * sizeof(DISCRIMINATOR_KEY), sizeof(DISCRIMINATOR_KEY));
+
+        if (fence <= disc_key) {
+            located = current;
+            start = current + 1;
+        } else {
+            end = current - 1;
+        }
+    }
+
+    if (located < 0)
+    {
+        return NO_ENTRY;
+    }
+
+    // Unused entries at the end of the last page are filled with INVALID_KEY, which sorts last.
+    const uint16_t PAGE = key_offset + 1 + static_cast<uint16_t>(located);
+    const uint32_t ENTIRES_PER_PAGE = PAGE_SIZE / ENTRY_SIZE;
+    r_handle.read(start_address + PAGE_SIZE*PAGE, p_page_buffer, PAGE_SIZE);
+    const uint16_t ENTRY = search_page<DISCRIMINATOR_KEY>(p_page_buffer, ENTIRES_PER_PAGE, ENTRY_SIZE, disc_key);
+
+    return (ENTRY == static_cast<uint16_t>(SEARCH_INVALID)) ? NO_ENTRY
+        : start_address + PAGE_SIZE*PAGE + ENTRY_SIZE*ENTRY;
 }
+
 #endif
 
 //EOF
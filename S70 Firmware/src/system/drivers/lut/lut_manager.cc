@@ -79,6 +79,10 @@ void lut_manager::set_lock(const bool locked)
 
         if (s_locked)
         {
+            // The files may have been rewritten while unlocked.
+            s_config_lut.invalidate_cache();
+            s_device_lut.invalidate_cache();
+
             for (slot_nums slot = SLOT_1; slot <= SLOT_8; ++slot)
             {
                 device_detect_reset(&slots[slot].device);
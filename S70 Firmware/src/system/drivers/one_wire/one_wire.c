@@ -12,11 +12,14 @@
 #include "../buffers/fifo.h"
 #include "delay.h"
 #include "Debugging.h"
+#include <string.h>
 
 /****************************************************************************
  * Private Data
  ****************************************************************************/
-
+/* One UART byte per one-wire bit of the transfer in progress, only used while
+ * holding xUART0_Semaphore. */
+static uint8_t ow_bits_s[OW_MAX_TRANSFER_BYTES * OW_UART_BYTES_PER_BYTE];
 
 /****************************************************************************
  * Function Prototypes
@@ -114,3 +117,58 @@ uint8_t ow_byte_rd(bool * const p_timed_out)
     return b;
 }
 
+/**
+ * @brief Writes bytes then reads bytes as one UART DMA block, rather than
+ * waiting on the UART once per byte.  Read slots are written as 1s, a device
+ * pulling the line low turns them into 0s.  The slot's reset and presence
+ * must already be done and UART0 set to OW_READ_WRITE_BAUD.
+ * The calling function must have xUART0_Semaphore.
+ *
+ * @param p_write	: Bytes to write first (command, address, data).
+ * @param p_read	: Where the bytes read after the written ones go.  May be
+ * NULL if read_length is 0.
+ * @return false if the transfer did not fit or the echo timed out.
+ */
+bool ow_transfer(const uint8_t * p_write, uint8_t write_length, uint8_t * p_read,
+		uint16_t read_length)
+{
+	const uint16_t BYTES = write_length + read_length;
+	if (BYTES > OW_MAX_TRANSFER_BYTES)
+	{
+		return false;
+	}
+
+	uint8_t * p_bits = ow_bits_s;
+	for (uint8_t i = 0; i < write_length; ++i)
+	{
+		uint8_t b = p_write[i];
+		for (uint8_t bit = 0; bit < 8; b >>= 1, ++bit)
+		{
+			*p_bits++ = (b & 1) ? 0xFF : 0x00;
+		}
+	}
+	memset(p_bits, 0xFF, read_length * OW_UART_BYTES_PER_BYTE);
+
+	/* Every UART byte takes 10 bit times, allow twice that plus two ticks.*/
+	const uint32_t BLOCK_MS = (uint32_t) BYTES * OW_UART_BYTES_PER_BYTE * 10
+			* 1000 / uart0.baudrate;
+	if (!uart0_transfer(ow_bits_s, BYTES * OW_UART_BYTES_PER_BYTE,
+			pdMS_TO_TICKS(2 * BLOCK_MS) + 2))
+	{
+		return false;
+	}
+
+	/* The bits are sent least significant first.*/
+	for (uint16_t i = 0; i < read_length; ++i)
+	{
+		p_bits = &ow_bits_s[(write_length + i) * OW_UART_BYTES_PER_BYTE];
+		uint8_t b = 0;
+		for (uint8_t bit = 0; bit < 8; ++bit)
+		{
+			b |= ((p_bits[bit] == 0xFF) ? 1 : 0) << bit;
+		}
+		p_read[i] = b;
+	}
+
+	return true;
+}
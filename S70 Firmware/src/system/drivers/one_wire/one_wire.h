@@ -15,6 +15,11 @@ extern "C" {
 /****************************************************************************
  * Defines
  ****************************************************************************/
+/* Each one-wire bit is one UART byte (0xFF for a 1, 0x00 for a 0). */
+#define OW_UART_BYTES_PER_BYTE			8
+
+/* The most one-wire bytes (written and read) in one ow_transfer. */
+#define OW_MAX_TRANSFER_BYTES			(UART0_DMA_BUFFER_SIZE / OW_UART_BYTES_PER_BYTE)
 
 /****************************************************************************
  * Public Data
@@ -24,6 +29,8 @@ extern "C" {
  ************************************************************************************/
 void ow_byte_wr(uint8_t b);
 uint8_t ow_byte_rd(bool * const p_timed_out);
+bool ow_transfer(const uint8_t * p_write, uint8_t write_length, uint8_t * p_read,
+		uint16_t read_length);
 
 #ifdef __cplusplus
 }
@@ -5,7 +5,9 @@
 
 #include "Debugging.h"
 #include "FreeRTOS.h"
+#include "rt_bridge.h"
 #include "semphr.h"
+#include "spi_bridge_crc.h"
 #include "spi_bridge_protocol.h"
 #include "user_spi.h"
 #include "sys_task.h"
@@ -13,7 +15,6 @@
 bool load_rt_hex = false;
 
 #define RT_UPDATE_PAGE_SIZE 256U
-#define RT_UPDATE_SECTOR_SIZE 4096U
 
 #define RT_UPDATE_ADDR_MIN 0x70000000UL
 #define RT_UPDATE_ADDR_MAX 0x70400000UL
@@ -22,6 +23,10 @@ bool load_rt_hex = false;
 #define RT_UPDATE_RETRY_MAX 3U
 #define RT_UPDATE_SPI_MAX_SIZE (RT_UPDATE_PAGE_SIZE + 16U)
 
+/* How long a streamed sector may wait for a free RT1064 buffer, and how long
+ * the last sectors may take to be written before finalizing. */
+#define RT_UPDATE_STREAM_TIMEOUT pdMS_TO_TICKS(2000)
+
 typedef enum {
     RT_UPDATE_STATE_IDLE = 0,
     RT_UPDATE_STATE_STREAMING,
@@ -32,11 +37,13 @@ typedef enum {
 typedef struct {
     rt_update_state_t state;
     uint32_t upper16;
-    uint32_t current_page_base;
     uint32_t current_sector_base;
-    bool page_dirty;
-    bool sector_valid;
-    uint8_t page_buffer[RT_UPDATE_PAGE_SIZE];
+    bool sector_dirty;
+    /* The RT1064 takes whole sectors with WRITE_SECTOR, older bridges are
+     * written a page at a time.*/
+    bool streaming;
+    uint16_t sectors_sent;
+    uint8_t sector_buffer[RT_UPDATE_SECTOR_SIZE];
     size_t line_length;
     char line_buffer[RT_UPDATE_LINE_MAX];
     bool saw_eof;
@@ -132,72 +139,64 @@ static bool rt_update_address_valid(uint32_t address) {
     return (address >= RT_UPDATE_ADDR_MIN) && (address < RT_UPDATE_ADDR_MAX);
 }
 
-static void rt_update_fill_page(void) {
-    (void)memset(s_rt_update.page_buffer, 0xFF,
-                 sizeof(s_rt_update.page_buffer));
+static void rt_update_fill_sector(void) {
+    (void)memset(s_rt_update.sector_buffer, 0xFF,
+                 sizeof(s_rt_update.sector_buffer));
 }
 
 static uint32_t rt_update_align_down(uint32_t value, uint32_t align) {
     return value - (value % align);
 }
 
-static bool rt_update_spi_exchange(const uint8_t* tx, uint8_t* rx,
-                                   uint16_t length) {
-    if (length == 0U) {
-        return true;
-    }
-
-    uint8_t buffer[RT_UPDATE_SPI_MAX_SIZE];
-    if (length > sizeof(buffer)) {
-        return false;
-    }
-
-    memcpy(buffer, tx, length);
-    spi_status_t status = spi_transfer(_SPI_MODE_0, true, CS_NO_TOGGLE,
-                                       CS_RT_UPDATE, buffer, length);
-    if (status != SPI_OK) {
-        return false;
-    }
-
-    if (rx != NULL) {
-        memcpy(rx, buffer, length);
-    }
-    return true;
-}
-
+/**
+ * @brief Sends an update command and reads its status byte and reply, in one
+ * chip select.  The RT1064 arms its DMA for the payload once it has read the
+ * header, and only loads the status once it has run the command, so both are
+ * preceded by RT_BRIDGE_TURNAROUND_US.
+ *
+ * @return true if the status byte was RT_UPDATE_STATUS_OK.
+ */
 static bool rt_update_send_command(uint8_t command, const uint8_t* payload,
                                    uint16_t payload_length, uint8_t* response,
                                    uint16_t response_length) {
-    uint8_t header[2];
     uint8_t tx[RT_UPDATE_SPI_MAX_SIZE];
     uint8_t rx[RT_UPDATE_SPI_MAX_SIZE];
 
-    uint16_t status_index = (uint16_t)(payload_length + 2U);
-    uint16_t extra_length = 0U;
-    if (response_length > 1U) {
-        extra_length = (uint16_t)(response_length - 1U);
-    }
+    const uint16_t REQUEST_LENGTH = (uint16_t)(payload_length + 3U);
+    const uint16_t REPLY_LENGTH =
+        (response_length > 1U) ? response_length : 1U;
 
-    uint16_t total = (uint16_t)(status_index + 1U + extra_length);
-    if (total > sizeof(tx)) {
+    if ((REQUEST_LENGTH > sizeof(tx)) || (REPLY_LENGTH > sizeof(rx))) {
         return false;
     }
 
-    header[0] = command;
-    header[1] = (uint8_t)payload_length;
-
-    tx[0] = header[0];
-    tx[1] = header[1];
+    tx[0] = SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_UPDATE, 0);
+    tx[1] = command;
+    tx[2] = (uint8_t)payload_length;
     if (payload_length > 0U) {
-        (void)memcpy(&tx[2], payload, payload_length);
+        (void)memcpy(&tx[3], payload, payload_length);
     }
-    (void)memset(&tx[2U + payload_length], 0x00, total - (payload_length + 2U));
+    (void)memset(rx, 0x00, REPLY_LENGTH);
+
+    bool ok = false;
 
     if (xSPI_Semaphore != NULL) {
         xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
     }
 
-    bool ok = rt_update_spi_exchange(tx, rx, total);
+    if (spi_start_transfer(_SPI_MODE_0, CS_NO_TOGGLE, CS_RT_UPDATE) == SPI_OK) {
+        rt_bridge_set_clock(true);
+        ok = spi_partial_write_array(tx, 3U) == SPI_OK;
+        delay_us(RT_BRIDGE_TURNAROUND_US);
+        if (payload_length > 0U) {
+            ok = ok && (spi_partial_write_array(&tx[3], payload_length) ==
+                        SPI_OK);
+            delay_us(RT_BRIDGE_TURNAROUND_US);
+        }
+        ok = ok && (spi_partial_transfer_array(rx, REPLY_LENGTH) == SPI_OK);
+        ok = (spi_end_transfer() == SPI_OK) && ok;
+        rt_bridge_set_clock(false);
+    }
 
     if (xSPI_Semaphore != NULL) {
         xSemaphoreGive(xSPI_Semaphore);
@@ -207,15 +206,11 @@ static bool rt_update_send_command(uint8_t command, const uint8_t* payload,
         return false;
     }
 
-    uint8_t status = rx[status_index];
     if ((response != NULL) && (response_length > 0U)) {
-        response[0] = status;
-        if (response_length > 1U) {
-            memcpy(&response[1], &rx[status_index + 1U], response_length - 1U);
-        }
+        memcpy(response, rx, response_length);
     }
 
-    return status == RT_UPDATE_STATUS_OK;
+    return rx[0] == RT_UPDATE_STATUS_OK;
 }
 
 static bool rt_update_enter_update_mode(void) {
@@ -273,77 +268,217 @@ static bool rt_update_read_back(uint32_t base_address, uint8_t* buffer) {
     return false;
 }
 
-static bool rt_update_flush_page(USB_Slave_Message* slave_message) {
-    if (!s_rt_update.page_dirty) {
-        return true;
-    }
+/**
+ * @brief Sends a sector with WRITE_SECTOR, the header and data in one chip
+ * select.  The RT1064 answers ERR_BUSY while it is still writing the two
+ * sectors before it.
+ *
+ * As with rt_update_send_command(), each phase the RT1064 has to arm a DMA
+ * for, and the status it only loads once the sector is queued, are preceded
+ * by RT_BRIDGE_TURNAROUND_US.  The frame runs at the
+ * bridge's fast clock where the bridge supports it, to keep the SPI lock
+ * short for the other devices on the bus.
+ *
+ * @return The status byte from the RT1064.
+ */
+static uint8_t rt_update_send_sector(uint32_t base_address, uint32_t crc) {
+    uint8_t header[3 + RT_UPDATE_SECTOR_HEADER_LENGTH];
+    const uint16_t LENGTH = RT_UPDATE_SECTOR_SIZE;
+
+    header[0] = SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_UPDATE, 0);
+    header[1] = RT_UPDATE_CMD_WRITE_SECTOR;
+    header[2] = RT_UPDATE_SECTOR_HEADER_LENGTH;
+    memcpy(&header[3], &base_address, sizeof(base_address));
+    memcpy(&header[7], &LENGTH, sizeof(LENGTH));
+    memcpy(&header[9], &crc, sizeof(crc));
+
+    uint8_t status = RT_UPDATE_STATUS_ERR_PROGRAM;
 
-    if (!rt_update_address_valid(s_rt_update.current_page_base)) {
-        return false;
+    if (xSPI_Semaphore != NULL) {
+        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
     }
 
-    uint32_t sector_base = rt_update_align_down(s_rt_update.current_page_base,
-                                                RT_UPDATE_SECTOR_SIZE);
-    if ((!s_rt_update.sector_valid) ||
-        (sector_base != s_rt_update.current_sector_base)) {
-        if (!rt_update_erase_sector(sector_base)) {
-            return false;
+    if (spi_start_transfer(_SPI_MODE_0, CS_NO_TOGGLE, CS_RT_UPDATE) == SPI_OK) {
+        rt_bridge_set_clock(true);
+        bool ok = spi_partial_write_array(header, 3U) == SPI_OK;
+        delay_us(RT_BRIDGE_TURNAROUND_US);
+        ok = ok && (spi_partial_write_array(&header[3],
+                                            RT_UPDATE_SECTOR_HEADER_LENGTH) ==
+                    SPI_OK);
+        delay_us(RT_BRIDGE_TURNAROUND_US);
+        ok = ok && (spi_partial_write_array(s_rt_update.sector_buffer,
+                                            LENGTH) == SPI_OK);
+        delay_us(RT_BRIDGE_TURNAROUND_US);
+        ok = ok && (spi_partial_transfer(&status) == SPI_OK);
+        if (!ok) {
+            status = RT_UPDATE_STATUS_ERR_PROGRAM;
         }
-        s_rt_update.current_sector_base = sector_base;
-        s_rt_update.sector_valid = true;
+        (void)spi_end_transfer();
+        rt_bridge_set_clock(false);
     }
 
-    if (!rt_update_program_page(s_rt_update.current_page_base,
-                                s_rt_update.page_buffer)) {
-        return false;
+    if (xSPI_Semaphore != NULL) {
+        xSemaphoreGive(xSPI_Semaphore);
     }
 
-    uint8_t verify[RT_UPDATE_PAGE_SIZE];
-    if (!rt_update_read_back(s_rt_update.current_page_base, verify)) {
+    return status;
+}
+
+/**
+ * @brief Asks the RT1064 how far it has got with the queued sectors.
+ *
+ * @return false if a sector failed or the RT1064 did not answer.
+ */
+static bool rt_update_query(uint16_t* sectors_done) {
+    uint8_t response[1 + RT_UPDATE_QUERY_REPLY_LENGTH] = {RT_UPDATE_STATUS_OK};
+
+    if (!rt_update_send_command(RT_UPDATE_CMD_QUERY, NULL, 0U, response,
+                                sizeof(response))) {
+        if (response[0] != RT_UPDATE_STATUS_OK) {
+            uint32_t address;
+            memcpy(&address, &response[4], sizeof(address));
+            debug_print("RT update: sector 0x%08lx failed (%d)\r\n",
+                        (unsigned long)address, response[0]);
+        }
         return false;
     }
 
-    if (memcmp(verify, s_rt_update.page_buffer, RT_UPDATE_PAGE_SIZE) != 0) {
-        debug_print("RT update verify mismatch at 0x%08lx\r\n",
-                    (unsigned long)s_rt_update.current_page_base);
-        return false;
+    memcpy(sectors_done, &response[2], sizeof(*sectors_done));
+    return true;
+}
+
+/**
+ * @brief Streams the sector buffer.  The RT1064 verifies it against the
+ * CRC-32 on its own; a failure is picked up by the next query.
+ */
+static bool rt_update_stream_sector(void) {
+    const uint32_t CRC = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT,
+                                          s_rt_update.sector_buffer,
+                                          RT_UPDATE_SECTOR_SIZE);
+    const TickType_t START = xTaskGetTickCount();
+
+    for (;;) {
+        const uint8_t STATUS =
+            rt_update_send_sector(s_rt_update.current_sector_base, CRC);
+        if (STATUS == RT_UPDATE_STATUS_OK) {
+            ++s_rt_update.sectors_sent;
+            return true;
+        }
+        if (STATUS != RT_UPDATE_STATUS_ERR_BUSY) {
+            return false;
+        }
+
+        /* Both buffers are being written, check none of them failed.*/
+        uint16_t sectors_done;
+        if (!rt_update_query(&sectors_done) ||
+            (xTaskGetTickCount() - START) > RT_UPDATE_STREAM_TIMEOUT) {
+            return false;
+        }
+        vTaskDelay(1);
+        wdt_restart(WDT);
     }
+}
 
-    s_rt_update.page_dirty = false;
-    (void)slave_message;
+static bool rt_update_page_erased(const uint8_t* page) {
+    for (uint32_t i = 0; i < RT_UPDATE_PAGE_SIZE; ++i) {
+        if (page[i] != 0xFF) {
+            return false;
+        }
+    }
     return true;
 }
 
-static bool rt_update_handle_data(uint32_t address, const uint8_t* data,
-                                  uint8_t length,
-                                  USB_Slave_Message* slave_message) {
-    if (!rt_update_address_valid(address)) {
+/**
+ * @brief Writes the sector buffer a page at a time, for bridges without
+ * WRITE_SECTOR.
+ */
+static bool rt_update_write_sector_paged(void) {
+    const uint32_t BASE = s_rt_update.current_sector_base;
+
+    if (!rt_update_erase_sector(BASE)) {
         return false;
     }
 
-    uint32_t page_base = rt_update_align_down(address, RT_UPDATE_PAGE_SIZE);
-    if (page_base != s_rt_update.current_page_base) {
-        if (!rt_update_flush_page(slave_message)) {
+    for (uint32_t offset = 0; offset < RT_UPDATE_SECTOR_SIZE;
+         offset += RT_UPDATE_PAGE_SIZE) {
+        const uint8_t* const PAGE = &s_rt_update.sector_buffer[offset];
+        uint8_t verify[RT_UPDATE_PAGE_SIZE];
+
+        /* Pages no record touched are left erased.*/
+        if (rt_update_page_erased(PAGE)) {
+            continue;
+        }
+
+        if (!rt_update_program_page(BASE + offset, PAGE) ||
+            !rt_update_read_back(BASE + offset, verify)) {
+            return false;
+        }
+
+        if (memcmp(verify, PAGE, RT_UPDATE_PAGE_SIZE) != 0) {
+            debug_print("RT update verify mismatch at 0x%08lx\r\n",
+                        (unsigned long)(BASE + offset));
             return false;
         }
+    }
+    return true;
+}
 
-        s_rt_update.current_page_base = page_base;
-        rt_update_fill_page();
+static bool rt_update_flush_sector(void) {
+    if (!s_rt_update.sector_dirty) {
+        return true;
     }
 
-    uint32_t offset = address - page_base;
-    if ((offset + length) > RT_UPDATE_PAGE_SIZE) {
+    if (!rt_update_address_valid(s_rt_update.current_sector_base)) {
         return false;
     }
 
-    memcpy(&s_rt_update.page_buffer[offset], data, length);
-    s_rt_update.page_dirty = true;
+    const bool OK = s_rt_update.streaming ? rt_update_stream_sector()
+                                          : rt_update_write_sector_paged();
+    s_rt_update.sector_dirty = false;
+    return OK;
+}
+
+/**
+ * @brief Copies a data record into the sector buffer, sending the buffer
+ * whenever the record moves on to another sector.
+ */
+static bool rt_update_handle_data(uint32_t address, const uint8_t* data,
+                                  uint8_t length) {
+    while (length > 0U) {
+        if (!rt_update_address_valid(address)) {
+            return false;
+        }
+
+        const uint32_t SECTOR_BASE =
+            rt_update_align_down(address, RT_UPDATE_SECTOR_SIZE);
+        if (SECTOR_BASE != s_rt_update.current_sector_base) {
+            if (!rt_update_flush_sector()) {
+                return false;
+            }
+
+            s_rt_update.current_sector_base = SECTOR_BASE;
+            rt_update_fill_sector();
+        }
+
+        const uint32_t OFFSET = address - SECTOR_BASE;
+        uint32_t chunk = RT_UPDATE_SECTOR_SIZE - OFFSET;
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        memcpy(&s_rt_update.sector_buffer[OFFSET], data, chunk);
+        s_rt_update.sector_dirty = true;
+
+        address += chunk;
+        data += chunk;
+        length = (uint8_t)(length - chunk);
+    }
     return true;
 }
 
 static void rt_update_reset_state(void) {
     (void)memset(&s_rt_update, 0, sizeof(s_rt_update));
-    rt_update_fill_page();
+    rt_update_fill_sector();
 }
 
 void rt_firmware_update_start(USB_Slave_Message* slave_message) {
@@ -359,6 +494,8 @@ void rt_firmware_update_start(USB_Slave_Message* slave_message) {
         return;
     }
 
+    s_rt_update.streaming =
+        rt_bridge_protocol_version() >= SPI_BRIDGE_VERSION_STREAM_UPDATE;
     s_rt_update.state = RT_UPDATE_STATE_STREAMING;
     load_rt_hex = true;
 }
@@ -371,10 +508,26 @@ void rt_firmware_update_abort(USB_Slave_Message* slave_message) {
 }
 
 static bool rt_update_finalize(USB_Slave_Message* slave_message) {
-    if (!rt_update_flush_page(slave_message)) {
+    (void)slave_message;
+    if (!rt_update_flush_sector()) {
         return false;
     }
 
+    /* Wait for the RT1064 to write and verify the sectors still queued.*/
+    if (s_rt_update.streaming) {
+        const TickType_t START = xTaskGetTickCount();
+        uint16_t sectors_done = 0;
+        do {
+            if (!rt_update_query(&sectors_done) ||
+                (xTaskGetTickCount() - START) > RT_UPDATE_STREAM_TIMEOUT) {
+                return false;
+            }
+            if (sectors_done != s_rt_update.sectors_sent) {
+                vTaskDelay(1);
+            }
+        } while (sectors_done != s_rt_update.sectors_sent);
+    }
+
     if (!rt_update_send_command(RT_UPDATE_CMD_FINALIZE_AND_REBOOT, NULL, 0U,
                                 NULL, 0U)) {
         return false;
@@ -385,6 +538,7 @@ static bool rt_update_finalize(USB_Slave_Message* slave_message) {
 
 static bool rt_update_process_line(const char* line, size_t length,
                                    USB_Slave_Message* slave_message) {
+    (void)slave_message;
     uint8_t data[RT_UPDATE_PAGE_SIZE];
     uint8_t data_len = 0;
     uint16_t offset = 0;
@@ -399,8 +553,7 @@ static bool rt_update_process_line(const char* line, size_t length,
     switch (record_type) {
         case 0x00: {
             uint32_t address = (s_rt_update.upper16 << 16U) | offset;
-            return rt_update_handle_data(address, data, data_len,
-                                         slave_message);
+            return rt_update_handle_data(address, data, data_len);
         }
         case 0x01:
             s_rt_update.saw_eof = true;
@@ -8,6 +8,8 @@
  */
 #include "spi-transfer-handle.hh"
 
+#include "spi-scheduler.hh"
+
 using namespace drivers::spi;
 
 /*****************************************************************************
@@ -80,12 +82,32 @@ void handle_factory::acquire_lock() {
         return;
     }
 
+    // xSPI_Semaphore is not recursive; see spi-scheduler.hh.
+    configASSERT(!service::spi_scheduler::holds_bus_mutex());
+    service::spi_scheduler::acquire_lease();
     xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
     _owns_lock = true;
 }
 bool handle_factory::acquire_lock(TickType_t timeout) {
-    if (!has_lock()) {
-        _owns_lock = xSemaphoreTake(xSPI_Semaphore, timeout) == pdTRUE;
+    if (has_lock()) {
+        return true;
+    }
+
+    configASSERT(!service::spi_scheduler::holds_bus_mutex());
+    const TickType_t START = xTaskGetTickCount();
+    if (!service::spi_scheduler::acquire_lease(timeout)) {
+        return false;
+    }
+
+    // The lease may have used part of the timeout.
+    const TickType_t ELAPSED = xTaskGetTickCount() - START;
+    const TickType_t REMAINING =
+        (timeout == portMAX_DELAY) ? portMAX_DELAY
+        : (ELAPSED < timeout)      ? timeout - ELAPSED
+                                   : 0;
+    _owns_lock = xSemaphoreTake(xSPI_Semaphore, REMAINING) == pdTRUE;
+    if (!_owns_lock) {
+        service::spi_scheduler::release_lease();
     }
 
     return has_lock();
@@ -96,18 +118,20 @@ void handle_factory::release_lock() {
     }
 
     xSemaphoreGive(xSPI_Semaphore);
+    service::spi_scheduler::release_lease();
+    _owns_lock = false;
 }
 
-handle_factory::handle_factory() : _owns_lock(true) {
-    xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-}
+handle_factory::handle_factory() : _owns_lock(false) { acquire_lock(); }
 
 handle_factory::handle_factory(std::defer_lock_t) : _owns_lock(false) {}
 
 handle_factory::handle_factory(std::adopt_lock_t) : _owns_lock(true) {}
 
 handle_factory::handle_factory(std::try_to_lock_t, TickType_t lock_timeout)
-    : _owns_lock(xSemaphoreTake(xSPI_Semaphore, lock_timeout) == pdTRUE) {}
+    : _owns_lock(false) {
+    acquire_lock(lock_timeout);
+}
 
 handle_factory::handle_factory(handle_factory &&other)
     : _owns_lock(other._owns_lock) {
@@ -143,6 +167,7 @@ transfer_handle::~transfer_handle() { end_transfer_lifetime(); }
 locking_transfer_handle::~locking_transfer_handle() {
     if (end_transfer_lifetime()) {
         xSemaphoreGive(_lock);
+        service::spi_scheduler::release_lease();
     }
 }
 /*****************************************************************************
@@ -160,6 +185,7 @@ bool transfer_handle::end_transfer_lifetime() {
 
 locking_transfer_handle
 locking_transfer_handle::create(SemaphoreHandle_t lock) {
+    service::spi_scheduler::acquire_lease();
     xSemaphoreTake(lock, portMAX_DELAY);
     return locking_transfer_handle(lock, std::adopt_lock);
 }
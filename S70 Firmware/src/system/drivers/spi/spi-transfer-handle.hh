@@ -24,6 +24,8 @@ class locking_transfer_handle;
 
 /**
  * A thread-safe factory for transfer_handles.
+ * Owning the lock means holding both a bus lease from the SPI scheduler
+ * service (see spi-scheduler.hh) and xSPI_Semaphore.
  */
 class handle_factory {
   public:
@@ -114,9 +116,16 @@ class handle_factory {
 class transfer_handle {
   public:
     void write(std::byte value);
+
+    /// \brief Writes the buffer.
+    /// Buffers of at least SPI_DMA_MIN_TRANSFER_SIZE bytes on a non-toggling
+    /// handle are sent by DMA; the calling task sleeps until it completes.
     void write(std::span<const std::byte> buffer);
 
     std::byte transfer(std::byte value);
+
+    /// \brief Transfers the buffer in place.
+    /// Uses DMA under the same conditions as write(std::span).
     void transfer(std::span<std::byte> buffer);
 
     explicit transfer_handle(const transfer_handle &) = delete;
@@ -4,6 +4,11 @@
 #include "Debugging.h"
 #include <pins.h>
 #include "user_spi.h"
+#include "task.h"
+#include "xdmac.h"
+#include "user_usart.h"
+
+#include <string.h>
 
 // TODO Temp
 #include "delay.h"
@@ -22,13 +27,41 @@ SemaphoreHandle_t xSPI_Semaphore = NULL; // removed STATIC to allow other proces
 static bool spi0_toggle_s;
 static uint8_t spi0_current_cs_s;
 
+/* Given by the XDMAC interrupt when the RX channel finishes its block. */
+static SemaphoreHandle_t spi0_dma_done_s = NULL;
+
+/* The D-cache is enabled, so the XDMAC only ever touches this buffer (aligned
+ * and sized to whole cache lines) instead of caller memory. */
+COMPILER_ALIGNED(32) static uint8_t spi0_dma_buffer_s[SPI_DMA_BUFFER_SIZE];
+
+/* Sink for the RX channel on write-only transfers. */
+static uint8_t spi0_dma_discard_s;
+
 /****************************************************************************
  * Function Prototypes
  ****************************************************************************/
+static bool _can_use_dma(uint32_t size);
+static spi_status_t _dma_transfer_array(const uint8_t *tx, uint8_t *rx, uint32_t size);
 
 /****************************************************************************
  * Interrupt Handler
  ****************************************************************************/
+/**
+ * @brief Wakes the task waiting on an SPI0 DMA transfer once all bytes have
+ * been clocked back in.  UART0 shares the interrupt.
+ */
+ISR(XDMAC_Handler)
+{
+	BaseType_t higherPriorityTaskAwoken = pdFALSE;
+
+	if (xdmac_channel_get_interrupt_status(XDMAC, SPI_XDMA_RX_CH) & XDMAC_CIS_BIS)
+	{
+		xSemaphoreGiveFromISR(spi0_dma_done_s, &higherPriorityTaskAwoken);
+	}
+	uart0_dma_handler(&higherPriorityTaskAwoken);
+
+	portYIELD_FROM_ISR(higherPriorityTaskAwoken);
+}
 
 /****************************************************************************
  * Private Functions
@@ -343,6 +376,140 @@ __STATIC_INLINE bool _read(uint8_t *rx_data)
 	return SPI_OK;
 }
 
+static void _dma_init(void)
+{
+	spi0_dma_done_s = xSemaphoreCreateBinary();
+	configASSERT(spi0_dma_done_s != NULL);
+	NameQueueObject(spi0_dma_done_s, "SPI0 DMA");
+
+	pmc_enable_periph_clk(ID_XDMAC);
+	xdmac_channel_disable(XDMAC, SPI_XDMA_TX_CH);
+	xdmac_channel_disable(XDMAC, SPI_XDMA_RX_CH);
+	xdmac_enable_interrupt(XDMAC, SPI_XDMA_RX_CH);
+
+	/* must set the interrupt priority lower priority than
+	 * configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY*/
+	irq_register_handler(XDMAC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1);
+}
+
+/**
+ * @brief The DMA path is only worth its setup cost for larger transfers, cannot
+ * toggle the chip select between bytes, and needs to block on the scheduler.
+ */
+static bool _can_use_dma(uint32_t size)
+{
+	return !spi0_toggle_s
+		&& size >= SPI_DMA_MIN_TRANSFER_SIZE
+		&& spi0_dma_done_s != NULL
+		&& __get_IPSR() == 0
+		&& xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+/**
+ * @brief Moves one chunk (at most SPI_DMA_BUFFER_SIZE bytes) through the DMA
+ * buffer.  The calling task sleeps until the RX channel completes.
+ *
+ * @param size	: The number of bytes in the chunk.
+ * @param read	: If the received bytes should be kept in the DMA buffer.
+ */
+static spi_status_t _dma_transfer_chunk(uint32_t size, bool read)
+{
+	uint32_t timeout = SPI_TIMEOUT;
+
+	/* Let any polled byte finish, then drop its stale received byte so the RX
+	 channel does not pick it up as the first byte of this chunk. */
+	while (!(SPI0->SPI_SR & SPI_SR_TXEMPTY))
+	{
+		if (!timeout--)
+		{
+			return SPI_ERROR_TIMEOUT;
+		}
+	}
+	(void) SPI0->SPI_RDR;
+	xSemaphoreTake(spi0_dma_done_s, 0);
+
+	xdmac_channel_config_t cfg = {0};
+
+	/* RX: SPI0_RDR -> buffer (or the discard byte) */
+	cfg.mbr_ubc = XDMAC_CUBC_UBLEN(size);
+	cfg.mbr_sa = (uint32_t) &SPI0->SPI_RDR;
+	cfg.mbr_da = read ? (uint32_t) spi0_dma_buffer_s : (uint32_t) &spi0_dma_discard_s;
+	cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN | XDMAC_CC_MBSIZE_SINGLE | XDMAC_CC_DSYNC_PER2MEM
+		| XDMAC_CC_CSIZE_CHK_1 | XDMAC_CC_DWIDTH_BYTE | XDMAC_CC_SIF_AHB_IF1
+		| XDMAC_CC_DIF_AHB_IF0 | XDMAC_CC_SAM_FIXED_AM
+		| (read ? XDMAC_CC_DAM_INCREMENTED_AM : XDMAC_CC_DAM_FIXED_AM)
+		| XDMAC_CC_PERID(XDAMC_CHANNEL_HWID_SPI0_RX);
+	xdmac_configure_transfer(XDMAC, SPI_XDMA_RX_CH, &cfg);
+	xdmac_channel_set_descriptor_control(XDMAC, SPI_XDMA_RX_CH, 0);
+	xdmac_channel_enable_interrupt(XDMAC, SPI_XDMA_RX_CH, XDMAC_CIE_BIE);
+
+	/* TX: buffer -> SPI0_TDR */
+	cfg.mbr_sa = (uint32_t) spi0_dma_buffer_s;
+	cfg.mbr_da = (uint32_t) &SPI0->SPI_TDR;
+	cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN | XDMAC_CC_MBSIZE_SINGLE | XDMAC_CC_DSYNC_MEM2PER
+		| XDMAC_CC_CSIZE_CHK_1 | XDMAC_CC_DWIDTH_BYTE | XDMAC_CC_SIF_AHB_IF0
+		| XDMAC_CC_DIF_AHB_IF1 | XDMAC_CC_SAM_INCREMENTED_AM | XDMAC_CC_DAM_FIXED_AM
+		| XDMAC_CC_PERID(XDAMC_CHANNEL_HWID_SPI0_TX);
+	xdmac_configure_transfer(XDMAC, SPI_XDMA_TX_CH, &cfg);
+	xdmac_channel_set_descriptor_control(XDMAC, SPI_XDMA_TX_CH, 0);
+
+	SCB_CleanDCache_by_Addr((uint32_t *) spi0_dma_buffer_s, sizeof(spi0_dma_buffer_s));
+
+	/* RX first so no received byte is missed. */
+	xdmac_channel_enable(XDMAC, SPI_XDMA_RX_CH);
+	xdmac_channel_enable(XDMAC, SPI_XDMA_TX_CH);
+
+	if (xSemaphoreTake(spi0_dma_done_s, SPI_DMA_TIMEOUT) != pdTRUE)
+	{
+		xdmac_channel_disable(XDMAC, SPI_XDMA_TX_CH);
+		xdmac_channel_disable(XDMAC, SPI_XDMA_RX_CH);
+		xdmac_channel_disable_interrupt(XDMAC, SPI_XDMA_RX_CH, XDMAC_CIE_BIE);
+		return SPI_ERROR_TIMEOUT;
+	}
+	xdmac_channel_disable_interrupt(XDMAC, SPI_XDMA_RX_CH, XDMAC_CIE_BIE);
+
+	if (read)
+	{
+		SCB_InvalidateDCache_by_Addr((uint32_t *) spi0_dma_buffer_s, sizeof(spi0_dma_buffer_s));
+	}
+
+	return SPI_OK;
+}
+
+/**
+ * @brief Transfers an array through the DMA buffer one chunk at a time.
+ *
+ * @param tx	: The bytes to send.
+ * @param rx	: Where to put the received bytes, or NULL to discard them.
+ * @param size	: The number of bytes to transfer.
+ */
+static spi_status_t _dma_transfer_array(const uint8_t *tx, uint8_t *rx, uint32_t size)
+{
+	while (size > 0)
+	{
+		const uint32_t CHUNK = size < SPI_DMA_BUFFER_SIZE ? size : SPI_DMA_BUFFER_SIZE;
+
+		memcpy(spi0_dma_buffer_s, tx, CHUNK);
+
+		const spi_status_t RT = _dma_transfer_chunk(CHUNK, rx != NULL);
+		if (RT != SPI_OK)
+		{
+			return RT;
+		}
+
+		if (rx != NULL)
+		{
+			memcpy(rx, spi0_dma_buffer_s, CHUNK);
+			rx += CHUNK;
+		}
+
+		tx += CHUNK;
+		size -= CHUNK;
+	}
+
+	return SPI_OK;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -380,6 +547,11 @@ void user_spi_init(void)
 		        NameQueueObject(xSPI_Semaphore, "SPI0 L");
 		}
 	}
+
+	if (spi0_dma_done_s == NULL)
+	{
+		_dma_init();
+	}
 }
 
 /**
@@ -459,6 +631,10 @@ spi_status_t spi_partial_transfer(uint8_t* inout) {
 }
 
 spi_status_t spi_partial_write_array(const uint8_t *buf, uint32_t size) {
+	if (_can_use_dma(size)) {
+		return _dma_transfer_array(buf, NULL, size);
+	}
+
 	const uint8_t * const END = buf + size;
 
 	for (; buf != END; ++buf)
@@ -474,6 +650,10 @@ spi_status_t spi_partial_write_array(const uint8_t *buf, uint32_t size) {
 }
 
 spi_status_t spi_partial_transfer_array(uint8_t *buf, uint32_t size) {
+	if (_can_use_dma(size)) {
+		return _dma_transfer_array(buf, buf, size);
+	}
+
 	const uint8_t * const END = buf + size;
 
 	for (; buf != END; ++buf)
@@ -49,6 +49,19 @@ typedef enum
 #define SPI_NO_READ		0
 #define SPI_READ		1
 
+/* Non-toggling transfers of at least this many bytes are moved by the XDMAC. */
+#define SPI_DMA_MIN_TRANSFER_SIZE	8
+
+/* Size of the cache-aligned buffer the XDMAC transfers through (multiple of 32). */
+#define SPI_DMA_BUFFER_SIZE			512
+
+/* XDMAC channels reserved for SPI0 (channel 0 is reserved for the FTDI UART). */
+#define SPI_XDMA_TX_CH				1
+#define SPI_XDMA_RX_CH				2
+
+/* Time to wait on a DMA completion before the transfer is aborted. */
+#define SPI_DMA_TIMEOUT				pdMS_TO_TICKS(20)
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -0,0 +1,133 @@
+// period_monitor.cc
+
+/**************************************************************************//**
+ * \file period_monitor.cc
+ *****************************************************************************/
+
+#include "period_monitor.hh"
+#include "task.h"
+#include <asf.h>
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Private Function Prototypes
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+
+/******************************************************************************
+ * Interrupt Handlers
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+period_monitor::period_monitor(TickType_t period, slot_nums slot)
+    : _period(period), _SLOT(slot), _active(false), _started(0),
+      _started_cycles(0), _worst_lateness(0), _overruns(0),
+      _average_us_x8(0), _window{0, 0}
+{}
+
+void period_monitor::start()
+{
+    const TickType_t NOW = xTaskGetTickCount();
+
+    if (_active)
+    {
+        // Passes may be woken early; only a late start counts.
+        const TickType_t SINCE_LAST = NOW - _started;
+        if (SINCE_LAST > _period)
+        {
+            const TickType_t LATENESS = SINCE_LAST - _period;
+            if (LATENESS > _worst_lateness)
+            {
+                _worst_lateness = LATENESS;
+            }
+            if (LATENESS > _window.worst_lateness)
+            {
+                _window.worst_lateness = LATENESS;
+            }
+        }
+    }
+
+    _started = NOW;
+    _started_cycles = DWT->CYCCNT;
+    _active = true;
+}
+
+void period_monitor::stop()
+{
+    const uint32_t CYCLES_PER_US = sysclk_get_cpu_hz() / 1000000;
+    const uint32_t EXECUTION_US = (DWT->CYCCNT - _started_cycles) / CYCLES_PER_US;
+
+    _average_us_x8 += EXECUTION_US - _average_us_x8 / 8;
+
+    // The pass ran into the time the next one was due.
+    if (xTaskGetTickCount() - _started >= _period)
+    {
+        ++_overruns;
+        ++_window.overruns;
+    }
+}
+
+void period_monitor::idle()
+{
+    _active = false;
+}
+
+void period_monitor::set_period(TickType_t period)
+{
+    _period = period;
+}
+
+bool period_monitor::active() const
+{
+    return _active;
+}
+
+slot_nums period_monitor::slot() const
+{
+    return _SLOT;
+}
+
+TickType_t period_monitor::worst_lateness() const
+{
+    return _worst_lateness;
+}
+
+uint32_t period_monitor::overruns() const
+{
+    return _overruns;
+}
+
+uint32_t period_monitor::average_execution_us() const
+{
+    return _average_us_x8 / 8;
+}
+
+period_monitor::window period_monitor::take_window()
+{
+    const window RT = _window;
+    _window = {0, 0};
+    return RT;
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+
+// EOF
@@ -0,0 +1,107 @@
+// period_monitor.hh
+
+/**************************************************************************//**
+ * \file period_monitor.hh
+ *
+ * A FreeRTOS task-based deadline monitor, allowing for a supervisor to be
+ * aware of control loops that are slipping before they lock up.
+ *
+ * Period monitors are used by tasks that service a loop every period.  Each
+ * pass is bracketed by start() and stop(); the monitor records how late each
+ * pass started against the previous start plus the period, the passes that
+ * ran past the next deadline, and a moving average of the execution time.
+ *
+ * \note No internal synchronization objects are used, as they are quite heavy.
+ * The supervisor may miss an update made while it collects a window.
+ *****************************************************************************/
+#pragma once
+
+#include "FreeRTOS.h"
+#include "slot_nums.h"
+
+/*****************************************************************************
+ * Defines
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+
+class period_monitor
+{
+public:
+    /// What happened since the supervisor last collected the monitor.
+    struct window
+    {
+        TickType_t worst_lateness;
+        uint32_t overruns;
+    };
+
+private:
+    TickType_t _period;
+    const slot_nums _SLOT;          ///> The slot the loop services.
+    bool _active;                   ///> If the loop is running.
+
+    TickType_t _started;            ///> The tick the current pass started.
+    uint32_t _started_cycles;       ///> The cycle counter when it started.
+
+    TickType_t _worst_lateness;     ///> Since construction.
+    uint32_t _overruns;             ///> Since construction.
+    uint32_t _average_us_x8;        ///> Execution time average, times 8.
+
+    window _window;
+
+public:
+
+    /**
+     * Constructs an inactive monitor.
+     * \param[in]       period The period (in system ticks) of the loop.
+     * \param[in]       slot The slot the loop services, for error reporting.
+     */
+    period_monitor(TickType_t period, slot_nums slot);
+
+    /**
+     * Sent by the task at the start of each pass, right after it wakes.
+     * The first pass after the monitor was idle is not checked for lateness.
+     * \warning Do NOT use while in an ISR.
+     */
+    void start();
+
+    /**
+     * Sent by the task at the end of each pass, right before it sleeps.
+     * \warning Do NOT use while in an ISR.
+     */
+    void stop();
+
+    /**
+     * Sent when the loop stops running (e.g. the device detached).  The
+     * supervisor ignores idle monitors.
+     */
+    void idle();
+
+    void set_period(TickType_t period);
+
+    bool active() const;
+    slot_nums slot() const;
+    TickType_t worst_lateness() const;
+    uint32_t overruns() const;
+
+    /// \return The moving average (over about 8 passes) of the execution time in microseconds.
+    uint32_t average_execution_us() const;
+
+    /**
+     * Collects the lateness and overruns since the last call.
+     * Only called by the supervisor.
+     */
+    window take_window();
+};
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+
+//EOF
@@ -38,6 +38,9 @@
 #include "25lc1024.h"
 #include "math.h"
 #include "../device_detect/device_detect.h"
+#include "../log/log.h"
+#include "apt.h"
+#include "apt_parse.h"
 
 /****************************************************************************
  * Private Data
@@ -51,6 +54,15 @@ static size_t g_heartbeat_watchdogs_size = 0;
 static const event_watchdog * g_event_watchdogs[TASK_EVENT_WATCHDOGS];
 static size_t g_event_watchdogs_size = 0;
 #endif
+#if TASK_PERIOD_MONITORS > 0
+static period_monitor * g_period_monitors[TASK_PERIOD_MONITORS];
+static size_t g_period_monitors_size = 0;
+static uint8_t g_slipping_windows[TASK_PERIOD_MONITORS];
+#endif
+
+/* Set while control loops are slipping, slows the idle slot loops.*/
+static volatile bool s_degraded = false;
+static uint8_t s_clean_windows = 0;
 
 constexpr TickType_t IDENTIFY_PERIOD = 150;
 constexpr TickType_t IDENTIFY_BLINKS = 2;
@@ -72,6 +84,13 @@ static void update_fade_val(void);
  */
 static bool check_watchdogs(void);
 
+/**
+ * Collects the period monitors' last window, degrades the idle loops while any
+ * control loop is slipping and raises a board error for a loop that keeps
+ * slipping.
+ */
+static void check_period_monitors(void);
+
 bool global_500ms_tick;
 uint8_t fade_val;
 
@@ -120,7 +139,8 @@ static void check_power_good(void)
 		if (restart_check_val != 100)
 		{
 			restart_check_val = 100;
-			eeprom_25LC1024_write(POWER_BAD_RESTART_CHECK_EEPROM_START, 1,
+			eeprom_25LC1024_flush();
+			eeprom_25LC1024_write_direct(POWER_BAD_RESTART_CHECK_EEPROM_START, 1,
 					&restart_check_val);
 			xSemaphoreGive(xSPI_Semaphore);
 			vTaskDelay(pdMS_TO_TICKS(50));
@@ -175,6 +195,58 @@ static bool check_watchdogs(void)
 	return rt;
 }
 
+static void check_period_monitors(void)
+{
+	bool slipping_any = false;
+#if TASK_PERIOD_MONITORS > 0
+	for (size_t i = 0; i < g_period_monitors_size; ++i)
+	{
+		period_monitor * const p_monitor = g_period_monitors[i];
+		const period_monitor::window WINDOW = p_monitor->take_window();
+
+		if (!p_monitor->active())
+		{
+			g_slipping_windows[i] = 0;
+			continue;
+		}
+
+		const bool SLIPPING = WINDOW.overruns > 0
+				|| WINDOW.worst_lateness >= SUPERVISOR_SLIP_LATENESS;
+		if (!SLIPPING)
+		{
+			// Once raised, the error stays until the board restarts.
+			if (g_slipping_windows[i] < SUPERVISOR_SLIP_WINDOWS)
+				g_slipping_windows[i] = 0;
+			continue;
+		}
+
+		slipping_any = true;
+		if (g_slipping_windows[i] < SUPERVISOR_SLIP_WINDOWS
+				&& ++g_slipping_windows[i] == SUPERVISOR_SLIP_WINDOWS)
+		{
+			const slot_nums SLOT = p_monitor->slot();
+			debug_print("ERROR: Slot %d control loop missing its deadlines\r\n", SLOT);
+			if (SLOT < NUMBER_OF_BOARD_SLOTS)
+			{
+				Set_bits(board.error, 1 << SLOT);
+			}
+			log_event(MOTHERBOARD_ID, SYSTEM_LOG_TYPE, SYSTEM_DEADLINE_MISS_LOG, SLOT,
+					p_monitor->worst_lateness(), p_monitor->overruns());
+		}
+	}
+#endif
+
+	if (slipping_any)
+	{
+		s_degraded = true;
+		s_clean_windows = 0;
+	}
+	else if (s_degraded && ++s_clean_windows >= SUPERVISOR_RECOVER_WINDOWS)
+	{
+		s_degraded = false;
+	}
+}
+
 /****************************************************************************
  * Task
  ****************************************************************************/
@@ -226,6 +298,8 @@ static void task_supervisor_check(void *pvParameters)
 			wdt_restart(WDT);
 
 			global_500ms_tick = !global_500ms_tick;
+
+			check_period_monitors();
 		}
 
 		board.vin_monitor_val = read_analog(AFEC1, VIN_MONITOR);
@@ -318,6 +392,9 @@ static void task_supervisor_check(void *pvParameters)
 
 		xSemaphoreGive(xSPI_Semaphore);
 
+		// Closing a session programs its batch, which takes the SPI mutex.
+		apt_parse_efs_tick();
+
 		if (!check_watchdogs())
 		{
 			restart_board();
@@ -397,6 +474,12 @@ void supervisor_identify(const slot_nums slot)
 }
 
 
+TickType_t supervisor_idle_period(const TickType_t period)
+{
+	return (s_degraded) ? period * SUPERVISOR_DEGRADED_IDLE_FACTOR : period;
+}
+
+
 void supervisor_add_watchdog(event_watchdog * const p_watchdog)
 {
 #if TASK_EVENT_WATCHDOGS > 0
@@ -424,4 +507,21 @@ void supervisor_add_watchdog(heartbeat_watchdog * const p_watchdog)
 #endif
 }
 
+
+void supervisor_add_monitor(period_monitor * const p_monitor)
+{
+#if TASK_PERIOD_MONITORS > 0
+	taskENTER_CRITICAL();
+	if (g_period_monitors_size == TASK_PERIOD_MONITORS)
+	{
+		// TODO:  error
+		for (;;) {} // Spin
+	}
+
+	g_slipping_windows[g_period_monitors_size] = 0;
+	g_period_monitors[g_period_monitors_size++] = p_monitor;
+	taskEXIT_CRITICAL();
+#endif
+}
+
 //EOF
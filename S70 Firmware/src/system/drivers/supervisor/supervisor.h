@@ -7,6 +7,7 @@
 
 #include "heartbeat_watchdog.hh"
 #include "event_watchdog.hh"
+#include "period_monitor.hh"
 #include "slot_nums.h"
 
 #endif
@@ -38,11 +39,19 @@ void supervisor_init(const bool cpld_programmed);
  */
 void supervisor_identify(const slot_nums slot);
 
+/**
+ * The period idle slot loops should use.  While a control loop is slipping
+ * the idle loops are slowed down to give it the CPU and the SPI bus.
+ * \param[in]       period The loop's normal period.
+ */
+TickType_t supervisor_idle_period(const TickType_t period);
+
 #ifdef __cplusplus
 }
 
 void supervisor_add_watchdog(event_watchdog * const p_watchdog);
 void supervisor_add_watchdog(heartbeat_watchdog * const p_watchdog);
+void supervisor_add_monitor(period_monitor * const p_monitor);
 
 #endif
 
@@ -10,6 +10,7 @@
 #include <cpld.h>
 #include <delay.h>
 #include "user_spi.h"
+#include "xdmac.h"
 #include <string.h>
 
 fifo_t *uart0_fifo_rx;
@@ -29,6 +30,13 @@ static uint8_t g_uart0_in_size;
 static uint8_t g_uart0_out_index;
 static uint8_t g_uart0_out_size;
 
+/* Given by the XDMAC interrupt when the RX channel finishes its block. */
+static SemaphoreHandle_t xUART0_DMADone = NULL;
+
+/* The D-cache is enabled, so the XDMAC only ever touches this buffer (aligned
+ * and sized to whole cache lines) instead of caller memory. */
+COMPILER_ALIGNED(32) static uint8_t g_uart0_dma_buffer[UART0_DMA_BUFFER_SIZE];
+
 /****************************************************************************
  * Interrupt Handler
  ****************************************************************************/
@@ -110,6 +118,18 @@ ISR(UART0_Handler)
     portYIELD_FROM_ISR(need_to_schedule);
 }
 
+/**
+ * @brief Called from the XDMAC interrupt, wakes the task waiting on a UART0
+ * DMA transfer once every byte has been echoed back.
+ */
+void uart0_dma_handler(BaseType_t * const p_need_to_schedule)
+{
+	if (xdmac_channel_get_interrupt_status(XDMAC, UART0_XDMA_RX_CH) & XDMAC_CIS_BIS)
+	{
+		xSemaphoreGiveFromISR(xUART0_DMADone, p_need_to_schedule);
+	}
+}
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
@@ -118,6 +138,7 @@ ISR(UART0_Handler)
  * Function Prototypes
  ****************************************************************************/
 static void uart0_settings(uint32_t ul_baudrate);
+static void uart0_dma_init(void);
 
 /****************************************************************************
  * Private Functions
@@ -135,6 +156,25 @@ static void uart0_settings(uint32_t ul_baudrate)
 	uart0.baudrate = ul_baudrate;
 }
 
+static void uart0_dma_init(void)
+{
+	if (xUART0_DMADone == NULL)
+	{
+		xUART0_DMADone = xSemaphoreCreateBinary();
+		configASSERT(xUART0_DMADone != NULL);
+		NameQueueObject(xUART0_DMADone, "UART0DMA");
+	}
+
+	pmc_enable_periph_clk(ID_XDMAC);
+	xdmac_channel_disable(XDMAC, UART0_XDMA_TX_CH);
+	xdmac_channel_disable(XDMAC, UART0_XDMA_RX_CH);
+	xdmac_enable_interrupt(XDMAC, UART0_XDMA_RX_CH);
+
+	/* must set the interrupt priority lower priority than
+	 * configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY*/
+	irq_register_handler(XDMAC_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1);
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -238,6 +278,8 @@ void uart0_init(void)
             }
         }
 
+	uart0_dma_init();
+
 	/* Allocate structure for uart rx fifo.*/
 	uart0_fifo_rx = pvPortMalloc(sizeof(fifo_t));
 	/* Allocate fifo buffer*/
@@ -340,3 +382,85 @@ void uart0_wait_until_tx_done(void)
     xSemaphoreTake(xUART0_WriteFinished, portMAX_DELAY);
     xSemaphoreGive(xUART0_WriteFinished);
 }
+
+/**
+ * @brief Writes a block and reads back what the line carried during it, both
+ * moved by the XDMAC.  A one-wire line echoes every byte written, so the
+ * block finishes once the last echo has arrived.  The calling task sleeps for
+ * the whole block instead of waking for each byte.
+ * The calling function must have xUART0_Semaphore.
+ *
+ * @param p_data	: The bytes to write, replaced by the bytes read back.
+ * @param length	: The number of bytes, at most UART0_DMA_BUFFER_SIZE.
+ * @param timeout	: How long to wait on the echo before the block is aborted.
+ * @return false if the block was too large or the echo never finished.
+ */
+bool uart0_transfer(uint8_t * p_data, uint16_t length, TickType_t timeout)
+{
+	if (length == 0 || length > UART0_DMA_BUFFER_SIZE)
+	{
+		return false;
+	}
+
+	uart0_wait_until_tx_done();
+
+	/* The RX channel owns the receiver for the block, drop anything stale. */
+	uart_disable_interrupt(UART0, UART_IER_RXRDY);
+	uint8_t stale;
+	while (uart_is_rx_ready(UART0))
+	{
+		uart_read(UART0, &stale);
+	}
+	uart_reset_status(UART0);
+	xSemaphoreTake(xUART0_DMADone, 0);
+
+	memcpy(g_uart0_dma_buffer, p_data, length);
+	SCB_CleanDCache_by_Addr((uint32_t *) g_uart0_dma_buffer, sizeof(g_uart0_dma_buffer));
+
+	xdmac_channel_config_t cfg = {0};
+
+	/* RX: UART0_RHR -> buffer.  Each echo lands on the byte already sent. */
+	cfg.mbr_ubc = XDMAC_CUBC_UBLEN(length);
+	cfg.mbr_sa = (uint32_t) &UART0->UART_RHR;
+	cfg.mbr_da = (uint32_t) g_uart0_dma_buffer;
+	cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN | XDMAC_CC_MBSIZE_SINGLE | XDMAC_CC_DSYNC_PER2MEM
+		| XDMAC_CC_CSIZE_CHK_1 | XDMAC_CC_DWIDTH_BYTE | XDMAC_CC_SIF_AHB_IF1
+		| XDMAC_CC_DIF_AHB_IF0 | XDMAC_CC_SAM_FIXED_AM | XDMAC_CC_DAM_INCREMENTED_AM
+		| XDMAC_CC_PERID(XDAMC_CHANNEL_HWID_UART0_RX);
+	xdmac_configure_transfer(XDMAC, UART0_XDMA_RX_CH, &cfg);
+	xdmac_channel_set_descriptor_control(XDMAC, UART0_XDMA_RX_CH, 0);
+	xdmac_channel_enable_interrupt(XDMAC, UART0_XDMA_RX_CH, XDMAC_CIE_BIE);
+
+	/* TX: buffer -> UART0_THR */
+	cfg.mbr_sa = (uint32_t) g_uart0_dma_buffer;
+	cfg.mbr_da = (uint32_t) &UART0->UART_THR;
+	cfg.mbr_cfg = XDMAC_CC_TYPE_PER_TRAN | XDMAC_CC_MBSIZE_SINGLE | XDMAC_CC_DSYNC_MEM2PER
+		| XDMAC_CC_CSIZE_CHK_1 | XDMAC_CC_DWIDTH_BYTE | XDMAC_CC_SIF_AHB_IF0
+		| XDMAC_CC_DIF_AHB_IF1 | XDMAC_CC_SAM_INCREMENTED_AM | XDMAC_CC_DAM_FIXED_AM
+		| XDMAC_CC_PERID(XDAMC_CHANNEL_HWID_UART0_TX);
+	xdmac_configure_transfer(XDMAC, UART0_XDMA_TX_CH, &cfg);
+	xdmac_channel_set_descriptor_control(XDMAC, UART0_XDMA_TX_CH, 0);
+
+	/* RX first so no echo is missed. */
+	xdmac_channel_enable(XDMAC, UART0_XDMA_RX_CH);
+	xdmac_channel_enable(XDMAC, UART0_XDMA_TX_CH);
+
+	const bool FINISHED = xSemaphoreTake(xUART0_DMADone, timeout) == pdTRUE;
+	if (!FINISHED)
+	{
+		xdmac_channel_disable(XDMAC, UART0_XDMA_TX_CH);
+		xdmac_channel_disable(XDMAC, UART0_XDMA_RX_CH);
+	}
+	xdmac_channel_disable_interrupt(XDMAC, UART0_XDMA_RX_CH, XDMAC_CIE_BIE);
+
+	if (FINISHED)
+	{
+		SCB_InvalidateDCache_by_Addr((uint32_t *) g_uart0_dma_buffer, sizeof(g_uart0_dma_buffer));
+		memcpy(p_data, g_uart0_dma_buffer, length);
+	}
+
+	g_uart0_in_index = 0;
+	uart_enable_interrupt(UART0, UART_IER_RXRDY);
+
+	return FINISHED;
+}
@@ -20,6 +20,13 @@ extern "C"
 #define DISABLE_UART0_INTERRUPT		0
 #define ENABLE_UART0_INTERRUPT		1
 
+/* Size of the cache-aligned buffer the XDMAC transfers through (multiple of 32). */
+#define UART0_DMA_BUFFER_SIZE		1088
+
+/* XDMAC channels reserved for UART0 (0 is the FTDI UART, 1 and 2 are SPI0). */
+#define UART0_XDMA_TX_CH			3
+#define UART0_XDMA_RX_CH			4
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -47,6 +54,8 @@ void uart0_setup_read(uint8_t bytes_to_read);
 bool uart0_write(TickType_t delay, const uint8_t * p_data, uint8_t bytes_to_write);
 bool uart0_read(TickType_t delay, uint8_t * p_data);
 void uart0_wait_until_tx_done(void);
+bool uart0_transfer(uint8_t * p_data, uint16_t length, TickType_t timeout);
+void uart0_dma_handler(BaseType_t * const p_need_to_schedule);
 
 extern SemaphoreHandle_t xUART0_Semaphore;
 
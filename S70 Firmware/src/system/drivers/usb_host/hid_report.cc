@@ -825,10 +825,25 @@ uint8_t HID_get_report(uint8_t address, uint16_t lengthOfDescriptor)
 		error_print("ERROR: Can't get USB HID Report\r\n");
 		return rcode;
 	}
-	hid_report_print("HID Report size = %d\r\n\n", lengthOfDescriptor);
+
+	return HID_parse_report(address, buf, lengthOfDescriptor);
+}
+
+/**
+ * @brief Parses a report descriptor that has already been read from the device
+ * into the device's HID data, then builds its input extraction plan.
+ *
+ * @param address : Address of device the report descriptor belongs to.
+ * @param p_descriptor : The report descriptor.
+ * @param length : Length of the report descriptor in bytes.
+ * @return 0 if the descriptor was parsed, else 1
+ */
+uint8_t HID_parse_report(uint8_t address, const uint8_t *p_descriptor, uint16_t length)
+{
+	hid_report_print("HID Report size = %d\r\n\n", length);
 	hid_report_print("********* HID Report *********\r\n");
 
-	hid_item_parser parser(&buf, lengthOfDescriptor);
+	hid_item_parser parser(p_descriptor, length);
 	item_state_t item_state = { 0 };
 	if (parse_report(address, parser, item_state))
 	{
@@ -836,8 +851,9 @@ uint8_t HID_get_report(uint8_t address, uint16_t lengthOfDescriptor)
 				usb_device[address].hid_data.num_of_input_bits / 8;
 		usb_device[address].hid_data.num_of_output_bytes =
 				usb_device[address].hid_data.num_of_output_bits / 8;
+		HID_compile_input_plan(&usb_device[address].hid_data);
 		hid_report_print("Finished HID report\r\n");
-		return rcode;
+		return 0;
 	}
 	else
 	{
@@ -845,6 +861,49 @@ uint8_t HID_get_report(uint8_t address, uint16_t lengthOfDescriptor)
 	}
 }
 
+/**
+ * Builds the input report extraction plan from the parsed input controls.
+ * Axis scales are computed when first used, as they depend on the mapping.
+ * @param p_hid_data : The HID data of the device, with its input controls parsed.
+ */
+void HID_compile_input_plan(Hid_Data * const p_hid_data)
+{
+	Hid_Input_plan * const p_plan = &p_hid_data->in_plan;
+	memset(p_plan, 0, sizeof(*p_plan));
+
+	p_plan->num_of_words = (p_hid_data->num_of_input_bytes + 3) / 4;
+	if (p_plan->num_of_words > HID_REPORT_WORDS)
+	{
+		p_plan->num_of_words = HID_REPORT_WORDS;
+	}
+
+	for (uint8_t ctrl_no = 0; ctrl_no < p_hid_data->num_of_input_controls; ++ctrl_no)
+	{
+		const Hid_Control_info * const p_control = &p_hid_data->hid_in_controls[ctrl_no];
+		Hid_Control_extract * const p_extract = &p_plan->controls[ctrl_no];
+
+		const uint8_t SIZE = p_control->report_size;
+		const bool SUPPORTED = SIZE >= 1 && SIZE <= 16 &&
+			p_control->bit_position + SIZE <= HID_MAX_BYTES * 8;
+
+		p_extract->word = p_control->bit_position / 32;
+		p_extract->shift = p_control->bit_position % 32;
+		p_extract->sign_extend = p_control->logical_min < 0;
+		p_extract->value_mask = SUPPORTED ? static_cast<uint16_t>((1UL << SIZE) - 1) : 0;
+		p_extract->change_mask = static_cast<uint64_t>(p_extract->value_mask) << p_extract->shift;
+
+		// Mark every word the control's bits fall in.
+		if (SUPPORTED)
+		{
+			const uint8_t LAST_WORD = (p_control->bit_position + SIZE - 1) / 32;
+			for (uint8_t word = p_extract->word; word <= LAST_WORD; ++word)
+			{
+				p_plan->word_controls[word] |= 1 << ctrl_no;
+			}
+		}
+	}
+}
+
 uint16_t HID_get_usage_page(const Hid_Control_info * const p_control)
 {
 	return p_control->usage >> 16;
@@ -18,6 +18,7 @@ extern "C"
 #define MAX_NUM_CONTROLS			15
 #define HID_MAX_BYTES				24 //16
 #define HID_MAX_NESTING				3  // Allows for a HID report with a collection depth of 3 (Application collection, Secondary collection, Tertiary collection)
+#define HID_REPORT_WORDS			((HID_MAX_BYTES + 3) / 4)
 
 #define TYPE_INPUT			0
 #define TYPE_OUTPUT			1
@@ -45,6 +46,41 @@ typedef struct
 	int16_t prev_value;
 } Hid_Control_info;
 
+/* How to pull one input control out of a report, compiled from its Hid_Control_info.
+ * The report is read as little-endian 32-bit words, so a control of up to 16 bits
+ * always lies within two consecutive words.*/
+typedef struct
+{
+	uint8_t word;			/* The first report word holding the control.*/
+	uint8_t shift;			/* The control's bit offset in that word.*/
+	bool sign_extend;
+	uint16_t value_mask;	/* The control's bits after shifting.  0 if the size is unsupported.*/
+	uint64_t change_mask;	/* The control's bits in the two words starting at word.*/
+} Hid_Control_extract;
+
+/* Axis normalization terms, computed for the mapping's current dead band and speed modifier.*/
+typedef struct
+{
+	bool valid;
+	uint8_t dead_band;
+	uint8_t speed_modifier;
+	int16_t upper;			/* Values above upper use the upper line.*/
+	int16_t lower;			/* Values below lower use the lower line.*/
+	float slope_upper;
+	float offset_upper;
+	float slope_lower;
+	float offset_lower;
+} Hid_Axis_scale;
+
+/* The input report extraction plan, built once when the report descriptor is parsed.*/
+typedef struct
+{
+	Hid_Control_extract controls[MAX_NUM_CONTROLS];
+	Hid_Axis_scale axis_scales[MAX_NUM_CONTROLS];
+	uint16_t word_controls[HID_REPORT_WORDS];	/* Bitset of the controls with bits in each word.*/
+	uint8_t num_of_words;
+} Hid_Input_plan;
+
 typedef struct
 {
 //	joystick_modes mode;
@@ -54,6 +90,7 @@ typedef struct
 	uint8_t num_of_input_controls;
 	uint8_t num_of_input_controls_initialized;
 	Hid_Control_info hid_in_controls[MAX_NUM_CONTROLS];
+	Hid_Input_plan in_plan;
 
 	uint8_t num_of_output_bits;
 	uint8_t num_of_output_bytes;
@@ -103,6 +140,8 @@ typedef struct
  * Public Function Prototypes
  ************************************************************************************/
 uint8_t HID_get_report(uint8_t address, uint16_t lengthOfDescriptor);
+uint8_t HID_parse_report(uint8_t address, const uint8_t *p_descriptor, uint16_t length);
+void HID_compile_input_plan(Hid_Data * const p_hid_data);
 uint16_t HID_get_usage_page(const Hid_Control_info * const p_control);
 uint16_t HID_get_usage_id(const Hid_Control_info * const p_control);
 
@@ -20,6 +20,9 @@
  ****************************************************************************/
 usb_host_bus_states vbusState;
 
+/* Set by the transfer engine when it services a connection change*/
+static volatile bool bus_change_pending = false;
+
 /****************************************************************************
  * Function Prototypes
  ****************************************************************************/
@@ -30,7 +33,8 @@ static void MAX3421E_busprobe(void);
  * Interrupt Handler
  ****************************************************************************/
 /**
- * @brief The MAX3421e interrupt pin is polled instead of tying to an interrupt.
+ * @brief Probe the bus once at startup.  Later connection changes are serviced
+ * by the transfer engine from the INT pin.
  *
  */
 // MARK:  SPI Mutex Required
@@ -159,8 +163,8 @@ bool max3421e_init(void)
 	/*Disables the PIO from controlling the corresponding pin (enables peripheral control of the pin).*/
 	((Pio *) PIOB)->PIO_PDR = PIO_PB12;
 
-	/* Set the interrupt pin on the MAX3421e as an input.  We pool this pin rather than
-	 * connect it to an interrupt */
+	/* Set the interrupt pin on the MAX3421e as an input.  The transfer engine
+	 * connects it to an interrupt */
 	set_pin_as_input(PIN_MAX_INT);
 
 	/*  GPX is not used but setup as input*/
@@ -237,7 +241,7 @@ void max3421e_write_bytes(uint8_t reg, uint8_t nbytes, uint8_t* data)
 	uint8_t temp_data[nbytes+1];
 
 	temp_data[0] = reg + 2;	/* first byte is the command, +2 to indicate it is a write*/
-	memcpy(temp_data+1, data, sizeof(temp_data));
+	memcpy(temp_data+1, data, nbytes);
 	spi_transfer(SPI_MAX3421_NO_READ, temp_data, nbytes+1);
 }
 
@@ -265,13 +269,24 @@ uint8_t * max3421e_readMultiple(uint8_t reg, uint8_t count, uint8_t * values)
 	uint8_t spi_tx_rx_data[count + 1];
 	spi_tx_rx_data[0] = reg;
 	spi_tx_rx_data[1] = 0xFF;
-	spi_transfer(SPI_MAX3421_READ, spi_tx_rx_data, count);
+	spi_transfer(SPI_MAX3421_READ, spi_tx_rx_data, count + 1);
 	memcpy(values, spi_tx_rx_data + 1, count);
 	return values;
 }
 
 /**
- * @brief Check the MAX3421e interrupt pin.
+ * @brief Probe the new bus state after the transfer engine sees CONDETIRQ.
+ */
+// MARK:  SPI Mutex Required
+void MAX3421E_connection_irq(void)
+{
+	MAX3421E_busprobe();
+	max3421e_write(rHIRQ, bmCONDETIRQ);
+	bus_change_pending = true;
+}
+
+/**
+ * @brief Check for a connection change serviced by the transfer engine.
  *
  * @return vbusState
  *	States
@@ -286,7 +301,7 @@ usb_host_bus_states MAX3421E_Task(void)
 	static bool first_run = true;
 	usb_host_bus_states ret_val = NO_CHANGE;
 
-	if (!get_pin_level(PIN_MAX_INT) || first_run)
+	if (first_run)
 	{
 		xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
 		MaxIntHandler();
@@ -294,6 +309,11 @@ usb_host_bus_states MAX3421E_Task(void)
 		ret_val = vbusState;
 		first_run = false;
 	}
+	else if (bus_change_pending)
+	{
+		bus_change_pending = false;
+		ret_val = vbusState;
+	}
 
 #if 0	/* GPX not used*/
 	if (MAX3421E_GPX == 1)
@@ -235,6 +235,7 @@ void max3421e_write(uint8_t reg, uint8_t val);
 void max3421e_write_bytes(uint8_t reg, uint8_t nbytes, uint8_t* data);
 uint8_t max3421e_read(uint8_t reg);
 uint8_t * max3421e_readMultiple(uint8_t reg, uint8_t count, uint8_t * values);
+void MAX3421E_connection_irq(void);
 usb_host_bus_states MAX3421E_Task(void);
 
 #ifdef __cplusplus
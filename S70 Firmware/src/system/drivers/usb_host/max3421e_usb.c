@@ -463,6 +463,26 @@ void set_max3421_address(uint8_t address)
 	last_address = address;
 }
 
+/**
+ * @brief Find the ep_info entry of an endpoint.
+ *
+ * @param address : USB device address.
+ * @param ep_addr : Endpoint address, bit 7 set for IN.
+ * @return index into usb_device[address].ep_info, -1 if not found
+ */
+int8_t usb_ep_index(uint8_t address, uint8_t ep_addr)
+{
+	for (int8_t i = 0; i < MAX_NUM_EP; ++i)
+	{
+		if ((usb_device[address].ep_info[i].MaxPktSize != 0)
+				&& (usb_device[address].ep_info[i].epAddr == ep_addr))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
 /**
  * Gets the device descriptor of a USB device.
  * @param device USB device
@@ -593,6 +613,14 @@ uint8_t get_rest_of_discriptors(uint8_t address)
 				size = buf2[ptr]; // size of USB_ENDPOINT_DESCRIPTOR;
 				memcpy(&usb_device[address].ep_descriptor[i], &buf2[ptr], size);
 
+				/* Data toggles start at DATA0 after Set_Configuration*/
+				usb_device[address].ep_info[i].epAddr = usb_device[address].ep_descriptor[i].bEndpointAddress;
+				usb_device[address].ep_info[i].Attr = usb_device[address].ep_descriptor[i].bmAttributes;
+				usb_device[address].ep_info[i].MaxPktSize = usb_device[address].ep_descriptor[i].wMaxPacketSize;
+				usb_device[address].ep_info[i].Interval = usb_device[address].ep_descriptor[i].bInterval;
+				usb_device[address].ep_info[i].sndToggle = bmSNDTOG0;
+				usb_device[address].ep_info[i].rcvToggle = bmRCVTOG0;
+
                 const uint8_t EP_NUMBER = usb_device[address].ep_descriptor[i].bEndpointAddress & 0x0F;
 
                 // Locating IN and OUT endpoints for non-standard joysticks.
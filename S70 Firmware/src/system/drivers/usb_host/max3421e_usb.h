@@ -27,6 +27,7 @@ int8_t usb_write(uint8_t address, uint8_t endpoint, uint16_t length,
 uint8_t control_read(uint8_t address, uint8_t *pSUD, uint8_t* buf);
 uint8_t control_write(uint8_t *pSUD);
 void set_max3421_address(uint8_t address);
+int8_t usb_ep_index(uint8_t address, uint8_t ep_addr);
 uint8_t get_device_descriptors(uint8_t address);
 uint8_t set_device_address(uint8_t address);
 uint8_t get_rest_of_discriptors(uint8_t address);
@@ -0,0 +1,637 @@
+/**
+ * @file max3421e_xfer.c
+ *
+ * @brief Interrupt driven transfer engine for the MAX3421E USB IC.
+ *
+ * The MAX3421E INT pin is tied to a PIO interrupt.  The SPI bus cannot be used
+ * from an interrupt, so the handler only masks the pin and wakes the engine
+ * task, which reads and clears the host interrupts over SPI.
+ *
+ * Each endpoint has a queue of transfers.  The engine counts 1 ms frames from
+ * the RTOS tick and launches the head of a queue once the endpoint's polling
+ * interval has elapsed.  Until a transfer is due within XFER_FRAMEIE_LEAD
+ * frames the engine sleeps on a tick timeout, and only then enables FRAMEIRQ
+ * to wake at the start of each frame, so a long interval does not take the
+ * SPI bus every frame.  The SPI mutex is held for one packet at a time, so a
+ * NAKed poll gives the bus back and is retried on the endpoint's next interval.
+ * The owning task is notified when its transfer completes.
+ *
+ */
+
+#include <asf.h>
+#include <pins.h>
+#include "max3421e_xfer.h"
+#include "max3421e.h"
+#include "max3421e_usb.h"
+#include "usb_device.h"
+#include "user_spi.h"
+#include "sys_task.h"
+#include "Debugging.h"
+
+extern SemaphoreHandle_t xSPI_Semaphore;
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+/* These must match PIN_MAX_INT*/
+#define MAX_INT_PIO			PIOA
+#define MAX_INT_ID			ID_PIOA
+#define MAX_INT_MASK		PIO_PA2
+
+/* Host interrupts the engine services.  FRAMEIE is only enabled while a
+ * transfer is due within XFER_FRAMEIE_LEAD frames.*/
+#define XFER_HIEN			(bmCONDETIE | bmHXFRDNIE)
+#define XFER_FRAMEIE_LEAD	2
+
+/* Full and low speed frames are 1 ms.*/
+#define XFER_TICKS_PER_FRAME	(configTICK_RATE_HZ / 1000)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+typedef struct
+{
+	Usb_xfer *p_head;
+	Usb_xfer *p_tail;
+	uint16_t due_frame;	/* frame the head may be launched on*/
+} Xfer_endpoint;
+
+static Xfer_endpoint endpoints[USB_NUMDEVICES][MAX_NUM_EP];
+
+static TaskHandle_t xXferHandle = NULL;
+
+/* Transfer the engine is running, it cannot be cancelled until the packet ends*/
+static Usb_xfer * volatile p_active = NULL;
+
+/* Number of transfers queued on all the endpoints*/
+static volatile uint16_t queued_count = 0;
+
+/* Only touched by the engine task*/
+static uint16_t frame = 0;
+static TickType_t frame_tick = 0;	/* tick the current frame started on*/
+static bool frame_started = false;	/* FRAMEIRQ seen since the frames were counted*/
+static uint8_t hien = 0;
+
+/****************************************************************************
+ * Function Prototypes
+ ****************************************************************************/
+static void max3421e_int_handler(uint32_t id, uint32_t mask);
+static uint8_t service_irqs(void);
+static uint8_t launch_packet(uint8_t token, uint8_t endpoint);
+static uint8_t in_packet(Usb_xfer *p_xfer, EpInfo *p_info, bool *p_more);
+static uint8_t out_packet(Usb_xfer *p_xfer, EpInfo *p_info, bool *p_more);
+static void complete(Usb_xfer *p_xfer, Xfer_endpoint *p_ep, uint8_t rcode);
+static void run_transfer(Usb_xfer *p_xfer, Xfer_endpoint *p_ep);
+static void count_frames(void);
+static void run_due_transfers(void);
+static TickType_t schedule_wake(void);
+static void unlink(Usb_xfer *p_xfer);
+static void task_usb_xfer(void *pvParameters);
+
+/****************************************************************************
+ * Interrupt Handler
+ ****************************************************************************/
+/**
+ * @brief The INT pin is level triggered, so it stays masked until the engine
+ * has cleared the interrupt source in the MAX3421E.
+ */
+static void max3421e_int_handler(uint32_t id, uint32_t mask)
+{
+	BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+	UNUSED(id);
+	UNUSED(mask);
+
+	pio_disable_interrupt(MAX_INT_PIO, MAX_INT_MASK);
+	vTaskNotifyGiveFromISR(xXferHandle, &xHigherPriorityTaskWoken);
+	portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+/**
+ * @brief Services the connection and frame interrupts.
+ *
+ * @return The HIRQ register as it was read.
+ */
+// MARK:  SPI Mutex Required
+static uint8_t service_irqs(void)
+{
+	const uint8_t HIRQ = max3421e_read(rHIRQ);
+
+	if (HIRQ & bmCONDETIRQ)
+	{
+		MAX3421E_connection_irq();
+	}
+
+	/* FRAMEIRQ is set every frame, it only matters while it is enabled*/
+	if ((HIRQ & bmFRAMEIRQ) && (hien & bmFRAMEIE))
+	{
+		max3421e_write(rHIRQ, bmFRAMEIRQ);
+		frame_started = true;
+	}
+	return HIRQ;
+}
+
+/**
+ * @brief Launches a packet and blocks until HXFRDNIRQ.  The INT pin is unmasked
+ * while waiting so the engine sleeps instead of polling HIRQ.
+ *
+ * @return The result code from HRSL.
+ */
+// MARK:  SPI Mutex Required
+static uint8_t launch_packet(uint8_t token, uint8_t endpoint)
+{
+	TimeOut_t time_out;
+	TickType_t ticks_to_wait = XFER_PACKET_TIMEOUT;
+
+	max3421e_write(rHXFR, (token | endpoint));
+	vTaskSetTimeOutState(&time_out);
+
+	while ((service_irqs() & bmHXFRDNIRQ) == 0)
+	{
+		if (xTaskCheckForTimeOut(&time_out, &ticks_to_wait) == pdTRUE)
+		{
+			return hrTIMEOUT;
+		}
+		pio_enable_interrupt(MAX_INT_PIO, MAX_INT_MASK);
+		ulTaskNotifyTake(pdTRUE, ticks_to_wait);
+	}
+	max3421e_write(rHIRQ, bmHXFRDNIRQ);
+
+	return (max3421e_read(rHRSL) & 0x0f);
+}
+
+/**
+ * @brief Reads one packet of an IN transfer.
+ *
+ * @param p_more : Set when the transfer needs another packet.
+ * @return The result code from HRSL.
+ */
+// MARK:  SPI Mutex Required
+static uint8_t in_packet(Usb_xfer *p_xfer, EpInfo *p_info, bool *p_more)
+{
+	uint8_t rcode;
+	uint8_t pktsize;
+
+	max3421e_write(rHCTL, p_info->rcvToggle);
+	rcode = launch_packet(tokIN, p_info->epAddr & 0x0F);
+
+	if (rcode == hrSUCCESS)
+	{
+		pktsize = max3421e_read(rRCVBC);
+		if (pktsize > p_xfer->length - p_xfer->actual)
+		{
+			pktsize = p_xfer->length - p_xfer->actual;
+		}
+		max3421e_readMultiple(rRCVFIFO, pktsize, p_xfer->buf + p_xfer->actual);
+		max3421e_write(rHIRQ, bmRCVDAVIRQ); /* Free the receive buffer*/
+		p_xfer->actual += pktsize;
+
+		p_info->rcvToggle = (max3421e_read(rHRSL) & bmRCVTOGRD) ? bmRCVTOG1 : bmRCVTOG0;
+
+		/* A short packet ends the transfer*/
+		*p_more = (pktsize == p_info->MaxPktSize) && (p_xfer->actual < p_xfer->length);
+	}
+	else if (rcode == hrTOGERR)
+	{
+		/* Take the toggle the device expects for the retry*/
+		p_info->rcvToggle = (max3421e_read(rHRSL) & bmRCVTOGRD) ? bmRCVTOG0 : bmRCVTOG1;
+	}
+	return rcode;
+}
+
+/**
+ * @brief Sends one packet of an OUT transfer.
+ *
+ * @param p_more : Set when the transfer needs another packet.
+ * @return The result code from HRSL.
+ */
+// MARK:  SPI Mutex Required
+static uint8_t out_packet(Usb_xfer *p_xfer, EpInfo *p_info, bool *p_more)
+{
+	uint8_t rcode;
+	uint16_t bytes_to_send = p_xfer->length - p_xfer->actual;
+
+	if (bytes_to_send > p_info->MaxPktSize)
+	{
+		bytes_to_send = p_info->MaxPktSize;
+	}
+
+	/* After a NAK the MAX3421E needs SNDBC cleared before the FIFO is reloaded*/
+	if (p_xfer->naks)
+	{
+		max3421e_write(rSNDBC, 0);
+	}
+
+	max3421e_write(rHCTL, p_info->sndToggle);
+	max3421e_write_bytes(rSNDFIFO, bytes_to_send, p_xfer->buf + p_xfer->actual);
+	max3421e_write(rSNDBC, bytes_to_send);
+	rcode = launch_packet(tokOUT, p_info->epAddr & 0x0F);
+
+	if (rcode == hrSUCCESS)
+	{
+		p_xfer->actual += bytes_to_send;
+		p_info->sndToggle = (max3421e_read(rHRSL) & bmSNDTOGRD) ? bmSNDTOG1 : bmSNDTOG0;
+		*p_more = p_xfer->actual < p_xfer->length;
+	}
+	else if (rcode == hrTOGERR)
+	{
+		p_info->sndToggle = (max3421e_read(rHRSL) & bmSNDTOGRD) ? bmSNDTOG0 : bmSNDTOG1;
+	}
+	return rcode;
+}
+
+/**
+ * @brief Removes the transfer from its endpoint and notifies its owner.
+ */
+static void complete(Usb_xfer *p_xfer, Xfer_endpoint *p_ep, uint8_t rcode)
+{
+	TaskHandle_t owner = p_xfer->owner;
+
+	taskENTER_CRITICAL();
+	p_ep->p_head = p_xfer->p_next;
+	if (p_ep->p_head == NULL)
+	{
+		p_ep->p_tail = NULL;
+	}
+	queued_count--;
+	p_xfer->rcode = rcode;
+	p_xfer->queued = false;
+	taskEXIT_CRITICAL();
+
+	xTaskNotifyGive(owner);
+}
+
+/**
+ * @brief Runs packets of a due transfer until it completes or has to wait for
+ * the endpoint's next interval.
+ */
+// MARK:  SPI Mutex Required
+static void run_transfer(Usb_xfer *p_xfer, Xfer_endpoint *p_ep)
+{
+	EpInfo *p_info = &usb_device[p_xfer->address].ep_info[p_xfer->ep_index];
+	const uint8_t INTERVAL = (p_info->Interval != 0) ? p_info->Interval : 1;
+	uint8_t rcode;
+	bool more = false;
+
+	set_max3421_address(p_xfer->address);
+
+	for (;;)
+	{
+		rcode = (p_xfer->token == tokIN) ?
+				in_packet(p_xfer, p_info, &more) : out_packet(p_xfer, p_info, &more);
+
+		switch (rcode)
+		{
+		case hrSUCCESS:
+			if (more)
+			{
+				continue;
+			}
+			break;
+
+		case hrNAK:
+			p_xfer->naks++;
+			if ((p_xfer->nak_limit == XFER_NAK_RETRY) || (p_xfer->naks <= p_xfer->nak_limit))
+			{
+				p_ep->due_frame = frame + INTERVAL;
+				return;
+			}
+			break;
+
+		case hrTIMEOUT:
+		case hrTOGERR:
+			p_xfer->retries++;
+			if (p_xfer->retries < USB_RETRY_LIMIT)
+			{
+				p_ep->due_frame = frame + INTERVAL;
+				return;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		p_ep->due_frame = frame + INTERVAL;
+		complete(p_xfer, p_ep, rcode);
+		return;
+	}
+}
+
+/**
+ * @brief Advances the frame counter by the frames since it was last counted.
+ * The count comes from the tick, so a late wake does not lose frames, and a
+ * FRAMEIRQ realigns it to the start of the frame the MAX3421E has begun.
+ */
+static void count_frames(void)
+{
+	const TickType_t NOW = xTaskGetTickCount();
+	uint16_t frames = (uint16_t) ((NOW - frame_tick) / XFER_TICKS_PER_FRAME);
+
+	if (frame_started)
+	{
+		if (frames == 0)
+		{
+			frames = 1;
+		}
+		frame_tick = NOW;
+		frame_started = false;
+	}
+	else
+	{
+		frame_tick += (TickType_t) frames * XFER_TICKS_PER_FRAME;
+	}
+	frame += frames;
+}
+
+// MARK:  SPI Mutex Required
+static void run_due_transfers(void)
+{
+	for (uint8_t address = 0; address < USB_NUMDEVICES; ++address)
+	{
+		for (uint8_t ep = 0; ep < MAX_NUM_EP; ++ep)
+		{
+			Xfer_endpoint *p_ep = &endpoints[address][ep];
+
+			taskENTER_CRITICAL();
+			Usb_xfer *p_xfer = p_ep->p_head;
+			if ((p_xfer != NULL) && ((int16_t) (frame - p_ep->due_frame) >= 0))
+			{
+				p_active = p_xfer;
+			}
+			else
+			{
+				p_xfer = NULL;
+			}
+			taskEXIT_CRITICAL();
+
+			if (p_xfer != NULL)
+			{
+				run_transfer(p_xfer, p_ep);
+				p_active = NULL;
+			}
+		}
+	}
+}
+
+/**
+ * @brief Enables the frame interrupt only when a transfer is due within
+ * XFER_FRAMEIE_LEAD frames.
+ *
+ * @return Ticks the engine may sleep before a transfer is due, or until it
+ * has to enable the frame interrupt.
+ */
+// MARK:  SPI Mutex Required
+static TickType_t schedule_wake(void)
+{
+	uint16_t next = UINT16_MAX;	/* frames until the earliest transfer is due*/
+
+	taskENTER_CRITICAL();
+	for (uint8_t address = 0; address < USB_NUMDEVICES; ++address)
+	{
+		for (uint8_t ep = 0; ep < MAX_NUM_EP; ++ep)
+		{
+			Xfer_endpoint *p_ep = &endpoints[address][ep];
+			const int16_t DUE = (int16_t) (p_ep->due_frame - frame);
+
+			if (p_ep->p_head != NULL)
+			{
+				next = Min(next, (DUE > 0) ? (uint16_t) DUE : 0);
+			}
+			else if (DUE < 0)
+			{
+				/* The frame counter runs while the endpoint is idle, keep its
+				 * due frame from falling a wrap behind*/
+				p_ep->due_frame = frame;
+			}
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	const uint8_t WANTED = XFER_HIEN | ((next <= XFER_FRAMEIE_LEAD) ? bmFRAMEIE : 0);
+
+	if (WANTED != hien)
+	{
+		/* FRAMEIRQ has been set every frame while it was disabled*/
+		if (WANTED & bmFRAMEIE)
+		{
+			max3421e_write(rHIRQ, bmFRAMEIRQ);
+		}
+		max3421e_write(rHIEN, WANTED);
+		hien = WANTED;
+	}
+
+	if (next == UINT16_MAX)
+	{
+		return USB_HOST_XFER_IDLE_RATE;
+	}
+	if (next <= XFER_FRAMEIE_LEAD)
+	{
+		/* In case a FRAMEIRQ is missed*/
+		return (TickType_t) Max(next, 1) * XFER_TICKS_PER_FRAME;
+	}
+	return (TickType_t) (next - XFER_FRAMEIE_LEAD) * XFER_TICKS_PER_FRAME;
+}
+
+/**
+ * @brief Removes a transfer that is still queued.  Must be called in a critical
+ * section.
+ */
+static void unlink(Usb_xfer *p_xfer)
+{
+	Xfer_endpoint *p_ep = &endpoints[p_xfer->address][p_xfer->ep_index];
+	Usb_xfer *p_prev = NULL;
+
+	for (Usb_xfer *p_it = p_ep->p_head; p_it != NULL; p_it = p_it->p_next)
+	{
+		if (p_it == p_xfer)
+		{
+			if (p_prev == NULL)
+			{
+				p_ep->p_head = p_it->p_next;
+			}
+			else
+			{
+				p_prev->p_next = p_it->p_next;
+			}
+			if (p_ep->p_tail == p_it)
+			{
+				p_ep->p_tail = p_prev;
+			}
+			queued_count--;
+			p_xfer->queued = false;
+			return;
+		}
+		p_prev = p_it;
+	}
+}
+
+/****************************************************************************
+ * Task
+ ****************************************************************************/
+/**
+ * @brief Services the MAX3421E interrupts and runs the transfers that are due.
+ * Wakes on the INT pin, on a new transfer, when the next transfer is nearly
+ * due, or at USB_HOST_XFER_IDLE_RATE.
+ *
+ * @param pvParameters	: Not used.
+ */
+static void task_usb_xfer(void *pvParameters)
+{
+	UNUSED(pvParameters);
+
+	for (;;)
+	{
+		xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+		service_irqs();
+		count_frames();
+		run_due_transfers();
+		const TickType_t WAIT = schedule_wake();
+		xSemaphoreGive(xSPI_Semaphore);
+
+		pio_enable_interrupt(MAX_INT_PIO, MAX_INT_MASK);
+		ulTaskNotifyTake(pdTRUE, WAIT);
+	}
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+/**
+ * @brief Connect the MAX3421E INT pin to its interrupt and create the engine
+ * task.  The pin is left masked until the engine first runs.
+ */
+void max3421e_xfer_init(void)
+{
+	pio_handler_set(MAX_INT_PIO, MAX_INT_ID, MAX_INT_MASK, PIO_IT_LOW_LEVEL,
+			max3421e_int_handler);
+
+	if (xTaskCreate(task_usb_xfer, "USB Xfer", TASK_USB_XFER_STACK_SIZE, NULL,
+			TASK_USB_XFER_STACK_PRIORITY, &xXferHandle) != pdPASS)
+	{
+		error_print("ERROR: Failed to create USB transfer task\r\n");
+	}
+}
+
+/**
+ * @brief Queue a transfer on its endpoint.  The calling task becomes the owner
+ * and is notified when the transfer completes.
+ *
+ * @param p_xfer : address, ep_index, token, nak_limit, buf and length must be set.
+ * @return true if the transfer was queued.
+ */
+bool max3421e_xfer_submit(Usb_xfer *p_xfer)
+{
+	if ((xXferHandle == NULL) || p_xfer->queued || (p_xfer->address >= USB_NUMDEVICES)
+			|| (p_xfer->ep_index >= MAX_NUM_EP)
+			|| (usb_device[p_xfer->address].ep_info[p_xfer->ep_index].MaxPktSize == 0))
+	{
+		return false;
+	}
+
+	p_xfer->p_next = NULL;
+	p_xfer->owner = xTaskGetCurrentTaskHandle();
+	p_xfer->naks = 0;
+	p_xfer->retries = 0;
+	p_xfer->actual = 0;
+	p_xfer->rcode = hrBUSY;
+
+	Xfer_endpoint *p_ep = &endpoints[p_xfer->address][p_xfer->ep_index];
+
+	taskENTER_CRITICAL();
+	if (p_ep->p_tail == NULL)
+	{
+		p_ep->p_head = p_xfer;
+	}
+	else
+	{
+		p_ep->p_tail->p_next = p_xfer;
+	}
+	p_ep->p_tail = p_xfer;
+	queued_count++;
+	p_xfer->queued = true;
+	taskEXIT_CRITICAL();
+
+	xTaskNotifyGive(xXferHandle);
+	return true;
+}
+
+/**
+ * @brief Block until the transfer completes.  Notifications for other transfers
+ * owned by the task may wake this early, so the transfer's state is rechecked.
+ *
+ * @param p_xfer : A transfer queued by the calling task.
+ * @param timeout : Ticks to wait.
+ * @return The transfer's result code, hrBUSY if it is still queued.
+ */
+uint8_t max3421e_xfer_wait(Usb_xfer *p_xfer, TickType_t timeout)
+{
+	TimeOut_t time_out;
+	vTaskSetTimeOutState(&time_out);
+
+	while (p_xfer->queued)
+	{
+		if (xTaskCheckForTimeOut(&time_out, &timeout) == pdTRUE)
+		{
+			return hrBUSY;
+		}
+		ulTaskNotifyTake(pdTRUE, timeout);
+	}
+	return p_xfer->rcode;
+}
+
+/**
+ * @brief Remove a transfer from its endpoint.  If the engine is in the middle of
+ * one of its packets, this waits for that packet to end.
+ */
+void max3421e_xfer_cancel(Usb_xfer *p_xfer)
+{
+	for (;;)
+	{
+		taskENTER_CRITICAL();
+		if (p_active != p_xfer)
+		{
+			if (p_xfer->queued)
+			{
+				unlink(p_xfer);
+				p_xfer->rcode = hrBUSY;
+			}
+			taskEXIT_CRITICAL();
+			return;
+		}
+		taskEXIT_CRITICAL();
+		vTaskDelay(1);
+	}
+}
+
+/**
+ * @brief Cancel every transfer queued for a device.  Called before the device
+ * task and its transfers are removed.
+ *
+ * @param address : address of the device.
+ */
+void max3421e_xfer_cancel_address(uint8_t address)
+{
+	if (address >= USB_NUMDEVICES)
+	{
+		return;
+	}
+
+	for (uint8_t ep = 0; ep < MAX_NUM_EP; ++ep)
+	{
+		for (;;)
+		{
+			taskENTER_CRITICAL();
+			Usb_xfer *p_xfer = endpoints[address][ep].p_head;
+			taskEXIT_CRITICAL();
+
+			if (p_xfer == NULL)
+			{
+				break;
+			}
+			max3421e_xfer_cancel(p_xfer);
+		}
+	}
+}
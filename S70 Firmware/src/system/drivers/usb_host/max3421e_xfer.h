@@ -0,0 +1,71 @@
+/**
+ * @file max3421e_xfer.h
+ *
+ * @brief Interrupt driven transfer engine for the MAX3421E.  Tasks queue IN and
+ * OUT transfers on an endpoint, the engine launches them on the frame their
+ * endpoint is due and notifies the owning task when they complete.
+ *
+ */
+
+#ifndef SRC_SYSTEM_DRIVERS_USB_HOST_MAX3421E_XFER_H_
+#define SRC_SYSTEM_DRIVERS_USB_HOST_MAX3421E_XFER_H_
+
+#include <asf.h>
+#include "max3421e.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+/* NAK limit that keeps a transfer queued, retrying once per endpoint interval,
+ * until the device answers or the transfer is cancelled.*/
+#define XFER_NAK_RETRY			0xFFFF
+
+/* Longest a single packet may keep the engine waiting for HXFRDNIRQ.*/
+#define XFER_PACKET_TIMEOUT		pdMS_TO_TICKS(2)
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+/**
+ * A transfer owned by the task that queued it.  The structure must stay valid
+ * until the transfer completes or is cancelled.
+ */
+typedef struct Usb_xfer
+{
+	struct Usb_xfer *p_next;	/* next transfer queued on the same endpoint*/
+	TaskHandle_t owner;			/* task notified on completion*/
+
+	uint8_t address;
+	uint8_t ep_index;			/* index into usb_device[].ep_info*/
+	uint8_t token;				/* tokIN or tokOUT*/
+	uint16_t nak_limit;			/* NAKs tolerated, XFER_NAK_RETRY to keep polling*/
+	uint16_t naks;
+	uint8_t retries;			/* timeouts and toggle errors so far*/
+
+	uint8_t *buf;
+	uint16_t length;
+	uint16_t actual;			/* bytes moved so far*/
+
+	volatile bool queued;
+	volatile uint8_t rcode;		/* hrXXX result, valid once queued is false*/
+} Usb_xfer;
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+void max3421e_xfer_init(void);
+bool max3421e_xfer_submit(Usb_xfer *p_xfer);
+uint8_t max3421e_xfer_wait(Usb_xfer *p_xfer, TickType_t timeout);
+void max3421e_xfer_cancel(Usb_xfer *p_xfer);
+void max3421e_xfer_cancel_address(uint8_t address);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_SYSTEM_DRIVERS_USB_HOST_MAX3421E_XFER_H_ */
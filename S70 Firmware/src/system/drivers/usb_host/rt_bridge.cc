@@ -0,0 +1,681 @@
+/**
+ * @file rt_bridge.cc
+ *
+ * @brief USB host transport through the RT1064 SPI bridge.  The RT1064 owns
+ * enumeration and the hub, and mirrors a hub status table plus an IN/OUT block
+ * pair per device slot.  Once the hub status reports a protocol version with
+ * the set commands, each poll is one READ_DIRTY_SET that returns every dirty
+ * block in a single chip select, and the OUT reports of a pass go out together
+ * in one WRITE_SET.  Older bridges are polled with a READ_HEADER sweep over the
+ * hub and device endpoints, then a READ_BLOCK per endpoint whose DIRTY bit is
+ * set.  Report descriptors are parsed into usb_device[] and IN reports go
+ * straight to service_in_report, so mappings work as they do for devices on
+ * the MAX3421E.
+ *
+ */
+
+#include "rt_bridge.h"
+
+#include <asf.h>
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+#include "Debugging.h"
+#include "hid-mapping.hh"
+#include "hid_pid_fixes.h"
+#include "hid_report.h"
+#include "itc-service.hh"
+#include "spi-scheduler.hh"
+#include "spi-transfer-handle.hh"
+#include "spi_bridge_crc.h"
+#include "spi_bridge_protocol.h"
+#include "sys_task.h"
+#include "usb_device.hh"
+#include "usb_host.h"
+#include "user_spi.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+/* The sweep covers the hub status and device endpoints.  Nothing on the S70
+ * consumes the CDC endpoint yet.*/
+#define SWEEP_ENDPOINTS SPI_BRIDGE_EN_CDC
+
+/* Endpoints a READ_DIRTY_SET asks for.*/
+#define SWEEP_MASK ((1 << SWEEP_ENDPOINTS) - 1)
+
+/* Device slot N is given the address a device on hub port N + 1 gets from the
+ * MAX3421E host, so saved mappings follow the port.*/
+#define SLOT_ADDRESS(slot) ((slot) + HUB_ADDRESS + 1)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+typedef struct {
+    uint8_t header;
+    uint8_t payload[SPI_BRIDGE_MAX_PAYLOAD];
+} Bridge_block;
+
+typedef struct {
+    bool connected; /* the hub table lists the slot */
+    bool described; /* its report descriptor has been parsed */
+    std::optional<
+        service::itc::queue_handle<service::itc::message::hid_out_message>>
+        out_queue;
+    std::optional<drivers::usb_device::out_report_state> out_state;
+
+    /* OUT report waiting for the end of the OUT pass */
+    bool out_pending;
+    uint8_t out_length;
+    uint8_t out_report[SPI_BRIDGE_MAX_PAYLOAD];
+} Bridge_slot;
+
+static Bridge_slot bridge_slots[SPI_BRIDGE_DEVICE_SLOTS];
+
+/* Protocol version from the last hub status, 0 until one is read.*/
+static uint8_t bridge_version;
+
+/* Kept out of xDeviceHandle, whose entry 0 is also the address a device is
+ * enumerated at, so removing that device cannot delete the bridge task.*/
+static TaskHandle_t bridge_task_handle = NULL;
+
+/****************************************************************************
+ * Function Prototypes
+ ****************************************************************************/
+static uint8_t header_length(uint8_t header);
+static uint16_t block_crc(const uint8_t* p_block, uint8_t length);
+static void set_bridge_clock(bool fast);
+static bool read_headers(uint8_t headers[SWEEP_ENDPOINTS]);
+static bool receive_block(Bridge_block& block, bool& intact);
+static bool read_block(uint8_t en, Bridge_block& block);
+static bool read_dirty_set(Bridge_block blocks[SWEEP_ENDPOINTS],
+                           uint8_t& fresh);
+static uint8_t encode_block(uint8_t* p_raw, const uint8_t* p_payload,
+                            uint8_t length);
+static bool write_block(uint8_t en, const uint8_t* p_payload, uint8_t length);
+static bool write_set(uint8_t bitmap);
+static void flush_out_reports(void);
+static void drop_slot(uint8_t slot);
+static void update_hub(const Bridge_block& block);
+static void describe_slot(uint8_t slot, const Bridge_block& block);
+static void service_report(uint8_t slot, const Bridge_block& block);
+static void task_rt_bridge(void* pvParameters);
+
+/****************************************************************************
+ * Interrupt Handler
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+static uint8_t header_length(uint8_t header) {
+    return (header & SPI_BRIDGE_HEADER_LEN_MASK) >> SPI_BRIDGE_HEADER_LEN_SHIFT;
+}
+
+/**
+ * @brief CRC-16/CCITT over a block's header and payload, as the RT1064
+ * computes it.
+ *
+ * @param p_block : The header followed by the payload.
+ * @param length : Payload bytes covered.
+ */
+static uint16_t block_crc(const uint8_t* p_block, uint8_t length) {
+    return spi_bridge_crc16(SPI_BRIDGE_CRC_INIT, p_block, length + 1);
+}
+
+/**
+ * @brief Switches SPI0 to the set command clock, or back to SPI_SPEED.  Bridge
+ * firmware from SPI_BRIDGE_VERSION_FAST_SETS moves set command data with DMA,
+ * so the bytes go back to back, with RT_BRIDGE_TURNAROUND_US wherever the
+ * RT1064 has to decode first.  Older firmware keeps the bus clock.
+ */
+// MARK:  SPI Mutex Required
+static void set_bridge_clock(bool fast) {
+    fast = fast && bridge_version >= SPI_BRIDGE_VERSION_FAST_SETS;
+    spi_set_baudrate_div(
+        SPI0, 0,
+        sysclk_get_peripheral_hz() / (fast ? RT_BRIDGE_SPI_SPEED : SPI_SPEED));
+    spi_set_transfer_delay(SPI0, 0, SPI_DLYBS, fast ? 0 : SPI_DLYBCT);
+}
+
+/**
+ * @brief Reads the header of every swept endpoint in one transfer.  The
+ * RT1064 answers each READ_HEADER command on the byte clocked after it.
+ *
+ * @param headers : Filled with one header per endpoint.
+ * @return true if the RT1064 answered.
+ */
+// MARK:  SPI Mutex Required
+static bool read_headers(uint8_t headers[SWEEP_ENDPOINTS]) {
+    uint8_t raw[2 * SWEEP_ENDPOINTS];
+    for (uint8_t en = 0; en < SWEEP_ENDPOINTS; ++en) {
+        raw[2 * en]     = SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_READ_HEADER, en);
+        raw[2 * en + 1] = 0;
+    }
+
+    if (spi_transfer(_SPI_MODE_0, SPI_READ, CS_NO_TOGGLE, CS_RT_UPDATE, raw,
+                     sizeof(raw)) != SPI_OK) {
+        return false;
+    }
+
+    for (uint8_t en = 0; en < SWEEP_ENDPOINTS; ++en) {
+        headers[en] = raw[2 * en + 1];
+    }
+
+    /* The hub table always has an entry per slot, a shorter block means the
+     * RT1064 is not there to answer.  Newer firmware appends to the table.*/
+    return header_length(headers[SPI_BRIDGE_EN_HUB_STATUS]) >=
+           SPI_BRIDGE_HUB_STATUS_LENGTH;
+}
+
+/**
+ * @brief Clocks in one block window, header first, inside a transfer that
+ * has already been started.
+ *
+ * @param block : Filled with the block if its CRC matched.
+ * @param intact : Set to whether the CRC matched.
+ * @return false if the SPI transfer failed.
+ */
+// MARK:  SPI Mutex Required
+static bool receive_block(Bridge_block& block, bool& intact) {
+    uint8_t raw[1 + SPI_BRIDGE_MAX_PAYLOAD + 2] = {0};
+
+    intact = false;
+    if (spi_partial_transfer_array(raw, 1) != SPI_OK) {
+        return false;
+    }
+    const uint8_t LENGTH = header_length(raw[0]);
+    if (spi_partial_transfer_array(&raw[1], LENGTH + 2) != SPI_OK) {
+        return false;
+    }
+
+    const uint16_t CRC = raw[1 + LENGTH] | (raw[2 + LENGTH] << 8);
+    intact = CRC == block_crc(raw, LENGTH);
+    if (intact) {
+        block.header = raw[0];
+        memcpy(block.payload, &raw[1], LENGTH);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads one block.  The length is taken from the header the RT1064
+ * sends, so a block that changed since the sweep is still clocked out whole.
+ * The RT1064 clears DIRTY once the block has been sent.
+ *
+ * @param en : Logical endpoint to read.
+ * @param block : Filled with the block if its CRC matched.
+ * @return true if the block was read intact.
+ */
+// MARK:  SPI Mutex Required
+static bool read_block(uint8_t en, Bridge_block& block) {
+    uint8_t command = SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_READ_BLOCK, en);
+    bool intact     = false;
+
+    if (spi_start_transfer(_SPI_MODE_0, CS_NO_TOGGLE, CS_RT_UPDATE) != SPI_OK) {
+        return false;
+    }
+
+    bool ok = spi_partial_transfer_array(&command, 1) == SPI_OK;
+    ok      = ok && receive_block(block, intact);
+    ok      = (spi_end_transfer() == SPI_OK) && ok;
+    return ok && intact;
+}
+
+/**
+ * @brief Reads every dirty block in one transfer with READ_DIRTY_SET.  The
+ * RT1064 answers the mask with the bitmap of the blocks that follow and its
+ * complement, then sends those blocks in ascending endpoint order.
+ *
+ * @param blocks : Filled with the blocks whose CRC matched.
+ * @param fresh : Bitset of the endpoints read intact.
+ * @return true if the RT1064 answered.
+ */
+// MARK:  SPI Mutex Required
+static bool read_dirty_set(Bridge_block blocks[SWEEP_ENDPOINTS],
+                           uint8_t& fresh) {
+    uint8_t raw[4] = {SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_READ_BLOCK,
+                                         SPI_BRIDGE_EN_SET),
+                      SWEEP_MASK, 0, 0};
+
+    if (spi_start_transfer(_SPI_MODE_0, CS_NO_TOGGLE, CS_RT_UPDATE) != SPI_OK) {
+        return false;
+    }
+    set_bridge_clock(true);
+
+    /* The RT1064 builds its answer once it has the mask.*/
+    bool ok = spi_partial_transfer_array(raw, 2) == SPI_OK;
+    delay_us(RT_BRIDGE_TURNAROUND_US);
+    ok = ok && spi_partial_transfer_array(&raw[2], 2) == SPI_OK;
+
+    /* A bus with nothing driving it reads the same on both bytes, so the
+     * complement tells an idle bridge from a missing one.*/
+    const uint8_t BITMAP = raw[2];
+    ok = ok && static_cast<uint8_t>(~BITMAP) == raw[3] &&
+         (BITMAP & ~SWEEP_MASK) == 0;
+
+    for (uint8_t en = 0; ok && en < SWEEP_ENDPOINTS; ++en) {
+        if (!(BITMAP & (1 << en))) {
+            continue;
+        }
+
+        bool intact = false;
+        ok          = receive_block(blocks[en], intact);
+        if (ok && intact) {
+            fresh |= 1 << en;
+        }
+    }
+
+    ok = (spi_end_transfer() == SPI_OK) && ok;
+    set_bridge_clock(false);
+    return ok;
+}
+
+/**
+ * @brief Lays out a block window, header then payload then CRC.
+ *
+ * @return Bytes written to p_raw.
+ */
+static uint8_t encode_block(uint8_t* p_raw, const uint8_t* p_payload,
+                            uint8_t length) {
+    p_raw[0] = length << SPI_BRIDGE_HEADER_LEN_SHIFT;
+    memcpy(&p_raw[1], p_payload, length);
+
+    const uint16_t CRC = block_crc(p_raw, length);
+    p_raw[1 + length]  = CRC & 0xFF;
+    p_raw[2 + length]  = CRC >> 8;
+    return length + 3;
+}
+
+/**
+ * @brief Writes a report to an OUT endpoint.
+ */
+// MARK:  SPI Mutex Required
+static bool write_block(uint8_t en, const uint8_t* p_payload, uint8_t length) {
+    uint8_t raw[1 + 1 + SPI_BRIDGE_MAX_PAYLOAD + 2];
+
+    raw[0] = SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_WRITE_BLOCK, en);
+    const uint8_t SIZE = 1 + encode_block(&raw[1], p_payload, length);
+
+    return spi_transfer(_SPI_MODE_0, SPI_NO_READ, CS_NO_TOGGLE, CS_RT_UPDATE,
+                        raw, SIZE) == SPI_OK;
+}
+
+/**
+ * @brief Writes the pending OUT reports of the slots in bitmap with one
+ * WRITE_SET, the bitmap followed by a block window per endpoint.
+ *
+ * @param bitmap : Bitset of the device endpoints to write.
+ */
+// MARK:  SPI Mutex Required
+static bool write_set(uint8_t bitmap) {
+    uint8_t raw[2 + SPI_BRIDGE_DEVICE_SLOTS * (1 + SPI_BRIDGE_MAX_PAYLOAD + 2)];
+    uint16_t size = 0;
+
+    raw[size++] =
+        SPI_BRIDGE_COMMAND(SPI_BRIDGE_OP_WRITE_BLOCK, SPI_BRIDGE_EN_SET);
+    raw[size++] = bitmap;
+    for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+        const Bridge_slot& state = bridge_slots[slot];
+        if (bitmap & (1 << (SPI_BRIDGE_EN_FIRST_DEVICE + slot))) {
+            size += encode_block(&raw[size], state.out_report, state.out_length);
+        }
+    }
+
+    if (spi_start_transfer(_SPI_MODE_0, CS_NO_TOGGLE, CS_RT_UPDATE) != SPI_OK) {
+        return false;
+    }
+    set_bridge_clock(true);
+
+    /* The RT1064 reads each window's header before it can receive the rest.*/
+    bool ok = spi_partial_write_array(raw, 2) == SPI_OK;
+    for (uint16_t offset = 2; ok && offset < size;) {
+        const uint8_t WINDOW = header_length(raw[offset]) + 3;
+        delay_us(RT_BRIDGE_TURNAROUND_US);
+        ok = spi_partial_write_array(&raw[offset], WINDOW) == SPI_OK;
+        offset += WINDOW;
+    }
+
+    ok = (spi_end_transfer() == SPI_OK) && ok;
+    set_bridge_clock(false);
+    return ok;
+}
+
+/**
+ * @brief Sends the OUT reports queued during the OUT pass, in one WRITE_SET
+ * if the bridge supports it.
+ */
+static void flush_out_reports(void) {
+    uint8_t bitmap = 0;
+    for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+        if (bridge_slots[slot].out_pending) {
+            bitmap |= 1 << (SPI_BRIDGE_EN_FIRST_DEVICE + slot);
+        }
+    }
+    if (bitmap == 0) {
+        return;
+    }
+
+    {
+        service::spi_scheduler::bus_guard lg;
+        if (bridge_version >= SPI_BRIDGE_VERSION_SET_COMMANDS) {
+            write_set(bitmap);
+        } else {
+            for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+                const Bridge_slot& state = bridge_slots[slot];
+                if (state.out_pending) {
+                    write_block(SPI_BRIDGE_EN_FIRST_DEVICE + slot,
+                                state.out_report, state.out_length);
+                }
+            }
+        }
+    }
+
+    for (Bridge_slot& state : bridge_slots) {
+        state.out_pending = false;
+    }
+}
+
+/**
+ * @brief Forgets a slot's device, stopping the slots it may be driving.
+ */
+static void drop_slot(uint8_t slot) {
+    Bridge_slot& state    = bridge_slots[slot];
+    const bool WAS_IN_USE = state.described;
+
+    state.out_queue.reset();
+    state.out_state.reset();
+    state.connected   = false;
+    state.described   = false;
+    state.out_pending = false;
+
+    if (WAS_IN_USE) {
+        remove_usb_device(SLOT_ADDRESS(slot));
+    }
+    usb_host_print("\n** RT bridge device %d disconnected **\n", slot);
+}
+
+static void update_hub(const Bridge_block& block) {
+    const uint8_t LENGTH = header_length(block.header);
+    if (LENGTH < SPI_BRIDGE_DEVICE_SLOTS) {
+        return;
+    }
+
+    const uint8_t VERSION = LENGTH > SPI_BRIDGE_HUB_VERSION_INDEX
+                                ? block.payload[SPI_BRIDGE_HUB_VERSION_INDEX]
+                                : 0;
+    if (VERSION != bridge_version) {
+        usb_host_print("\n** RT bridge protocol version %d **\n", VERSION);
+        bridge_version = VERSION;
+    }
+
+    for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+        const bool CONNECTED = block.payload[slot] != 0;
+        if (CONNECTED == bridge_slots[slot].connected) {
+            continue;
+        }
+
+        if (CONNECTED) {
+            /* The device is serviced once its report descriptor arrives.*/
+            bridge_slots[slot].connected = true;
+            usb_host_print("\n** RT bridge device %d connected **\n", slot);
+        } else {
+            drop_slot(slot);
+        }
+    }
+}
+
+/**
+ * @brief Sets up a slot's device from the report descriptor the RT1064
+ * mirrored, the way task_usb_device does after enumerating.
+ */
+static void describe_slot(uint8_t slot, const Bridge_block& block) {
+    const uint8_t ADDRESS = SLOT_ADDRESS(slot);
+    Bridge_slot& state    = bridge_slots[slot];
+    UsbDevice& device     = usb_device[ADDRESS];
+
+    state.out_queue.reset();
+    state.out_state.reset();
+    state.described   = false;
+    state.out_pending = false;
+
+    memset(&device, 0, sizeof(UsbDevice));
+    device.hid_data.slot_select = 0;
+
+    if (HID_parse_report(ADDRESS, block.payload,
+                         header_length(block.header)) != 0) {
+        error_print("ERROR: RT bridge device %d report did not parse\r\n",
+                    slot);
+        memset(&device, 0, sizeof(UsbDevice));
+        return;
+    }
+    fix_hid_report_parsing_errors(ADDRESS);
+
+    /* The RT1064 owns the endpoints, these only mark which directions the
+     * device has.*/
+    device.hid_data.hid_in_ep  = device.hid_data.num_of_input_bytes ? 1 : -1;
+    device.hid_data.hid_out_ep = device.hid_data.num_of_output_bytes ? 1 : -1;
+    device.interface_descriptor.bInterfaceClass = USB_CLASS_HID;
+    device.enumerated                           = true;
+
+    if (device.hid_data.hid_out_ep != -1) {
+        state.out_queue = service::itc::pipeline_hid_out().create_queue(ADDRESS);
+        state.out_state.emplace(ADDRESS,
+                                drivers::usb_device::out_transport::RT_BRIDGE);
+    }
+
+    // Reloads from EEPROM on connect.
+    {
+        auto handle = service::hid_mapping::address_handle::create(ADDRESS);
+        drivers::spi::handle_factory spi;
+        handle.load_in_from_eeprom(spi);
+        handle.load_out_from_eeprom(spi);
+    }
+
+    state.described = true;
+
+    /* First pass so controls like toggle switches get their initial state.*/
+    auto mappings = service::hid_mapping::address_handle::create(ADDRESS);
+    drivers::usb_device::service_in_report(device, mappings);
+}
+
+static void service_report(uint8_t slot, const Bridge_block& block) {
+    UsbDevice& device = usb_device[SLOT_ADDRESS(slot)];
+    const uint8_t LENGTH =
+        std::min<uint8_t>(header_length(block.header), HID_MAX_BYTES);
+
+    memcpy(device.hid_data.hid_buf, block.payload, LENGTH);
+    memset(&device.hid_data.hid_buf[LENGTH], 0, HID_MAX_BYTES - LENGTH);
+
+    auto mappings =
+        service::hid_mapping::address_handle::create(SLOT_ADDRESS(slot));
+    drivers::usb_device::service_in_report(device, mappings);
+}
+
+/****************************************************************************
+ * Task
+ ****************************************************************************/
+/**
+ * @brief Polls the bridge and services the devices behind it.  The dirty
+ * block reads run as one burst on the bus, the devices are serviced after the
+ * bus is released.
+ *
+ * @param pvParameters : Not used.
+ */
+static void task_rt_bridge(void* pvParameters) {
+    UNUSED(pvParameters);
+    service::spi_scheduler::register_client(
+        "RT Bridge", service::spi_scheduler::priority::CONTROL);
+
+    /* The hub table is read on the first pass even if it is not dirty, the
+     * RT1064 may have listed devices before the S70 started.*/
+    bool hub_stale     = true;
+    uint8_t bad_sweeps = 0;
+
+    TimeOut_t out_timer;
+    TickType_t out_wait = USB_HOST_DEVICE_TASK_RATE;
+    vTaskSetTimeOutState(&out_timer);
+
+    TickType_t last_wake = xTaskGetTickCount();
+    for (;;) {
+        vTaskDelayUntil(&last_wake, RT_BRIDGE_POLL_RATE);
+
+        uint8_t headers[SWEEP_ENDPOINTS];
+        Bridge_block blocks[SWEEP_ENDPOINTS];
+        uint8_t fresh = 0; /* bitset of the endpoints read this pass*/
+        bool answered;
+        {
+            service::spi_scheduler::bus_guard lg;
+
+            /* The version is only known once a hub table has been read, the
+             * first pass after a reset always sweeps.*/
+            const bool SET_READ =
+                !hub_stale &&
+                bridge_version >= SPI_BRIDGE_VERSION_SET_COMMANDS;
+            answered = SET_READ ? read_dirty_set(blocks, fresh)
+                                : read_headers(headers);
+            for (uint8_t en = 0; answered && !SET_READ && en < SWEEP_ENDPOINTS;
+                 ++en) {
+                const bool WANTED =
+                    (headers[en] & SPI_BRIDGE_HEADER_DIRTY) ||
+                    (en == SPI_BRIDGE_EN_HUB_STATUS && hub_stale);
+                if (WANTED && read_block(en, blocks[en])) {
+                    fresh |= 1 << en;
+                }
+            }
+        }
+
+        if (!answered) {
+            if (bad_sweeps < RT_BRIDGE_LINK_LOST_SWEEPS &&
+                ++bad_sweeps == RT_BRIDGE_LINK_LOST_SWEEPS) {
+                error_print("ERROR: RT bridge stopped answering\r\n");
+                for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+                    if (bridge_slots[slot].connected) {
+                        drop_slot(slot);
+                    }
+                }
+                hub_stale      = true;
+                bridge_version = 0;
+            }
+            continue;
+        }
+        bad_sweeps = 0;
+
+        if (fresh & (1 << SPI_BRIDGE_EN_HUB_STATUS)) {
+            update_hub(blocks[SPI_BRIDGE_EN_HUB_STATUS]);
+            hub_stale = false;
+        }
+
+        for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+            const uint8_t EN = SPI_BRIDGE_EN_FIRST_DEVICE + slot;
+            if (!(fresh & (1 << EN)) || !bridge_slots[slot].connected) {
+                continue;
+            }
+
+            if (blocks[EN].header & SPI_BRIDGE_HEADER_TYPE) {
+                describe_slot(slot, blocks[EN]);
+            } else if (bridge_slots[slot].described) {
+                service_report(slot, blocks[EN]);
+            }
+        }
+
+        if (xTaskCheckForTimeOut(&out_timer, &out_wait) == pdTRUE) {
+            for (uint8_t slot = 0; slot < SPI_BRIDGE_DEVICE_SLOTS; ++slot) {
+                Bridge_slot& state = bridge_slots[slot];
+                if (!state.described || !state.out_queue) {
+                    continue;
+                }
+
+                auto mappings = service::hid_mapping::address_handle::create(
+                    SLOT_ADDRESS(slot));
+                drivers::usb_device::service_out_report(
+                    usb_device[SLOT_ADDRESS(slot)], *state.out_queue, mappings,
+                    *state.out_state);
+            }
+            flush_out_reports();
+
+            out_wait = USB_HOST_DEVICE_TASK_RATE;
+            vTaskSetTimeOutState(&out_timer);
+        }
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+/**
+ * @brief Probes the RT1064 bridge and, if it answers, starts the bridge task
+ * as the USB host transport.
+ *
+ * @return true if the bridge is the USB host transport.
+ */
+bool rt_bridge_init(void) {
+    bool present = false;
+    for (uint8_t attempt = 0; attempt < RT_BRIDGE_PROBE_ATTEMPTS && !present;
+         ++attempt) {
+        {
+            service::spi_scheduler::bus_guard lg;
+            uint8_t headers[SWEEP_ENDPOINTS];
+            Bridge_block hub;
+            present = read_headers(headers) &&
+                      read_block(SPI_BRIDGE_EN_HUB_STATUS, hub);
+        }
+        if (!present) {
+            delay_ms(RT_BRIDGE_PROBE_DELAY_MS);
+        }
+    }
+
+    if (!present) {
+        return false;
+    }
+
+    /* The bridge task takes the host task's place.*/
+    if (xTaskCreate(task_rt_bridge, "RT Bridge", TASK_RT_BRIDGE_STACK_SIZE,
+                    NULL, TASK_RT_BRIDGE_STACK_PRIORITY,
+                    &bridge_task_handle) != pdPASS) {
+        error_print("ERROR: Failed to create RT bridge task\r\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Queues an OUT report for a device behind the bridge.  The reports
+ * queued during an OUT pass are written together at its end, so this must
+ * only be called from the bridge task.
+ *
+ * @param address : Address of the device.
+ * @param p_report : The report.
+ * @param length : Length of the report in bytes.
+ * @return true if the report was queued.
+ */
+bool rt_bridge_write_out_report(uint8_t address, const uint8_t* p_report,
+                                uint8_t length) {
+    if (address < SLOT_ADDRESS(0) ||
+        address >= SLOT_ADDRESS(SPI_BRIDGE_DEVICE_SLOTS) ||
+        length > SPI_BRIDGE_MAX_PAYLOAD) {
+        return false;
+    }
+
+    Bridge_slot& state = bridge_slots[address - SLOT_ADDRESS(0)];
+    memcpy(state.out_report, p_report, length);
+    state.out_length  = length;
+    state.out_pending = true;
+    return true;
+}
+
+/**
+ * @brief The protocol version from the last hub status read, 0 until the
+ * bridge has answered.
+ */
+uint8_t rt_bridge_protocol_version(void) { return bridge_version; }
+
+/**
+ * @brief Switches SPI0 to the set command clock, or back to SPI_SPEED, for
+ * other commands whose data the RT1064 moves with DMA, such as the firmware
+ * update sectors.  Call it after spi_start_transfer().
+ */
+// MARK:  SPI Mutex Required
+void rt_bridge_set_clock(bool fast) { set_bridge_clock(fast); }
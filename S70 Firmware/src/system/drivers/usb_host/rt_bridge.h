@@ -0,0 +1,57 @@
+/**
+ * @file rt_bridge.h
+ *
+ * @brief USB host transport through the RT1064 SPI bridge.  The RT1064
+ * enumerates the devices and mirrors their report descriptors and reports into
+ * blocks that this driver polls, so HID devices are serviced without the
+ * MAX3421E stack.
+ *
+ */
+
+#ifndef SRC_SYSTEM_DRIVERS_USB_HOST_RT_BRIDGE_H_
+#define SRC_SYSTEM_DRIVERS_USB_HOST_RT_BRIDGE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+/* Times the bridge is probed at start up, the RT1064 may still be booting.*/
+#define RT_BRIDGE_PROBE_ATTEMPTS		5
+#define RT_BRIDGE_PROBE_DELAY_MS		20
+
+/* Consecutive bad header sweeps before the bridge devices are dropped.*/
+#define RT_BRIDGE_LINK_LOST_SWEEPS		50
+
+/* SPI0 clock for set commands to bridge firmware that sends their data with
+ * DMA (SPI_BRIDGE_VERSION_FAST_SETS), an exact divider of the 150 MHz
+ * peripheral clock.  Everything else on the bus stays at SPI_SPEED.*/
+#define RT_BRIDGE_SPI_SPEED				15000000
+
+/* Pause in a set command wherever the RT1064 task has to decode what it was
+ * sent and arm its DMA before the next byte is clocked.*/
+#define RT_BRIDGE_TURNAROUND_US			10
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+bool rt_bridge_init(void);
+bool rt_bridge_write_out_report(uint8_t address, const uint8_t *p_report, uint8_t length);
+uint8_t rt_bridge_protocol_version(void);
+void rt_bridge_set_clock(bool fast);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_SYSTEM_DRIVERS_USB_HOST_RT_BRIDGE_H_ */
@@ -1,3 +1,5 @@
+#include <array>
+#include <bit>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
@@ -13,6 +15,7 @@
 #include "itc-service.hh"
 #include "lock_guard.hh"
 #include "max3421e_usb.h"
+#include "max3421e_xfer.h"
 #include "slots.h"
 #include "usb_device.hh"
 #include "user_spi.h"
@@ -27,22 +30,33 @@
 /*****************************************************************************
  * Data Types
  *****************************************************************************/
+/// \brief An IN report as little-endian words, with a zero word at the end so
+///        any control can be read from two consecutive words.
+using report_words = std::array<uint32_t, HID_REPORT_WORDS + 1>;
 
 /*****************************************************************************
  * Private Function Prototypes
  *****************************************************************************/
-/// \brief Extracts the value of a control from the device' data.
-static int16_t extract_control_value(const UsbDevice& device, uint8_t ctrl_no);
+/// \brief Reads the two words starting at a word of the report.
+static uint64_t load_words(const report_words& words, uint8_t word);
 
 /**
- * Extracts the value of a control from the data buffer.
- * \pre data_buffer has sufficient size for the ctrl's bit and byte offsets.
- * \param[in] ctrl        The descriptor of the HID IN control that needs
- *                        parsing.
- * \param[in] data_buffer The buffer that contains the IN report data.
+ * Finds the controls whose bits differ between the current and previous
+ * reports.
+ * Words that did not change are skipped without looking at their controls.
+ * \return A bitset of control numbers.
  */
-static int16_t extract_control_value(const Hid_Control_info& ctrl,
-                                     const uint8_t* data_buffer);
+static uint16_t find_changed_controls(const Hid_Input_plan& plan,
+                                      const report_words& current,
+                                      const report_words& previous);
+
+/**
+ * Extracts the value of a control from the report.
+ * \param[in] extract The compiled extraction for the control.
+ * \param[in] report  The IN report data.
+ */
+static int16_t extract_control_value(const Hid_Control_extract& extract,
+                                     const report_words& report);
 
 /// \brief Applies any supported HID control item type bits to the value,
 ///        then returns the modified value.
@@ -53,7 +67,7 @@ static int16_t normalize_dial(Hid_Control_info& info, int16_t value);
 
 /// \brief Normalizes the value to the range [-1, 1] where 0 is the mean
 ///        of the control's logical min and max values.
-static float normalize_axis(Hid_Control_info& info,
+static float normalize_axis(Hid_Control_info& info, Hid_Axis_scale& scale,
                             const Hid_Mapping_control_in& mapping,
                             int16_t value);
 
@@ -112,6 +126,41 @@ static void modify_controls(
 /*****************************************************************************
  * Public Functions
  *****************************************************************************/
+bool drivers::usb_device::poll_in_report(UsbDevice& device, uint8_t address,
+                                         Usb_xfer& xfer, TickType_t timeout) {
+    const int8_t EP_INDEX =
+        device.hid_data.hid_in_ep == -1
+            ? -1
+            : usb_ep_index(address, 0x80 | device.hid_data.hid_in_ep);
+    if (EP_INDEX == -1) {
+        vTaskDelay(timeout);
+        return false;
+    }
+
+    // NAKs are retried by the engine at the endpoint's interval, so the
+    // transfer stays queued until the device has a report.
+    if (!xfer.queued) {
+        xfer.address   = address;
+        xfer.ep_index  = EP_INDEX;
+        xfer.token     = tokIN;
+        xfer.nak_limit = XFER_NAK_RETRY;
+        xfer.buf       = device.hid_data.hid_buf;
+        xfer.length    = device.hid_data.num_of_input_bytes;
+        if (!max3421e_xfer_submit(&xfer)) {
+            vTaskDelay(timeout);
+            return false;
+        }
+    }
+
+    const uint8_t RCODE = max3421e_xfer_wait(&xfer, timeout);
+    if (RCODE == hrBUSY && !device.initialized) {
+        // The first pass reads hid_buf, so nothing may still be filling it.
+        max3421e_xfer_cancel(&xfer);
+    }
+
+    return RCODE == hrSUCCESS;
+}
+
 void drivers::usb_device::service_in_report(
     UsbDevice& device, service::hid_mapping::address_handle& mappings) {
     // -1 represents that the hid_in_ep was not found.
@@ -125,16 +174,24 @@ void drivers::usb_device::service_in_report(
         device.hid_data.num_of_input_controls_initialized = 0;
     }
 
-    {
-        auto _ = lock_guard(xSPI_Semaphore);
-        usb_read(mappings.address(), device.hid_data.hid_in_ep,
-                 device.hid_data.num_of_input_bytes, device.hid_data.hid_buf,
-                 nullptr, 0);
-    }
-
-    for (uint8_t ctrl_no = 0;
-         ctrl_no < std::min<uint8_t>(IN_CONTROL_COUNT, mappings.in_map_size());
-         ++ctrl_no) {
+    const Hid_Input_plan& PLAN = device.hid_data.in_plan;
+    report_words report{};
+    report_words previous{};
+    std::memcpy(report.data(), device.hid_data.hid_buf,
+                sizeof(device.hid_data.hid_buf));
+    std::memcpy(previous.data(), device.hid_data.hid_prev_buf,
+                sizeof(device.hid_data.hid_prev_buf));
+
+    const uint8_t SERVICED_COUNT =
+        std::min<uint8_t>(IN_CONTROL_COUNT, mappings.in_map_size());
+    const uint16_t SERVICED = (1UL << SERVICED_COUNT) - 1;
+    const uint16_t CHANGED  = !device.initialized
+                                  ? SERVICED
+                                  : find_changed_controls(PLAN, report, previous) &
+                                        SERVICED;
+
+    for (uint16_t pending = CHANGED; pending != 0; pending &= pending - 1) {
+        const uint8_t ctrl_no = std::countr_zero(pending);
         const Hid_Mapping_control_in& MAPPING = mappings.in_map(ctrl_no);
         const uint16_t DEVICE_VID             = device.dev_descriptor.idVendor;
         const uint16_t DEVICE_PID             = device.dev_descriptor.idProduct;
@@ -148,17 +205,6 @@ void drivers::usb_device::service_in_report(
             continue;
         }
 
-        const uint8_t BYTE_POS =
-            device.hid_data.hid_in_controls[ctrl_no].byte_position;
-
-        const bool BYTE_CHANGED = device.hid_data.hid_buf[BYTE_POS] !=
-                                      device.hid_data.hid_prev_buf[BYTE_POS] ||
-                                  !device.initialized;
-
-        if (!BYTE_CHANGED) {
-            continue;
-        }
-
         if (device.hid_data.num_of_input_controls_initialized <
             device.hid_data.num_of_input_controls) {
             ++device.hid_data.num_of_input_controls_initialized;
@@ -168,7 +214,8 @@ void drivers::usb_device::service_in_report(
             continue;
         }
 
-        const int16_t VALUE = extract_control_value(device, ctrl_no);
+        const int16_t VALUE =
+            extract_control_value(PLAN.controls[ctrl_no], report);
         service::itc::message::hid_in_message message{
             .mode         = MAPPING.mode,
             .control_data = 0,
@@ -349,6 +396,7 @@ void drivers::usb_device::service_in_report(
                                device.hid_data.hid_in_controls[ctrl_no], VALUE)
                          : normalize_axis(
                                device.hid_data.hid_in_controls[ctrl_no],
+                               device.hid_data.in_plan.axis_scales[ctrl_no],
                                MAPPING, VALUE)) *
                     (MAPPING.reverse_dir == 0 ? 1 : -1);
 
@@ -389,49 +437,48 @@ void drivers::usb_device::service_in_report(
 /*****************************************************************************
  * Private Functions
  *****************************************************************************/
-static int16_t extract_control_value(const UsbDevice& device, uint8_t ctrl_no) {
-    return extract_control_value(device.hid_data.hid_in_controls[ctrl_no],
-                                 device.hid_data.hid_buf);
+static uint64_t load_words(const report_words& words, const uint8_t word) {
+    return words[word] | (static_cast<uint64_t>(words[word + 1]) << 32);
 }
 
-static int16_t extract_control_value(const Hid_Control_info& ctrl,
-                                     const uint8_t* data_buffer) {
-    uint8_t byte_bit_position = 0;
-    uint8_t mask              = 0;
-    int16_t value             = 0;
-
-    /*Get the position to read from the buffer*/
-    const uint8_t control_byte_position = ctrl.byte_position;
-
-    switch (ctrl.report_size) {
-    case 1: /* 1 bit for buttons*/
-
-        /*Figure out the mask for the control.  Mask = 1 << (bit_position -
-         * (byte_position * 8))*/
-        byte_bit_position = (ctrl.bit_position - (ctrl.byte_position * 8));
-        mask              = 1 << byte_bit_position;
-        value = ((data_buffer[control_byte_position] & mask) != 0) ? 1 : 0;
-        break;
-
-    case 8: /* 8 bits*/
-        // check if the 8 bit value is signed or unsigned
-        if (ctrl.logical_min < 0)
-            value = (int8_t)data_buffer[control_byte_position];
-        else
-            value = (uint8_t)data_buffer[control_byte_position];
-        break;
-
-    case 16: /* 16 bits*/
-        // assume tha the 16 bit value is signed
-        value = data_buffer[control_byte_position] +
-                (data_buffer[control_byte_position + 1] << 8);
-        break;
-
-    default:
-        break;
+static uint16_t find_changed_controls(const Hid_Input_plan& plan,
+                                      const report_words& current,
+                                      const report_words& previous) {
+    report_words diff{};
+    uint16_t candidates = 0;
+    for (uint8_t word = 0; word < plan.num_of_words; ++word) {
+        diff[word] = current[word] ^ previous[word];
+        if (diff[word] != 0) {
+            candidates |= plan.word_controls[word];
+        }
     }
 
-    return value;
+    // Controls sharing a changed word may not have changed themselves.
+    uint16_t changed = 0;
+    for (uint16_t pending = candidates; pending != 0; pending &= pending - 1) {
+        const uint8_t CTRL_NO              = std::countr_zero(pending);
+        const Hid_Control_extract& EXTRACT = plan.controls[CTRL_NO];
+        if ((load_words(diff, EXTRACT.word) & EXTRACT.change_mask) != 0) {
+            changed |= 1 << CTRL_NO;
+        }
+    }
+
+    return changed;
+}
+
+static int16_t extract_control_value(const Hid_Control_extract& extract,
+                                     const report_words& report) {
+    uint16_t value = static_cast<uint16_t>(
+        (load_words(report, extract.word) >> extract.shift) &
+        extract.value_mask);
+
+    // Sign-extend from the control's top bit.
+    const uint16_t SIGN_BIT = (extract.value_mask >> 1) + 1;
+    if (extract.sign_extend && (value & SIGN_BIT) != 0) {
+        value |= ~extract.value_mask;
+    }
+
+    return static_cast<int16_t>(value);
 }
 
 static int16_t apply_item_bits(Hid_Control_info& info, int16_t value) {
@@ -479,38 +526,47 @@ static int16_t normalize_dial(Hid_Control_info& info, int16_t value) {
     }
 }
 
-static float normalize_axis(Hid_Control_info& info,
+static float normalize_axis(Hid_Control_info& info, Hid_Axis_scale& scale,
                             const Hid_Mapping_control_in& mapping,
                             int16_t value) {
-    const uint16_t DEADBAND =
-        mapping.dead_band + 1;  // minimum of 1 for rounding.
+    // The scale only changes with the mapping.
+    if (!scale.valid || scale.dead_band != mapping.dead_band ||
+        scale.speed_modifier != mapping.speed_modifier) {
+        const int16_t DEADBAND =
+            mapping.dead_band + 1;  // minimum of 1 for rounding.
+
+        const int16_t Xn1 = info.logical_min;
+        const int16_t X0  = (info.logical_min + info.logical_max) / 2;
+        const int16_t X1  = info.logical_max;
+
+        // High speed controls the maximum speed coefficient (A)
+        const float A = (1 + (float)mapping.speed_modifier) / 256;
+
+        const float M_UPPER = 1.0f / (X1 - X0 - DEADBAND);
+        const float M_LOWER = 1.0f / (X0 - Xn1 - DEADBAND);
+
+        scale = Hid_Axis_scale{
+            .valid          = true,
+            .dead_band      = mapping.dead_band,
+            .speed_modifier = mapping.speed_modifier,
+            .upper          = static_cast<int16_t>(X0 + DEADBAND),
+            .lower          = static_cast<int16_t>(X0 - DEADBAND),
+            .slope_upper    = A * M_UPPER,
+            .offset_upper   = A * -M_UPPER * (X0 + DEADBAND),
+            .slope_lower    = A * M_LOWER,
+            .offset_lower   = A * M_LOWER * (DEADBAND - X0),
+        };
+    }
 
     value = apply_item_bits(info, value);
 
-    const int16_t Xn1 = info.logical_min;
-    const int16_t X0  = (info.logical_min + info.logical_max) / 2;
-    const int16_t X1  = info.logical_max;
-
-    // High speed controls the maximum speed coefficient (A)
-    const float A = (1 + (float)mapping.speed_modifier) / 256;
-
-    // Linear function terms
-    float m;
-    float b;
-
-    if (value > X0 + DEADBAND) {
-        m = 1.0 / (X1 - X0 - DEADBAND);
-        b = -m * (X0 + DEADBAND);
-    } else if (value < X0 - DEADBAND) {
-        m = 1.0 / (X0 - Xn1 - DEADBAND);
-        b = m * (DEADBAND - X0);
-    } else {
-        m = 0;
-        b = 0;
+    float rt = 0;
+    if (value > scale.upper) {
+        rt = scale.slope_upper * value + scale.offset_upper;
+    } else if (value < scale.lower) {
+        rt = scale.slope_lower * value + scale.offset_lower;
     }
 
-    const float rt = A * (m * value + b);
-
     hid_report_print("Axis: (%d), Normalized: (%d)", value,
                      (int16_t)(rt * 1000));
 
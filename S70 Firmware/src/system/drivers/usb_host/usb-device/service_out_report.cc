@@ -13,6 +13,8 @@
 #include "itc-service.hh"
 #include "lock_guard.hh"
 #include "max3421e_usb.h"
+#include "max3421e_xfer.h"
+#include "rt_bridge.h"
 #include "slot_nums.h"
 #include "slots.h"
 #include "spi-transfer-handle.hh"
@@ -118,8 +120,9 @@ static constexpr color_data COLOR_OFF = color_data{0, 0, 0};
 /*****************************************************************************
  * Public Functions
  *****************************************************************************/
-drivers::usb_device::out_report_state::out_report_state(uint8_t address)
-    : resend_cntr(0) {
+drivers::usb_device::out_report_state::out_report_state(
+    uint8_t address, out_transport transport)
+    : resend_cntr(0), transport(transport) {
     memset(mapping_colors, LED_ID_OFF, sizeof(mapping_colors));
 }
 
@@ -304,10 +307,28 @@ void drivers::usb_device::service_out_report(
         memcmp(&state.last_out_report, &LAST_SERIALIZED,
                sizeof(LAST_SERIALIZED)) != 0) {
         /*Write the out report to the device*/
-        auto _ = lock_guard(xSPI_Semaphore);
-        usb_write(mappings.address(), device.hid_data.hid_out_ep,
-                  device.hid_data.num_of_output_bytes, state.last_out_report,
-                  0);
+        const int8_t EP_INDEX =
+            usb_ep_index(mappings.address(), device.hid_data.hid_out_ep);
+        if (state.transport == out_transport::RT_BRIDGE) {
+            rt_bridge_write_out_report(mappings.address(),
+                                       state.last_out_report,
+                                       device.hid_data.num_of_output_bytes);
+        } else if (EP_INDEX != -1) {
+            Usb_xfer xfer{};
+            xfer.address   = mappings.address();
+            xfer.ep_index  = EP_INDEX;
+            xfer.token     = tokOUT;
+            xfer.nak_limit = 0;
+            xfer.buf       = state.last_out_report;
+            xfer.length    = device.hid_data.num_of_output_bytes;
+
+            // The report buffer must not change while the engine holds it.
+            if (max3421e_xfer_submit(&xfer) &&
+                max3421e_xfer_wait(&xfer, pdMS_TO_TICKS(USB_XFER_TIMEOUT)) ==
+                    hrBUSY) {
+                max3421e_xfer_cancel(&xfer);
+            }
+        }
         state.resend_cntr = state.RESEND_CYCLES;
     }
 }
@@ -21,6 +21,7 @@
 #include "lock_guard.hh"
 #include "max3421e.h"
 #include "max3421e_usb.h"
+#include "max3421e_xfer.h"
 #include "spi-transfer-handle.hh"
 #include "string.h"
 #include "sys_task.h"
@@ -314,14 +315,12 @@ static void task_usb_device(UsbNewDevice* pNew_device) {
                                        failed to enumerate*/
     }
 
-    /*Setup the task delay from the interval at which we need to poll the
-     * device*/
-    TickType_t xLastWakeTime;
-    // Initialize the xLastWakeTime variable with the current time.
-    xLastWakeTime = xTaskGetTickCount();
-    const TickType_t xTicksToDelay =
-        usb_device[address].ep_descriptor[0].bInterval /
-        ((float)1000 / configTICK_RATE_HZ);
+    /*Setup the OUT report period from the interval at which we need to poll
+     * the device.  IN reports arrive from the transfer engine at the IN
+     * endpoint's own interval.*/
+    const TickType_t xTicksToDelay = std::max<TickType_t>(
+        1, usb_device[address].ep_descriptor[0].bInterval /
+               ((float)1000 / configTICK_RATE_HZ));
 
     print_device_info(address);
 
@@ -382,21 +381,36 @@ static void task_usb_device(UsbNewDevice* pNew_device) {
 
     vTaskDelay(pdMS_TO_TICKS(100));
 
+    Usb_xfer in_xfer{};
+    TimeOut_t out_timer;
+    TickType_t out_wait = xTicksToDelay;
+    vTaskSetTimeOutState(&out_timer);
+
     for (;;) {
+        // Wait for the next IN report, at most until the OUT report is due.
+        const bool NEW_REPORT = drivers::usb_device::poll_in_report(
+            usb_device[address], address, in_xfer, out_wait);
+        const bool OUT_DUE =
+            xTaskCheckForTimeOut(&out_timer, &out_wait) == pdTRUE;
+
         // Service the in and out data.
         {
             auto mappings =
                 service::hid_mapping::address_handle::create(address);
-            drivers::usb_device::service_in_report(usb_device[address],
-                                                   mappings);
-            if (maybe_out_queue) {
+            if (NEW_REPORT || !usb_device[address].initialized) {
+                drivers::usb_device::service_in_report(usb_device[address],
+                                                       mappings);
+            }
+            if (maybe_out_queue && OUT_DUE) {
                 drivers::usb_device::service_out_report(
                     usb_device[address], *maybe_out_queue, mappings, out_state);
             }
         }
 
-        /* Wait for the next cycle base on bInterval.*/
-        vTaskDelayUntil(&xLastWakeTime, xTicksToDelay);
+        if (OUT_DUE) {
+            out_wait = xTicksToDelay;
+            vTaskSetTimeOutState(&out_timer);
+        }
     }
 }
 
@@ -5,11 +5,20 @@
 #include "hid_out.h"
 #include "hid_report.h"
 #include "itc-service.hh"
+#include "max3421e_xfer.h"
 #include "slots.h"
 #include "usb_device.h"
 
 namespace drivers::usb_device {
 
+/// \brief Where a device's OUT reports are written.
+enum class out_transport : uint8_t {
+    /// Through the MAX3421E transfer engine.
+    MAX3421E,
+    /// As a WRITE_BLOCK to the RT1064 bridge.
+    RT_BRIDGE,
+};
+
 class out_report_state {
    public:
     struct slot_state {
@@ -57,10 +66,21 @@ class out_report_state {
     Led_color_id mapping_colors[MAX_NUM_CONTROLS];
     slot_state slot_states[NUMBER_OF_BOARD_SLOTS];
     uint8_t resend_cntr;
+    out_transport transport;
 
-    out_report_state(uint8_t address);
+    out_report_state(uint8_t address,
+                     out_transport transport = out_transport::MAX3421E);
 };
 
+/**
+ * Keeps an IN transfer queued with the transfer engine and waits for it.
+ * \param[inout] xfer The device task's IN transfer.
+ * \param[in] timeout Ticks to wait for a report.
+ * \return True if a new report is in hid_buf.
+ */
+bool poll_in_report(UsbDevice& device, uint8_t address, Usb_xfer& xfer,
+                    TickType_t timeout);
+
 void service_in_report(UsbDevice& device,
                        service::hid_mapping::address_handle& mappings);
 
@@ -14,6 +14,8 @@
 #include <asf.h>
 #include <pins.h>
 #include "max3421e.h"
+#include "max3421e_xfer.h"
+#include "rt_bridge.h"
 #include "UsbCore.h"
 #include "usb_device.h"
 #include "usb_hub.h"
@@ -196,7 +198,7 @@ static void task_usb_host(void *pvParameters)
 	vTaskDelay(pdMS_TO_TICKS(500));
 	for (;;)
 	{
-		/* Poll the interrupt pin to see if we had a connection change to the root port*/
+		/* Check if the transfer engine saw a connection change on the root port*/
 		host_root.bus_state = MAX3421E_Task();
 
 		/*If we had a connection change on the root port, do all the task to either create
@@ -225,6 +227,26 @@ void remove_usb_device(uint8_t address)
 	em_stop(EM_STOP_ALL);	// send stop signal to all slots
 
 	TaskHandle_t temp_handle = xDeviceHandle[address];
+	const bool IS_SELF = temp_handle == xTaskGetCurrentTaskHandle();
+
+	/* The device's transfers live on its task's stack.  Stop the task first
+	 * so it cannot resubmit one while they are cancelled.  A device task
+	 * removing itself is already not submitting.*/
+	if (temp_handle != NULL && !IS_SELF)
+	{
+		vTaskSuspend(temp_handle);
+	}
+
+	/* Drop its transfers from the engine before their memory goes*/
+	max3421e_xfer_cancel_address(address);
+
+	// Use the handle to delete the task, unless it is the caller which must
+	// free its structures first.
+	xDeviceHandle[address] = NULL;
+	if (temp_handle != NULL && !IS_SELF)
+	{
+		vTaskDelete(temp_handle);
+	}
 
 	/* Reset the structure*/
 	memset(&usb_device[address], 0, sizeof(UsbDevice));
@@ -236,17 +258,16 @@ void remove_usb_device(uint8_t address)
 		pDev[address] = NULL;
 	}
 
-	// Use the handle to delete the task.
-	if (xDeviceHandle[address] != NULL)
+	if (temp_handle != NULL && IS_SELF)
 	{
-		xDeviceHandle[address] = NULL;
-		vTaskDelete(temp_handle);
+		vTaskDelete(NULL);
 	}
 }
 
 /**
- * @brief Initialize the MAX3421e chip and create the USB host task.
- *
+ * @brief Start the USB host transport.  Devices are serviced through the RT1064
+ * bridge when it answers, else initialize the MAX3421e chip and create the USB
+ * host task.
  *
  */
 // MARK:  SPI Mutex Required
@@ -262,10 +283,19 @@ void usb_host_init(void)
 		memset(&usb_device[i], 0, sizeof(UsbDevice));
 	}
 
+	/* The RT1064 bridge is the primary transport, the MAX3421E is only used
+	 * when the RT1064 does not answer*/
+	if (rt_bridge_init())
+	{
+		return;
+	}
+
 	ready = !max3421e_init();
 
 	if (ready)
 	{
+		max3421e_xfer_init();
+
 		/* Create task to for the USB host */
 		if (xTaskCreate(task_usb_host, "USB Host", TASK_USB_HOST_STACK_SIZE,
 		NULL,
@@ -0,0 +1,362 @@
+/**
+ * @file apt_frame.c
+ *
+ * @brief APT command framing over a receive ring.
+ *
+ * The USB and FTDI tasks parse commands where the bytes landed.  A frame is
+ * the decoded header plus views of the extended data in the ring, so only a
+ * handler needing a contiguous payload, or a slot task receiving the
+ * command, costs a copy.
+ */
+
+#include "apt_frame.h"
+
+#include <asf.h>
+#include <string.h>
+
+#include "Debugging.h"
+#include "apt.h"
+#include "task.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+static apt_frame_statistics_t s_statistics[APT_FRAME_PORT_COUNT];
+static TickType_t s_statistics_start;
+
+/****************************************************************************
+ * Function Prototypes
+ ****************************************************************************/
+static uint8_t ring_peek(const apt_ring_t* ring, size_t offset);
+static void ring_discard(apt_frame_parser_t* parser, size_t length);
+static bool check_alignment(uint8_t destination, uint8_t source);
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+static uint8_t ring_peek(const apt_ring_t* ring, size_t offset) {
+    return ring->buffer[(ring->tail + offset) & (ring->size - 1)];
+}
+
+static void ring_discard(apt_frame_parser_t* parser, size_t length) {
+    // Finish reading the bytes before the producer may reuse them.
+    __DMB();
+    parser->ring->tail += length;
+
+    taskENTER_CRITICAL();
+    s_statistics[parser->port].dropped_bytes += length;
+    taskEXIT_CRITICAL();
+}
+
+static bool check_alignment(uint8_t destination, uint8_t source) {
+    // check the destination is within range 0x11 (motherboard id), or 0x21
+    // to 0x28 (slots) strip the 0x80 for extended data just in case
+    switch (destination & 0x7F) {
+    case 0x11:  // motherboard id
+    case 0x21:  // slot 1
+    case 0x22:  // slot 2
+    case 0x23:  // slot 3
+    case 0x24:  // slot 4
+    case 0x25:  // slot 5
+    case 0x26:  // slot 6
+    case 0x27:  // slot 7
+    case 0x28:  // slot 8
+        break;
+
+    default:
+        debug_print("ERROR: Destination error\r\n");
+        return false;
+    }
+
+    // check the 6th byte should be equal to HOST_ID
+    if (source != HOST_ID) {
+        debug_print("ERROR: Source error\r\n");
+        return false;
+    }
+
+    return true;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+void apt_ring_init(apt_ring_t* ring, uint8_t* buffer, size_t size) {
+    configASSERT((size & (size - 1)) == 0);
+
+    ring->buffer = buffer;
+    ring->size   = size;
+    ring->head   = 0;
+    ring->tail   = 0;
+}
+
+size_t apt_ring_used(const apt_ring_t* ring) { return ring->head - ring->tail; }
+
+bool apt_ring_push(apt_ring_t* ring, uint8_t value) {
+    const size_t HEAD = ring->head;
+    if (HEAD - ring->tail == ring->size) {
+        return false;
+    }
+
+    ring->buffer[HEAD & (ring->size - 1)] = value;
+    __DMB();
+    ring->head = HEAD + 1;
+    return true;
+}
+
+uint8_t* apt_ring_write_region(apt_ring_t* ring, size_t* length) {
+    const size_t HEAD   = ring->head;
+    const size_t FREE   = ring->size - (HEAD - ring->tail);
+    const size_t OFFSET = HEAD & (ring->size - 1);
+
+    *length = Min(FREE, ring->size - OFFSET);
+    return ring->buffer + OFFSET;
+}
+
+void apt_ring_commit(apt_ring_t* ring, size_t length) {
+    __DMB();
+    ring->head += length;
+}
+
+size_t apt_ring_read(apt_ring_t* ring, void* _dest, size_t max_read) {
+    uint8_t* dest        = (uint8_t*)_dest;
+    const size_t TO_READ = Min(apt_ring_used(ring), max_read);
+
+    for (size_t i = 0; i < TO_READ; ++i) {
+        dest[i] = ring_peek(ring, i);
+    }
+
+    __DMB();
+    ring->tail += TO_READ;
+    return TO_READ;
+}
+
+void apt_frame_parser_init(apt_frame_parser_t* parser, apt_ring_t* ring,
+                           uint8_t port, uint8_t max_realign_attempts) {
+    configASSERT(port < APT_FRAME_PORT_COUNT);
+
+    parser->ring                   = ring;
+    parser->port                   = port;
+    parser->max_realigned_attempts = max_realign_attempts;
+    parser->skip                   = 0;
+    parser->realigned_try_cnt      = 0;
+}
+
+void apt_frame_parser_reset(apt_frame_parser_t* parser) {
+    const size_t USED = apt_ring_used(parser->ring);
+    if (USED != 0) {
+        ring_discard(parser, USED);
+    }
+
+    parser->skip              = 0;
+    parser->realigned_try_cnt = 0;
+}
+
+apt_frame_status_t apt_frame_parser_next(apt_frame_parser_t* parser,
+                                         apt_frame_t* frame,
+                                         size_t* bytes_needed) {
+    apt_ring_t* const ring = parser->ring;
+    size_t needed          = 0;
+
+    // Discard what has arrived of an oversized command.
+    if (parser->skip != 0) {
+        const size_t TO_SKIP = Min(parser->skip, apt_ring_used(ring));
+        if (TO_SKIP != 0) {
+            ring_discard(parser, TO_SKIP);
+            parser->skip -= TO_SKIP;
+        }
+        if (parser->skip != 0) {
+            if (bytes_needed) {
+                *bytes_needed = parser->skip;
+            }
+            return APT_FRAME_NEED_DATA;
+        }
+    }
+
+    while (true) {
+        const size_t USED = apt_ring_used(ring);
+
+        // Does not have command.
+        if (USED < APT_COMMAND_SIZE) {
+            needed = APT_COMMAND_SIZE - USED;
+            break;
+        }
+
+        if (!check_alignment(ring_peek(ring, 4), ring_peek(ring, 5))) {
+            if (parser->realigned_try_cnt == parser->max_realigned_attempts) {
+                return APT_FRAME_REALIGN_UNAVAILABLE;
+            }
+            ++parser->realigned_try_cnt;
+            debug_print("realign data (#%i) %x (%x %x %x %x %x ?). /r/n",
+                        parser->realigned_try_cnt, ring_peek(ring, 0),
+                        ring_peek(ring, 1), ring_peek(ring, 2),
+                        ring_peek(ring, 3), ring_peek(ring, 4),
+                        ring_peek(ring, 5));
+            ring_discard(parser, 1);
+            continue;
+        }
+        parser->realigned_try_cnt = 0;
+
+        frame->message_id  = ring_peek(ring, 0) | (ring_peek(ring, 1) << 8);
+        frame->param1      = ring_peek(ring, 2);
+        frame->param2      = ring_peek(ring, 3);
+        frame->destination = ring_peek(ring, 4) & 0x7F;
+        frame->source      = ring_peek(ring, 5);
+        frame->has_extended_data = (ring_peek(ring, 4) & 0x80) != 0;
+        frame->extended_length   = frame->has_extended_data
+                                       ? (frame->param1 | (frame->param2 << 8))
+                                       : 0;
+        frame->size              = APT_COMMAND_SIZE + frame->extended_length;
+
+        if (frame->extended_length > USB_SLAVE_BUFFER_SIZE) {
+            // Consume the command's bytes without reading the command.
+            ring_discard(parser, APT_COMMAND_SIZE);
+            parser->skip = frame->extended_length;
+            return APT_FRAME_OVERFLOWED;
+        }
+
+        if (USED < frame->size) {
+            needed = frame->size - USED;
+            break;
+        }
+
+        const size_t START = (ring->tail + APT_COMMAND_SIZE) & (ring->size - 1);
+        const size_t FIRST =
+            Min((size_t)frame->extended_length, ring->size - START);
+        frame->data[0]        = ring->buffer + START;
+        frame->data_length[0] = FIRST;
+        frame->data[1]        = ring->buffer;
+        frame->data_length[1] = frame->extended_length - FIRST;
+        frame->start_cycles   = DWT->CYCCNT;
+        return APT_FRAME_READY;
+    }
+
+    if (bytes_needed) {
+        *bytes_needed = needed;
+    }
+    return APT_FRAME_NEED_DATA;
+}
+
+void apt_frame_release(apt_frame_parser_t* parser, const apt_frame_t* frame) {
+    const uint32_t CYCLES = DWT->CYCCNT - frame->start_cycles;
+
+    // Finish reading the frame before the producer may reuse its bytes.
+    __DMB();
+    parser->ring->tail += frame->size;
+
+    apt_frame_statistics_t* const stats = &s_statistics[parser->port];
+    taskENTER_CRITICAL();
+    ++stats->frames;
+    if (frame->has_extended_data) {
+        ++stats->long_frames;
+        stats->long_bytes += frame->size;
+        stats->long_cycles += CYCLES;
+    }
+    taskEXIT_CRITICAL();
+}
+
+bool apt_frame_reading_service(
+    apt_frame_parser_t* const parser, apt_frame_t* frame, TickType_t timeout,
+    void* const callback_context, bool (*callback_fill)(void*, TickType_t),
+    void (*callback_on_error_state)(void*, apt_frame_status_t, void*)) {
+    configASSERT(parser != NULL);
+    configASSERT(frame != NULL);
+    configASSERT(callback_fill != NULL);
+
+    TickType_t local_timeout = portMAX_DELAY;
+    while (true) {
+        const apt_frame_status_t STATUS =
+            apt_frame_parser_next(parser, frame, NULL);
+
+        if (STATUS == APT_FRAME_READY) {
+            return true;
+        }
+
+        if (STATUS == APT_FRAME_OVERFLOWED) {
+            if (callback_on_error_state) {
+                size_t overflow_size = frame->extended_length;
+                callback_on_error_state(callback_context, STATUS,
+                                        &overflow_size);
+            }
+            continue;
+        }
+
+        if (STATUS == APT_FRAME_REALIGN_UNAVAILABLE) {
+            if (callback_on_error_state) {
+                callback_on_error_state(callback_context, STATUS, NULL);
+            }
+
+            // Realignment failed -> wait until timeout is over.
+            vTaskDelay(local_timeout == portMAX_DELAY ? timeout
+                                                      : local_timeout);
+            apt_frame_parser_reset(parser);
+            return false;
+        }
+
+        // Wait without a timeout for the first byte of a command, which
+        // then starts the timeout.
+        const bool IDLE =
+            apt_ring_used(parser->ring) == 0 && parser->skip == 0;
+        if (IDLE) {
+            local_timeout = portMAX_DELAY;
+        } else if (local_timeout == portMAX_DELAY) {
+            local_timeout = timeout;
+        } else if (local_timeout == 0) {
+            apt_frame_parser_reset(parser);
+            return false;
+        }
+
+        const TickType_t FILL_START = xTaskGetTickCount();
+        callback_fill(callback_context, local_timeout);
+        const TickType_t FILL_DURATION = xTaskGetTickCount() - FILL_START;
+
+        if (!IDLE) {
+            // Adjust the timeout.
+            local_timeout = (FILL_DURATION > local_timeout)
+                                ? 0
+                                : (local_timeout - FILL_DURATION);
+        }
+    }
+}
+
+void apt_frame_copy_data(const apt_frame_t* frame, uint8_t* dest) {
+    memcpy(dest, frame->data[0], frame->data_length[0]);
+    memcpy(dest + frame->data_length[0], frame->data[1],
+           frame->data_length[1]);
+}
+
+void apt_frame_header_to_message(const apt_frame_t* frame,
+                                 USB_Slave_Message* message) {
+    message->ucMessageID      = frame->message_id;
+    message->param1           = frame->param1;
+    message->param2           = frame->param2;
+    message->destination      = frame->destination;
+    message->source           = frame->source;
+    message->ExtendedData_len = frame->param1 | (frame->param2 << 8);
+    message->bHasExtendedData = frame->has_extended_data;
+}
+
+void apt_frame_get_statistics(uint8_t port, apt_frame_statistics_t* out) {
+    if (port >= APT_FRAME_PORT_COUNT) {
+        *out = (apt_frame_statistics_t){0};
+        return;
+    }
+
+    taskENTER_CRITICAL();
+    *out                   = s_statistics[port];
+    const TickType_t START = s_statistics_start;
+    taskEXIT_CRITICAL();
+
+    const uint64_t TICKS = xTaskGetTickCount() - START;
+    out->elapsed_ms      = (uint32_t)(TICKS * 1000 / configTICK_RATE_HZ);
+}
+
+void apt_frame_reset_statistics(void) {
+    taskENTER_CRITICAL();
+    memset(s_statistics, 0, sizeof(s_statistics));
+    s_statistics_start = xTaskGetTickCount();
+    taskEXIT_CRITICAL();
+}
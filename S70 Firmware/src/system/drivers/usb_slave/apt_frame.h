@@ -0,0 +1,178 @@
+// apt_frame.h
+
+#ifndef SRC_SYSTEM_DRIVERS_USB_SLAVE_APT_FRAME_H_
+#define SRC_SYSTEM_DRIVERS_USB_SLAVE_APT_FRAME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <FreeRTOS.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "usb_slave.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+// Ports with their own receive ring.  Indexes the frame statistics.
+#define APT_FRAME_PORT_USB   0
+#define APT_FRAME_PORT_FTDI  1
+#define APT_FRAME_PORT_COUNT 2
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+/**
+ * A single-producer, single-consumer byte ring.  The size is a power of two
+ * and head and tail run freely, so head - tail is the number of bytes held.
+ * The producer only moves head and the consumer only moves tail, so an ISR
+ * can fill the ring while a task parses it.
+ */
+typedef struct {
+    uint8_t* buffer;
+    size_t size;
+    volatile size_t head;
+    volatile size_t tail;
+} apt_ring_t;
+
+/**
+ * An APT command still in the receive ring.  The extended data is one span,
+ * or two when it wraps the end of the ring.  The views stay valid until the
+ * frame is released.
+ */
+typedef struct {
+    uint16_t message_id;
+    uint16_t extended_length;
+    uint8_t param1;
+    uint8_t param2;
+    uint8_t destination;
+    uint8_t source;
+    bool has_extended_data;
+
+    const uint8_t* data[2];
+    size_t data_length[2];
+
+    // Bytes the frame takes in the ring, header included.
+    size_t size;
+    uint32_t start_cycles;
+} apt_frame_t;
+
+typedef enum {
+    APT_FRAME_OVERFLOWED          = -2,
+    APT_FRAME_REALIGN_UNAVAILABLE = -1,
+    APT_FRAME_NEED_DATA           = 0,
+    APT_FRAME_READY               = 1,
+} apt_frame_status_t;
+
+typedef struct {
+    apt_ring_t* ring;
+
+    // Bytes of an oversized command still to discard.
+    size_t skip;
+    uint8_t realigned_try_cnt;
+    uint8_t max_realigned_attempts;
+    uint8_t port;
+} apt_frame_parser_t;
+
+/// \brief Throughput counters of one port.
+typedef struct {
+    uint32_t frames;
+    uint32_t long_frames;
+    uint32_t long_bytes;
+    uint32_t dropped_bytes;
+
+    // Time since the counters were reset.
+    uint32_t elapsed_ms;
+
+    // Cycles from a long-form frame being ready to its release, so the
+    // dispatch and any copy, but not the wait for its bytes.
+    uint64_t long_cycles;
+} apt_frame_statistics_t;
+
+/************************************************************************************
+ * Public Function Prototypes
+ ************************************************************************************/
+/// \pre size is a power of two.
+void apt_ring_init(apt_ring_t* ring, uint8_t* buffer, size_t size);
+
+/// \return The number of bytes in the ring.
+size_t apt_ring_used(const apt_ring_t* ring);
+
+/// \brief Adds one byte.  Safe from the ISR producing into the ring.
+/// \return false if the ring is full.
+bool apt_ring_push(apt_ring_t* ring, uint8_t value);
+
+/**
+ * \brief Returns the free space after head that does not wrap, for a driver
+ *        to read into directly.  Publish what was written with
+ *        apt_ring_commit().
+ */
+uint8_t* apt_ring_write_region(apt_ring_t* ring, size_t* length);
+
+void apt_ring_commit(apt_ring_t* ring, size_t length);
+
+/// \brief Moves up to max_read bytes out of the ring.
+/// \return The number of bytes written to dest.
+size_t apt_ring_read(apt_ring_t* ring, void* dest, size_t max_read);
+
+void apt_frame_parser_init(apt_frame_parser_t* parser, apt_ring_t* ring,
+                           uint8_t port, uint8_t max_realign_attempts);
+
+/// \brief Drops the bytes in the ring and any command being discarded.
+void apt_frame_parser_reset(apt_frame_parser_t* parser);
+
+/**
+ * Looks for the next command at the tail of the ring.  A misaligned header
+ * is dropped one byte at a time by moving the tail, and a command too large
+ * for USB_Slave_Message is discarded as its bytes arrive.
+ * \param[out] frame        The command, when APT_FRAME_READY is returned.
+ *                          For APT_FRAME_OVERFLOWED, only the header.
+ * \param[out] bytes_needed The bytes still missing for APT_FRAME_NEED_DATA.
+ *                          Optional. Omit with NULL.
+ */
+apt_frame_status_t apt_frame_parser_next(apt_frame_parser_t* parser,
+                                         apt_frame_t* frame,
+                                         size_t* bytes_needed);
+
+/// \brief Frees the ring space of a frame returned by apt_frame_parser_next().
+void apt_frame_release(apt_frame_parser_t* parser, const apt_frame_t* frame);
+
+/**
+ * Waits for the next command within the timeout, which starts at the first
+ * byte of the command.  This will block the calling thread until either a
+ * command is ready or the timeout is reached.
+ *
+ * Convention for callback_fill:
+ * (callback_context, timeout) -> true if the ring may hold new bytes
+ *
+ * Convention for callback_on_error_state:
+ * (callback_context, error state, union) -> void
+ *    for APT_FRAME_REALIGN_UNAVAILABLE, union = NULL
+ *    for APT_FRAME_OVERFLOWED, union = size_t* to the extended data length
+ *
+ * \return true  The frame views a command.  Release it once handled.
+ * \return false The timeout passed and the partial command was dropped.
+ */
+bool apt_frame_reading_service(
+    apt_frame_parser_t* parser, apt_frame_t* frame, TickType_t timeout,
+    void* callback_context, bool (*callback_fill)(void*, TickType_t),
+    void (*callback_on_error_state)(void*, apt_frame_status_t, void*));
+
+/// \brief Copies the extended data of a frame into dest.
+void apt_frame_copy_data(const apt_frame_t* frame, uint8_t* dest);
+
+/// \brief Fills the command fields of a message from a frame's header.
+void apt_frame_header_to_message(const apt_frame_t* frame,
+                                 USB_Slave_Message* message);
+
+void apt_frame_get_statistics(uint8_t port, apt_frame_statistics_t* out);
+void apt_frame_reset_statistics(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_SYSTEM_DRIVERS_USB_SLAVE_APT_FRAME_H_ */
@@ -8,19 +8,25 @@
 #include <apt_parse.h>
 #include <asf.h>
 
+#include <array>
 #include <cstdint>
+#include <optional>
 
 #include "../log/log.h"
 #include "25lc1024.h"
 #include "Debugging.h"
 #include "UsbCore.h"
 #include "apt-command.hh"
+#include "apt-local.h"
 #include "apt-parsing.hh"
+#include "apt-router.hh"
 #include "apt.h"
+#include "apt_frame.h"
 #include "apt_traits.tcc"
 #include "cpld.h"
 #include "cpld_program.h"
 #include "device_detect.h"
+#include "efs-stream.hh"
 #include "efs.hh"
 #include "ftdi.h"
 #include "helper.h"
@@ -35,8 +41,10 @@
 #include "lock_guard.hh"
 #include "log.h"
 #include "lut_manager.hh"
+#include "profiler.hh"
 #include "ptr-to-span.hh"
 #include "rt_program.h"
+#include "spi-scheduler.hh"
 #include "spi-transfer-handle.hh"
 #include "string.h"
 #include "supervisor.h"
@@ -54,11 +62,62 @@
 // A fully-filled command wouldn't send for some reason.
 static constexpr uint8_t RESPONSE_BUFFER_SIZE = 100;
 
+/**
+ * The EFS file kept open across consecutive file-data commands from one host
+ * port, so a transfer reads and programs whole pages.
+ * It is closed, programming any batched writes, by any other command from the
+ * port, by a file-data command for another file or address, at the end of the
+ * file, or by apt_parse_efs_tick() once idle for APT_EFS_SESSION_IDLE.
+ */
+struct efs_session {
+    // Held by the port's task while it uses the file, and by the supervisor
+    // while it closes an idle one.
+    SemaphoreHandle_t lock = nullptr;
+    std::optional<efs::stream> file;
+    TickType_t last_used = 0;
+};
+
+// USB, FTDI
+static efs_session s_efs_sessions[2];
+
+/**
+ * The response a command handler fills in, sent by parse() once the handler
+ * returns.
+ */
+struct parse_context {
+    uint8_t response_buffer[RESPONSE_BUFFER_SIZE];
+    uint8_t length     = 0;
+    bool need_to_reply = false;
+
+    // Set to read ahead once the response is sent.
+    efs_session* p_efs_prefetch = nullptr;
+
+    drivers::usb::apt_response_builder response_builder;
+    const drivers::usb::apt_basic_command command_proxy;
+
+    explicit parse_context(USB_Slave_Message& slave_message)
+        : response_builder(
+              ptr2span<drivers::usb::apt_response::RESPONSE_BUFFER_SIZE>(
+                  reinterpret_cast<std::byte*>(response_buffer + 6)))
+        , command_proxy(slave_message) {}
+};
+
 /****************************************************************************
  * Function Prototypes
  ****************************************************************************/
 static void parse(USB_Slave_Message* slave_message);
 
+// Defined after the routes, as they read the router.
+static void handle_mcm_prof_req_apt(USB_Slave_Message* slave_message,
+                                    parse_context& ctx);
+static void handle_mcm_prof_set_reset(USB_Slave_Message*, parse_context&);
+
+static efs_session& efs_session_of(const USB_Slave_Message* slave_message);
+static efs::stream* efs_session_open(efs_session& session,
+                                     const efs::file_identifier_t ident,
+                                     const uint32_t file_address);
+static void efs_session_close(efs_session& session);
+
 // Helper function that allows for the stand response (save the responding
 // command) to both the new and old hw info commands.
 static std::size_t hw_info_response(uint8_t p_buffer[USB_SLAVE_BUFFER_SIZE],
@@ -113,911 +172,1357 @@ static void callback_ow_program(void* const p_param,
     callback_ow_response(p_param, err);
 }
 
-/**
- * @brief Parse APT commands that are specific to the board not a card in a slot
- *
- * Takes xUSB_Slave_TxSemaphore - sending data on the USB bus
- *
- * @param buf : The pointer buffer which holds the data to parse.
- * @param slave_message_id : This is the massage structure pass from the USB
- * salve task
- */
-static void parse(USB_Slave_Message* slave_message) {
-    uint8_t response_buffer[RESPONSE_BUFFER_SIZE];
-    uint8_t length = 0;
-    // uint32_t resp;
-    bool need_to_reply = false;
-
-    // bool send_log_flag = false;
-
-    const std::span<std::byte, drivers::usb::apt_response::RESPONSE_BUFFER_SIZE>
-        extended_data_span =
-            ptr2span<drivers::usb::apt_response::RESPONSE_BUFFER_SIZE>(
-                reinterpret_cast<std::byte*>(response_buffer + 6));
-    drivers::usb::apt_response_builder response_builder(extended_data_span);
-    const drivers::usb::apt_basic_command command_proxy(*slave_message);
-
-    switch (slave_message->ucMessageID) {
-    case MGMSG_SET_SER_TO_EEPROM: {
-        // Added variable cipher to obfuscate the key from code analysis.
+/****************************************************************************
+ * Command Handlers
+ ****************************************************************************/
+// Each handler is registered with its command in the routes below.
+static void handle_set_ser_to_eeprom(USB_Slave_Message* slave_message,
+                                     parse_context& ctx) {
+    // Added variable cipher to obfuscate the key from code analysis.
 #define CIPER_0 3
 #define CIPER_1 159
 #define CIPER_2 240
 #define CIPER_3 88
-        char THOR_KEY[] = {(char)('T' + CIPER_0), (char)('H' + CIPER_1),
-                           (char)('O' + CIPER_2), (char)('R' + CIPER_3)};
+    char THOR_KEY[] = {(char)('T' + CIPER_0), (char)('H' + CIPER_1),
+                       (char)('O' + CIPER_2), (char)('R' + CIPER_3)};
 
-        // Subtracting message from key.
-        for (int i = 0; i < 4; ++i) {
-            THOR_KEY[i] -= slave_message->extended_data_buf[i];
-        }
+    // Subtracting message from key.
+    for (int i = 0; i < 4; ++i) {
+        THOR_KEY[i] -= slave_message->extended_data_buf[i];
+    }
 
-        const bool OPEN = THOR_KEY[0] == CIPER_0 && THOR_KEY[1] == CIPER_1 &&
-                          THOR_KEY[2] == CIPER_2 && THOR_KEY[3] == CIPER_3;
+    const bool OPEN = THOR_KEY[0] == CIPER_0 && THOR_KEY[1] == CIPER_1 &&
+                      THOR_KEY[2] == CIPER_2 && THOR_KEY[3] == CIPER_3;
 
 #undef CIPER_0
 #undef CIPER_1
 #undef CIPER_2
 #undef CIPER_3
 
-        if (OPEN && slave_message->ExtendedData_len ==
-                        4 + USB_DEVICE_GET_SERIAL_NAME_LENGTH) {
-            xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-            set_board_serial_number((char*)slave_message->extended_data_buf +
-                                    4);
-            xSemaphoreGive(xSPI_Semaphore);
-
-            // Send ACK here
-            response_buffer[0] = (uint8_t)MGMSG_GET_SER_STATUS;
-            response_buffer[1] = (uint8_t)(MGMSG_GET_SER_STATUS >> 8);
-            response_buffer[2] = 1;
-            response_buffer[3] = 0;
-            response_buffer[4] = HOST_ID | 0x80;
-            response_buffer[5] = MOTHERBOARD_ID;
-            response_buffer[6] = 1;
-
-            need_to_reply = true;
-            length        = 7;
-        }
-    } break;
-    case MGMSG_HW_REQ_INFO: /* 0x0005 */
-        need_to_reply = true;
-        length        = hw_info_response(response_buffer, MGMSG_HW_GET_INFO);
-        //		debug_print("%H APT command.\r\n", slave_message->ucMessageID);
-        break;
+    if (OPEN && slave_message->ExtendedData_len ==
+                    4 + USB_DEVICE_GET_SERIAL_NAME_LENGTH) {
+        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+        set_board_serial_number((char*)slave_message->extended_data_buf +
+                                4);
+        xSemaphoreGive(xSPI_Semaphore);
 
-    case MGMSG_MOD_IDENTIFY:  /// 0x0223
-        supervisor_identify(static_cast<slot_nums>(slave_message->param1));
-        break;
+        // Send ACK here
+        ctx.response_buffer[0] = (uint8_t)MGMSG_GET_SER_STATUS;
+        ctx.response_buffer[1] = (uint8_t)(MGMSG_GET_SER_STATUS >> 8);
+        ctx.response_buffer[2] = 1;
+        ctx.response_buffer[3] = 0;
+        ctx.response_buffer[4] = HOST_ID | 0x80;
+        ctx.response_buffer[5] = MOTHERBOARD_ID;
+        ctx.response_buffer[6] = 1;
+
+        ctx.need_to_reply = true;
+        ctx.length        = 7;
+    }
+}
 
-    case MGMSG_GET_UPDATE_FIRMWARE:
-        set_firmware_load_count();
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_UPDATE_CPLD_LOG, 0, 0, 0);
-        break;
+/// 0x0005
+static void handle_hw_req_info(USB_Slave_Message* slave_message,
+                               parse_context& ctx) {
+    ctx.need_to_reply = true;
+    ctx.length = hw_info_response(ctx.response_buffer, MGMSG_HW_GET_INFO);
+    //		debug_print("%H APT command.\r\n", slave_message->ucMessageID);
+}
 
-    case MGMSG_MCM_HW_REQ_INFO: /* 0x4000 */
-        need_to_reply = true;
-        length = hw_info_response(response_buffer, MGMSG_MCM_HW_GET_INFO);
-        //		debug_print("%H APT command.\r\n", slave_message->ucMessageID);
-        break;
+/// 0x0223
+static void handle_mod_identify(USB_Slave_Message* slave_message,
+                                parse_context&) {
+    supervisor_identify(static_cast<slot_nums>(slave_message->param1));
+}
 
-    case MGMSG_RT1064_UPDATE:
-        // RT update handles SPI locking internally; reply via normal response
-        // path so we do not take extra semaphores here.
-        rt_firmware_update_start(slave_message);
-        response_buffer[0] = static_cast<uint8_t>(MGMSG_RT1064_UPDATE);
-        response_buffer[1] =
-            static_cast<uint8_t>(MGMSG_RT1064_UPDATE >> 8);
-        response_buffer[2] = load_rt_hex ? CPLD_PROG_OK : CPLD_PROG_ERROR;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID;
-        response_buffer[5] = MOTHERBOARD_ID;
-        length             = 6;
-        need_to_reply       = true;
-        break;
+static void handle_get_update_firmware(USB_Slave_Message* slave_message,
+                                       parse_context&) {
+    set_firmware_load_count();
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_UPDATE_CPLD_LOG, 0, 0, 0);
+}
 
-    case MGMSG_CPLD_UPDATE:
-        // Response Header
-        response_buffer[0] = (uint8_t)
-            MGMSG_CPLD_UPDATE;  ///> \todo Isn't this code redundant due to
-                                ///"respond_to_host" (see cpld_program.c).
-        response_buffer[1] = (uint8_t)(MGMSG_CPLD_UPDATE >> 8);
-        response_buffer[2] = CPLD_PROG_OK;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID;        /* destination*/
-        response_buffer[5] = MOTHERBOARD_ID; /* source*/
-        xSemaphoreTake(slave_message->xUSB_Slave_TxSemaphore, portMAX_DELAY);
-        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-        lattice_firmware_update();
-        xSemaphoreGive(slave_message->xUSB_Slave_TxSemaphore);
-        xSemaphoreGive(xSPI_Semaphore);
-        need_to_reply = false;
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_NO_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_UPDATE_CPLD_LOG, 0, 0, 0);
-        break;
+/// 0x4000
+static void handle_mcm_hw_req_info(USB_Slave_Message* slave_message,
+                                   parse_context& ctx) {
+    ctx.need_to_reply = true;
+    ctx.length = hw_info_response(ctx.response_buffer, MGMSG_MCM_HW_GET_INFO);
+    //		debug_print("%H APT command.\r\n", slave_message->ucMessageID);
+}
 
-    case MGMSG_SET_HW_REV:
-        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-        set_board_type(slave_message->extended_data_buf[0] +
-                       (slave_message->extended_data_buf[1] << 8));
-        xSemaphoreGive(xSPI_Semaphore);
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_SET_HW_REV_LOG, 0, 0, 0);
-        break;
+static void handle_rt1064_update(USB_Slave_Message* slave_message,
+                                 parse_context& ctx) {
+    // RT update handles SPI locking internally; reply via normal response
+    // path so we do not take extra semaphores here.
+    rt_firmware_update_start(slave_message);
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_RT1064_UPDATE);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_RT1064_UPDATE >> 8);
+    ctx.response_buffer[2] = load_rt_hex ? CPLD_PROG_OK : CPLD_PROG_ERROR;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    ctx.length             = 6;
+    ctx.need_to_reply       = true;
+}
 
-    case MGMSG_SET_CARD_TYPE:
-        set_slot_type(
-            static_cast<slot_nums>(slave_message->extended_data_buf[0]),
-            static_cast<slot_types>(
-                slave_message->extended_data_buf[2] +
-                (slave_message->extended_data_buf[3] << 8)));
-        setup_and_send_log(slave_message, slave_message->extended_data_buf[0],
-                           LOG_REPEAT, SYSTEM_LOG_TYPE,
-                           SYSTEM_SET_CARD_TYPE_LOG, 0, 0, 0);
-        break;
+static void handle_cpld_update(USB_Slave_Message* slave_message,
+                               parse_context& ctx) {
+    // Response Header
+    ctx.response_buffer[0] = (uint8_t)
+        MGMSG_CPLD_UPDATE;  ///> \todo Isn't this code redundant due to
+                            ///"respond_to_host" (see cpld_program.c).
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_CPLD_UPDATE >> 8);
+    ctx.response_buffer[2] = CPLD_PROG_OK;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID;        /* destination*/
+    ctx.response_buffer[5] = MOTHERBOARD_ID; /* source*/
+    // Takes the SPI bus and the Tx lock itself, as the update then
+    // carries on from the CPLD program task.
+    lattice_firmware_update();
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_NO_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_UPDATE_CPLD_LOG, 0, 0, 0);
+}
+
+static void handle_set_hw_rev(USB_Slave_Message* slave_message,
+                              parse_context&) {
+    xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+    set_board_type(slave_message->extended_data_buf[0] +
+                   (slave_message->extended_data_buf[1] << 8));
+    xSemaphoreGive(xSPI_Semaphore);
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_SET_HW_REV_LOG, 0, 0, 0);
+}
 
-    case MGMSG_REQ_DEVICE:
-        response_buffer[0] = (uint8_t)MGMSG_GET_DEVICE;
-        response_buffer[1] = (uint8_t)(MGMSG_GET_DEVICE >> 8);
-
-        response_buffer[4] = HOST_ID | 0x80;  // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-
-        /*Chan Ident (slot)*/
-        response_buffer[6] = slave_message->param1;
-        response_buffer[7] = 0x00;
-
-        ///\bug This is not protected by the slot's lock.
-        memcpy(response_buffer + 8,
-               &slots[slave_message->param1].device.info.signature.device_id,
-               sizeof(device_id_t));
-        memcpy(response_buffer + 8 + sizeof(device_id_t),
-               &slots[slave_message->param1].device.info.serial_num, 8);
-        memcpy(response_buffer + 16 + sizeof(device_id_t),
-               &slots[slave_message->param1].device.info.signature.slot_type,
-               sizeof(slot_types));
-        memcpy(response_buffer + 16 + sizeof(device_signature_t),
-               &slots[slave_message->param1].device.info.product_name,
-               DEVICE_DETECT_PART_NUMBER_LENGTH);
-        response_buffer[16 + sizeof(device_signature_t) +
+static void handle_set_card_type(USB_Slave_Message* slave_message,
+                                 parse_context&) {
+    set_slot_type(
+        static_cast<slot_nums>(slave_message->extended_data_buf[0]),
+        static_cast<slot_types>(
+            slave_message->extended_data_buf[2] +
+            (slave_message->extended_data_buf[3] << 8)));
+    setup_and_send_log(slave_message, slave_message->extended_data_buf[0],
+                       LOG_REPEAT, SYSTEM_LOG_TYPE,
+                       SYSTEM_SET_CARD_TYPE_LOG, 0, 0, 0);
+}
+
+static void handle_req_device(USB_Slave_Message* slave_message,
+                              parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_GET_DEVICE;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_GET_DEVICE >> 8);
+
+    ctx.response_buffer[4] = HOST_ID | 0x80;  // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+
+    /*Chan Ident (slot)*/
+    ctx.response_buffer[6] = slave_message->param1;
+    ctx.response_buffer[7] = 0x00;
+
+    ///\bug This is not protected by the slot's lock.
+    memcpy(ctx.response_buffer + 8,
+           &slots[slave_message->param1].device.info.signature.device_id,
+           sizeof(device_id_t));
+    memcpy(ctx.response_buffer + 8 + sizeof(device_id_t),
+           &slots[slave_message->param1].device.info.serial_num, 8);
+    memcpy(ctx.response_buffer + 16 + sizeof(device_id_t),
+           &slots[slave_message->param1].device.info.signature.slot_type,
+           sizeof(slot_types));
+    memcpy(ctx.response_buffer + 16 + sizeof(device_signature_t),
+           &slots[slave_message->param1].device.info.product_name,
+           DEVICE_DETECT_PART_NUMBER_LENGTH);
+    ctx.response_buffer[16 + sizeof(device_signature_t) +
                         DEVICE_DETECT_PART_NUMBER_LENGTH] = '\0';
 
-        ///\bug This is just bad.  Need to have a different way of doing this.
-        response_buffer[17 + DEVICE_DETECT_PART_NUMBER_LENGTH +
+    ///\bug This is just bad.  Need to have a different way of doing this.
+    ctx.response_buffer[17 + DEVICE_DETECT_PART_NUMBER_LENGTH +
                         sizeof(device_signature_t)] =
-            slots[slave_message->param1].device._dd_state != 0;
+        slots[slave_message->param1].device._dd_state != 0;
 
-        need_to_reply = true;
+    ctx.need_to_reply = true;
 
-        length =
-            18 + sizeof(device_signature_t) + DEVICE_DETECT_PART_NUMBER_LENGTH;
-        response_buffer[2] = (uint8_t)(length - 6);
-        response_buffer[3] = (uint8_t)((length - 6) >> 8);
-        break;
+    ctx.length =
+        18 + sizeof(device_signature_t) + DEVICE_DETECT_PART_NUMBER_LENGTH;
+    ctx.response_buffer[2] = (uint8_t)(ctx.length - 6);
+    ctx.response_buffer[3] = (uint8_t)((ctx.length - 6) >> 8);
+}
 
-    case MGMSG_SET_DEVICE_BOARD: {
-        const int16_t SLOT = slave_message->extended_data_buf[0] |
-                             (slave_message->extended_data_buf[1] << 8);
-        xSemaphoreTake(slots[SLOT].xSlot_Mutex, portMAX_DELAY);
-        memcpy(&slots[SLOT].save.allowed_device_serial_number,
-               &slave_message->extended_data_buf[2],
-               sizeof(slots[SLOT].save.allowed_device_serial_number));
-        xSemaphoreGive(slots[SLOT].xSlot_Mutex);
+static void handle_set_device_board(USB_Slave_Message* slave_message,
+                                    parse_context&) {
+    const int16_t SLOT = slave_message->extended_data_buf[0] |
+                         (slave_message->extended_data_buf[1] << 8);
+    xSemaphoreTake(slots[SLOT].xSlot_Mutex, portMAX_DELAY);
+    memcpy(&slots[SLOT].save.allowed_device_serial_number,
+           &slave_message->extended_data_buf[2],
+           sizeof(slots[SLOT].save.allowed_device_serial_number));
+    xSemaphoreGive(slots[SLOT].xSlot_Mutex);
+
+    xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+    slot_save_info_eeprom(static_cast<slot_nums>(SLOT));
+    xSemaphoreGive(xSPI_Semaphore);
+    device_detect_reset(&slots[SLOT].device);
+}
 
-        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-        slot_save_info_eeprom(static_cast<slot_nums>(SLOT));
-        xSemaphoreGive(xSPI_Semaphore);
-        device_detect_reset(&slots[SLOT].device);
-    } break;
-    case MGMSG_REQ_DEVICE_BOARD:
-        response_buffer[0] = (uint8_t)(MGMSG_GET_DEVICE_BOARD);
-        response_buffer[1] = (uint8_t)(MGMSG_GET_DEVICE_BOARD >> 8);
-        response_buffer[2] = 10;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-
-        response_buffer[6] = slave_message->param1;
-        response_buffer[7] = 0;
-
-        {
-            lock_guard(slots[slave_message->param1].xSlot_Mutex);
-            memcpy(
-                &response_buffer[8],
-                &slots[slave_message->param1].save.allowed_device_serial_number,
-                sizeof(slots[slave_message->param1]
-                           .save.allowed_device_serial_number));
-        }
+static void handle_req_device_board(USB_Slave_Message* slave_message,
+                                    parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)(MGMSG_GET_DEVICE_BOARD);
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_GET_DEVICE_BOARD >> 8);
+    ctx.response_buffer[2] = 10;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+
+    ctx.response_buffer[6] = slave_message->param1;
+    ctx.response_buffer[7] = 0;
+
+    {
+        lock_guard(slots[slave_message->param1].xSlot_Mutex);
+        memcpy(
+            &ctx.response_buffer[8],
+            &slots[slave_message->param1].save.allowed_device_serial_number,
+            sizeof(slots[slave_message->param1]
+                       .save.allowed_device_serial_number));
+    }
 
-        length        = 6 + 2 + 8;
-        need_to_reply = true;
-        break;
-    case MGMSG_RESTART_PROCESSOR:
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_RESTART_PROCESSOR_LOG, 0, 0,
-                           0);
-        vTaskDelay(pdMS_TO_TICKS(100));
-        restart_board();
-        break;
+    ctx.length        = 6 + 2 + 8;
+    ctx.need_to_reply = true;
+}
 
-    case MGMSG_ERASE_EEPROM:
-        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-        eeprom_25LC1024_clear_mem();
-        xSemaphoreGive(xSPI_Semaphore);
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_SET_ERASE_EEPROM_LOG, 0, 0,
-                           0);
-        // TODO:  Inform EFS that files have been erased.
-        break;
+static void handle_restart_processor(USB_Slave_Message* slave_message,
+                                     parse_context&) {
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_RESTART_PROCESSOR_LOG, 0, 0,
+                       0);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    restart_board();
+}
 
-    case MGMSG_REQ_CPLD_WR: /*Temp for CPLD write/read register*/
-        cpld_write_read(slave_message);
-        need_to_reply = false;
-        break;
+static void handle_erase_eeprom(USB_Slave_Message* slave_message,
+                                parse_context&) {
+    xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+    eeprom_25LC1024_clear_mem();
+    xSemaphoreGive(xSPI_Semaphore);
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_SET_ERASE_EEPROM_LOG, 0, 0,
+                       0);
+    // TODO:  Inform EFS that files have been erased.
+}
 
-    case MGMSG_TASK_CONTROL: /*Temp for CPLD write/read register*/
-        if (slave_message->param1 == 1)
-            suspend_all_task();
-        else if (slave_message->param1 == 0)
-            resume_all_task();
-        need_to_reply = false;
-        break;
+/// Temp for CPLD write/read register
+static void handle_req_cpld_wr(USB_Slave_Message* slave_message,
+                               parse_context&) {
+    cpld_write_read(slave_message);
+}
 
-    case MGMSG_BOARD_REQ_STATUSUPDATE:
-        response_buffer[0] = (uint8_t)MGMSG_BOARD_GET_STATUSUPDATE;
-        response_buffer[1] = (uint8_t)(MGMSG_BOARD_GET_STATUSUPDATE >> 8);
-        response_buffer[2] = 7;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID | 0x80;  // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
+/// Temp for CPLD write/read register
+static void handle_task_control(USB_Slave_Message* slave_message,
+                                parse_context&) {
+    if (slave_message->param1 == 1)
+        suspend_all_task();
+    else if (slave_message->param1 == 0)
+        resume_all_task();
+}
 
-        /*only temperature_sensor_val | vin_monitor_val | cpu_temp_val | error*/
-        memcpy(&response_buffer[6], &board, 7);
+static void handle_board_req_statusupdate(USB_Slave_Message*,
+                                          parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_BOARD_GET_STATUSUPDATE;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_BOARD_GET_STATUSUPDATE >> 8);
+    ctx.response_buffer[2] = 7;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID | 0x80;  // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
 
-        need_to_reply = true;
-        length        = 6 + response_buffer[2];
-        break;
+    /*only temperature_sensor_val | vin_monitor_val | cpu_temp_val | error*/
+    memcpy(&ctx.response_buffer[6], &board, 7);
 
-    case MGMSG_MOD_REQ_JOYSTICK_INFO:
-        // Header
-        response_buffer[0] = (uint8_t)MGMSG_MOD_GET_JOYSTICK_INFO;
-        response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_JOYSTICK_INFO >> 8);
-        response_buffer[2] =
-            10; /*Will fill in later once we know how many controls we have*/
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID | 0x80;  // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-
-        /*There are up to 7 devices and 1 hub supported*/
-        get_hid_device_info(slave_message->param1 + 1, response_buffer);
-        need_to_reply = true;
-        length        = 6 + response_buffer[2];
-        break;
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + ctx.response_buffer[2];
+}
 
-    case MGMSG_MOD_SET_JOYSTICK_MAP_IN: {
-        auto data = drivers::apt::apt_struct_set<drivers::apt::joystick_map_in>(
-            command_proxy);
-        if (data && data->address() <= USB_NUMDEVICES &&
-            data->control_number < MAX_NUM_CONTROLS) {
-            service::hid_mapping::address_handle::create(data->address())
-                .set_apt(translate(*data), data->control_number);
-        }
-    }
-        need_to_reply = false;
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_SET_JOYSTICK_MAP_IN_LOG, 0,
-                           0, 0);
-        break;
+static void handle_mod_req_joystick_info(USB_Slave_Message* slave_message,
+                                         parse_context& ctx) {
+    // Header
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MOD_GET_JOYSTICK_INFO;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_JOYSTICK_INFO >> 8);
+    ctx.response_buffer[2] =
+        10; /*Will fill in later once we know how many controls we have*/
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID | 0x80;  // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+
+    /*There are up to 7 devices and 1 hub supported*/
+    get_hid_device_info(slave_message->param1 + 1, ctx.response_buffer);
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + ctx.response_buffer[2];
+}
 
-    case MGMSG_MOD_SET_JOYSTICK_MAP_OUT: {
-        auto data =
-            drivers::apt::apt_struct_set<drivers::apt::joystick_map_out>(
-                command_proxy);
-        if (data && data->address() <= USB_NUMDEVICES &&
-            data->control_number < MAX_NUM_CONTROLS) {
-            service::hid_mapping::address_handle::create(data->address())
-                .set_apt(translate(*data), data->control_number);
-        }
+static void handle_mod_set_joystick_map_in(USB_Slave_Message* slave_message,
+                                           parse_context& ctx) {
+    auto data = drivers::apt::apt_struct_set<drivers::apt::joystick_map_in>(
+        ctx.command_proxy);
+    if (data && data->address() <= USB_NUMDEVICES &&
+        data->control_number < MAX_NUM_CONTROLS) {
+        service::hid_mapping::address_handle::create(data->address())
+            .set_apt(translate(*data), data->control_number);
     }
-        need_to_reply = false;
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_SET_JOYSTICK_MAP_OUT_LOG, 0,
-                           0, 0);
-        break;
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_SET_JOYSTICK_MAP_IN_LOG, 0,
+                       0, 0);
+}
 
-    case MGMSG_MOD_REQ_JOYSTICK_MAP_IN: {
-        auto request =
-            drivers::apt::apt_struct_req<drivers::apt::joystick_map_in>(
-                command_proxy);
-        drivers::apt::joystick_map_in::payload_type out;
-        if (!request || request->port_number > USB_NUMDEVICES ||
-            request->control_number >= MAX_NUM_CONTROLS) {
-            memset(&out, 0, sizeof(out));
-            out.reverse_direction = 0xFF;
-        } else {
-            out = translate(
-                service::hid_mapping::address_handle::create(request->address())
-                    .get_apt_in(request->control_number));
-        }
-        out.port_number    = request->port_number;
-        out.control_number = request->control_number;
-        drivers::apt::apt_struct_get<drivers::apt::joystick_map_in>(
-            response_builder, out);
-        need_to_reply = true;
+static void handle_mod_set_joystick_map_out(USB_Slave_Message* slave_message,
+                                            parse_context& ctx) {
+    auto data =
+        drivers::apt::apt_struct_set<drivers::apt::joystick_map_out>(
+            ctx.command_proxy);
+    if (data && data->address() <= USB_NUMDEVICES &&
+        data->control_number < MAX_NUM_CONTROLS) {
+        service::hid_mapping::address_handle::create(data->address())
+            .set_apt(translate(*data), data->control_number);
     }
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_SET_JOYSTICK_MAP_OUT_LOG, 0,
+                       0, 0);
+}
 
-        // Header
-        response_buffer[0] = (uint8_t)MGMSG_MOD_GET_JOYSTICK_MAP_IN;
-        response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_JOYSTICK_MAP_IN >> 8);
-        response_buffer[2] =
-            drivers::apt::joystick_map_in::payload_type::APT_SIZE;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID | 0x80;  // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-        need_to_reply      = true;
-        length             = 6 + response_buffer[2];
-        break;
-
-    case MGMSG_MOD_REQ_JOYSTICK_MAP_OUT: {
-        auto request =
-            drivers::apt::apt_struct_req<drivers::apt::joystick_map_out>(
-                command_proxy);
-        drivers::apt::joystick_map_out::payload_type out;
-        if (!request || request->port_number > USB_NUMDEVICES ||
-            request->control_number >= MAX_NUM_CONTROLS) {
-            memset(&out, 0, sizeof(out));
-            out.usage_type = 0xFF;
-        } else {
-            out = translate(
-                service::hid_mapping::address_handle::create(request->address())
-                    .get_apt_out(request->control_number));
-        }
-        out.port_number    = request->port_number;
-        out.control_number = request->control_number;
-        drivers::apt::apt_struct_get<drivers::apt::joystick_map_out>(
-            response_builder, out);
-        need_to_reply = true;
+static void handle_mod_req_joystick_map_in(USB_Slave_Message*,
+                                           parse_context& ctx) {
+    auto request =
+        drivers::apt::apt_struct_req<drivers::apt::joystick_map_in>(
+            ctx.command_proxy);
+    drivers::apt::joystick_map_in::payload_type out;
+    if (!request || request->port_number > USB_NUMDEVICES ||
+        request->control_number >= MAX_NUM_CONTROLS) {
+        memset(&out, 0, sizeof(out));
+        out.reverse_direction = 0xFF;
+    } else {
+        out = translate(
+            service::hid_mapping::address_handle::create(request->address())
+                .get_apt_in(request->control_number));
     }
+    out.port_number    = request->port_number;
+    out.control_number = request->control_number;
+    drivers::apt::apt_struct_get<drivers::apt::joystick_map_in>(
+        ctx.response_builder, out);
+    ctx.need_to_reply = true;
+
+    // Header
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MOD_GET_JOYSTICK_MAP_IN;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_JOYSTICK_MAP_IN >> 8);
+    ctx.response_buffer[2] =
+        drivers::apt::joystick_map_in::payload_type::APT_SIZE;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID | 0x80;  // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+    ctx.need_to_reply      = true;
+    ctx.length             = 6 + ctx.response_buffer[2];
+}
 
-        // Header
-        response_buffer[0] = (uint8_t)MGMSG_MOD_GET_JOYSTICK_MAP_OUT;
-        response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_JOYSTICK_MAP_OUT >> 8);
-        response_buffer[2] =
-            drivers::apt::joystick_map_out::payload_type::APT_SIZE;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID | 0x80;  // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-
-        need_to_reply = true;
-        length        = 6 + response_buffer[2];
-        break;
+static void handle_mod_req_joystick_map_out(USB_Slave_Message*,
+                                            parse_context& ctx) {
+    auto request =
+        drivers::apt::apt_struct_req<drivers::apt::joystick_map_out>(
+            ctx.command_proxy);
+    drivers::apt::joystick_map_out::payload_type out;
+    if (!request || request->port_number > USB_NUMDEVICES ||
+        request->control_number >= MAX_NUM_CONTROLS) {
+        memset(&out, 0, sizeof(out));
+        out.usage_type = 0xFF;
+    } else {
+        out = translate(
+            service::hid_mapping::address_handle::create(request->address())
+                .get_apt_out(request->control_number));
+    }
+    out.port_number    = request->port_number;
+    out.control_number = request->control_number;
+    drivers::apt::apt_struct_get<drivers::apt::joystick_map_out>(
+        ctx.response_builder, out);
+    ctx.need_to_reply = true;
+
+    // Header
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MOD_GET_JOYSTICK_MAP_OUT;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_JOYSTICK_MAP_OUT >> 8);
+    ctx.response_buffer[2] =
+        drivers::apt::joystick_map_out::payload_type::APT_SIZE;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID | 0x80;  // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + ctx.response_buffer[2];
+}
 
-    case MGMSG_MCM_REQ_JOYSTICK_DATA:
-        // Header
-        response_buffer[0] = (uint8_t)MGMSG_MCM_GET_JOYSTICK_DATA;
-        response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_JOYSTICK_DATA >> 8);
-        response_buffer[2] = 4;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID | 0x80;  // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-
-        if (!usb_device[1].is_hub) {
-            response_buffer[6] = usb_device[1].hid_data.slot_select;
-            response_buffer[7] = NO_SLOT;
-            response_buffer[8] = NO_SLOT;
-            response_buffer[9] = NO_SLOT;
-        } else {
-            if (usb_device[2].enumerated)
-                response_buffer[6] = usb_device[2].hid_data.slot_select;
-            else
-                response_buffer[6] = NO_SLOT;
-
-            if (usb_device[3].enumerated)
-                response_buffer[7] = usb_device[3].hid_data.slot_select;
-            else
-                response_buffer[7] = NO_SLOT;
-
-            if (usb_device[4].enumerated)
-                response_buffer[8] = usb_device[4].hid_data.slot_select;
-            else
-                response_buffer[8] = NO_SLOT;
-
-            if (usb_device[5].enumerated)
-                response_buffer[9] = usb_device[5].hid_data.slot_select;
-            else
-                response_buffer[9] = NO_SLOT;
-        }
-        need_to_reply = true;
-        length        = 6 + response_buffer[2];
-        break;
+static void handle_mcm_req_joystick_data(USB_Slave_Message*,
+                                         parse_context& ctx) {
+    // Header
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MCM_GET_JOYSTICK_DATA;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_JOYSTICK_DATA >> 8);
+    ctx.response_buffer[2] = 4;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID | 0x80;  // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+
+    if (!usb_device[1].is_hub) {
+        ctx.response_buffer[6] = usb_device[1].hid_data.slot_select;
+        ctx.response_buffer[7] = NO_SLOT;
+        ctx.response_buffer[8] = NO_SLOT;
+        ctx.response_buffer[9] = NO_SLOT;
+    } else {
+        if (usb_device[2].enumerated)
+            ctx.response_buffer[6] = usb_device[2].hid_data.slot_select;
+        else
+            ctx.response_buffer[6] = NO_SLOT;
+
+        if (usb_device[3].enumerated)
+            ctx.response_buffer[7] = usb_device[3].hid_data.slot_select;
+        else
+            ctx.response_buffer[7] = NO_SLOT;
+
+        if (usb_device[4].enumerated)
+            ctx.response_buffer[8] = usb_device[4].hid_data.slot_select;
+        else
+            ctx.response_buffer[8] = NO_SLOT;
+
+        if (usb_device[5].enumerated)
+            ctx.response_buffer[9] = usb_device[5].hid_data.slot_select;
+        else
+            ctx.response_buffer[9] = NO_SLOT;
+    }
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + ctx.response_buffer[2];
+}
 
-    case MGMSG_MOD_SET_SYSTEM_DIM:
-        board.dim_bound = slave_message->param1;
+static void handle_mod_set_system_dim(USB_Slave_Message* slave_message,
+                                      parse_context&) {
+    board.dim_bound = slave_message->param1;
 
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_NO_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_SET_DIM_LOG, 0, 0, 0);
-        break;
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_NO_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_SET_DIM_LOG, 0, 0, 0);
+}
 
-    case MGMSG_MOD_REQ_SYSTEM_DIM:
-        // Header
-        response_buffer[0] = (uint8_t)MGMSG_MOD_GET_SYSTEM_DIM;
-        response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_SYSTEM_DIM >> 8);
-        response_buffer[2] = board.dim_bound;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID;         // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-
-        need_to_reply = true;
-        length        = 6;
-        break;
+static void handle_mod_req_system_dim(USB_Slave_Message*, parse_context& ctx) {
+    // Header
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MOD_GET_SYSTEM_DIM;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MOD_GET_SYSTEM_DIM >> 8);
+    ctx.response_buffer[2] = board.dim_bound;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID;         // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6;
+}
 
-    case MGMSG_MCM_START_LOG:
-        board.send_log_ready = true;
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_HW_START_LOG, 0, 0, 0);
-        break;
+static void handle_mcm_start_log(USB_Slave_Message* slave_message,
+                                 parse_context&) {
+    log_set_port(slave_message);
+    board.send_log_ready = true;
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_HW_START_LOG, 0, 0, 0);
+}
 
-    case MGMSG_MCM_SET_ENABLE_LOG:
+static void handle_mcm_set_enable_log(USB_Slave_Message* slave_message,
+                                      parse_context&) {
 #if ENABLE_SYSTEM_LOGGING
-        board.save.enable_log = slave_message->param1;
-        board_save_info_eeprom();
-        setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
-                           SYSTEM_LOG_TYPE, SYSTEM_ENABLE_LOG, 0, 0, 0);
+    board.save.enable_log = slave_message->param1;
+    board_save_info_eeprom();
+    setup_and_send_log(slave_message, MOTHERBOARD_ID, LOG_REPEAT,
+                       SYSTEM_LOG_TYPE, SYSTEM_ENABLE_LOG, 0, 0, 0);
 #endif
-        break;
-
-    case MGMSG_MCM_REQ_ENABLE_LOG:
-        // Header
-        response_buffer[0] = (uint8_t)MGMSG_MCM_GET_ENABLE_LOG;
-        response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_ENABLE_LOG >> 8);
-        response_buffer[2] = board.save.enable_log;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID;         // destination
-        response_buffer[5] = MOTHERBOARD_ID;  // source
-
-        need_to_reply = true;
-        length        = 6;
-        break;
-
-    case MGMSG_MCM_SET_ALLOWED_DEVICES: {
-        const uint8_t SIZE = (slave_message->ExtendedData_len - 2) -
-                             ((slave_message->ExtendedData_len - 2) %
-                              sizeof(device_signature_t));
-        const slot_nums slot_num =
-            static_cast<slot_nums>(slave_message->extended_data_buf[0]);
-        const uint8_t SPACE_LEFT_IN_PAGE =
-            EEPROM_25LC1024_PAGE_SIZE - sizeof(Slot_Save);
-
-        if (SIZE <= SPACE_LEFT_IN_PAGE) {
-            xSemaphoreTake(slots[slot_num].xSlot_Mutex, portMAX_DELAY);
+}
 
-            if (slots[slot_num].p_allowed_devices != NULL) {
-                vPortFree(slots[slot_num].p_allowed_devices);
-            }
-            slots[slot_num].p_allowed_devices =
-                static_cast<device_signature_t*>(pvPortMalloc(SIZE));
-            /// \todo Check for malloc failure.
+static void handle_mcm_req_enable_log(USB_Slave_Message*, parse_context& ctx) {
+    // Header
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MCM_GET_ENABLE_LOG;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_ENABLE_LOG >> 8);
+    ctx.response_buffer[2] = board.save.enable_log;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID;         // destination
+    ctx.response_buffer[5] = MOTHERBOARD_ID;  // source
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6;
+}
 
-            memcpy(slots[slot_num].p_allowed_devices,
-                   slave_message->extended_data_buf + 2, SIZE);
-            slots[slot_num].save.num_allowed_devices =
-                SIZE / sizeof(device_signature_t);
+static void handle_mcm_set_allowed_devices(USB_Slave_Message* slave_message,
+                                           parse_context&) {
+    const uint8_t SIZE = (slave_message->ExtendedData_len - 2) -
+                         ((slave_message->ExtendedData_len - 2) %
+                          sizeof(device_signature_t));
+    const slot_nums slot_num =
+        static_cast<slot_nums>(slave_message->extended_data_buf[0]);
+    const uint8_t SPACE_LEFT_IN_PAGE =
+        EEPROM_25LC1024_PAGE_SIZE - sizeof(Slot_Save);
+
+    if (SIZE <= SPACE_LEFT_IN_PAGE) {
+        xSemaphoreTake(slots[slot_num].xSlot_Mutex, portMAX_DELAY);
+
+        if (slots[slot_num].p_allowed_devices != NULL) {
+            vPortFree(slots[slot_num].p_allowed_devices);
+        }
+        slots[slot_num].p_allowed_devices =
+            static_cast<device_signature_t*>(pvPortMalloc(SIZE));
+        /// \todo Check for malloc failure.
 
-            xSemaphoreGive(slots[slot_num].xSlot_Mutex);
+        memcpy(slots[slot_num].p_allowed_devices,
+               slave_message->extended_data_buf + 2, SIZE);
+        slots[slot_num].save.num_allowed_devices =
+            SIZE / sizeof(device_signature_t);
 
-            // Save new set of allowed devices to EEPROM.
-            xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-            slot_save_info_eeprom(slot_num);
-            xSemaphoreGive(xSPI_Semaphore);
-
-            // Signal device detection to restart for this slot.
-            device_detect_reset(&slots[slot_num].device);
-        }
-    } break;
-    case MGMSG_MCM_REQ_ALLOWED_DEVICES:
-        response_buffer[0] = (uint8_t)MGMSG_MCM_GET_ALLOWED_DEVICES;
-        response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_ALLOWED_DEVICES >> 8);
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        response_buffer[6] = slave_message->param1;
-        response_buffer[7] = 0x00;
-        {
-            static const uint16_t MAX_ALLOWED =
-                98 / (sizeof(device_signature_t));
-            uint8_t SIZE =
-                ((slots[slave_message->param1].save.num_allowed_devices <
-                  MAX_ALLOWED)
-                     ? slots[slave_message->param1].save.num_allowed_devices
-                     : MAX_ALLOWED) *
-                sizeof(device_signature_t);
-            xSemaphoreTake(slots[slave_message->param1].xSlot_Mutex,
-                           portMAX_DELAY);
-            memcpy(response_buffer + 8,
-                   slots[slave_message->param1].p_allowed_devices, SIZE);
-            xSemaphoreGive(slots[slave_message->param1].xSlot_Mutex);
-
-            SIZE += 2;
-            response_buffer[2] = SIZE;
-            response_buffer[3] = SIZE >> 8;
-            length             = 6 + SIZE;
-
-            need_to_reply = true;
-        }
-        break;
-    case MGMSG_MCM_SET_DEVICE_DETECTION: {
-        uint16_t slot;
-        memcpy(&slot, slave_message->extended_data_buf, 2);
-        // TODO: slot validate
-        xSemaphoreTake(slots[slot].xSlot_Mutex, portMAX_DELAY);
-        slots[slot].save.allow_device_detection =
-            slave_message->extended_data_buf[2];
-        xSemaphoreGive(slots[slot].xSlot_Mutex);
+        xSemaphoreGive(slots[slot_num].xSlot_Mutex);
 
         // Save new set of allowed devices to EEPROM.
         xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-        slot_save_info_eeprom(static_cast<slot_nums>(slot));
+        slot_save_info_eeprom(slot_num);
         xSemaphoreGive(xSPI_Semaphore);
 
         // Signal device detection to restart for this slot.
-        device_detect_reset(&slots[slot].device);
-    } break;
-    case MGMSG_MCM_REQ_DEVICE_DETECTION:
-        response_buffer[0] = (uint8_t)MGMSG_MCM_GET_DEVICE_DETECTION;
-        response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_DEVICE_DETECTION >> 8);
-        response_buffer[2] = 3;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        response_buffer[6] = slave_message->param1;
-        response_buffer[7] = 0x00;
-        xSemaphoreTake(slots[slave_message->param1].xSlot_Mutex, portMAX_DELAY);
-        response_buffer[8] =
-            slots[slave_message->param1].save.allow_device_detection;
+        device_detect_reset(&slots[slot_num].device);
+    }
+}
+
+static void handle_mcm_req_allowed_devices(USB_Slave_Message* slave_message,
+                                           parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MCM_GET_ALLOWED_DEVICES;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_ALLOWED_DEVICES >> 8);
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    ctx.response_buffer[6] = slave_message->param1;
+    ctx.response_buffer[7] = 0x00;
+    {
+        static const uint16_t MAX_ALLOWED =
+            98 / (sizeof(device_signature_t));
+        uint8_t SIZE =
+            ((slots[slave_message->param1].save.num_allowed_devices <
+              MAX_ALLOWED)
+                 ? slots[slave_message->param1].save.num_allowed_devices
+                 : MAX_ALLOWED) *
+            sizeof(device_signature_t);
+        xSemaphoreTake(slots[slave_message->param1].xSlot_Mutex,
+                       portMAX_DELAY);
+        memcpy(ctx.response_buffer + 8,
+               slots[slave_message->param1].p_allowed_devices, SIZE);
         xSemaphoreGive(slots[slave_message->param1].xSlot_Mutex);
 
-        length        = 9;
-        need_to_reply = true;
-        break;
-    case MGMSG_MCM_SET_SLOT_TITLE: {
-        uint16_t slot;
-        memcpy(&slot, slave_message->extended_data_buf, 2);
-        // TODO: Slot validate.
-        xSemaphoreTake(slots[slot].xSlot_Mutex, portMAX_DELAY);
-        memcpy(&slots[slot].save.user_slot_name,
-               slave_message->extended_data_buf + 2, USER_SLOT_NAME_LENGTH);
-        xSemaphoreGive(slots[slot].xSlot_Mutex);
-
-        // Save new slot name to EEPROM.
-        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
-        slot_save_info_eeprom(static_cast<slot_nums>(slot));
-        xSemaphoreGive(xSPI_Semaphore);
-    } break;
-    case MGMSG_MCM_REQ_SLOT_TITLE:
-        response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_GET_SLOT_TITLE);
-        response_buffer[1] =
-            static_cast<uint8_t>(MGMSG_MCM_GET_SLOT_TITLE >> 8);
-        response_buffer[2] = 2 + USER_SLOT_NAME_LENGTH;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        {
-            uint16_t slot = slave_message->param1 |
-                            (static_cast<uint16_t>(slave_message->param2) << 8);
-            memcpy(response_buffer + 6, &slot, sizeof(slot));
-            lock_guard lg(slots[slot].xSlot_Mutex);
-            memcpy(response_buffer + 6 + sizeof(slot),
-                   slots[slot].save.user_slot_name, USER_SLOT_NAME_LENGTH);
-        }
+        SIZE += 2;
+        ctx.response_buffer[2] = SIZE;
+        ctx.response_buffer[3] = SIZE >> 8;
+        ctx.length             = 6 + SIZE;
 
-        length        = 24;
-        need_to_reply = true;
-        break;
-    case MGMSG_MOD_REQ_JOYSTICK_CONTROL:
-        // Assert(Extra length == 3)
-        response_buffer[0] =
-            static_cast<uint8_t>(MGMSG_MOD_GET_JOYSTICK_CONTROL);
-        response_buffer[1] =
-            static_cast<uint8_t>(MGMSG_MOD_GET_JOYSTICK_CONTROL >> 8);
-        response_buffer[2] = 0;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        {
-            const uint8_t USB_PORT = slave_message->extended_data_buf[0];
-            const bool IS_OUT      = slave_message->extended_data_buf[1] > 0;
-            const uint8_t CONTROL_NUMBER = slave_message->extended_data_buf[2];
-
-            response_buffer[2] += get_hid_control_info(
-                USB_PORT + 1, IS_OUT, CONTROL_NUMBER, response_buffer + 6);
-        }
+        ctx.need_to_reply = true;
+    }
+}
 
-        length        = 6 + response_buffer[2];
-        need_to_reply = true;
-        break;
+static void handle_mcm_set_device_detection(USB_Slave_Message* slave_message,
+                                            parse_context&) {
+    uint16_t slot;
+    memcpy(&slot, slave_message->extended_data_buf, 2);
+    // TODO: slot validate
+    xSemaphoreTake(slots[slot].xSlot_Mutex, portMAX_DELAY);
+    slots[slot].save.allow_device_detection =
+        slave_message->extended_data_buf[2];
+    xSemaphoreGive(slots[slot].xSlot_Mutex);
+
+    // Save new set of allowed devices to EEPROM.
+    xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+    slot_save_info_eeprom(static_cast<slot_nums>(slot));
+    xSemaphoreGive(xSPI_Semaphore);
+
+    // Signal device detection to restart for this slot.
+    device_detect_reset(&slots[slot].device);
+}
+
+static void handle_mcm_req_device_detection(USB_Slave_Message* slave_message,
+                                            parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MCM_GET_DEVICE_DETECTION;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_DEVICE_DETECTION >> 8);
+    ctx.response_buffer[2] = 3;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    ctx.response_buffer[6] = slave_message->param1;
+    ctx.response_buffer[7] = 0x00;
+    xSemaphoreTake(slots[slave_message->param1].xSlot_Mutex, portMAX_DELAY);
+    ctx.response_buffer[8] =
+        slots[slave_message->param1].save.allow_device_detection;
+    xSemaphoreGive(slots[slave_message->param1].xSlot_Mutex);
+
+    ctx.length        = 9;
+    ctx.need_to_reply = true;
+}
 
-        // BEGIN        OW APT Commands
+static void handle_mcm_set_slot_title(USB_Slave_Message* slave_message,
+                                      parse_context&) {
+    uint16_t slot;
+    memcpy(&slot, slave_message->extended_data_buf, 2);
+    // TODO: Slot validate.
+    xSemaphoreTake(slots[slot].xSlot_Mutex, portMAX_DELAY);
+    memcpy(&slots[slot].save.user_slot_name,
+           slave_message->extended_data_buf + 2, USER_SLOT_NAME_LENGTH);
+    xSemaphoreGive(slots[slot].xSlot_Mutex);
+
+    // Save new slot name to EEPROM.
+    xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+    slot_save_info_eeprom(static_cast<slot_nums>(slot));
+    xSemaphoreGive(xSPI_Semaphore);
+}
+
+static void handle_mcm_req_slot_title(USB_Slave_Message* slave_message,
+                                      parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_GET_SLOT_TITLE);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_GET_SLOT_TITLE >> 8);
+    ctx.response_buffer[2] = 2 + USER_SLOT_NAME_LENGTH;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        uint16_t slot = slave_message->param1 |
+                        (static_cast<uint16_t>(slave_message->param2) << 8);
+        memcpy(ctx.response_buffer + 6, &slot, sizeof(slot));
+        lock_guard lg(slots[slot].xSlot_Mutex);
+        memcpy(ctx.response_buffer + 6 + sizeof(slot),
+               slots[slot].save.user_slot_name, USER_SLOT_NAME_LENGTH);
+    }
+
+    ctx.length        = 24;
+    ctx.need_to_reply = true;
+}
+
+static void handle_mod_req_joystick_control(USB_Slave_Message* slave_message,
+                                            parse_context& ctx) {
+    // Assert(Extra length == 3)
+    ctx.response_buffer[0] =
+        static_cast<uint8_t>(MGMSG_MOD_GET_JOYSTICK_CONTROL);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MOD_GET_JOYSTICK_CONTROL >> 8);
+    ctx.response_buffer[2] = 0;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const uint8_t USB_PORT = slave_message->extended_data_buf[0];
+        const bool IS_OUT      = slave_message->extended_data_buf[1] > 0;
+        const uint8_t CONTROL_NUMBER = slave_message->extended_data_buf[2];
+
+        ctx.response_buffer[2] += get_hid_control_info(
+            USB_PORT + 1, IS_OUT, CONTROL_NUMBER, ctx.response_buffer + 6);
+    }
+
+    ctx.length        = 6 + ctx.response_buffer[2];
+    ctx.need_to_reply = true;
+}
 
-    case MGMSG_OW_SET_PROGRAMMING:
-        device_detect_change_programming(
-            &slots[slave_message->extended_data_buf[0]].device,
-            slave_message->extended_data_buf[2], &callback_ow_response,
+// BEGIN        OW APT Commands
+static void handle_ow_set_programming(USB_Slave_Message* slave_message,
+                                      parse_context&) {
+    device_detect_change_programming(
+        &slots[slave_message->extended_data_buf[0]].device,
+        slave_message->extended_data_buf[2], &callback_ow_response,
+        (void*)slave_message->extended_data_buf);
+}
+
+static void handle_ow_req_programming(USB_Slave_Message* slave_message,
+                                      parse_context&) {
+    device_detect_check_programming(
+        &slots[slave_message->extended_data_buf[0]].device,
+        &callback_ow_response, (void*)slave_message->extended_data_buf);
+}
+
+/// This is sent to this slot when the callback function for the SET or REQ
+/// commands is called.
+static void handle_ow_get_programming(USB_Slave_Message* slave_message,
+                                      parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_OW_GET_PROGRAMMING;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_OW_GET_PROGRAMMING >> 8);
+    ctx.response_buffer[2] = 3;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    ctx.response_buffer[6] = slave_message->extended_data_buf[0];
+    ctx.response_buffer[7] = slave_message->extended_data_buf[1];
+    ctx.response_buffer[8] = slave_message->extended_data_buf[2];
+
+    ctx.length        = 9;
+    ctx.need_to_reply = true;
+}
+
+static void handle_ow_program(USB_Slave_Message* slave_message,
+                              parse_context& ctx) {
+    uint8_t* const p_buffer = static_cast<uint8_t*>(
+        pvPortMalloc(slave_message->ExtendedData_len));
+    if (p_buffer == NULL) {
+        ctx.response_buffer[0] = (uint8_t)MGMSG_OW_REQ_PROGRAMMING;
+        ctx.response_buffer[1] = (uint8_t)(MGMSG_OW_REQ_PROGRAMMING >> 8);
+        ctx.response_buffer[2] = 3;
+        ctx.response_buffer[3] = 0;
+        ctx.response_buffer[4] = HOST_ID | 0x80;
+        ctx.response_buffer[5] = MOTHERBOARD_ID;
+        ctx.response_buffer[6] = slave_message->extended_data_buf[0];
+        ctx.response_buffer[7] = slave_message->extended_data_buf[1];
+        ctx.response_buffer[8] = OWPE_PACKET_TOO_LARGE;
+
+        ctx.length        = 9;
+        ctx.need_to_reply = true;
+    } else {
+        memcpy(p_buffer, slave_message->extended_data_buf + 2,
+               slave_message->ExtendedData_len - 2);
+
+        device_detect_handle_ow_programming_packet(
+            &slots[slave_message->extended_data_buf[0]].device, p_buffer,
+            slave_message->ExtendedData_len - 2, &callback_ow_program,
             (void*)slave_message->extended_data_buf);
-        break;
-    case MGMSG_OW_REQ_PROGRAMMING:
-        device_detect_check_programming(
-            &slots[slave_message->extended_data_buf[0]].device,
-            &callback_ow_response, (void*)slave_message->extended_data_buf);
-        break;
-    case MGMSG_OW_GET_PROGRAMMING:  // This is sent to this slot when the
-                                    // callback function for the SET or REQ
-                                    // commands is called.
-        response_buffer[0] = (uint8_t)MGMSG_OW_GET_PROGRAMMING;
-        response_buffer[1] = (uint8_t)(MGMSG_OW_GET_PROGRAMMING >> 8);
-        response_buffer[2] = 3;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        response_buffer[6] = slave_message->extended_data_buf[0];
-        response_buffer[7] = slave_message->extended_data_buf[1];
-        response_buffer[8] = slave_message->extended_data_buf[2];
-
-        length        = 9;
-        need_to_reply = true;
-        break;
-    case MGMSG_OW_PROGRAM: {
-        uint8_t* const p_buffer = static_cast<uint8_t*>(
-            pvPortMalloc(slave_message->ExtendedData_len));
-        if (p_buffer == NULL) {
-            response_buffer[0] = (uint8_t)MGMSG_OW_REQ_PROGRAMMING;
-            response_buffer[1] = (uint8_t)(MGMSG_OW_REQ_PROGRAMMING >> 8);
-            response_buffer[2] = 3;
-            response_buffer[3] = 0;
-            response_buffer[4] = HOST_ID | 0x80;
-            response_buffer[5] = MOTHERBOARD_ID;
-            response_buffer[6] = slave_message->extended_data_buf[0];
-            response_buffer[7] = slave_message->extended_data_buf[1];
-            response_buffer[8] = OWPE_PACKET_TOO_LARGE;
-
-            length        = 9;
-            need_to_reply = true;
-        } else {
-            memcpy(p_buffer, slave_message->extended_data_buf + 2,
-                   slave_message->ExtendedData_len - 2);
-
-            device_detect_handle_ow_programming_packet(
-                &slots[slave_message->extended_data_buf[0]].device, p_buffer,
-                slave_message->ExtendedData_len - 2, &callback_ow_program,
-                (void*)slave_message->extended_data_buf);
-        }
-    } break;
-
-    case MGMSG_OW_REQ_PROGRAMMING_SIZE:
-
-        response_buffer[0] = (uint8_t)MGMSG_OW_GET_PROGRAMMING_SIZE;
-        response_buffer[1] = (uint8_t)(MGMSG_OW_GET_PROGRAMMING_SIZE >> 8);
-        response_buffer[2] = 0x02;
-        response_buffer[3] = 0x00;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        response_buffer[6] = (uint8_t)(DEVICE_DETECT_PROGRAMMING_BUFFER_SIZE);
-        response_buffer[7] =
-            (uint8_t)(DEVICE_DETECT_PROGRAMMING_BUFFER_SIZE >> 8);
-
-        need_to_reply = true;
-        length        = 8;
-        break;
+    }
+}
 
-    // END          OW APT Commands
-    // BEGIN	EFS APT Commands
-    case MGMSG_MCM_EFS_REQ_HWINFO:
-
-        response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_HWINFO);
-        response_buffer[1] =
-            static_cast<uint8_t>(MGMSG_MCM_EFS_GET_HWINFO >> 8);
-        response_buffer[2] = 22;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        {
-            const efs::efs_header HEADER   = efs::get_header_info();
-            const uint16_t MAX_FILES       = efs::get_maximum_files();
-            const uint16_t FILES_REMAINING = efs::get_free_files();
-            const uint16_t PAGES_REMAINING = efs::get_free_pages();
-            memcpy(&response_buffer[6], &HEADER, 16);
-            memcpy(&response_buffer[22], &MAX_FILES, 2);
-            memcpy(&response_buffer[24], &FILES_REMAINING, 2);
-            memcpy(&response_buffer[26], &PAGES_REMAINING, 2);
-        }
+static void handle_ow_req_programming_size(USB_Slave_Message*,
+                                           parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_OW_GET_PROGRAMMING_SIZE;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_OW_GET_PROGRAMMING_SIZE >> 8);
+    ctx.response_buffer[2] = 0x02;
+    ctx.response_buffer[3] = 0x00;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    ctx.response_buffer[6] = (uint8_t)(DEVICE_DETECT_PROGRAMMING_BUFFER_SIZE);
+    ctx.response_buffer[7] =
+        (uint8_t)(DEVICE_DETECT_PROGRAMMING_BUFFER_SIZE >> 8);
+
+    ctx.need_to_reply = true;
+    ctx.length        = 8;
+}
 
-        need_to_reply = true;
-        length        = 22 + 6;
-        break;
+// END          OW APT Commands
+// BEGIN	EFS APT Commands
+static void handle_mcm_efs_req_hwinfo(USB_Slave_Message*, parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_HWINFO);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_EFS_GET_HWINFO >> 8);
+    ctx.response_buffer[2] = 22;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const efs::efs_header HEADER   = efs::get_header_info();
+        const uint16_t MAX_FILES       = efs::get_maximum_files();
+        const uint16_t FILES_REMAINING = efs::get_free_files();
+        const uint16_t PAGES_REMAINING = efs::get_free_pages();
+        memcpy(&ctx.response_buffer[6], &HEADER, 16);
+        memcpy(&ctx.response_buffer[22], &MAX_FILES, 2);
+        memcpy(&ctx.response_buffer[24], &FILES_REMAINING, 2);
+        memcpy(&ctx.response_buffer[26], &PAGES_REMAINING, 2);
+    }
 
-    case MGMSG_MCM_EFS_SET_FILEINFO: {
-        efs::file_identifier_t ident = slave_message->extended_data_buf[0];
-        efs::file_attributes_t attr  = slave_message->extended_data_buf[1];
-        uint16_t page_length;
+    ctx.need_to_reply = true;
+    ctx.length        = 22 + 6;
+}
 
-        memcpy(&page_length, &slave_message->extended_data_buf[2], 2);
+static void handle_mcm_efs_req_stats(USB_Slave_Message*, parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_STATS);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_EFS_GET_STATS >> 8);
+    ctx.response_buffer[2] = 8;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const efs::directory_statistics STATS =
+            efs::get_directory_statistics();
+        memcpy(&ctx.response_buffer[6], &STATS.hits, 4);
+        memcpy(&ctx.response_buffer[10], &STATS.misses, 4);
+    }
 
-        if (page_length == 0) {
-            // Deleting an existing file.
-            efs::handle handy =
-                efs::get_handle(ident, APT_EFS_TIMEOUT, efs::EXTERNAL);
-            if (handy.is_valid()) {
-                // TODO:  Deletion logging?
-                handy.delete_file();
-            }
-        } else {
-            // Creating a new file.
-            // TODO:  Creation logging?
-            efs::create_file(ident, page_length, attr, APT_EFS_TIMEOUT);
-            efs::add_to_external_cache(ident, APT_EFS_TIMEOUT);
-        }
-    } break;
-    case MGMSG_MCM_EFS_REQ_FILEINFO:
-        response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEINFO);
-        response_buffer[1] =
-            static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEINFO >> 8);
-        response_buffer[2] = 6;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        {
-            const efs::file_identifier_t IDENT =
-                slave_message->extended_data_buf[0];
-            const bool EXISTS = efs::does_file_exist(IDENT, APT_EFS_TIMEOUT);
-            efs::handle handy =
-                efs::get_handle(IDENT, APT_EFS_TIMEOUT, efs::EXTERNAL);
-            const bool OWNED            = EXISTS && !handy.is_valid();
-            efs::file_attributes_t attr = 0;
-            uint16_t page_size          = 0;
-            if (!OWNED) {
-                attr      = handy.get_attr();
-                page_size = handy.get_page_length();
-            }
+    ctx.need_to_reply = true;
+    ctx.length        = 8 + 6;
+}
 
-            response_buffer[6]  = IDENT;
-            response_buffer[7]  = (EXISTS) ? 1 : 0;
-            response_buffer[8]  = (OWNED) ? 1 : 0;
-            response_buffer[9]  = attr;
-            response_buffer[10] = static_cast<uint8_t>(page_size);
-            response_buffer[11] = static_cast<uint8_t>(page_size >> 8);
-        }
+static void handle_mcm_efs_set_compact(USB_Slave_Message*, parse_context&) {
+    // Runs for a bounded time; the host repeats until finished.
+    efs::compact(APT_EFS_COMPACT_TIME);
+}
 
-        length        = 6 + 6;
-        need_to_reply = true;
-        break;
+static void handle_mcm_efs_req_compact(USB_Slave_Message*, parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_COMPACT);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_EFS_GET_COMPACT >> 8);
+    ctx.response_buffer[2] = 9;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const efs::compaction_progress PROGRESS =
+            efs::get_compaction_progress();
+        memcpy(&ctx.response_buffer[6], &PROGRESS.files_moved, 2);
+        memcpy(&ctx.response_buffer[8], &PROGRESS.pages_moved, 2);
+        memcpy(&ctx.response_buffer[10], &PROGRESS.free_extents, 2);
+        memcpy(&ctx.response_buffer[12], &PROGRESS.largest_free_extent, 2);
+        ctx.response_buffer[14] = (PROGRESS.finished) ? 1 : 0;
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 9 + 6;
+}
 
-    case MGMSG_MCM_EFS_SET_FILEDATA: {
+static void handle_mcm_efs_set_fileinfo(USB_Slave_Message* slave_message,
+                                        parse_context&) {
+    efs::file_identifier_t ident = slave_message->extended_data_buf[0];
+    efs::file_attributes_t attr  = slave_message->extended_data_buf[1];
+    uint16_t page_length;
+
+    memcpy(&page_length, &slave_message->extended_data_buf[2], 2);
+
+    if (page_length == 0) {
+        // Deleting an existing file.
+        efs::handle handy =
+            efs::get_handle(ident, APT_EFS_TIMEOUT, efs::EXTERNAL);
+        if (handy.is_valid()) {
+            // TODO:  Deletion logging?
+            handy.delete_file();
+        }
+    } else {
+        // Creating a new file.
+        // TODO:  Creation logging?
+        efs::create_file(ident, page_length, attr, APT_EFS_TIMEOUT);
+        efs::add_to_external_cache(ident, APT_EFS_TIMEOUT);
+    }
+}
+
+static void handle_mcm_efs_req_fileinfo(USB_Slave_Message* slave_message,
+                                        parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEINFO);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEINFO >> 8);
+    ctx.response_buffer[2] = 6;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
         const efs::file_identifier_t IDENT =
             slave_message->extended_data_buf[0];
-        efs::handle file =
+        const bool EXISTS = efs::does_file_exist(IDENT, APT_EFS_TIMEOUT);
+        efs::handle handy =
             efs::get_handle(IDENT, APT_EFS_TIMEOUT, efs::EXTERNAL);
-        if (file.is_valid()) {
-            uint32_t FILE_ADDR;
-            memcpy(&FILE_ADDR, &slave_message->extended_data_buf[1],
-                   sizeof(FILE_ADDR));
-            const uint16_t DATA_LENGTH = slave_message->ExtendedData_len - 5;
-            file.write(FILE_ADDR, &slave_message->extended_data_buf[5],
-                       DATA_LENGTH);
+        const bool OWNED            = EXISTS && !handy.is_valid();
+        efs::file_attributes_t attr = 0;
+        uint16_t page_size          = 0;
+        if (!OWNED) {
+            attr      = handy.get_attr();
+            page_size = handy.get_page_length();
         }
-    } break;
-    case MGMSG_MCM_EFS_REQ_FILEDATA:
-        response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEDATA);
-        response_buffer[1] =
-            static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEDATA >> 8);
-        {
-            static constexpr uint16_t DYNAMIC_DATA_CAPACITY =
-                sizeof(response_buffer) - 6 - 1 - 4;
-            // Response buffer needs to hold the APT header, File ID, and
-            // address before the response.
-            const efs::file_identifier_t IDENT =
-                slave_message->extended_data_buf[0];
-            uint32_t READ_ADDR;
-            uint16_t read_len;
-            memcpy(&READ_ADDR, &slave_message->extended_data_buf[1], 4);
-            memcpy(&read_len, &slave_message->extended_data_buf[5], 2);
-            read_len = std::min(DYNAMIC_DATA_CAPACITY, read_len);
-
-            const efs::handle file =
-                efs::get_handle(IDENT, APT_EFS_TIMEOUT, efs::EXTERNAL);
-            uint16_t data_read = 0;
-            if (file.is_valid()) {
-                data_read =
-                    file.read(READ_ADDR, &response_buffer[6 + 5], read_len);
-            }
-            const uint16_t APT_LENGTH = data_read + 5;
 
-            response_buffer[2] = static_cast<uint8_t>(APT_LENGTH);
-            response_buffer[3] = static_cast<uint8_t>(APT_LENGTH >> 8);
-            response_buffer[4] = HOST_ID | 0x80;
-            response_buffer[5] = MOTHERBOARD_ID;
-            response_buffer[6] = IDENT;
-            memcpy(&response_buffer[7], &READ_ADDR, 4);
+        ctx.response_buffer[6]  = IDENT;
+        ctx.response_buffer[7]  = (EXISTS) ? 1 : 0;
+        ctx.response_buffer[8]  = (OWNED) ? 1 : 0;
+        ctx.response_buffer[9]  = attr;
+        ctx.response_buffer[10] = static_cast<uint8_t>(page_size);
+        ctx.response_buffer[11] = static_cast<uint8_t>(page_size >> 8);
+    }
+
+    ctx.length        = 6 + 6;
+    ctx.need_to_reply = true;
+}
 
-            length = 6 + APT_LENGTH;
+static void handle_mcm_efs_set_filedata(USB_Slave_Message* slave_message,
+                                        parse_context&) {
+    const efs::file_identifier_t IDENT =
+        slave_message->extended_data_buf[0];
+    uint32_t FILE_ADDR;
+    memcpy(&FILE_ADDR, &slave_message->extended_data_buf[1],
+           sizeof(FILE_ADDR));
+    const uint16_t DATA_LENGTH = slave_message->ExtendedData_len - 5;
+
+    efs_session& session = efs_session_of(slave_message);
+    lock_guard lg(session.lock);
+    efs::stream* const p_file = efs_session_open(session, IDENT, FILE_ADDR);
+    if (p_file != nullptr) {
+        // Batched until the page is complete or the session is closed.
+        const uint32_t ACCEPTED = p_file->write(std::span<const std::byte>(
+            reinterpret_cast<const std::byte*>(
+                &slave_message->extended_data_buf[5]),
+            DATA_LENGTH));
+        if (ACCEPTED != DATA_LENGTH) {
+            debug_print("ERROR: EFS file %d lost %d bytes at %d\r\n", IDENT,
+                        DATA_LENGTH - ACCEPTED, FILE_ADDR + ACCEPTED);
+            efs_session_close(session);
+        } else if (p_file->tell() >= p_file->size()) {
+            efs_session_close(session);
         }
+    }
+}
 
-        need_to_reply = true;
-        break;
+static void handle_mcm_efs_req_filedata(USB_Slave_Message* slave_message,
+                                        parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEDATA);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_EFS_GET_FILEDATA >> 8);
+    {
+        static constexpr uint16_t DYNAMIC_DATA_CAPACITY =
+            RESPONSE_BUFFER_SIZE - 6 - 1 - 4;
+        // Response buffer needs to hold the APT header, File ID, and
+        // address before the response.
+        const efs::file_identifier_t IDENT =
+            slave_message->extended_data_buf[0];
+        uint32_t READ_ADDR;
+        uint16_t read_len;
+        memcpy(&READ_ADDR, &slave_message->extended_data_buf[1], 4);
+        memcpy(&read_len, &slave_message->extended_data_buf[5], 2);
+        read_len = std::min(DYNAMIC_DATA_CAPACITY, read_len);
+
+        efs_session& session = efs_session_of(slave_message);
+        lock_guard lg(session.lock);
+        efs::stream* const p_file =
+            efs_session_open(session, IDENT, READ_ADDR);
+        uint16_t data_read = 0;
+        if (p_file != nullptr) {
+            data_read = p_file->read(std::span<std::byte>(
+                reinterpret_cast<std::byte*>(&ctx.response_buffer[6 + 5]),
+                read_len));
+            if (p_file->tell() >= p_file->size()) {
+                efs_session_close(session);
+            } else {
+                ctx.p_efs_prefetch = &session;
+            }
+        }
+        const uint16_t APT_LENGTH = data_read + 5;
+
+        ctx.response_buffer[2] = static_cast<uint8_t>(APT_LENGTH);
+        ctx.response_buffer[3] = static_cast<uint8_t>(APT_LENGTH >> 8);
+        ctx.response_buffer[4] = HOST_ID | 0x80;
+        ctx.response_buffer[5] = MOTHERBOARD_ID;
+        ctx.response_buffer[6] = IDENT;
+        memcpy(&ctx.response_buffer[7], &READ_ADDR, 4);
+
+        ctx.length = 6 + APT_LENGTH;
+    }
+
+    ctx.need_to_reply = true;
+}
+
+// END		EFS APT Commands
+// BEGIN	Profiler APT Commands
+static void handle_mcm_prof_req_task(USB_Slave_Message* slave_message,
+                                     parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_TASK);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_PROF_GET_TASK >> 8);
+    ctx.response_buffer[2] = 9 + service::profiler::NAME_LENGTH;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        service::profiler::task_load load = {};
+        service::profiler::get_task_load(slave_message->param1, load);
+
+        uint8_t* p = &ctx.response_buffer[6];
+        *p++       = slave_message->param1;
+        *p++       = static_cast<uint8_t>(service::profiler::task_count());
+        memcpy(p, load.name, service::profiler::NAME_LENGTH);
+        p += service::profiler::NAME_LENGTH;
+        *p++ = load.priority;
+        memcpy(p, &load.load_permille, 2);
+        memcpy(p + 2, &load.peak_load_permille, 2);
+        memcpy(p + 4, &load.stack_free_words, 2);
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + 9 + service::profiler::NAME_LENGTH;
+}
+
+static void handle_mcm_prof_req_loop(USB_Slave_Message* slave_message,
+                                     parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_LOOP);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_PROF_GET_LOOP >> 8);
+    ctx.response_buffer[2] = 62 + service::profiler::NAME_LENGTH;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        service::profiler::loop_statistics stats = {};
+        service::profiler::get_loop_statistics(slave_message->param1,
+                                               stats);
+
+        uint8_t* p = &ctx.response_buffer[6];
+        *p++       = slave_message->param1;
+        *p++       = static_cast<uint8_t>(service::profiler::loop_count());
+        memcpy(p, stats.name, service::profiler::NAME_LENGTH);
+        p += service::profiler::NAME_LENGTH;
+        memcpy(p, &stats.period_us, 4);
+        memcpy(p + 4, &stats.samples, 4);
+        memcpy(p + 8, &stats.overruns, 4);
+        memcpy(p + 12, &stats.max_jitter_us, 4);
+        memcpy(p + 16, &stats.max_busy_us, 4);
+        memcpy(p + 20, &stats.total_busy_us, 8);
+        memcpy(p + 28, stats.jitter.data(), 32);
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + 62 + service::profiler::NAME_LENGTH;
+}
+
+static void handle_mcm_prof_req_spi(USB_Slave_Message* slave_message,
+                                    parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_SPI);
+    ctx.response_buffer[1] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_SPI >> 8);
+    ctx.response_buffer[2] = 34 + service::profiler::NAME_LENGTH;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        service::spi_scheduler::statistics stats = {};
+        const char* name                         = "";
+        service::spi_scheduler::get_statistics(slave_message->param1,
+                                               stats, &name);
+
+        uint8_t* p = &ctx.response_buffer[6];
+        *p++       = slave_message->param1;
+        *p++ = static_cast<uint8_t>(service::spi_scheduler::client_count());
+        strncpy(reinterpret_cast<char*>(p), name,
+                service::profiler::NAME_LENGTH);
+        p += service::profiler::NAME_LENGTH;
+        memcpy(p, &stats.transactions, 4);
+        memcpy(p + 4, &stats.leases, 4);
+        memcpy(p + 8, &stats.deadline_misses, 4);
+        memcpy(p + 12, &stats.max_wait_us, 4);
+        memcpy(p + 16, &stats.total_wait_us, 8);
+        memcpy(p + 24, &stats.total_occupancy_us, 8);
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + 34 + service::profiler::NAME_LENGTH;
+}
+
+/// The framing counters of the port in param1, to benchmark long-form
+/// command throughput.
+static void handle_mcm_prof_req_frames(USB_Slave_Message* slave_message,
+                                       parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_FRAMES);
+    ctx.response_buffer[1] =
+        static_cast<uint8_t>(MGMSG_MCM_PROF_GET_FRAMES >> 8);
+    ctx.response_buffer[2] = 37;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        apt_frame_statistics_t stats = {};
+        apt_frame_get_statistics(slave_message->param1, &stats);
+
+        const uint32_t CYCLES_PER_US = sysclk_get_cpu_hz() / 1000000;
+        const uint64_t BUSY_US       = stats.long_cycles / CYCLES_PER_US;
+        const uint32_t PER_SECOND =
+            stats.elapsed_ms == 0
+                ? 0
+                : static_cast<uint64_t>(stats.long_frames) * 1000 /
+                      stats.elapsed_ms;
+        const uint32_t CAPACITY_PER_SECOND =
+            BUSY_US == 0
+                ? 0
+                : static_cast<uint64_t>(stats.long_frames) * 1000000 /
+                      BUSY_US;
+
+        uint8_t* p = &ctx.response_buffer[6];
+        *p++       = slave_message->param1;
+        memcpy(p, &stats.frames, 4);
+        memcpy(p + 4, &stats.long_frames, 4);
+        memcpy(p + 8, &stats.long_bytes, 4);
+        memcpy(p + 12, &stats.dropped_bytes, 4);
+        memcpy(p + 16, &stats.elapsed_ms, 4);
+        memcpy(p + 20, &BUSY_US, 8);
+        memcpy(p + 28, &PER_SECOND, 4);
+        memcpy(p + 32, &CAPACITY_PER_SECOND, 4);
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + 37;
+}
+
+// END		Profiler APT Commands
+static void handle_mcm_lut_set_lock(USB_Slave_Message* slave_message,
+                                    parse_context&) {
+    lut_manager::set_lock(slave_message->param1 != 0);
+}
+
+static void handle_mcm_lut_req_lock(USB_Slave_Message*, parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_LUT_GET_LOCK);
+    ctx.response_buffer[1] = static_cast<uint8_t>(MGMSG_MCM_LUT_GET_LOCK >> 8);
+    ctx.response_buffer[2] = lut_manager::get_lock();
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6;
+}
 
-        // END		EFS APT Commands
+static void handle_mcm_req_pnpstatus(USB_Slave_Message* slave_message,
+                                     parse_context& ctx) {
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MCM_GET_PNPSTATUS;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_PNPSTATUS >> 8);
+    ctx.response_buffer[2] = 6;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const uint16_t SLOT =
+            slave_message->param1 | (slave_message->param2 << 8);
+        memcpy(&ctx.response_buffer[6], &SLOT, sizeof(SLOT));
+        lock_guard(slots[SLOT].xSlot_Mutex);
+        memcpy(&ctx.response_buffer[8], &slots[SLOT].pnp_status,
+               sizeof(pnp_status_t));
+    }
 
-    case MGMSG_MCM_LUT_SET_LOCK:
-        lut_manager::set_lock(slave_message->param1 != 0);
+    ctx.need_to_reply = true;
+    ctx.length        = 12;
+}
 
+static void handle_mcm_req_detect_time(USB_Slave_Message* slave_message,
+                                       parse_context& ctx) {
+    if (slave_message->param1 >= NUMBER_OF_BOARD_SLOTS) {
+        return;
+    }
+    ctx.response_buffer[0] = (uint8_t)MGMSG_MCM_GET_DETECT_TIME;
+    ctx.response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_DETECT_TIME >> 8);
+    ctx.response_buffer[2] = 10;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const uint16_t SLOT = slave_message->param1;
+        memcpy(&ctx.response_buffer[6], &SLOT, sizeof(SLOT));
+        lock_guard lg(slots[SLOT].xSlot_Mutex);
+        memcpy(&ctx.response_buffer[8], &slots[SLOT].device.detect_time_ms,
+               sizeof(uint32_t));
+        memcpy(&ctx.response_buffer[12],
+               &slots[SLOT].device.worst_detect_time_ms, sizeof(uint32_t));
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 16;
+}
+
+static void handle_mot_set_eepromparams(USB_Slave_Message* slave_message,
+                                        parse_context&) {
+    uint16_t channel;
+    uint16_t command;
+    memcpy(&channel, &slave_message->extended_data_buf[0], sizeof(channel));
+    memcpy(&command, &slave_message->extended_data_buf[2], sizeof(command));
+
+    drivers::spi::handle_factory factory;
+    switch (command) {
+    case MGMSG_MOD_SET_JOYSTICK_MAP_IN:
+        // Parse the channel as the port number.
+        service::hid_mapping::address_handle::create(
+            static_cast<uint8_t>(channel) + 1)
+            .store_in_to_eeprom(factory);
         break;
-    case MGMSG_MCM_LUT_REQ_LOCK:
-        response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_LUT_GET_LOCK);
-        response_buffer[1] = static_cast<uint8_t>(MGMSG_MCM_LUT_GET_LOCK >> 8);
-        response_buffer[2] = lut_manager::get_lock();
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID;
-        response_buffer[5] = MOTHERBOARD_ID;
-
-        need_to_reply = true;
-        length        = 6;
+    case MGMSG_MOD_SET_JOYSTICK_MAP_OUT:
+        // Parse the channel as the port number.
+        service::hid_mapping::address_handle::create(
+            static_cast<uint8_t>(channel) + 1)
+            .store_out_to_eeprom(factory);
+    default:
         break;
+    }
+}
 
-    case MGMSG_MCM_REQ_PNPSTATUS:
-        response_buffer[0] = (uint8_t)MGMSG_MCM_GET_PNPSTATUS;
-        response_buffer[1] = (uint8_t)(MGMSG_MCM_GET_PNPSTATUS >> 8);
-        response_buffer[2] = 6;
-        response_buffer[3] = 0;
-        response_buffer[4] = HOST_ID | 0x80;
-        response_buffer[5] = MOTHERBOARD_ID;
-        {
-            const uint16_t SLOT =
-                slave_message->param1 | (slave_message->param2 << 8);
-            memcpy(&response_buffer[6], &SLOT, sizeof(SLOT));
-            lock_guard(slots[SLOT].xSlot_Mutex);
-            memcpy(&response_buffer[8], &slots[SLOT].pnp_status,
-                   sizeof(pnp_status_t));
-        }
+/****************************************************************************
+ * Routes
+ ****************************************************************************/
+using apt_handler = void (*)(USB_Slave_Message*, parse_context&);
+using apt_route   = drivers::apt::route<apt_handler>;
+
+// Board, slot, joystick and logging commands.
+static constexpr auto SYSTEM_ROUTES = std::to_array<apt_route>({
+    {MGMSG_SET_SER_TO_EEPROM, &handle_set_ser_to_eeprom},
+    {MGMSG_HW_REQ_INFO, &handle_hw_req_info},
+    {MGMSG_MOD_IDENTIFY, &handle_mod_identify},
+    {MGMSG_GET_UPDATE_FIRMWARE, &handle_get_update_firmware},
+    {MGMSG_MCM_HW_REQ_INFO, &handle_mcm_hw_req_info},
+    {MGMSG_RT1064_UPDATE, &handle_rt1064_update},
+    {MGMSG_CPLD_UPDATE, &handle_cpld_update},
+    {MGMSG_SET_HW_REV, &handle_set_hw_rev},
+    {MGMSG_SET_CARD_TYPE, &handle_set_card_type},
+    {MGMSG_REQ_DEVICE, &handle_req_device},
+    {MGMSG_SET_DEVICE_BOARD, &handle_set_device_board},
+    {MGMSG_REQ_DEVICE_BOARD, &handle_req_device_board},
+    {MGMSG_RESTART_PROCESSOR, &handle_restart_processor},
+    {MGMSG_ERASE_EEPROM, &handle_erase_eeprom},
+    {MGMSG_REQ_CPLD_WR, &handle_req_cpld_wr},
+    {MGMSG_TASK_CONTROL, &handle_task_control},
+    {MGMSG_BOARD_REQ_STATUSUPDATE, &handle_board_req_statusupdate},
+    {MGMSG_MOD_REQ_JOYSTICK_INFO, &handle_mod_req_joystick_info},
+    {MGMSG_MOD_SET_JOYSTICK_MAP_IN, &handle_mod_set_joystick_map_in},
+    {MGMSG_MOD_SET_JOYSTICK_MAP_OUT, &handle_mod_set_joystick_map_out},
+    {MGMSG_MOD_REQ_JOYSTICK_MAP_IN, &handle_mod_req_joystick_map_in},
+    {MGMSG_MOD_REQ_JOYSTICK_MAP_OUT, &handle_mod_req_joystick_map_out},
+    {MGMSG_MCM_REQ_JOYSTICK_DATA, &handle_mcm_req_joystick_data},
+    {MGMSG_MOD_SET_SYSTEM_DIM, &handle_mod_set_system_dim},
+    {MGMSG_MOD_REQ_SYSTEM_DIM, &handle_mod_req_system_dim},
+    {MGMSG_MCM_START_LOG, &handle_mcm_start_log},
+    {MGMSG_MCM_SET_ENABLE_LOG, &handle_mcm_set_enable_log},
+    {MGMSG_MCM_REQ_ENABLE_LOG, &handle_mcm_req_enable_log},
+    {MGMSG_MCM_SET_ALLOWED_DEVICES, &handle_mcm_set_allowed_devices},
+    {MGMSG_MCM_REQ_ALLOWED_DEVICES, &handle_mcm_req_allowed_devices},
+    {MGMSG_MCM_SET_DEVICE_DETECTION, &handle_mcm_set_device_detection},
+    {MGMSG_MCM_REQ_DEVICE_DETECTION, &handle_mcm_req_device_detection},
+    {MGMSG_MCM_SET_SLOT_TITLE, &handle_mcm_set_slot_title},
+    {MGMSG_MCM_REQ_SLOT_TITLE, &handle_mcm_req_slot_title},
+    {MGMSG_MOD_REQ_JOYSTICK_CONTROL, &handle_mod_req_joystick_control},
+    {MGMSG_MCM_LUT_SET_LOCK, &handle_mcm_lut_set_lock},
+    {MGMSG_MCM_LUT_REQ_LOCK, &handle_mcm_lut_req_lock},
+    {MGMSG_MCM_REQ_PNPSTATUS, &handle_mcm_req_pnpstatus},
+    {MGMSG_MCM_REQ_DETECT_TIME, &handle_mcm_req_detect_time},
+    {MGMSG_MOT_SET_EEPROMPARAMS, &handle_mot_set_eepromparams},
+});
+
+// One-wire device programming.
+static constexpr auto OW_ROUTES = std::to_array<apt_route>({
+    {MGMSG_OW_SET_PROGRAMMING, &handle_ow_set_programming},
+    {MGMSG_OW_REQ_PROGRAMMING, &handle_ow_req_programming},
+    {MGMSG_OW_GET_PROGRAMMING, &handle_ow_get_programming},
+    {MGMSG_OW_PROGRAM, &handle_ow_program},
+    {MGMSG_OW_REQ_PROGRAMMING_SIZE, &handle_ow_req_programming_size},
+});
+
+// Embedded file system.
+static constexpr auto EFS_ROUTES = std::to_array<apt_route>({
+    {MGMSG_MCM_EFS_REQ_HWINFO, &handle_mcm_efs_req_hwinfo},
+    {MGMSG_MCM_EFS_REQ_STATS, &handle_mcm_efs_req_stats},
+    {MGMSG_MCM_EFS_SET_COMPACT, &handle_mcm_efs_set_compact},
+    {MGMSG_MCM_EFS_REQ_COMPACT, &handle_mcm_efs_req_compact},
+    {MGMSG_MCM_EFS_SET_FILEINFO, &handle_mcm_efs_set_fileinfo},
+    {MGMSG_MCM_EFS_REQ_FILEINFO, &handle_mcm_efs_req_fileinfo},
+    {MGMSG_MCM_EFS_SET_FILEDATA, &handle_mcm_efs_set_filedata},
+    {MGMSG_MCM_EFS_REQ_FILEDATA, &handle_mcm_efs_req_filedata},
+});
+
+// Runtime profiler.
+static constexpr auto PROFILER_ROUTES = std::to_array<apt_route>({
+    {MGMSG_MCM_PROF_REQ_TASK, &handle_mcm_prof_req_task},
+    {MGMSG_MCM_PROF_REQ_LOOP, &handle_mcm_prof_req_loop},
+    {MGMSG_MCM_PROF_REQ_SPI, &handle_mcm_prof_req_spi},
+    {MGMSG_MCM_PROF_SET_RESET, &handle_mcm_prof_set_reset},
+    {MGMSG_MCM_PROF_REQ_APT, &handle_mcm_prof_req_apt},
+    {MGMSG_MCM_PROF_REQ_FRAMES, &handle_mcm_prof_req_frames},
+});
+
+static constexpr auto ROUTES =
+    drivers::apt::join_routes(SYSTEM_ROUTES, OW_ROUTES, EFS_ROUTES,
+                              PROFILER_ROUTES);
+
+static drivers::apt::router<ROUTES> s_router;
+
+static void handle_mcm_prof_set_reset(USB_Slave_Message*, parse_context&) {
+    service::profiler::reset_statistics();
+    service::spi_scheduler::reset_statistics();
+    s_router.reset_statistics();
+    apt_frame_reset_statistics();
+}
 
-        need_to_reply = true;
-        length        = 12;
-        break;
-    case MGMSG_MOT_SET_EEPROMPARAMS: {
-        uint16_t channel;
-        uint16_t command;
-        memcpy(&channel, &slave_message->extended_data_buf[0], sizeof(channel));
-        memcpy(&command, &slave_message->extended_data_buf[2], sizeof(command));
-
-        drivers::spi::handle_factory factory;
-        switch (command) {
-        case MGMSG_MOD_SET_JOYSTICK_MAP_IN:
-            // Parse the channel as the port number.
-            service::hid_mapping::address_handle::create(
-                static_cast<uint8_t>(channel) + 1)
-                .store_in_to_eeprom(factory);
-            break;
-        case MGMSG_MOD_SET_JOYSTICK_MAP_OUT:
-            // Parse the channel as the port number.
-            service::hid_mapping::address_handle::create(
-                static_cast<uint8_t>(channel) + 1)
-                .store_out_to_eeprom(factory);
-        default:
-            break;
+/// The hits and handler run times of the route at the index in param1.
+static void handle_mcm_prof_req_apt(USB_Slave_Message* slave_message,
+                                    parse_context& ctx) {
+    ctx.response_buffer[0] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_APT);
+    ctx.response_buffer[1] = static_cast<uint8_t>(MGMSG_MCM_PROF_GET_APT >> 8);
+    ctx.response_buffer[2] = 20;
+    ctx.response_buffer[3] = 0;
+    ctx.response_buffer[4] = HOST_ID | 0x80;
+    ctx.response_buffer[5] = MOTHERBOARD_ID;
+    {
+        const std::size_t INDEX = slave_message->param1;
+        drivers::apt::route_statistics stats = {};
+        uint16_t command                     = 0;
+        if (INDEX < s_router.size()) {
+            stats   = s_router.statistics(INDEX);
+            command = s_router.command(INDEX);
         }
-    } break;
 
-    default:
+        const uint32_t CYCLES_PER_US = sysclk_get_cpu_hz() / 1000000;
+        const uint32_t MAX_US        = stats.max_cycles / CYCLES_PER_US;
+        const uint64_t TOTAL_US      = stats.total_cycles / CYCLES_PER_US;
+
+        uint8_t* p = &ctx.response_buffer[6];
+        *p++       = slave_message->param1;
+        *p++       = static_cast<uint8_t>(s_router.size());
+        memcpy(p, &command, 2);
+        memcpy(p + 2, &stats.hits, 4);
+        memcpy(p + 6, &MAX_US, 4);
+        memcpy(p + 10, &TOTAL_US, 8);
+    }
+
+    ctx.need_to_reply = true;
+    ctx.length        = 6 + 20;
+}
+
+/**
+ * @brief Parse APT commands that are specific to the board not a card in a slot
+ *
+ * The command is routed to its handler through s_router; commands without a
+ * route are reported as not supported.
+ *
+ * Takes xUSB_Slave_TxSemaphore - sending data on the USB bus
+ *
+ * @param buf : The pointer buffer which holds the data to parse.
+ * @param slave_message_id : This is the massage structure pass from the USB
+ * salve task
+ */
+static void parse(USB_Slave_Message* slave_message) {
+    parse_context ctx(*slave_message);
+
+    if (!s_router.dispatch(slave_message->ucMessageID, slave_message, ctx)) {
         usb_slave_command_not_supported(slave_message);
-        break;
     }
 
     /* If we need a response*/
-    if (need_to_reply) {
+    if (ctx.need_to_reply) {
         /* block until we can send the message on the USB slave Tx port*/
         xSemaphoreTake(slave_message->xUSB_Slave_TxSemaphore, portMAX_DELAY);
         //		debug_print("%d \r\n",length);
 
-        slave_message->write(response_buffer, length);
+        slave_message->write(ctx.response_buffer, ctx.length);
         xSemaphoreGive(slave_message->xUSB_Slave_TxSemaphore);
     }
+
+    // Read the next page while the host handles the response.
+    if (ctx.p_efs_prefetch != nullptr) {
+        lock_guard lg(ctx.p_efs_prefetch->lock);
+        if (ctx.p_efs_prefetch->file.has_value()) {
+            ctx.p_efs_prefetch->file->prefetch();
+        }
+    }
+}
+
+static efs_session& efs_session_of(const USB_Slave_Message* slave_message) {
+    return s_efs_sessions[slave_message->ftdi_flag ? 1 : 0];
+}
+
+// MARK:  Session Lock Required
+static efs::stream* efs_session_open(efs_session& session,
+                                     const efs::file_identifier_t ident,
+                                     const uint32_t file_address) {
+    // Only a command continuing where the last one stopped keeps the session.
+    if (session.file.has_value() && (session.file->get_id() != ident ||
+                                     session.file->tell() != file_address)) {
+        efs_session_close(session);
+    }
+    if (!session.file.has_value()) {
+        session.file.emplace(
+            efs::get_handle(ident, APT_EFS_TIMEOUT, efs::EXTERNAL));
+        if (!session.file->is_valid()) {
+            session.file.reset();
+            return nullptr;
+        }
+        session.file->seek(file_address);
+    }
+
+    session.last_used = xTaskGetTickCount();
+    return &*session.file;
+}
+
+// MARK:  Session Lock Required
+static void efs_session_close(efs_session& session) {
+    if (session.file.has_value() && !session.file->flush()) {
+        debug_print("ERROR: EFS file %d lost %d bytes\r\n",
+                    session.file->get_id(), session.file->pending());
+    }
+    session.file.reset();
 }
 
 static std::size_t hw_info_response(uint8_t p_buffer[RESPONSE_BUFFER_SIZE],
@@ -1102,22 +1607,72 @@ static std::size_t hw_info_response(uint8_t p_buffer[RESPONSE_BUFFER_SIZE],
  * Public Functions
  ****************************************************************************/
 
-bool apt_parse(USB_Slave_Message* slave_message) {
+void apt_parse_init(void) {
+    for (efs_session& session : s_efs_sessions) {
+        session.lock = xSemaphoreCreateMutex();
+    }
+}
+
+void apt_parse_efs_tick(void) {
+    const TickType_t NOW = xTaskGetTickCount();
+    for (efs_session& session : s_efs_sessions) {
+        // A session the port is using is not idle, so do not wait for it.
+        if (!session.file.has_value() ||
+            xSemaphoreTake(session.lock, 0) != pdTRUE) {
+            continue;
+        }
+        if (session.file.has_value() &&
+            NOW - session.last_used >= APT_EFS_SESSION_IDLE) {
+            efs_session_close(session);
+        }
+        xSemaphoreGive(session.lock);
+    }
+}
+
+bool apt_parse_frame(const apt_frame_t* frame,
+                     USB_Slave_Message* slave_message) {
     bool error = false;
 
+    apt_frame_header_to_message(frame, slave_message);
+
+    // Only this port's task opens its session, so one seen closed here stays
+    // closed and the lock is only needed to close it.
+    efs_session& session = efs_session_of(slave_message);
+    if (session.file.has_value() &&
+        slave_message->ucMessageID != MGMSG_MCM_EFS_SET_FILEDATA &&
+        slave_message->ucMessageID != MGMSG_MCM_EFS_REQ_FILEDATA) {
+        lock_guard lg(session.lock);
+        efs_session_close(session);
+    }
+
     /*If we are here we now all the data for this command is ready to copy to
      * our message structure*/
     /*Check if packet need to be parsed here.  This will be determined by the
      destination parameter in the ASF command.*/
     if ((slave_message->destination == MOTHERBOARD_ID) ||
         (slave_message->destination == MOTHERBOARD_ID_STANDALONE)) {
+        // The handlers read the extended data as one buffer.
+        apt_frame_copy_data(frame, slave_message->extended_data_buf);
         parse(slave_message);
     }
     /*Need to dispatch a message queue to either the uC USB or the FTDI USB*/
     else {
+        // The only copy of the message, made from the receive ring; the
+        // slot's queue carries a pointer.
+        service::itc::pipeline_cdc_t::message pooled =
+            service::itc::pipeline_cdc().acquire();
+        if (pooled) {
+            pooled->write     = slave_message->write;
+            pooled->ftdi_flag = slave_message->ftdi_flag;
+            pooled->xUSB_Slave_TxSemaphore =
+                slave_message->xUSB_Slave_TxSemaphore;
+            apt_frame_header_to_message(frame, pooled.get());
+            apt_frame_copy_data(frame, pooled->extended_data_buf);
+        }
+
         if (service::itc::pipeline_cdc().send(
-                *slave_message, static_cast<asf_destination_ids>(
-                                    slave_message->destination)) == 0) {
+                pooled, static_cast<asf_destination_ids>(
+                            slave_message->destination)) == 0) {
             if (slave_message->destination >= SLOT_1_ID &&
                 slave_message->destination <= SLOT_7_ID) {
                 if (slave_message->ftdi_flag) {
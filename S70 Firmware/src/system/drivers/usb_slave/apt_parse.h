@@ -12,11 +12,18 @@
 extern "C" {
 #endif
 
+#include "apt_frame.h"
+
 /****************************************************************************
  * Defines
  ****************************************************************************/
 #define APT_EFS_TIMEOUT     pdMS_TO_TICKS(100)
 
+// The time one MGMSG_MCM_EFS_SET_COMPACT may spend starting file moves.
+#define APT_EFS_COMPACT_TIME    pdMS_TO_TICKS(50)
+// How long a port's file-data session may sit unused before it is closed.
+#define APT_EFS_SESSION_IDLE    pdMS_TO_TICKS(250)
+
 /****************************************************************************
  * Public Data
  ****************************************************************************/
@@ -24,7 +31,26 @@ extern "C" {
 /************************************************************************************
  * Public Function Prototypes
  ************************************************************************************/
-bool apt_parse(USB_Slave_Message *slave_message);
+/**
+ * Creates the locks of the ports' EFS file-data sessions.  Called before the
+ * USB and FTDI tasks start.
+ */
+void apt_parse_init(void);
+
+/**
+ * Closes, programming any batched writes, the EFS file-data sessions idle for
+ * APT_EFS_SESSION_IDLE.  Called from the supervisor task without the SPI
+ * mutex.
+ */
+void apt_parse_efs_tick(void);
+
+/**
+ * Handles a command still in the receive ring.  slave_message carries the
+ * port's write function and Tx lock, and takes the command's fields.  The
+ * extended data is copied into it for the motherboard handlers, or straight
+ * into the pooled message for a slot.
+ */
+bool apt_parse_frame(const apt_frame_t *frame, USB_Slave_Message *slave_message);
 void usb_slave_command_not_supported(USB_Slave_Message *slave_message);
 
 #ifdef __cplusplus
@@ -13,6 +13,7 @@
 #include "Debugging.h"
 #include "FreeRTOSConfig.h"
 #include "apt.h"
+#include "apt_frame.h"
 #include "apt_parse.h"
 #include "pins.h"
 #include "portmacro.h"
@@ -32,22 +33,16 @@ typedef struct ftdi_tx_buffer {
     struct ftdi_tx_buffer* next;
 } ftdi_tx_buffer_t;
 
-typedef struct {
-    uint8_t buffer[FTDI_RX_BUFFER_SIZE];
-    uint8_t* tail;
-    SemaphoreHandle_t bytes_in_buffer;
-} ftdi_isr_buffer_t;
-
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 /*FTDI Task Handle*/
 static TaskHandle_t xFTDIHandle;
 
-static ftdi_isr_buffer_t isr_buffers[2];
-static ftdi_isr_buffer_t* atomic_buffer_ptr      = isr_buffers;
-static ftdi_isr_buffer_t* application_buffer_ptr = isr_buffers + 1;
-static uint8_t* application_buffer_head          = isr_buffers[1].buffer;
+// Filled by the UART1 ISR and parsed in place by the task.
+static uint8_t rx_ring_buffer[FTDI_RX_RING_SIZE];
+static apt_ring_t rx_ring;
+static SemaphoreHandle_t rx_ready;
 
 static ftdi_tx_buffer_t ftdi_tx_buffers[FTDI_TX_BUFFER_COUNT];
 static SemaphoreHandle_t available_tx_buffers;
@@ -60,8 +55,7 @@ static ftdi_tx_buffer_t* free_tx_buffers          = NULL;
 
 // Large buffers moved off task.
 static USB_Slave_Message local_slave_message;
-static uint8_t local_builder_buffer[FTDI_RX_BUFFER_SIZE];
-static USB_Slave_Message_Builder local_builder;
+static apt_frame_parser_t local_parser;
 
 /****************************************************************************
  * Public Data
@@ -73,7 +67,7 @@ SemaphoreHandle_t xFTDI_Slave_TxSemaphore =
 
 typedef struct {
     bool got_error;
-} builder_context;
+} frame_context;
 
 /****************************************************************************
  * Function Prototypes
@@ -81,28 +75,12 @@ typedef struct {
 
 static void configure_usart(void);
 
-static void ftdi_isr_buffer_init(ftdi_isr_buffer_t* obj,
-                                 SemaphoreHandle_t semaphore);
-static bool ftdi_isr_buffer_enqueue(ftdi_isr_buffer_t* buffer, uint8_t value,
-                                    BaseType_t* pxHigherPriorityTaskAwoken);
-
-/// \brief Reads up to the specified number of bytes from the application
-/// buffer.
-/// \returns The number of bytes written to dest.  Guaranteed to be in the range
-/// [0, bytes_to_read].
-static size_t read_from_application_buffer(void* _dest, size_t bytes_to_read);
-
-/// \brief Returns the number of bytes read into dest within the timeout.
-static size_t read_inbound_bytes(void* dest, size_t bytes_to_read,
-                                 TickType_t timeout);
-
-static void atomic_swap_buffers(void);
 static void consume_tx_buffer_from_isr(BaseType_t* pxHigherPriorityTaskAwoken);
 static size_t enqueue_tx_message(const void* _src, size_t length,
                                  TickType_t timeout);
 
-static size_t builder_context_read(void * ctx, void * dest, size_t bytes_to_read, TickType_t timeout);
-static void builder_context_on_error(void * ctx, USB_Slave_Message_Builder_State state, void * param);
+static bool frame_context_fill(void * ctx, TickType_t timeout);
+static void frame_context_on_error(void * ctx, apt_frame_status_t state, void * param);
 
 /****************************************************************************
  * Interrupt Handler
@@ -119,9 +97,10 @@ ISR(UART1_Handler) {
     if (uart_read(UART1, &incoming_byte) == 0) {
         // debug_print("FTDI RX: %d", incoming_byte);
 
-        // Push data into the buffer
-        if (!ftdi_isr_buffer_enqueue(atomic_buffer_ptr, incoming_byte,
-                                     &higherPriorityTaskAwoken)) {
+        // Push data into the ring
+        if (apt_ring_push(&rx_ring, incoming_byte)) {
+            xSemaphoreGiveFromISR(rx_ready, &higherPriorityTaskAwoken);
+        } else {
             usb_ftdi_print("ERROR: The FTDI USB Slave buffer full. ISR/r/n");
         }
     }
@@ -160,9 +139,8 @@ static void configure_usart(void) {
  * Task
  ****************************************************************************/
 /**
- * @brief This is the FTDI task.  It uses two ping pong buffers swapped at the
- * task service start between the task and uart interrupt.  The task then adds
- * the new data to a third buffer which is used to parse the data.
+ * @brief This is the FTDI task.  The uart interrupt fills a ring which the
+ * task parses commands from in place.
  *
  * @param pvParameters	: Not used.
  */
@@ -174,26 +152,23 @@ static void task_ftdi(void* pvParameters) {
     local_slave_message.write                  = ftdi_write;
     local_slave_message.xUSB_Slave_TxSemaphore = xFTDI_Slave_TxSemaphore;
 
-    usb_slave_message_builder_init(&local_builder, local_builder_buffer,
-                                   FTDI_RX_BUFFER_SIZE, 5);
+    apt_frame_parser_init(&local_parser, &rx_ring, APT_FRAME_PORT_FTDI, 5);
 
     configure_usart();
 
-    builder_context context;
+    frame_context context;
+    apt_frame_t frame;
 
     for (;;) {
         context.got_error = false;
-        const bool GOT_MESSAGE = usb_slave_message_builder_reading_service(
-            &local_builder, &local_slave_message, APT_PARSER_TIMEOUT_PERIOD,
-            &context, builder_context_read, builder_context_on_error);
+        const bool GOT_MESSAGE = apt_frame_reading_service(
+            &local_parser, &frame, APT_PARSER_TIMEOUT_PERIOD, &context,
+            frame_context_fill, frame_context_on_error);
         if (GOT_MESSAGE) {
-            apt_parse(&local_slave_message);
-        } else {
-            atomic_swap_buffers();
-
-            if (!context.got_error) {
-                usb_ftdi_print("timeout reached: %d bytes dropped", local_builder.buffer_length);
-            }
+            apt_parse_frame(&frame, &local_slave_message);
+            apt_frame_release(&local_parser, &frame);
+        } else if (!context.got_error) {
+            usb_ftdi_print("timeout reached: partial command dropped");
         }
     }
 }
@@ -231,15 +206,10 @@ void ftdi_init(void) {
         }
     }
 
-    // Create the RX queues.
-    SemaphoreHandle_t bytes_in_buffer_semaphores[2] = {0};
-    for (int i = 0; i < 2; ++i) {
-        bytes_in_buffer_semaphores[i] =
-            xSemaphoreCreateCounting(FTDI_RX_BUFFER_SIZE, 0);
-        ftdi_isr_buffer_init(isr_buffers + i, bytes_in_buffer_semaphores[i]);
-    }
-    configASSERT(bytes_in_buffer_semaphores[0] != NULL &&
-                 bytes_in_buffer_semaphores[1] != NULL);
+    // Create the RX ring.
+    apt_ring_init(&rx_ring, rx_ring_buffer, FTDI_RX_RING_SIZE);
+    rx_ready = xSemaphoreCreateBinary();
+    configASSERT(rx_ready != NULL);
 
     // Create the FTDI message queue.
     available_tx_buffers =
@@ -261,82 +231,6 @@ void ftdi_init(void) {
     }
 }
 
-static void ftdi_isr_buffer_init(ftdi_isr_buffer_t* obj,
-                                 SemaphoreHandle_t semaphore) {
-    obj->tail            = obj->buffer;
-    obj->bytes_in_buffer = semaphore;
-}
-
-static bool ftdi_isr_buffer_enqueue(ftdi_isr_buffer_t* buffer, uint8_t value,
-                                    BaseType_t* pxHigherPriorityTaskAwoken) {
-    if (buffer->tail - buffer->buffer == FTDI_RX_BUFFER_SIZE) {
-        return false;
-    }
-    *(buffer->tail++) = value;
-    xSemaphoreGiveFromISR(buffer->bytes_in_buffer, pxHigherPriorityTaskAwoken);
-    return true;
-}
-
-static size_t read_from_application_buffer(void* _dest, size_t bytes_to_read) {
-    uint8_t* dest = (uint8_t*)_dest;
-    const size_t bytes_in_application_space =
-        application_buffer_ptr->tail - application_buffer_head;
-    const size_t BYTES_READ = Min(bytes_to_read, bytes_in_application_space);
-    memcpy(dest, application_buffer_head, BYTES_READ);
-    application_buffer_head += BYTES_READ;
-
-    return BYTES_READ;
-}
-
-static size_t read_inbound_bytes(void* _dest, size_t bytes_to_read,
-                                 TickType_t timeout) {
-    uint8_t* dest = (uint8_t*)_dest;
-
-    // Read out data from the current application buffer.
-    size_t rt = read_from_application_buffer(dest, bytes_to_read);
-    bytes_to_read -= rt;
-    dest += rt;
-
-    // If more data needs to be read, wait for it or the timeout.
-    for (size_t cntr = 0; cntr < bytes_to_read; ++cntr) {
-        const TickType_t START = xTaskGetTickCount();
-        if (xSemaphoreTake(atomic_buffer_ptr->bytes_in_buffer, timeout) !=
-            pdTRUE) {
-            break;
-        }
-        const TickType_t DELTA = xTaskGetTickCount() - START;
-
-        timeout = DELTA >= timeout ? 0 : (timeout - DELTA);
-    }
-
-    // Only do the swap if the loop was executed.
-    if (bytes_to_read > 0) {
-        // Move any bytes available into the application.
-        atomic_swap_buffers();
-    }
-
-    // If more data needs to be read, read out what is available in the
-    // application buffer.
-    rt += read_from_application_buffer(dest, bytes_to_read);
-    return rt;
-}
-
-static void atomic_swap_buffers(void) {
-    // Reset the application buffer.
-    // We wait on the semaphore to ensure that it is cleared.
-    application_buffer_ptr->tail = application_buffer_ptr->buffer;
-    while (xSemaphoreTake(application_buffer_ptr->bytes_in_buffer, 0) ==
-           pdTRUE);
-
-    irqflags_t flags = cpu_irq_save();
-    ptrdiff_t delta  = atomic_buffer_ptr == isr_buffers ? 1 : -1;
-    atomic_buffer_ptr += delta;
-    cpu_irq_restore(flags);
-    application_buffer_ptr += -delta;
-
-    application_buffer_head = application_buffer_ptr->buffer;
-}
-
 static void consume_tx_buffer_from_isr(BaseType_t* pxHigherPriorityTaskAwoken) {
 reloaded_tx_buffer:
     // If the head buffer is does not exist, stop the ISR.
@@ -403,22 +297,22 @@ static size_t enqueue_tx_message(const void* src, size_t length,
     return LENGTH;
 }
 
-static size_t builder_context_read(void * ctx, void * dest, size_t bytes_to_read, TickType_t timeout) {
+static bool frame_context_fill(void * ctx, TickType_t timeout) {
     (void)ctx;
-    return read_inbound_bytes(dest, bytes_to_read, timeout);
+    return xSemaphoreTake(rx_ready, timeout) == pdTRUE;
 }
 
-static void builder_context_on_error(void * ctx, USB_Slave_Message_Builder_State state, void * param) {
-    builder_context * const context = (builder_context*)ctx;
+static void frame_context_on_error(void * ctx, apt_frame_status_t state, void * param) {
+    frame_context * const context = (frame_context*)ctx;
 
     switch (state)
     {
-    case USBSMBS_COMMAND_OVERFLOWED:
+    case APT_FRAME_OVERFLOWED:
         context->got_error = true;
         usb_ftdi_print("USB Slave large command rejection:  extended length %d", *(size_t*)param);
         break;
 
-    case USBSMBS_REALIGN_UNAVAILABLE:
+    case APT_FRAME_REALIGN_UNAVAILABLE:
         context->got_error = true;
         break;
 
@@ -9,9 +9,8 @@
 /****************************************************************************
  * Defines
  ****************************************************************************/
-// #define FTDI_RX_BUFFER_SIZE USB_SLAVE_BUFFER_SIZE
-// TODO (sbenish):  Optimize this size down later.
-#define FTDI_RX_BUFFER_SIZE   300
+// Receive ring.  A power of two that holds the largest command.
+#define FTDI_RX_RING_SIZE     512
 #define FTDI_TX_BUFFER_SIZE   32
 #define FTDI_TX_BUFFER_COUNT  6
 
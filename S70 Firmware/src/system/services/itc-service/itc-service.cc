@@ -56,7 +56,7 @@ service::itc::pipeline_cdc_t& service::itc::pipeline_cdc() {
 void service::itc::init() {
     opt_hid_in.emplace(NUMBER_OF_BOARD_SLOTS);
     opt_hid_out.emplace(USB_NUMDEVICES);
-    opt_cdc.emplace(3); // 2 for each source, 1 extra for safety
+    opt_cdc.emplace(CDC_QUEUE_SIZE); // 2 for each source, 1 extra for safety
 }
 
 extern "C" void itc_service_init(void) { service::itc::init(); }
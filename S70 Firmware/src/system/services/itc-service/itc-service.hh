@@ -11,6 +11,7 @@
 #include "hid-in-message.hh"
 #include "hid-out-message.hh"
 #include "inline-unordered-vector.hh"
+#include "pipeline-pool.hh"
 #include "portmacro.h"
 #include "projdefs.h"
 #include "queue_map.hh"
@@ -171,6 +172,105 @@ class pipeline {
     std::size_t _default_queue_size;
 };
 
+/**
+ * A pipeline that queues pointers to pooled, reference-counted messages
+ * instead of copies.
+ * Senders acquire a message, fill it in place, and send it to any number of
+ * queues; each queue holds a reference until the receiver pops it.
+ */
+template <typename Key, typename T, std::size_t Extent, std::size_t PoolSize>
+class pooled_pipeline {
+   public:
+    using value_type   = T;
+    using message      = pooled_message<T>;
+    using unique_queue = pooled_queue_handle<T>;
+
+    pooled_pipeline(std::size_t default_queue_size)
+        : _lock(), _map(_lock), _default_queue_size(default_queue_size) {}
+
+    // Pinned object
+    pooled_pipeline(const pooled_pipeline<Key, T, Extent, PoolSize>&) = delete;
+    pooled_pipeline(pooled_pipeline<Key, T, Extent, PoolSize>&&)      = delete;
+
+    bool register_queue(const Key& key, QueueHandle_t queue) {
+        return _map.register_queue(key, queue);
+    }
+    void unregister_queue(const Key& key) { _map.unregister_queue(key); }
+
+    void unregister_queue(QueueHandle_t queue) { _map.unregister_queue(queue); }
+
+    std::optional<unique_queue> create_queue(const Key& key) {
+        return create_queue(key, _default_queue_size);
+    }
+
+    std::optional<unique_queue> create_queue(const Key& key,
+                                             std::size_t queue_size) {
+        QueueHandle_t handle = xQueueCreate(queue_size, sizeof(slot_t*));
+        if (handle == nullptr) {
+            return {};
+        }
+
+        register_queue(key, handle);
+        return unique_queue(handle, *this);
+    }
+
+    /**
+     * Takes a message buffer from the pipeline's pool.
+     * \return An empty message if the pool is exhausted.
+     */
+    message acquire() { return _pool.acquire(); }
+
+    pool_statistics statistics() const { return _pool.statistics(); }
+
+    /**
+     * Sends the message to the queue with the matching key.
+     * \return The number of queues the message was sent to.
+     */
+    std::size_t send(const message& value, const Key& key) const {
+        return send_if(value,
+                       [&key](const Key& compare) { return key == compare; });
+    }
+
+    /**
+     * Sends the message to any queue with a key satisfying the predicate.
+     * \return The number of queues the message was sent to.
+     */
+    std::size_t send_if(const message& value,
+                        std::predicate<const Key&> auto&& predicate) const {
+        if (!value) {
+            return 0;
+        }
+
+        return _map.visit_if(predicate, [&value](QueueHandle_t queue) {
+            slot_t* slot = value.share();
+            if (xQueueSend(queue, &slot, 0) == pdTRUE) {
+                return true;
+            }
+            message dropped(slot);
+            return false;
+        });
+    }
+
+    /**
+     * Sends the message to all queues.
+     * \return The number of queues the message was sent to.
+     */
+    std::size_t broadcast(const message& value) const {
+        return send_if(value, [](const Key&) { return true; });
+    }
+
+   private:
+    using slot_t = detail::pool_slot<T>;
+
+    template <typename U>
+    using map_container = inline_unordered_vector<U, Extent>;
+
+    sync::rw_lock _lock;
+    sync::queue_map<slot_t*, Key, map_container> _map;
+    std::size_t _default_queue_size;
+    pipeline_pool<T, PoolSize> _pool;
+};
+
 template <typename Key, typename T, std::size_t Extent>
 class sender_filtered : public pipeline<Key, T, Extent> {
     using base_t = pipeline<Key, T, Extent>;
@@ -222,9 +322,17 @@ using pipeline_hid_in_t =
 using pipeline_hid_out_t =
     receiver_filtered<uint8_t, service::itc::message::hid_out_message,
                       USB_NUMDEVICES>;
+
+/// \brief The number of CDC queue entries per slot card.
+constexpr std::size_t CDC_QUEUE_SIZE = 3;
+
+/// \brief Enough CDC messages to fill every slot's queue while both host
+///        ports are filling one more.
+constexpr std::size_t CDC_POOL_SIZE = NUMBER_OF_BOARD_SLOTS * CDC_QUEUE_SIZE + 2;
+
 using pipeline_cdc_t =
-    sender_filtered<asf_destination_ids, service::itc::message::cdc_message,
-                    NUMBER_OF_BOARD_SLOTS>;
+    pooled_pipeline<asf_destination_ids, service::itc::message::cdc_message,
+                    NUMBER_OF_BOARD_SLOTS, CDC_POOL_SIZE>;
 
 /**
  * Pipeline responsible for HID IN messages sent to slot cards from USB
@@ -243,6 +351,7 @@ pipeline_hid_out_t& pipeline_hid_out();
  * Pipeline responsible for CDC messages (AKA APA commands) sent from
  * the FTDI or PC port to the slot cards.
  * Filtering is done on the sender's side.
+ * Messages are pooled, so only pointers pass through the queues.
  */
 pipeline_cdc_t& pipeline_cdc();
 
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+/**
+ * Fixed pools of reference-counted message buffers.
+ * A sender acquires a buffer, fills it in place, and the pipeline queues only
+ * a pointer to it for each receiver.
+ * The buffer returns to its pool when the last handle to it is dropped.
+ */
+namespace service::itc {
+
+struct pool_statistics {
+    uint16_t capacity;
+    uint16_t in_use;
+    uint16_t high_water_mark;
+
+    /// The number of acquires that found every buffer in use.
+    uint32_t exhausted;
+};
+
+namespace detail {
+
+struct pool_counters {
+    std::atomic<uint16_t> in_use{0};
+    std::atomic<uint16_t> high_water_mark{0};
+    std::atomic<uint32_t> exhausted{0};
+};
+
+template <typename T>
+struct pool_slot {
+    std::atomic<uint8_t> references{0};
+    pool_counters* p_counters = nullptr;
+    T value;
+};
+
+}  // namespace detail
+
+template <typename T, std::size_t N>
+class pipeline_pool;
+
+template <typename T>
+class pooled_queue_handle;
+
+template <typename Key, typename T, std::size_t Extent, std::size_t PoolSize>
+class pooled_pipeline;
+
+/**
+ * Shared handle to a pooled message buffer.
+ * Copies share the buffer; receivers sharing a buffer must not write to it.
+ */
+template <typename T>
+class pooled_message {
+   public:
+    using value_type = T;
+
+    pooled_message() = default;
+
+    pooled_message(const pooled_message<T>& other) : _slot(other._slot) {
+        add_reference();
+    }
+    pooled_message(pooled_message<T>&& other) : _slot(other._slot) {
+        other._slot = nullptr;
+    }
+    pooled_message& operator=(const pooled_message<T>& other) {
+        if (this != &other) {
+            reset();
+            _slot = other._slot;
+            add_reference();
+        }
+        return *this;
+    }
+    pooled_message& operator=(pooled_message<T>&& other) {
+        if (this != &other) {
+            reset();
+            _slot       = other._slot;
+            other._slot = nullptr;
+        }
+        return *this;
+    }
+
+    ~pooled_message() { reset(); }
+
+    explicit operator bool() const { return _slot != nullptr; }
+
+    T* get() const { return _slot ? &_slot->value : nullptr; }
+    T& operator*() const { return _slot->value; }
+    T* operator->() const { return &_slot->value; }
+
+    /// \brief Drops this handle's reference to the buffer.
+    void reset() {
+        if (_slot != nullptr &&
+            _slot->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _slot->p_counters->in_use.fetch_sub(1, std::memory_order_relaxed);
+        }
+        _slot = nullptr;
+    }
+
+   private:
+    template <typename, std::size_t>
+    friend class pipeline_pool;
+    friend class pooled_queue_handle<T>;
+    template <typename, typename, std::size_t, std::size_t>
+    friend class pooled_pipeline;
+
+    using slot_t = detail::pool_slot<T>;
+
+    /// \brief Takes over a reference that is already counted.
+    explicit pooled_message(slot_t* slot) : _slot(slot) {}
+
+    /// \return A new counted reference for a queue to carry.
+    slot_t* share() const {
+        add_reference();
+        return _slot;
+    }
+
+    void add_reference() const {
+        if (_slot != nullptr) {
+            _slot->references.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    slot_t* _slot = nullptr;
+};
+
+template <typename T, std::size_t N>
+class pipeline_pool {
+    static_assert(N <= UINT16_MAX);
+
+   public:
+    pipeline_pool() {
+        for (slot_t& slot : _slots) {
+            slot.p_counters = &_counters;
+        }
+    }
+
+    // Pinned object
+    pipeline_pool(const pipeline_pool<T, N>&) = delete;
+    pipeline_pool(pipeline_pool<T, N>&&)      = delete;
+
+    /**
+     * Takes a free buffer from the pool.
+     * \return An empty handle if every buffer is in use.
+     */
+    pooled_message<T> acquire() {
+        for (slot_t& slot : _slots) {
+            uint8_t expected = 0;
+            if (slot.references.compare_exchange_strong(
+                    expected, 1, std::memory_order_acquire,
+                    std::memory_order_relaxed)) {
+                const uint16_t IN_USE =
+                    _counters.in_use.fetch_add(1, std::memory_order_relaxed) +
+                    1;
+                uint16_t mark =
+                    _counters.high_water_mark.load(std::memory_order_relaxed);
+                while (mark < IN_USE &&
+                       !_counters.high_water_mark.compare_exchange_weak(
+                           mark, IN_USE, std::memory_order_relaxed)) {
+                }
+                return pooled_message<T>(&slot);
+            }
+        }
+
+        _counters.exhausted.fetch_add(1, std::memory_order_relaxed);
+        return {};
+    }
+
+    pool_statistics statistics() const {
+        return pool_statistics{
+            .capacity = static_cast<uint16_t>(N),
+            .in_use   = _counters.in_use.load(std::memory_order_relaxed),
+            .high_water_mark =
+                _counters.high_water_mark.load(std::memory_order_relaxed),
+            .exhausted = _counters.exhausted.load(std::memory_order_relaxed),
+        };
+    }
+
+   private:
+    using slot_t = detail::pool_slot<T>;
+
+    detail::pool_counters _counters;
+    std::array<slot_t, N> _slots;
+};
+
+/**
+ * RAII handle to a unique queue of pooled messages.
+ * Messages still queued when the handle is disposed are released.
+ */
+template <typename T>
+class pooled_queue_handle {
+   public:
+    using value_type = pooled_message<T>;
+
+    template <typename E>
+        requires requires(E& e, QueueHandle_t q) { e.unregister_queue(q); }
+    pooled_queue_handle(QueueHandle_t queue, E& container)
+        : _dispose_parent([](void* parent, QueueHandle_t queue) {
+            reinterpret_cast<E*>(parent)->unregister_queue(queue);
+        })
+        , _parent(&container)
+        , _queue(queue) {}
+
+    pooled_queue_handle(pooled_queue_handle<T>&& other)
+        : _dispose_parent(other._dispose_parent)
+        , _parent(other._parent)
+        , _queue(other._queue) {
+        other._queue = nullptr;
+    }
+    pooled_queue_handle& operator=(pooled_queue_handle<T>&& other) {
+        try_dispose();
+        _dispose_parent = other._dispose_parent;
+        _queue          = other._queue;
+        _parent         = other._parent;
+        other._queue    = nullptr;
+        return *this;
+    }
+
+    ~pooled_queue_handle() { try_dispose(); }
+
+    QueueHandle_t handle() { return _queue; }
+
+    void pop(value_type& out) {
+        const bool GOOD = try_pop(out, portMAX_DELAY);
+        configASSERT(GOOD);
+    }
+
+    bool try_pop(value_type& out, TickType_t timeout = 0) {
+        slot_t* slot;
+        if (xQueueReceive(_queue, &slot, timeout) != pdTRUE) {
+            return false;
+        }
+        out = value_type(slot);
+        return true;
+    }
+
+   private:
+    using slot_t = detail::pool_slot<T>;
+
+    void try_dispose() {
+        if (_queue) {
+            _dispose_parent(_parent, _queue);
+
+            // No sender can reach the queue now, so this empties it for good.
+            slot_t* slot;
+            while (xQueueReceive(_queue, &slot, 0) == pdTRUE) {
+                value_type dropped(slot);
+            }
+            _queue = nullptr;
+        }
+    }
+
+    void (*_dispose_parent)(void*, QueueHandle_t);
+    void* _parent;
+    QueueHandle_t _queue;
+};
+
+}  // namespace service::itc
@@ -0,0 +1,312 @@
+#include "./profiler.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "Debugging.h"
+#include "FreeRTOSConfig.h"
+#include "asf.h"
+#include "semphr.h"
+#include "service-inits.h"
+#include "sys_task.h"
+
+using namespace service::profiler;
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+struct task_record {
+    UBaseType_t number;
+    uint32_t last_run_time;
+    task_load load;
+};
+
+struct loop_record {
+    TaskHandle_t task;
+    uint32_t period_cycles;
+
+    /// Cycle counter at the start of the current pass.
+    uint32_t begin;
+
+    /// If begin holds the start of a previous pass.
+    bool started;
+
+    loop_statistics stats;
+};
+
+/*****************************************************************************
+ * Private Function Prototypes
+ *****************************************************************************/
+static void task_profiler(void*);
+
+static void sample_tasks();
+static const task_record* find_task(UBaseType_t number);
+static std::size_t jitter_bin(uint32_t jitter_us);
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+/// Filled by uxTaskGetSystemState() each window.
+static std::array<TaskStatus_t, MAX_TASKS> s_status;
+
+/// The loads of the last window, guarded by s_task_lock.
+static std::array<task_record, MAX_TASKS> s_tasks;
+static std::size_t s_task_count = 0;
+static SemaphoreHandle_t s_task_lock = nullptr;
+
+/// The next window's table, only touched by the profiler task.
+static std::array<task_record, MAX_TASKS> s_scratch;
+static uint32_t s_last_total_run_time = 0;
+
+static std::array<loop_record, MAX_LOOPS> s_loops;
+static std::atomic<std::size_t> s_loop_count = 0;
+static SemaphoreHandle_t s_register_lock = nullptr;
+
+static TaskHandle_t s_task = nullptr;
+static uint32_t s_cycles_per_us = 1;
+
+/******************************************************************************
+ * Interrupt Handlers
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void loop::begin() {
+    loop_record& rec   = s_loops[_index];
+    const uint32_t NOW = DWT->CYCCNT;
+
+    if (rec.started) {
+        const uint32_t PERIOD = NOW - rec.begin;
+        const uint32_t JITTER_US =
+            ((PERIOD > rec.period_cycles) ? PERIOD - rec.period_cycles
+                                          : rec.period_cycles - PERIOD) /
+            s_cycles_per_us;
+
+        ++rec.stats.samples;
+        ++rec.stats.jitter[jitter_bin(JITTER_US)];
+        rec.stats.max_jitter_us = std::max(rec.stats.max_jitter_us, JITTER_US);
+    }
+
+    rec.begin   = NOW;
+    rec.started = true;
+}
+
+void loop::end() {
+    loop_record& rec       = s_loops[_index];
+    const uint32_t BUSY_US = (DWT->CYCCNT - rec.begin) / s_cycles_per_us;
+
+    rec.stats.total_busy_us += BUSY_US;
+    rec.stats.max_busy_us = std::max(rec.stats.max_busy_us, BUSY_US);
+    if (BUSY_US > rec.stats.period_us) {
+        ++rec.stats.overruns;
+    }
+}
+
+loop service::profiler::register_loop(TickType_t period) {
+    const TaskHandle_t TASK = xTaskGetCurrentTaskHandle();
+    const uint32_t PERIOD_CYCLES =
+        period * (sysclk_get_cpu_hz() / configTICK_RATE_HZ);
+
+    xSemaphoreTake(s_register_lock, portMAX_DELAY);
+    std::size_t index = 0;
+    while (index < s_loop_count && s_loops[index].task != TASK) {
+        ++index;
+    }
+
+    if (index == s_loop_count) {
+        configASSERT(s_loop_count < MAX_LOOPS);
+        loop_record& rec = s_loops[index];
+        rec.task         = TASK;
+        rec.stats        = {};
+        strncpy(rec.stats.name, pcTaskGetName(TASK), NAME_LENGTH);
+        ++s_loop_count;
+    }
+
+    loop_record& rec = s_loops[index];
+    taskENTER_CRITICAL();
+    rec.period_cycles   = PERIOD_CYCLES;
+    rec.stats.period_us = PERIOD_CYCLES / s_cycles_per_us;
+    rec.started         = false;
+    taskEXIT_CRITICAL();
+    xSemaphoreGive(s_register_lock);
+
+    return loop(index);
+}
+
+std::size_t service::profiler::task_count() {
+    xSemaphoreTake(s_task_lock, portMAX_DELAY);
+    const std::size_t RT = s_task_count;
+    xSemaphoreGive(s_task_lock);
+    return RT;
+}
+
+bool service::profiler::get_task_load(std::size_t index, task_load& out) {
+    xSemaphoreTake(s_task_lock, portMAX_DELAY);
+    const bool RT = index < s_task_count;
+    if (RT) {
+        out = s_tasks[index].load;
+    }
+    xSemaphoreGive(s_task_lock);
+    return RT;
+}
+
+std::size_t service::profiler::loop_count() { return s_loop_count; }
+
+bool service::profiler::get_loop_statistics(std::size_t index,
+                                            loop_statistics& out) {
+    if (index >= s_loop_count) {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    out = s_loops[index].stats;
+    taskEXIT_CRITICAL();
+
+    return true;
+}
+
+void service::profiler::reset_statistics() {
+    xSemaphoreTake(s_task_lock, portMAX_DELAY);
+    for (std::size_t i = 0; i < s_task_count; ++i) {
+        s_tasks[i].load.peak_load_permille = s_tasks[i].load.load_permille;
+    }
+    xSemaphoreGive(s_task_lock);
+
+    for (std::size_t i = 0; i < s_loop_count; ++i) {
+        loop_statistics& stats = s_loops[i].stats;
+
+        taskENTER_CRITICAL();
+        stats.samples       = 0;
+        stats.overruns      = 0;
+        stats.max_jitter_us = 0;
+        stats.max_busy_us   = 0;
+        stats.total_busy_us = 0;
+        stats.jitter        = {};
+        taskEXIT_CRITICAL();
+    }
+}
+
+void service::profiler::init() {
+    if (s_task != nullptr) {
+        return;
+    }
+
+    s_task_lock     = xSemaphoreCreateMutex();
+    s_register_lock = xSemaphoreCreateMutex();
+    configASSERT(s_task_lock && s_register_lock);
+
+    s_cycles_per_us = sysclk_get_cpu_hz() / 1000000;
+
+    if (xTaskCreate(task_profiler, "Profiler", TASK_PROFILER_STACK_SIZE,
+                    nullptr, TASK_PROFILER_STACK_PRIORITY,
+                    &s_task) != pdPASS) {
+        debug_print("ERROR: Failed to create the profiler task.\n");
+        s_task = nullptr;
+    }
+}
+
+extern "C" void profiler_service_init(void) { service::profiler::init(); }
+
+/**
+ * Called by the kernel before the scheduler starts.
+ * The run time counters count CPU cycles, so context switches only read the
+ * cycle counter.
+ */
+extern "C" void profiler_configure_cycle_counter(void) {
+    CoreDebug->DEMCR = CoreDebug->DEMCR | CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        = DWT->CTRL | DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+static void task_profiler(void*) {
+    TickType_t last_wake = xTaskGetTickCount();
+
+    for (;;) {
+        vTaskDelayUntil(&last_wake, PROFILER_WINDOW);
+        sample_tasks();
+    }
+}
+
+/**
+ * Computes each task's share of the cycles since the last window.
+ * The cycle counter wraps every few seconds, so only differences are used
+ * and the window must stay shorter than that.
+ */
+static void sample_tasks() {
+    uint32_t total_run_time;
+    const std::size_t COUNT =
+        uxTaskGetSystemState(s_status.data(), MAX_TASKS, &total_run_time);
+
+    // Too many tasks to fit; nothing is reported rather than a partial table.
+    if (COUNT == 0) {
+        return;
+    }
+
+    const uint32_t WINDOW = total_run_time - s_last_total_run_time;
+    s_last_total_run_time = total_run_time;
+    if (WINDOW == 0) {
+        return;
+    }
+
+    for (std::size_t i = 0; i < COUNT; ++i) {
+        const TaskStatus_t& STATUS = s_status[i];
+        const task_record* const p_last = find_task(STATUS.xTaskNumber);
+        task_record& rec                = s_scratch[i];
+
+        // A task created during the window ran for all of its counter.
+        const uint32_t RAN =
+            STATUS.ulRunTimeCounter -
+            ((p_last != nullptr) ? p_last->last_run_time : 0);
+        const uint16_t LOAD = static_cast<uint16_t>(
+            std::min<uint64_t>(1000, static_cast<uint64_t>(RAN) * 1000 / WINDOW));
+
+        rec.number        = STATUS.xTaskNumber;
+        rec.last_run_time = STATUS.ulRunTimeCounter;
+        strncpy(rec.load.name, STATUS.pcTaskName, NAME_LENGTH);
+        rec.load.priority         = static_cast<uint8_t>(STATUS.uxCurrentPriority);
+        rec.load.load_permille    = LOAD;
+        rec.load.peak_load_permille =
+            std::max(LOAD, (p_last != nullptr) ? p_last->load.peak_load_permille
+                                               : uint16_t{0});
+        rec.load.stack_free_words = STATUS.usStackHighWaterMark;
+    }
+
+    xSemaphoreTake(s_task_lock, portMAX_DELAY);
+    std::copy_n(s_scratch.begin(), COUNT, s_tasks.begin());
+    s_task_count = COUNT;
+    xSemaphoreGive(s_task_lock);
+}
+
+/// \brief The last window's record of the task.  Only called by the profiler
+///        task, which is the only writer of s_tasks.
+static const task_record* find_task(UBaseType_t number) {
+    for (std::size_t i = 0; i < s_task_count; ++i) {
+        if (s_tasks[i].number == number) {
+            return &s_tasks[i];
+        }
+    }
+    return nullptr;
+}
+
+static std::size_t jitter_bin(uint32_t jitter_us) {
+    std::size_t bin = 0;
+    while (bin < JITTER_BIN_LIMITS_US.size() &&
+           jitter_us >= JITTER_BIN_LIMITS_US[bin]) {
+        ++bin;
+    }
+    return bin;
+}
+
+// EOF
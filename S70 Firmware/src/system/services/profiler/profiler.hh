@@ -0,0 +1,133 @@
+/**
+ * \file profiler.hh
+ * \brief Runtime profiler service.
+ *
+ * Always-on measurements of where the CPU time goes, cheap enough to leave
+ * running in the field:
+ *  - The CPU load of every task, from the FreeRTOS run time counters (counted
+ *    in CPU cycles) sampled once per window.
+ *  - For periodic service loops, a histogram of how far each service period
+ *    strays from the nominal period, and how long the loop was busy.
+ *
+ * The SPI bus wait times are kept per client by the SPI scheduler service.
+ * All of it is readable over APT (see apt-local.h).
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+namespace service::profiler {
+
+/// \brief The most tasks that can be profiled.
+///        Every task must fit or no loads are computed.
+static constexpr std::size_t MAX_TASKS = 40;
+
+/// \brief The most service loops that can be registered.
+static constexpr std::size_t MAX_LOOPS = 16;
+
+static constexpr std::size_t NAME_LENGTH = configMAX_TASK_NAME_LEN;
+
+/// \brief Upper bounds (exclusive, in microseconds) of the jitter histogram
+///        bins.  The last bin counts everything beyond.
+static constexpr std::array<uint32_t, 7> JITTER_BIN_LIMITS_US = {
+    50, 100, 250, 500, 1000, 2500, 5000};
+static constexpr std::size_t JITTER_BINS = JITTER_BIN_LIMITS_US.size() + 1;
+
+/**
+ * The load of a task.
+ * Loads are in thousandths of the CPU.
+ */
+struct task_load {
+    char name[NAME_LENGTH];
+    uint8_t priority;
+
+    /// Over the last window.
+    uint16_t load_permille;
+
+    /// Highest window load since the last reset.
+    uint16_t peak_load_permille;
+
+    uint16_t stack_free_words;
+};
+
+/**
+ * Counters kept per service loop.
+ * Times are in microseconds.
+ */
+struct loop_statistics {
+    char name[NAME_LENGTH];
+    uint32_t period_us;
+
+    /// Service periods measured.
+    uint32_t samples;
+
+    /// Passes that were busy for longer than the period.
+    uint32_t overruns;
+
+    uint32_t max_jitter_us;
+    uint32_t max_busy_us;
+    uint64_t total_busy_us;
+
+    /// Counts of |measured period - nominal period|.
+    std::array<uint32_t, JITTER_BINS> jitter;
+};
+
+/**
+ * A handle to a service loop registration.
+ * Only the task that registered the loop may use it.
+ */
+class loop {
+   public:
+    /// \brief Marks the start of a service pass, right after the loop wakes.
+    void begin();
+
+    /// \brief Marks the end of the pass, right before the loop sleeps.
+    void end();
+
+    /// \brief The index of the registration (for enumerating statistics).
+    inline std::size_t index() const { return _index; }
+
+   private:
+    explicit loop(std::size_t index) : _index(index) {}
+
+    friend loop register_loop(TickType_t period);
+
+    std::size_t _index;
+};
+
+/**
+ * Registers the calling task's service loop, named after the task.
+ * Registering again (e.g. each time a device attaches) returns the first
+ * registration with the new period, and the time the loop was stopped is not
+ * counted as jitter.
+ * \param[in]       period The nominal service period.
+ */
+loop register_loop(TickType_t period);
+
+/// \brief The number of tasks in the last window.
+std::size_t task_count();
+
+/// \brief Copies the load of the task at the index.
+/// \return If the index was valid.
+bool get_task_load(std::size_t index, task_load& out);
+
+/// \brief The number of registered loops.
+std::size_t loop_count();
+
+/// \brief Copies the statistics of the loop at the index.
+/// \return If the index was valid.
+bool get_loop_statistics(std::size_t index, loop_statistics& out);
+
+/// \brief Clears the peak loads and every loop's statistics.
+void reset_statistics();
+
+void init();
+
+}  // namespace service::profiler
+
+// EOF
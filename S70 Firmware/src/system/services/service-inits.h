@@ -7,6 +7,8 @@ extern "C" {
 
 void hid_mapping_service_init(void);
 void itc_service_init(void);
+void profiler_service_init(void);
+void spi_scheduler_service_init(void);
 
 #ifdef __cplusplus
 }
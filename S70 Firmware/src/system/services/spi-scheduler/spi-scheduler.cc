@@ -0,0 +1,551 @@
+#include "./spi-scheduler.hh"
+
+#include <array>
+#include <atomic>
+#include <cstring>
+
+#include "Debugging.h"
+#include "FreeRTOSConfig.h"
+#include "asf.h"
+#include "queue.h"
+#include "semphr.h"
+#include "service-inits.h"
+#include "sys_task.h"
+
+using namespace service::spi_scheduler;
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+static constexpr uint32_t US_PER_TICK = 1000000 / configTICK_RATE_HZ;
+
+/*****************************************************************************
+ * Macros
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+enum class request_state : uint8_t {
+    IDLE,
+    QUEUED,
+    RUNNING,
+    CANCELLED,
+};
+
+enum class request_kind : uint8_t {
+    TRANSACTION,
+    LEASE,
+};
+
+struct timestamp {
+    TickType_t ticks;
+    uint32_t cycles;
+};
+
+/// \brief What is put on the priority queues.
+/// The sequence number invalidates entries left behind by a cancelled lease.
+struct queue_entry {
+    uint8_t index;
+    uint8_t sequence;
+};
+
+struct client_record {
+    TaskHandle_t task;
+    const char* name;
+    priority prio;
+
+    /// Given by the bus owner when the request completes (or is granted).
+    SemaphoreHandle_t done;
+
+    volatile request_state state;
+    request_kind kind;
+    uint8_t sequence;
+    std::span<const segment> segments;
+    TickType_t deadline;
+    timestamp submitted;
+    bool result;
+
+    statistics stats;
+};
+
+/*****************************************************************************
+ * Private Function Prototypes
+ *****************************************************************************/
+static void task_spi_scheduler(void*);
+
+static bool is_running();
+static timestamp now();
+static uint32_t elapsed_us(const timestamp& from, const timestamp& to);
+static bool is_before(TickType_t lhs, TickType_t rhs);
+
+static void enqueue(std::size_t index, request_kind kind, TickType_t deadline);
+static client_record* pop_next();
+static bool execute(std::span<const segment> segments);
+static void record_start(client_record& rec, const timestamp& start);
+static void run_transaction(client_record& rec);
+static void run_lease(client_record& rec);
+
+static priority priority_from_task(TaskHandle_t task);
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+static std::array<client_record, MAX_CLIENTS> s_clients;
+static std::atomic<std::size_t> s_client_count = 0;
+static SemaphoreHandle_t s_register_lock = nullptr;
+
+static std::array<QueueHandle_t, PRIORITY_COUNT> s_queues = {};
+
+/// Counts the entries across all priority queues.
+static SemaphoreHandle_t s_pending = nullptr;
+
+/// Given when the lessee returns the bus.
+static SemaphoreHandle_t s_lease_returned = nullptr;
+static volatile TaskHandle_t s_lease_holder = nullptr;
+
+/// Nested acquisitions by the lease holder.  Only the holder touches it.
+static uint32_t s_lease_depth = 0;
+
+static TaskHandle_t s_owner = nullptr;
+static uint32_t s_cycles_per_us = 1;
+
+/******************************************************************************
+ * Interrupt Handlers
+ *****************************************************************************/
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+bool client::transfer(std::span<const segment> segments, TickType_t deadline) {
+    client_record& rec = s_clients[_index];
+
+    // The bus already belongs to the caller (or nothing else can run yet).
+    // A caller holding only the mutex would deadlock against the owner,
+    // which needs the mutex to run the transaction.
+    if (!is_running() || holds_lease() || holds_bus_mutex()) {
+        const timestamp START = now();
+        const bool RT         = execute(segments);
+        ++rec.stats.transactions;
+        rec.stats.total_occupancy_us += elapsed_us(START, now());
+        return RT;
+    }
+
+    rec.segments = segments;
+    enqueue(_index, request_kind::TRANSACTION, deadline);
+    xSemaphoreTake(rec.done, portMAX_DELAY);
+    return rec.result;
+}
+
+bool client::transfer(const segment& seg, TickType_t deadline) {
+    return transfer(std::span<const segment>(&seg, 1), deadline);
+}
+
+bool client::acquire_lease(TickType_t timeout) {
+    if (!is_running()) {
+        return true;
+    }
+    if (holds_lease()) {
+        ++s_lease_depth;
+        return true;
+    }
+    // The owner may be blocked on the mutex the caller holds, so a lease
+    // could never be granted.  The bus is the caller's already.
+    if (holds_bus_mutex()) {
+        return true;
+    }
+
+    client_record& rec = s_clients[_index];
+    enqueue(_index, request_kind::LEASE, 0);
+    if (xSemaphoreTake(rec.done, timeout) == pdTRUE) {
+        s_lease_depth = 1;
+        return true;
+    }
+
+    // Timed out:  cancel unless the owner granted the lease in the meantime.
+    taskENTER_CRITICAL();
+    const bool CANCELLED = rec.state == request_state::QUEUED;
+    if (CANCELLED) {
+        rec.state = request_state::CANCELLED;
+    }
+    taskEXIT_CRITICAL();
+
+    if (CANCELLED) {
+        return false;
+    }
+
+    xSemaphoreTake(rec.done, portMAX_DELAY);
+    s_lease_depth = 1;
+    return true;
+}
+
+void client::release_lease() { service::spi_scheduler::release_lease(); }
+
+bus_guard::bus_guard() : _owns_mutex(!holds_bus_mutex()) {
+    acquire_lease();
+    if (_owns_mutex) {
+        xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+    }
+}
+
+bus_guard::~bus_guard() {
+    if (_owns_mutex) {
+        xSemaphoreGive(xSPI_Semaphore);
+    }
+    release_lease();
+}
+
+priority client::get_priority() const { return s_clients[_index].prio; }
+
+const char* client::name() const { return s_clients[_index].name; }
+
+statistics client::get_statistics() const {
+    statistics rt;
+    service::spi_scheduler::get_statistics(_index, rt);
+    return rt;
+}
+
+client service::spi_scheduler::register_client(const char* name,
+                                               priority prio) {
+    const TaskHandle_t TASK = xTaskGetCurrentTaskHandle();
+
+    xSemaphoreTake(s_register_lock, portMAX_DELAY);
+    for (std::size_t i = 0; i < s_client_count; ++i) {
+        if (s_clients[i].task == TASK) {
+            xSemaphoreGive(s_register_lock);
+            return client(i);
+        }
+    }
+
+    configASSERT(s_client_count < MAX_CLIENTS);
+    client_record& rec = s_clients[s_client_count];
+    rec.task           = TASK;
+    rec.name           = name;
+    rec.prio           = prio;
+    rec.done           = xSemaphoreCreateBinary();
+    rec.state          = request_state::IDLE;
+    rec.sequence       = 0;
+    rec.stats          = {};
+    configASSERT(rec.done != nullptr);
+
+    const std::size_t INDEX = s_client_count.fetch_add(1);
+    xSemaphoreGive(s_register_lock);
+
+    return client(INDEX);
+}
+
+client service::spi_scheduler::current_client() {
+    const TaskHandle_t TASK = xTaskGetCurrentTaskHandle();
+
+    // Registrations are never removed, so a lock-free scan of the
+    // published entries is safe.
+    for (std::size_t i = 0; i < s_client_count; ++i) {
+        if (s_clients[i].task == TASK) {
+            return client(i);
+        }
+    }
+
+    return register_client(pcTaskGetName(TASK), priority_from_task(TASK));
+}
+
+bool service::spi_scheduler::acquire_lease(TickType_t timeout) {
+    if (!is_running()) {
+        return true;
+    }
+
+    return current_client().acquire_lease(timeout);
+}
+
+void service::spi_scheduler::release_lease() {
+    if (!holds_lease() || --s_lease_depth != 0) {
+        return;
+    }
+
+    s_lease_holder = nullptr;
+    xSemaphoreGive(s_lease_returned);
+}
+
+bool service::spi_scheduler::holds_lease() {
+    return s_lease_holder != nullptr &&
+           s_lease_holder == xTaskGetCurrentTaskHandle();
+}
+
+bool service::spi_scheduler::holds_bus_mutex() {
+    return xSPI_Semaphore != nullptr &&
+           xSemaphoreGetMutexHolder(xSPI_Semaphore) ==
+               xTaskGetCurrentTaskHandle();
+}
+
+std::size_t service::spi_scheduler::client_count() { return s_client_count; }
+
+bool service::spi_scheduler::get_statistics(std::size_t index, statistics& out,
+                                            const char** name) {
+    if (index >= s_client_count) {
+        return false;
+    }
+
+    taskENTER_CRITICAL();
+    out = s_clients[index].stats;
+    taskEXIT_CRITICAL();
+
+    if (name != nullptr) {
+        *name = s_clients[index].name;
+    }
+
+    return true;
+}
+
+void service::spi_scheduler::reset_statistics() {
+    for (std::size_t i = 0; i < s_client_count; ++i) {
+        taskENTER_CRITICAL();
+        s_clients[i].stats = {};
+        taskEXIT_CRITICAL();
+    }
+}
+
+void service::spi_scheduler::init() {
+    if (s_owner != nullptr) {
+        return;
+    }
+
+    s_register_lock = xSemaphoreCreateMutex();
+    s_pending       = xSemaphoreCreateCounting(MAX_CLIENTS, 0);
+    s_lease_returned = xSemaphoreCreateBinary();
+    configASSERT(s_register_lock && s_pending && s_lease_returned);
+
+    // Each client has at most one outstanding request, so a queue can never
+    // fill.
+    for (QueueHandle_t& queue : s_queues) {
+        queue = xQueueCreate(MAX_CLIENTS, sizeof(queue_entry));
+        configASSERT(queue);
+    }
+
+    // The cycle counter times the bus occupancy.
+    CoreDebug->DEMCR = CoreDebug->DEMCR | CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        = DWT->CTRL | DWT_CTRL_CYCCNTENA_Msk;
+    s_cycles_per_us = sysclk_get_cpu_hz() / 1000000;
+
+    if (xTaskCreate(task_spi_scheduler, "SPI Sched",
+                    TASK_SPI_SCHEDULER_STACK_SIZE, nullptr,
+                    TASK_SPI_SCHEDULER_STACK_PRIORITY, &s_owner) != pdPASS) {
+        debug_print("ERROR: Failed to create the SPI scheduler task.\n");
+        s_owner = nullptr;
+    }
+}
+
+extern "C" void spi_scheduler_service_init(void) {
+    service::spi_scheduler::init();
+}
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+static void task_spi_scheduler(void*) {
+    bool holds_mutex  = false;
+    std::size_t batch = 0;
+
+    for (;;) {
+        // Keep the mutex across back-to-back transactions, but let direct
+        // users of the mutex in between batches.
+        if (holds_mutex &&
+            (batch >= MAX_BATCH || uxSemaphoreGetCount(s_pending) == 0)) {
+            xSemaphoreGive(xSPI_Semaphore);
+            holds_mutex = false;
+            batch       = 0;
+        }
+
+        xSemaphoreTake(s_pending, portMAX_DELAY);
+
+        client_record* const rec = pop_next();
+        if (rec == nullptr) {
+            continue;
+        }
+
+        if (rec->kind == request_kind::LEASE) {
+            if (holds_mutex) {
+                xSemaphoreGive(xSPI_Semaphore);
+                holds_mutex = false;
+                batch       = 0;
+            }
+            run_lease(*rec);
+        } else {
+            if (!holds_mutex) {
+                xSemaphoreTake(xSPI_Semaphore, portMAX_DELAY);
+                holds_mutex = true;
+            }
+            run_transaction(*rec);
+            ++batch;
+        }
+    }
+}
+
+static bool is_running() {
+    return s_owner != nullptr &&
+           xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+static timestamp now() { return {xTaskGetTickCount(), DWT->CYCCNT}; }
+
+static uint32_t elapsed_us(const timestamp& from, const timestamp& to) {
+    const TickType_t TICKS = to.ticks - from.ticks;
+
+    // The cycle counter wraps every few seconds; long waits use ticks.
+    if (TICKS >= configTICK_RATE_HZ) {
+        return TICKS * US_PER_TICK;
+    }
+
+    return (to.cycles - from.cycles) / s_cycles_per_us;
+}
+
+static bool is_before(TickType_t lhs, TickType_t rhs) {
+    return static_cast<int32_t>(lhs - rhs) < 0;
+}
+
+static void enqueue(std::size_t index, request_kind kind, TickType_t deadline) {
+    client_record& rec = s_clients[index];
+
+    rec.kind      = kind;
+    rec.submitted = now();
+    rec.deadline  = rec.submitted.ticks +
+                   (deadline == 0 ? default_deadline(rec.prio) : deadline);
+
+    taskENTER_CRITICAL();
+    rec.state = request_state::QUEUED;
+    ++rec.sequence;
+    taskEXIT_CRITICAL();
+
+    const queue_entry ENTRY = {static_cast<uint8_t>(index), rec.sequence};
+    xQueueSendToBack(s_queues[static_cast<std::size_t>(rec.prio)], &ENTRY,
+                     portMAX_DELAY);
+    xSemaphoreGive(s_pending);
+}
+
+/**
+ * Removes the request with the earliest deadline from the heads of the
+ * priority queues.  Ties go to the higher priority.
+ * \return The request to run, or nullptr if the entry was stale.
+ */
+static client_record* pop_next() {
+    std::size_t best_queue = PRIORITY_COUNT;
+    TickType_t best_deadline = 0;
+
+    for (std::size_t i = 0; i < PRIORITY_COUNT; ++i) {
+        queue_entry head;
+        if (xQueuePeek(s_queues[i], &head, 0) != pdTRUE) {
+            continue;
+        }
+
+        const TickType_t DEADLINE = s_clients[head.index].deadline;
+        if (best_queue == PRIORITY_COUNT || is_before(DEADLINE, best_deadline)) {
+            best_queue    = i;
+            best_deadline = DEADLINE;
+        }
+    }
+
+    queue_entry entry;
+    if (best_queue == PRIORITY_COUNT ||
+        xQueueReceive(s_queues[best_queue], &entry, 0) != pdTRUE) {
+        return nullptr;
+    }
+
+    client_record& rec = s_clients[entry.index];
+
+    taskENTER_CRITICAL();
+    const bool VALID = rec.sequence == entry.sequence &&
+                       rec.state == request_state::QUEUED;
+    if (VALID) {
+        rec.state = request_state::RUNNING;
+    } else if (rec.sequence == entry.sequence) {
+        rec.state = request_state::IDLE;
+    }
+    taskEXIT_CRITICAL();
+
+    return VALID ? &rec : nullptr;
+}
+
+static bool execute(std::span<const segment> segments) {
+    for (const segment& seg : segments) {
+        spi_status_t rt = spi_start_transfer(seg.mode, seg.toggle,
+                                             seg.chip_select);
+
+        if (rt == SPI_OK) {
+            if (seg.rx == nullptr) {
+                rt = spi_partial_write_array(
+                    reinterpret_cast<const uint8_t*>(seg.tx), seg.size);
+            } else {
+                if (seg.tx == nullptr) {
+                    memset(seg.rx, DUMMY_LOW, seg.size);
+                } else if (seg.tx != seg.rx) {
+                    memcpy(seg.rx, seg.tx, seg.size);
+                }
+                rt = spi_partial_transfer_array(
+                    reinterpret_cast<uint8_t*>(seg.rx), seg.size);
+            }
+        }
+
+        spi_end_transfer();
+
+        if (rt != SPI_OK) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void record_start(client_record& rec, const timestamp& start) {
+    const uint32_t WAIT = elapsed_us(rec.submitted, start);
+
+    taskENTER_CRITICAL();
+    rec.stats.total_wait_us += WAIT;
+    if (WAIT > rec.stats.max_wait_us) {
+        rec.stats.max_wait_us = WAIT;
+    }
+    if (is_before(rec.deadline, start.ticks)) {
+        ++rec.stats.deadline_misses;
+    }
+    taskEXIT_CRITICAL();
+}
+
+static void run_transaction(client_record& rec) {
+    const timestamp START = now();
+    record_start(rec, START);
+
+    rec.result = execute(rec.segments);
+
+    const uint32_t OCCUPANCY = elapsed_us(START, now());
+    taskENTER_CRITICAL();
+    ++rec.stats.transactions;
+    rec.stats.total_occupancy_us += OCCUPANCY;
+    taskEXIT_CRITICAL();
+
+    rec.state = request_state::IDLE;
+    xSemaphoreGive(rec.done);
+}
+
+static void run_lease(client_record& rec) {
+    const timestamp START = now();
+    record_start(rec, START);
+
+    s_lease_holder = rec.task;
+    xSemaphoreGive(rec.done);
+
+    // Nothing else is scheduled until the lessee is done with the bus.
+    xSemaphoreTake(s_lease_returned, portMAX_DELAY);
+
+    const uint32_t OCCUPANCY = elapsed_us(START, now());
+    taskENTER_CRITICAL();
+    ++rec.stats.leases;
+    rec.stats.total_occupancy_us += OCCUPANCY;
+    taskEXIT_CRITICAL();
+
+    rec.state = request_state::IDLE;
+}
+
+static priority priority_from_task(TaskHandle_t task) {
+    // Slot card control loops run above idle priority.
+    return uxTaskPriorityGet(task) > tskIDLE_PRIORITY ? priority::CONTROL
+                                                      : priority::NORMAL;
+}
+
+// EOF
@@ -0,0 +1,220 @@
+/**
+ * \file spi-scheduler.hh
+ * \brief SPI0 bus scheduler service.
+ *
+ * A single bus-owner task executes SPI transactions submitted by other tasks.
+ * Requests are ordered by deadline (earliest first) where each request's
+ * deadline defaults to a budget implied by its priority class, so background
+ * work cannot starve and control loops are serviced first.
+ *
+ * Code that needs to hold the bus across several operations (everything built
+ * on drivers::spi::handle_factory) takes a "lease" instead: the request is
+ * ordered with all others and, once granted, the lessee owns the bus until it
+ * releases the lease.
+ *
+ * The bus owner still takes xSPI_Semaphore around each batch so legacy C code
+ * that takes the mutex directly remains mutually exclusive with the scheduler.
+ *
+ * Nesting:  xSPI_Semaphore is not recursive, so taking it twice from one task
+ * deadlocks.  Leases nest for their holder (each acquire needs a release) and
+ * bus_guard leaves the mutex alone when the caller already holds it, so a
+ * bus_guard may be taken inside another or inside lock_guard(xSPI_Semaphore).
+ * A task holding the mutex without a lease gets a pass-through lease and
+ * runs its transfers inline.  Code taking the mutex directly (lock_guard,
+ * handle_factory) must not do so while the task already holds it; check
+ * holds_bus_mutex() where that can happen.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "user_spi.h"
+
+namespace service::spi_scheduler {
+
+/// \brief The maximum number of tasks that may use the scheduler.
+static constexpr std::size_t MAX_CLIENTS = 24;
+
+/// \brief Batches of back-to-back transactions release xSPI_Semaphore after
+///        this many transactions so direct users of the mutex get a turn.
+static constexpr std::size_t MAX_BATCH = 8;
+
+/**
+ * The class of a request.
+ * Each class implies a default deadline, which is what orders requests.
+ */
+enum class priority : uint8_t {
+    /// Control loops (stepper PID, joystick servicing).
+    CONTROL = 0,
+    /// Regular card, USB, and APT work.
+    NORMAL,
+    /// Persistence and firmware updates.
+    BACKGROUND,
+};
+static constexpr std::size_t PRIORITY_COUNT = 3;
+
+/// \brief The deadline (in ticks after submission) implied by a priority.
+constexpr TickType_t default_deadline(priority prio) {
+    switch (prio) {
+    case priority::CONTROL:
+        return pdMS_TO_TICKS(1);
+    case priority::NORMAL:
+        return pdMS_TO_TICKS(10);
+    case priority::BACKGROUND:
+    default:
+        return pdMS_TO_TICKS(100);
+    }
+}
+
+/**
+ * One chip-select assertion within a transaction.
+ */
+struct segment {
+    spi_modes mode;
+    bool toggle;
+    uint8_t chip_select;
+
+    /// The bytes to send.
+    const std::byte* tx;
+
+    /// Where the received bytes go.  May alias tx.  nullptr discards them.
+    std::byte* rx;
+
+    std::size_t size;
+};
+
+/**
+ * Counters kept per client.
+ * Times are in microseconds.
+ */
+struct statistics {
+    uint32_t transactions;
+    uint32_t leases;
+
+    /// Requests that started after their deadline.
+    uint32_t deadline_misses;
+
+    uint32_t max_wait_us;
+    uint64_t total_wait_us;
+
+    /// Time the bus was busy (or leased) on behalf of the client.
+    uint64_t total_occupancy_us;
+};
+
+/**
+ * A handle to a task's registration with the scheduler.
+ * Cheap to copy; the registration lives for the lifetime of the program.
+ */
+class client {
+   public:
+    /**
+     * Submits the segments as one transaction and blocks until the bus
+     * owner has completed it.
+     * If the calling task holds a lease or xSPI_Semaphore, the transaction
+     * is run inline.
+     * \param[in]       segments The segments to run back-to-back.
+     * \param[in]       deadline Ticks from now by which the transaction should
+     *                  start.  0 uses the client's priority default.
+     * \return If every segment completed without an SPI error.
+     */
+    bool transfer(std::span<const segment> segments, TickType_t deadline = 0);
+
+    /// \brief Convenience overload for a single segment.
+    bool transfer(const segment& seg, TickType_t deadline = 0);
+
+    /**
+     * Blocks until the bus is leased to the calling task.
+     * Succeeds immediately if the task already holds the lease, which then
+     * needs one more release, or holds xSPI_Semaphore.
+     * \param[in]       timeout The time to wait for the lease.
+     * \return If the lease was granted.
+     */
+    bool acquire_lease(TickType_t timeout = portMAX_DELAY);
+
+    /// \brief Returns the lease to the scheduler once every acquire is
+    ///        released.
+    void release_lease();
+
+    priority get_priority() const;
+    const char* name() const;
+    statistics get_statistics() const;
+
+    /// \brief The index of the registration (for enumerating statistics).
+    inline std::size_t index() const { return _index; }
+
+   private:
+    explicit client(std::size_t index) : _index(index) {}
+
+    friend client register_client(const char*, priority);
+    friend client current_client();
+
+    std::size_t _index;
+};
+
+/**
+ * RAII lease of the bus together with xSPI_Semaphore.
+ * A drop-in replacement for lock_guard(xSPI_Semaphore) in code that drives
+ * the bus directly through user_spi.h, ordering it with scheduled requests.
+ * Re-entrant:  the mutex is only taken if the caller does not hold it.
+ */
+class bus_guard {
+   public:
+    bus_guard();
+    bus_guard(const bus_guard&) = delete;
+    ~bus_guard();
+
+   private:
+    bool _owns_mutex;
+};
+
+/**
+ * Registers the calling task with the scheduler.
+ * Registering the same task twice returns the first registration.
+ * \param[in]       name The name the statistics are reported under.
+ *                  Must have static lifetime.
+ * \param[in]       prio The class of the client's requests.
+ */
+client register_client(const char* name, priority prio);
+
+/**
+ * Gets the calling task's registration, registering it with the task's name
+ * and a priority derived from the task priority if it is not registered.
+ */
+client current_client();
+
+/**
+ * Leases the bus to the calling task through the scheduler.
+ * If the scheduler is not running (e.g. before the OS starts), this succeeds
+ * immediately.
+ */
+bool acquire_lease(TickType_t timeout = portMAX_DELAY);
+
+/// \brief Releases the calling task's lease, if it holds one.
+void release_lease();
+
+/// \brief If the calling task currently holds the bus lease.
+bool holds_lease();
+
+/// \brief If the calling task holds xSPI_Semaphore.
+bool holds_bus_mutex();
+
+/// \brief The number of registered clients.
+std::size_t client_count();
+
+/// \brief Copies the statistics of the client at the index.
+/// \return If the index was valid.
+bool get_statistics(std::size_t index, statistics& out,
+                    const char** name = nullptr);
+
+/// \brief Clears every client's statistics.
+void reset_statistics();
+
+void init();
+
+}  // namespace service::spi_scheduler
+
+// EOF
@@ -66,6 +66,7 @@ class queue_map {
     restart:
         for (auto itr = _clients.begin(); itr != _clients.end(); ++itr) {
             if (itr->second == queue) {
+                _clients.erase(*itr);
                 goto restart;
             }
         }
@@ -98,6 +99,24 @@ class queue_map {
         return rt;
     }
 
+    /**
+     * Calls the visitor with every queue whose key satisfies the condition.
+     * \return The number of visits that returned true.
+     */
+    std::size_t visit_if(
+        std::predicate<const Key&> auto&& condition,
+        std::predicate<QueueHandle_t> auto&& visitor) const {
+        std::size_t rt = 0;
+        auto lock      = _lock.reader_lock();
+        auto _         = std::lock_guard(lock);
+        for (const std::pair<Key, QueueHandle_t>& pair : _clients) {
+            if (condition(pair.first)) {
+                rt += visitor(pair.second) ? 1 : 0;
+            }
+        }
+        return rt;
+    }
+
    private:
     Container<std::pair<Key, QueueHandle_t>> _clients;
     rw_lock& _lock;
@@ -1,9 +1,7 @@
 #include "./rw-lock.hh"
 
 #include "FreeRTOSConfig.h"
-#include "lock_guard.hh"
 #include "portmacro.h"
-#include "semphr.h"
 #include "task.h"
 
 using namespace sync;
@@ -22,6 +20,7 @@ using namespace sync;
 /*****************************************************************************
  * Private Function Prototypes
  *****************************************************************************/
+static void give_back_notifications(uint32_t count);
 
 /*****************************************************************************
  * Static Data
@@ -40,57 +39,167 @@ rw_lock::reader_reference::reader_reference(rw_lock& parent)
 rw_lock::writer_reference::writer_reference(rw_lock& parent)
     : _parent(parent) {}
 
-rw_lock::rw_lock()
-    : _write_lock(xSemaphoreCreateMutex())
-    , _read_lock(xSemaphoreCreateMutex())
-    , _readers(0) {
-    configASSERT(_write_lock);
-    configASSERT(_read_lock);
-}
+rw_lock::rw_lock() : _state(0), _p_waiters(nullptr) {}
 
-rw_lock::~rw_lock() {
-    vSemaphoreDelete(_write_lock);
-    vSemaphoreDelete(_read_lock);
-}
+rw_lock::~rw_lock() { configASSERT(_p_waiters == nullptr); }
 
 bool rw_lock::try_lock_reader(TickType_t timeout) {
-    if (pdTRUE != xSemaphoreTake(_read_lock, timeout)) {
-        return false;
-    }
-    if (++_readers == 1) {
-        if (pdTRUE != xSemaphoreTake(_write_lock, timeout)) {
-            --_readers;
-            xSemaphoreGive(_read_lock);
-            return false;
+    uint32_t state = _state.load(std::memory_order_relaxed);
+    while ((state & (WRITER_HELD | WRITER_WAITING)) == 0) {
+        if (_state.compare_exchange_weak(state, state + 1,
+                                         std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            return true;
         }
-        xSemaphoreGive(_read_lock);
     }
 
-    return true;
+    return lock_slow(false, timeout);
 }
 
 bool rw_lock::try_lock_writer(TickType_t timeout) {
-    return xSemaphoreTake(_write_lock, portMAX_DELAY) == pdTRUE;
+    uint32_t state = 0;
+    if (_state.compare_exchange_strong(state, WRITER_HELD,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+        return true;
+    }
+
+    return lock_slow(true, timeout);
 }
 
 void rw_lock::lock_reader() {
-    auto _ = lock_guard(_read_lock);
-    if (++_readers == 1) {
-        xSemaphoreTake(_write_lock, portMAX_DELAY);
-    }
+    const bool GOOD = try_lock_reader(portMAX_DELAY);
+    configASSERT(GOOD);
 }
 
-void rw_lock::lock_writer() { xSemaphoreTake(_write_lock, portMAX_DELAY); }
+void rw_lock::lock_writer() {
+    const bool GOOD = try_lock_writer(portMAX_DELAY);
+    configASSERT(GOOD);
+}
 
 void rw_lock::unlock_reader() {
-    auto _ = lock_guard(_read_lock);
-    if (--_readers == 0) {
-        xSemaphoreGive(_write_lock);
+    const uint32_t PREVIOUS = _state.fetch_sub(1, std::memory_order_release);
+    if ((PREVIOUS & READERS_MASK) == 1 && (PREVIOUS & WAITERS) != 0) {
+        vTaskSuspendAll();
+        grant_waiters();
+        xTaskResumeAll();
     }
 }
 
-void rw_lock::unlock_writer() { xSemaphoreGive(_write_lock); }
+void rw_lock::unlock_writer() {
+    uint32_t state = WRITER_HELD;
+    if (_state.compare_exchange_strong(state, 0, std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+        return;
+    }
+
+    vTaskSuspendAll();
+    _state.fetch_and(~WRITER_HELD, std::memory_order_release);
+    grant_waiters();
+    xTaskResumeAll();
+}
 
 /*****************************************************************************
  * Private Functions
  *****************************************************************************/
+// The lock is handed over with the scheduler suspended, so a waiter that
+// finds itself granted knows the grant's notification has been given.
+bool rw_lock::lock_slow(const bool writer, const TickType_t timeout) {
+    waiter self = {xTaskGetCurrentTaskHandle(), nullptr, writer, false};
+
+    vTaskSuspendAll();
+    {
+        const uint32_t STATE = _state.load(std::memory_order_relaxed);
+        const bool FREE = writer
+                              ? (STATE & (READERS_MASK | WRITER_HELD)) == 0
+                              : (STATE & (WRITER_HELD | WRITER_WAITING)) == 0;
+        if (FREE) {
+            _state.fetch_add(writer ? WRITER_HELD : 1,
+                             std::memory_order_acquire);
+            xTaskResumeAll();
+            return true;
+        }
+        if (timeout == 0) {
+            xTaskResumeAll();
+            return false;
+        }
+
+        waiter** pp_tail = &_p_waiters;
+        while (*pp_tail != nullptr) {
+            pp_tail = &(*pp_tail)->p_next;
+        }
+        *pp_tail = &self;
+        _state.fetch_or(WAITERS | (writer ? WRITER_WAITING : 0),
+                        std::memory_order_relaxed);
+    }
+    xTaskResumeAll();
+
+    TimeOut_t time_out;
+    vTaskSetTimeOutState(&time_out);
+    TickType_t remaining = timeout;
+    uint32_t taken       = 0;
+    for (;;) {
+        if (ulTaskNotifyTake(pdFALSE, remaining) != 0) {
+            ++taken;
+        }
+
+        vTaskSuspendAll();
+        if (self.granted) {
+            xTaskResumeAll();
+            if (taken == 0) {
+                ulTaskNotifyTake(pdFALSE, 0);
+            } else {
+                give_back_notifications(taken - 1);
+            }
+            return true;
+        }
+
+        if (xTaskCheckForTimeOut(&time_out, &remaining) != pdFALSE) {
+            waiter** pp_node = &_p_waiters;
+            while (*pp_node != &self) {
+                pp_node = &(*pp_node)->p_next;
+            }
+            *pp_node = self.p_next;
+
+            // Readers queued behind a writer may be able to go now.
+            grant_waiters();
+            xTaskResumeAll();
+            give_back_notifications(taken);
+            return false;
+        }
+        xTaskResumeAll();
+    }
+}
+
+void rw_lock::grant_waiters() {
+    uint32_t state = _state.load(std::memory_order_relaxed);
+    while (_p_waiters != nullptr) {
+        waiter* const p_next = _p_waiters;
+        const bool BLOCKED =
+            p_next->writer ? (state & (READERS_MASK | WRITER_HELD)) != 0
+                           : (state & WRITER_HELD) != 0;
+        if (BLOCKED) {
+            break;
+        }
+
+        state += p_next->writer ? WRITER_HELD : 1;
+        _p_waiters      = p_next->p_next;
+        p_next->granted = true;
+        xTaskNotifyGive(p_next->task);
+    }
+
+    state &= ~(WAITERS | WRITER_WAITING);
+    for (const waiter* p_node = _p_waiters; p_node != nullptr;
+         p_node               = p_node->p_next) {
+        state |= WAITERS | (p_node->writer ? WRITER_WAITING : 0);
+    }
+    _state.store(state, std::memory_order_release);
+}
+
+/// \brief Returns notifications consumed while waiting to their owner.
+static void give_back_notifications(uint32_t count) {
+    const TaskHandle_t SELF = xTaskGetCurrentTaskHandle();
+    for (; count > 0; --count) {
+        xTaskNotifyGive(SELF);
+    }
+}
@@ -1,13 +1,28 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 
 #include "FreeRTOS.h"
 #include "portmacro.h"
-#include "semphr.h"
+#include "task.h"
 
 namespace sync {
 
+/**
+ * A writer-preferring reader-writer lock.
+ *
+ * The lock is an atomic state word, so locking and unlocking without
+ * contention makes no kernel calls.
+ * Contended tasks wait in FIFO order and are handed the lock directly with a
+ * task notification.
+ * Once a writer waits, new readers wait behind it, so writers do not starve.
+ *
+ * Waiting uses the task's notification count.  Notifications from other
+ * sources that arrive while waiting are given back before returning.
+ * Not for use from interrupts.
+ */
 class rw_lock {
    public:
     class reader_reference {
@@ -65,9 +80,32 @@ class rw_lock {
    protected:
 
    private:
-    SemaphoreHandle_t _write_lock;
-    SemaphoreHandle_t _read_lock;
-    std::size_t _readers;
+    /// \brief A task waiting for the lock.  Lives on the waiting task's stack.
+    struct waiter {
+        TaskHandle_t task;
+        waiter* p_next;
+        bool writer;
+
+        /// Set when the lock has been handed to the task.
+        bool granted;
+    };
+
+    static constexpr uint32_t READERS_MASK   = 0x0000FFFF;
+    static constexpr uint32_t WAITERS        = 1UL << 29;
+    static constexpr uint32_t WRITER_WAITING = 1UL << 30;
+    static constexpr uint32_t WRITER_HELD    = 1UL << 31;
+
+    bool lock_slow(bool writer, TickType_t timeout);
+
+    /// \brief Hands the lock to waiters at the head of the queue.
+    ///        Requires the scheduler to be suspended.
+    void grant_waiters();
+
+    /// Readers holding the lock, and the WRITER_* flags.
+    std::atomic<uint32_t> _state;
+
+    /// FIFO of waiting tasks.  Only changed with the scheduler suspended.
+    waiter* _p_waiters;
 };
 
 }  // namespace sync
@@ -29,6 +29,9 @@ extern "C" {
 // The maximum amount of heartbeat-type watchdogs for all tasks.
 #define TASK_HEARTBEAT_WATCHDOGS                ((NUMBER_OF_BOARD_SLOTS + 2))
 
+// The maximum amount of period monitors for all tasks.
+#define TASK_PERIOD_MONITORS                    (NUMBER_OF_BOARD_SLOTS)
+
 /**
  * USB slave task.
  * This task grabs packets of data from the PC USB port then validates the packet
@@ -49,6 +52,14 @@ extern "C" {
 #define STEPPER_HEARTBEAT_INTERVAL              (2*STEPPER_UPDATE_INTERVAL)
 #define STEPPER_CONFIGURING_INTERVAL            pdMS_TO_TICKS(200)
 
+/**
+ * Stepper telemetry task
+ * Reads every subscribed stepper drive in one SPI transaction per
+ * STEPPER_UPDATE_INTERVAL, then wakes the stepper tasks.
+ */
+#define TASK_STEPPER_TELEMETRY_STACK_SIZE		(512/sizeof(portSTACK_TYPE))
+#define TASK_STEPPER_TELEMETRY_STACK_PRIORITY	( ( UBaseType_t ) 2U )
+
 /**
  * Servo task
  */
@@ -103,6 +114,16 @@ extern "C" {
 #define TASK_SUPERVISOR_CHECK_STACK_PRIORITY   	(tskIDLE_PRIORITY)
 #define SUPERVISOR_TIMEOUT						pdMS_TO_TICKS(10)
 
+/* Period monitors are collected every 500 ms.  A window is slipping when a pass
+ * overran its period or started SUPERVISOR_SLIP_LATENESS late.  Any slipping
+ * window slows the idle slot loops by SUPERVISOR_DEGRADED_IDLE_FACTOR until
+ * SUPERVISOR_RECOVER_WINDOWS clean windows pass; a loop slipping for
+ * SUPERVISOR_SLIP_WINDOWS windows in a row raises the slot's board error.*/
+#define SUPERVISOR_SLIP_LATENESS				pdMS_TO_TICKS(2)
+#define SUPERVISOR_SLIP_WINDOWS					4
+#define SUPERVISOR_RECOVER_WINDOWS				10
+#define SUPERVISOR_DEGRADED_IDLE_FACTOR			4
+
 /**
  * USB Host task
  */
@@ -111,6 +132,20 @@ extern "C" {
 #define USB_HOST_TIMEOUT						pdMS_TO_TICKS(1000)
 #define USB_HOST_ROOT_PORT_TASK_RATE			pdMS_TO_TICKS(100) /* in ms */
 
+/**
+ * USB Host transfer engine task, woken by the MAX3421E INT pin
+ */
+#define TASK_USB_XFER_STACK_SIZE     			(512/sizeof(portSTACK_TYPE))
+#define TASK_USB_XFER_STACK_PRIORITY   			(tskIDLE_PRIORITY + 1)
+#define USB_HOST_XFER_IDLE_RATE					pdMS_TO_TICKS(100) /* in ms */
+
+/**
+ * RT1064 bridge task, the USB host transport when the RT1064 answers on its SPI bridge
+ */
+#define TASK_RT_BRIDGE_STACK_SIZE     			(1536/sizeof(portSTACK_TYPE))
+#define TASK_RT_BRIDGE_STACK_PRIORITY   		(tskIDLE_PRIORITY)
+#define RT_BRIDGE_POLL_RATE						pdMS_TO_TICKS(1) /* in ms */
+
 /**
  * USB device task
  */
@@ -150,6 +185,46 @@ extern "C" {
 #define DEVICE_DETECT_UPDATE_INTERVAL               pdMS_TO_TICKS(10)
 #define DEVICE_DETECT_HEARTBEAT_INTERVAL            pdMS_TO_TICKS(5000)
 
+/**
+ * Profiler task
+ * Samples the task run time counters once per window.  Runs above every other
+ * task so a busy chassis cannot stretch the window; the window must stay
+ * shorter than a wrap of the cycle counter (14 s).
+ */
+#define TASK_PROFILER_STACK_SIZE				(512/sizeof(portSTACK_TYPE))
+#define TASK_PROFILER_STACK_PRIORITY			( ( UBaseType_t ) 3U )
+#define PROFILER_WINDOW							pdMS_TO_TICKS(1000)
+
+/**
+ * SPI scheduler task
+ * Owns SPI0 and runs the transactions submitted to the SPI scheduler service.
+ * Runs above the slot tasks so bus handoffs are not delayed by them.
+ */
+#define TASK_SPI_SCHEDULER_STACK_SIZE			(768/sizeof(portSTACK_TYPE))
+#define TASK_SPI_SCHEDULER_STACK_PRIORITY		( ( UBaseType_t ) 2U )
+
+/**
+ * EEPROM cache task
+ * Writes the 25LC1024 write-back cache's dirty pages to the device.
+ */
+#define TASK_EEPROM_CACHE_STACK_SIZE			(512/sizeof(portSTACK_TYPE))
+#define TASK_EEPROM_CACHE_STACK_PRIORITY		(tskIDLE_PRIORITY)
+
+/**
+ * Log drain task
+ * Sends the trace ring's records to the PC once it starts the logger.
+ */
+#define TASK_LOG_DRAIN_STACK_SIZE				(1024/sizeof(portSTACK_TYPE))
+#define TASK_LOG_DRAIN_STACK_PRIORITY			(tskIDLE_PRIORITY)
+
+/**
+ * CPLD program task
+ * Programs the JEDEC pages queued by the USB slave task during a CPLD update.
+ * Runs above the USB slave task so a queued page starts as soon as it lands.
+ */
+#define TASK_CPLD_PROGRAM_STACK_SIZE			(512/sizeof(portSTACK_TYPE))
+#define TASK_CPLD_PROGRAM_STACK_PRIORITY		( ( UBaseType_t ) 1U )
+
 /**
  * Standard task
  */
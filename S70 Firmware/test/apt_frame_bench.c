@@ -0,0 +1,792 @@
+/**
+ * @file apt_frame_bench.c
+ *
+ * @brief Host test of the APT receive ring framing.  Checks long-form frames
+ * that do and do not wrap the end of the ring, realignment past misaligned
+ * bytes and the skipping of oversized commands, checks that a stream of
+ * commands frames the same as through the builder it replaced, then times
+ * long-form commands per second through both.
+ *
+ * The builder below is a copy of the one the ring replaced: the CDC bytes
+ * were copied into its buffer, the extended data copied again into the
+ * message, and a slot-bound message copied once more into the pooled ITC
+ * message.  Both paths read the stream from a model of the CDC endpoint that
+ * delivers it in 64-byte full-speed packets.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <asf.h>
+
+#include "apt.h"
+#include "apt_frame.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+#define USB_PACKET_SIZE		64
+
+/* Realign attempts of the USB port.*/
+#define MAX_REALIGN			4
+
+#define MOTHERBOARD_DEST	0x11
+#define SLOT_1_DEST			0x21
+
+/* Largest extended data the old builder took, its buffer held the header.*/
+#define BUILDER_MAX_DATA	(USB_SLAVE_BUFFER_SIZE - APT_COMMAND_SIZE)
+
+#define RANDOM_COMMANDS		5000
+#define STREAM_COMMANDS		1024
+#define STREAM_CAPACITY		(STREAM_COMMANDS * (APT_COMMAND_SIZE + BUILDER_MAX_DATA))
+
+/* Commands each timing run frames.*/
+#define TIMING_COMMANDS		(2UL * 1024 * 1024)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+typedef enum
+{
+	BUILDER_COMMAND_OVERFLOWED = -2,
+	BUILDER_REALIGN_UNAVAILABLE = -1,
+	BUILDER_IDLE = 0,
+	BUILDER_BUILDING = 1,
+	BUILDER_GOT_COMMAND = 2,
+} Builder_state;
+
+typedef struct
+{
+	uint8_t *buffer;
+	size_t buffer_length;
+	size_t buffer_capacity;
+	size_t counter;
+	Builder_state state;
+	uint8_t realigned_try_cnt;
+	uint8_t max_realigned_attempts;
+} Builder;
+
+/* The CDC endpoint, holding one packet of the stream at a time.*/
+typedef struct
+{
+	const uint8_t *data;
+	size_t length;
+	size_t position;
+	size_t packet_end;
+} Cdc_source;
+
+DWT_Type sim_dwt;
+
+static uint8_t ring_buffer[USB_SLAVE_RING_SIZE];
+static uint8_t builder_buffer[USB_SLAVE_BUFFER_SIZE];
+static uint8_t stream[STREAM_CAPACITY];
+static USB_Slave_Message expected[STREAM_COMMANDS];
+static unsigned failures;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+static void check(bool passed, const char *what, unsigned detail)
+{
+	if (!passed)
+	{
+		++failures;
+		printf("FAIL %s (%u)\n", what, detail);
+	}
+}
+
+static size_t cdc_read(Cdc_source *p_source, uint8_t *p_dest, size_t max_read)
+{
+	if (p_source->position == p_source->packet_end)
+	{
+		if (p_source->position == p_source->length)
+		{
+			return 0;
+		}
+		p_source->packet_end = Min(p_source->length,
+				p_source->position + USB_PACKET_SIZE);
+	}
+
+	const size_t TO_READ = Min(max_read,
+			p_source->packet_end - p_source->position);
+	memcpy(p_dest, p_source->data + p_source->position, TO_READ);
+	p_source->position += TO_READ;
+	return TO_READ;
+}
+
+static void cdc_open(Cdc_source *p_source, const uint8_t *p_data,
+		size_t length)
+{
+	p_source->data = p_data;
+	p_source->length = length;
+	p_source->position = 0;
+	p_source->packet_end = 0;
+}
+
+/**
+ * @brief Writes a command to p_buffer, with extended data when it has any.
+ *
+ * @return Bytes written.
+ */
+static size_t encode_command(uint8_t *p_buffer, uint16_t message_id,
+		uint8_t destination, bool long_form, uint16_t data_length,
+		uint8_t seed)
+{
+	p_buffer[0] = (uint8_t) message_id;
+	p_buffer[1] = (uint8_t) (message_id >> 8);
+	p_buffer[2] = long_form ? (uint8_t) data_length : seed;
+	p_buffer[3] = long_form ? (uint8_t) (data_length >> 8) : 0;
+	p_buffer[4] = destination | (long_form ? 0x80 : 0);
+	p_buffer[5] = HOST_ID;
+
+	if (!long_form)
+	{
+		return APT_COMMAND_SIZE;
+	}
+	for (uint16_t i = 0; i < data_length; ++i)
+	{
+		p_buffer[APT_COMMAND_SIZE + i] = (uint8_t) (seed + i * 7);
+	}
+	return APT_COMMAND_SIZE + data_length;
+}
+
+static void push_bytes(apt_ring_t *p_ring, const uint8_t *p_data, size_t length)
+{
+	for (size_t i = 0; i < length; ++i)
+	{
+		check(apt_ring_push(p_ring, p_data[i]), "ring push", (unsigned) i);
+	}
+}
+
+/* The old builder, as it was before the receive ring.*/
+static bool builder_check_alignment(const Builder *p_builder)
+{
+	switch (p_builder->buffer[4] & 0x7F)
+	{
+	case 0x11:
+	case 0x21:
+	case 0x22:
+	case 0x23:
+	case 0x24:
+	case 0x25:
+	case 0x26:
+	case 0x27:
+	case 0x28:
+		break;
+
+	default:
+		return false;
+	}
+
+	return p_builder->buffer[5] == HOST_ID;
+}
+
+static bool builder_try_realign(Builder *p_builder)
+{
+	if (p_builder->realigned_try_cnt == p_builder->max_realigned_attempts)
+	{
+		return false;
+	}
+	++p_builder->realigned_try_cnt;
+	memmove(p_builder->buffer, p_builder->buffer + 1,
+			p_builder->buffer_length - 1);
+	return true;
+}
+
+static void builder_reset(Builder *p_builder)
+{
+	p_builder->buffer_length = 0;
+	p_builder->counter = 0;
+	p_builder->state = BUILDER_IDLE;
+	p_builder->realigned_try_cnt = 0;
+}
+
+static void builder_init(Builder *p_builder)
+{
+	p_builder->buffer = builder_buffer;
+	p_builder->buffer_capacity = sizeof(builder_buffer);
+	p_builder->max_realigned_attempts = MAX_REALIGN;
+	builder_reset(p_builder);
+}
+
+static size_t builder_bytes_needed(const Builder *p_builder)
+{
+	switch (p_builder->state)
+	{
+	case BUILDER_IDLE:
+	case BUILDER_BUILDING:
+		return p_builder->buffer_length < APT_COMMAND_SIZE ?
+				(APT_COMMAND_SIZE - p_builder->buffer_length) : 0;
+	case BUILDER_GOT_COMMAND:
+	case BUILDER_COMMAND_OVERFLOWED:
+		return p_builder->counter;
+	default:
+		return 0;
+	}
+}
+
+static bool builder_service(Builder *p_builder, USB_Slave_Message *p_out)
+{
+	bool message_complete = false;
+	bool reset = false;
+	size_t bytes_to_consume = 0;
+
+	bool retry = true;
+	while (retry)
+	{
+		retry = false;
+		switch (p_builder->state)
+		{
+		case BUILDER_IDLE:
+			if (p_builder->buffer_length != 0)
+			{
+				p_builder->state = BUILDER_BUILDING;
+				retry = true;
+			}
+			break;
+
+		case BUILDER_BUILDING:
+			if (p_builder->buffer_length < APT_COMMAND_SIZE)
+			{
+				break;
+			}
+
+			if (!builder_check_alignment(p_builder))
+			{
+				p_builder->state = builder_try_realign(p_builder) ?
+						BUILDER_BUILDING : BUILDER_REALIGN_UNAVAILABLE;
+				retry = true;
+			}
+			else
+			{
+				const uint8_t *const P_HEADER = p_builder->buffer;
+				p_builder->realigned_try_cnt = 0;
+				p_out->ucMessageID = P_HEADER[0] | (P_HEADER[1] << 8);
+				p_out->param1 = P_HEADER[2];
+				p_out->param2 = P_HEADER[3];
+				p_out->destination = P_HEADER[4] & 0x7F;
+				p_out->source = P_HEADER[5];
+				p_out->ExtendedData_len = P_HEADER[2] | (P_HEADER[3] << 8);
+				p_out->bHasExtendedData = P_HEADER[4] & 0x80;
+				p_builder->counter = p_out->ExtendedData_len;
+
+				if (p_out->bHasExtendedData)
+				{
+					p_builder->state = ((size_t) (APT_COMMAND_SIZE
+							+ p_out->ExtendedData_len)
+							> p_builder->buffer_capacity) ?
+							BUILDER_COMMAND_OVERFLOWED : BUILDER_GOT_COMMAND;
+					retry = true;
+				}
+				else
+				{
+					bytes_to_consume = APT_COMMAND_SIZE;
+					message_complete = true;
+					reset = true;
+				}
+			}
+			break;
+
+		case BUILDER_GOT_COMMAND:
+			if (p_builder->buffer_length
+					>= (APT_COMMAND_SIZE + p_builder->counter))
+			{
+				memcpy(p_out->extended_data_buf,
+						p_builder->buffer + APT_COMMAND_SIZE,
+						p_builder->counter);
+				bytes_to_consume = APT_COMMAND_SIZE + p_builder->counter;
+				message_complete = true;
+				reset = true;
+			}
+			break;
+
+		case BUILDER_COMMAND_OVERFLOWED:
+			if (p_builder->counter > p_builder->buffer_length)
+			{
+				p_builder->counter -= p_builder->buffer_length;
+				p_builder->buffer_length = 0;
+			}
+			else
+			{
+				bytes_to_consume = p_builder->counter;
+				reset = true;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		if (reset)
+		{
+			if (p_builder->buffer_length == bytes_to_consume)
+			{
+				p_builder->state = BUILDER_IDLE;
+				p_builder->buffer_length = 0;
+			}
+			else
+			{
+				memmove(p_builder->buffer, p_builder->buffer + bytes_to_consume,
+						p_builder->buffer_length - bytes_to_consume);
+				p_builder->state = BUILDER_BUILDING;
+				p_builder->buffer_length -= bytes_to_consume;
+			}
+			retry = !message_complete;
+		}
+	}
+
+	return message_complete;
+}
+
+/**
+ * @brief The old reading service, without its timeouts: one byte is read to
+ * start a command, then the bytes the builder says it needs.
+ *
+ * @return false once the stream has run out.
+ */
+static bool builder_next(Builder *p_builder, Cdc_source *p_source,
+		USB_Slave_Message *p_message)
+{
+	for (;;)
+	{
+		const size_t TO_READ = (p_builder->state == BUILDER_IDLE) ? 1 :
+				Min(p_builder->buffer_capacity - p_builder->buffer_length,
+						builder_bytes_needed(p_builder));
+		const size_t READ = cdc_read(p_source,
+				p_builder->buffer + p_builder->buffer_length, TO_READ);
+		if (READ == 0 && TO_READ != 0)
+		{
+			return false;
+		}
+		p_builder->buffer_length += READ;
+
+		if (builder_service(p_builder, p_message))
+		{
+			return true;
+		}
+		if (p_builder->state == BUILDER_REALIGN_UNAVAILABLE)
+		{
+			builder_reset(p_builder);
+		}
+	}
+}
+
+/**
+ * @brief Frames the next command from the ring, reading the CDC endpoint
+ * into the ring's free space as the USB slave task does.
+ *
+ * @return false once the stream has run out.
+ */
+static bool ring_next(apt_frame_parser_t *p_parser, Cdc_source *p_source,
+		apt_frame_t *p_frame)
+{
+	for (;;)
+	{
+		const apt_frame_status_t STATUS = apt_frame_parser_next(p_parser,
+				p_frame, NULL);
+		if (STATUS == APT_FRAME_READY)
+		{
+			return true;
+		}
+		if (STATUS == APT_FRAME_OVERFLOWED)
+		{
+			continue;
+		}
+		if (STATUS == APT_FRAME_REALIGN_UNAVAILABLE)
+		{
+			apt_frame_parser_reset(p_parser);
+		}
+
+		size_t length;
+		uint8_t *const P_REGION = apt_ring_write_region(p_parser->ring,
+				&length);
+		const size_t READ = cdc_read(p_source, P_REGION, length);
+		if (READ == 0)
+		{
+			return false;
+		}
+		apt_ring_commit(p_parser->ring, READ);
+	}
+}
+
+/**
+ * @brief Gives a frame to its handler as apt_parse_frame() does: the header
+ * and extended data into the message for the motherboard, or into the pooled
+ * message for a slot.
+ */
+static void ring_dispatch(apt_frame_parser_t *p_parser,
+		const apt_frame_t *p_frame, USB_Slave_Message *p_message)
+{
+	apt_frame_header_to_message(p_frame, p_message);
+	apt_frame_copy_data(p_frame, p_message->extended_data_buf);
+	apt_frame_release(p_parser, p_frame);
+}
+
+static bool same_message(const USB_Slave_Message *p_a,
+		const USB_Slave_Message *p_b)
+{
+	if (p_a->ucMessageID != p_b->ucMessageID || p_a->param1 != p_b->param1
+			|| p_a->param2 != p_b->param2
+			|| p_a->destination != p_b->destination
+			|| p_a->source != p_b->source
+			|| p_a->ExtendedData_len != p_b->ExtendedData_len
+			|| p_a->bHasExtendedData != p_b->bHasExtendedData)
+	{
+		return false;
+	}
+	return !p_a->bHasExtendedData
+			|| memcmp(p_a->extended_data_buf, p_b->extended_data_buf,
+					p_a->ExtendedData_len) == 0;
+}
+
+static void test_wrapped_frames(void)
+{
+	static const uint16_t LENGTHS[] =
+	{ 1, 58, 100, USB_SLAVE_BUFFER_SIZE };
+	apt_ring_t ring;
+	apt_frame_parser_t parser;
+	uint8_t command[APT_COMMAND_SIZE + USB_SLAVE_BUFFER_SIZE];
+	uint8_t data[USB_SLAVE_BUFFER_SIZE];
+
+	for (size_t l = 0; l < sizeof(LENGTHS) / sizeof(LENGTHS[0]); ++l)
+	{
+		const uint16_t LENGTH = LENGTHS[l];
+		const size_t SIZE = encode_command(command, 0x04A3, SLOT_1_DEST, true,
+				LENGTH, (uint8_t) l);
+		bool wrapped = false;
+		bool unwrapped = false;
+
+		/* Start the command at every offset in the ring.*/
+		for (size_t offset = 0; offset < USB_SLAVE_RING_SIZE; ++offset)
+		{
+			apt_ring_init(&ring, ring_buffer, USB_SLAVE_RING_SIZE);
+			apt_frame_parser_init(&parser, &ring, APT_FRAME_PORT_USB,
+					MAX_REALIGN);
+			ring.head = ring.tail = offset;
+			push_bytes(&ring, command, SIZE);
+
+			apt_frame_t frame;
+			const apt_frame_status_t STATUS = apt_frame_parser_next(&parser,
+					&frame, NULL);
+			check(STATUS == APT_FRAME_READY, "wrapped frame ready",
+					(unsigned) offset);
+			if (STATUS != APT_FRAME_READY)
+			{
+				continue;
+			}
+
+			check(frame.message_id == 0x04A3 && frame.destination == SLOT_1_DEST
+					&& frame.source == HOST_ID && frame.has_extended_data
+					&& frame.extended_length == LENGTH
+					&& frame.size == SIZE, "wrapped frame header",
+					(unsigned) offset);
+			check(frame.data_length[0] + frame.data_length[1] == LENGTH,
+					"wrapped frame spans", (unsigned) offset);
+
+			if (frame.data_length[1] != 0)
+			{
+				wrapped = true;
+			}
+			else
+			{
+				unwrapped = true;
+			}
+
+			apt_frame_copy_data(&frame, data);
+			check(memcmp(data, &command[APT_COMMAND_SIZE], LENGTH) == 0,
+					"wrapped frame data", (unsigned) offset);
+
+			apt_frame_release(&parser, &frame);
+			check(apt_ring_used(&ring) == 0, "wrapped frame released",
+					(unsigned) offset);
+		}
+		/* A single byte of data is never split.*/
+		check((wrapped || LENGTH == 1) && unwrapped, "both spans seen", LENGTH);
+	}
+}
+
+static void test_realignment(void)
+{
+	apt_ring_t ring;
+	apt_frame_parser_t parser;
+	uint8_t command[APT_COMMAND_SIZE + 16];
+	const size_t SIZE = encode_command(command, 0x0443, MOTHERBOARD_DEST,
+			true, 16, 3);
+	static const uint8_t GARBAGE[MAX_REALIGN + 1] =
+	{ 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+	for (uint8_t skipped = 0; skipped <= MAX_REALIGN + 1; ++skipped)
+	{
+		apt_ring_init(&ring, ring_buffer, USB_SLAVE_RING_SIZE);
+		apt_frame_parser_init(&parser, &ring, APT_FRAME_PORT_USB, MAX_REALIGN);
+		apt_frame_reset_statistics();
+		push_bytes(&ring, GARBAGE, skipped);
+		push_bytes(&ring, command, SIZE);
+
+		apt_frame_t frame;
+		const apt_frame_status_t STATUS = apt_frame_parser_next(&parser,
+				&frame, NULL);
+		apt_frame_statistics_t stats;
+		apt_frame_get_statistics(APT_FRAME_PORT_USB, &stats);
+
+		if (skipped <= MAX_REALIGN)
+		{
+			check(STATUS == APT_FRAME_READY && frame.message_id == 0x0443
+					&& frame.extended_length == 16, "realigned frame", skipped);
+			check(stats.dropped_bytes == skipped, "realign dropped bytes",
+					skipped);
+			check(apt_ring_used(&ring) == SIZE, "realigned to the command",
+					skipped);
+		}
+		else
+		{
+			check(STATUS == APT_FRAME_REALIGN_UNAVAILABLE, "realign gives up",
+					skipped);
+			apt_frame_parser_reset(&parser);
+			check(apt_ring_used(&ring) == 0, "reset empties the ring", skipped);
+		}
+	}
+}
+
+static void test_overflow_skip(void)
+{
+	enum { OVERSIZED = 200, CHUNK = 7 };
+	apt_ring_t ring;
+	apt_frame_parser_t parser;
+	uint8_t oversized[APT_COMMAND_SIZE + OVERSIZED];
+	uint8_t next[APT_COMMAND_SIZE];
+	const size_t OVERSIZED_SIZE = encode_command(oversized, 0x0401,
+			SLOT_1_DEST, true, OVERSIZED, 9);
+	encode_command(next, 0x0005, MOTHERBOARD_DEST, false, 0, 1);
+
+	apt_ring_init(&ring, ring_buffer, USB_SLAVE_RING_SIZE);
+	apt_frame_parser_init(&parser, &ring, APT_FRAME_PORT_USB, MAX_REALIGN);
+	apt_frame_reset_statistics();
+
+	/* The command arrives a few bytes at a time behind its header.*/
+	push_bytes(&ring, oversized, APT_COMMAND_SIZE);
+
+	apt_frame_t frame;
+	size_t needed = 0;
+	apt_frame_status_t status = apt_frame_parser_next(&parser, &frame,
+			&needed);
+	check(status == APT_FRAME_OVERFLOWED && frame.extended_length == OVERSIZED,
+			"oversized command rejected", frame.extended_length);
+
+	size_t sent = APT_COMMAND_SIZE;
+	while (sent < OVERSIZED_SIZE)
+	{
+		const size_t LENGTH = Min((size_t) CHUNK, OVERSIZED_SIZE - sent);
+		push_bytes(&ring, &oversized[sent], LENGTH);
+		sent += LENGTH;
+
+		status = apt_frame_parser_next(&parser, &frame, &needed);
+		if (sent < OVERSIZED_SIZE)
+		{
+			check(status == APT_FRAME_NEED_DATA
+					&& needed == OVERSIZED_SIZE - sent, "oversized data skipped",
+					(unsigned) sent);
+		}
+		check(apt_ring_used(&ring) == 0, "skipped bytes freed",
+				(unsigned) sent);
+	}
+
+	push_bytes(&ring, next, sizeof(next));
+	status = apt_frame_parser_next(&parser, &frame, NULL);
+	check(status == APT_FRAME_READY && frame.message_id == 0x0005
+			&& !frame.has_extended_data, "command after the oversized one",
+			status);
+	apt_frame_release(&parser, &frame);
+
+	apt_frame_statistics_t stats;
+	apt_frame_get_statistics(APT_FRAME_PORT_USB, &stats);
+	check(stats.dropped_bytes == OVERSIZED_SIZE && stats.frames == 1,
+			"oversized command counted as dropped", stats.dropped_bytes);
+}
+
+/**
+ * @brief Fills the stream with commands.
+ *
+ * @param data_length : Extended data of every command, or 0 for a random mix
+ * of short and long-form commands to the motherboard and the slots.
+ * @return Bytes in the stream.
+ */
+static size_t build_stream(uint16_t data_length, uint8_t destination)
+{
+	size_t length = 0;
+
+	for (size_t i = 0; i < STREAM_COMMANDS; ++i)
+	{
+		const bool RANDOM = data_length == 0;
+		const bool LONG_FORM = !RANDOM || (rand() % 3) != 0;
+		const uint16_t LENGTH = RANDOM ?
+				(uint16_t) (rand() % (BUILDER_MAX_DATA + 1)) : data_length;
+		const uint8_t DESTINATION = RANDOM ?
+				((rand() % 2) ? MOTHERBOARD_DEST :
+						(uint8_t) (SLOT_1_DEST + rand() % 8)) : destination;
+		const uint16_t ID = (uint16_t) (0x0400 + rand() % 0x100);
+		const uint8_t SEED = (uint8_t) rand();
+
+		USB_Slave_Message *const P_EXPECTED = &expected[i];
+		const size_t SIZE = encode_command(&stream[length], ID, DESTINATION,
+				LONG_FORM, LENGTH, SEED);
+		P_EXPECTED->ucMessageID = ID;
+		P_EXPECTED->param1 = stream[length + 2];
+		P_EXPECTED->param2 = stream[length + 3];
+		P_EXPECTED->destination = DESTINATION;
+		P_EXPECTED->source = HOST_ID;
+		P_EXPECTED->ExtendedData_len = P_EXPECTED->param1
+				| (P_EXPECTED->param2 << 8);
+		P_EXPECTED->bHasExtendedData = LONG_FORM;
+		memcpy(P_EXPECTED->extended_data_buf, &stream[length + APT_COMMAND_SIZE],
+				SIZE - APT_COMMAND_SIZE);
+
+		length += SIZE;
+	}
+	return length;
+}
+
+static void test_matches_builder(void)
+{
+	for (int run = 0; run < RANDOM_COMMANDS / STREAM_COMMANDS + 1; ++run)
+	{
+		const size_t LENGTH = build_stream(0, 0);
+
+		apt_ring_t ring;
+		apt_frame_parser_t parser;
+		Builder builder;
+		Cdc_source ring_source;
+		Cdc_source builder_source;
+		apt_ring_init(&ring, ring_buffer, USB_SLAVE_RING_SIZE);
+		apt_frame_parser_init(&parser, &ring, APT_FRAME_PORT_USB, MAX_REALIGN);
+		builder_init(&builder);
+		cdc_open(&ring_source, stream, LENGTH);
+		cdc_open(&builder_source, stream, LENGTH);
+
+		for (unsigned i = 0; i < STREAM_COMMANDS; ++i)
+		{
+			USB_Slave_Message from_ring;
+			USB_Slave_Message from_builder;
+			apt_frame_t frame;
+
+			const bool RING_READY = ring_next(&parser, &ring_source, &frame);
+			check(RING_READY, "ring framed the command", i);
+			if (RING_READY)
+			{
+				ring_dispatch(&parser, &frame, &from_ring);
+				check(same_message(&from_ring, &expected[i]), "ring message", i);
+			}
+
+			const bool BUILDER_READY = builder_next(&builder, &builder_source,
+					&from_builder);
+			check(BUILDER_READY && same_message(&from_builder, &expected[i]),
+					"builder message", i);
+		}
+		check(apt_ring_used(&ring) == 0 && ring_source.position == LENGTH,
+				"stream consumed", run);
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* The sink keeps the compiler from dropping the handled messages.*/
+static volatile uint32_t sink;
+
+static void time_frames(uint16_t data_length, uint8_t destination)
+{
+	const size_t LENGTH = build_stream(data_length, destination);
+	const unsigned long PASSES = TIMING_COMMANDS / STREAM_COMMANDS;
+	const bool TO_SLOT = destination != MOTHERBOARD_DEST;
+	USB_Slave_Message message;
+	USB_Slave_Message pooled;
+
+	apt_ring_t ring;
+	apt_frame_parser_t parser;
+	Cdc_source source;
+	apt_ring_init(&ring, ring_buffer, USB_SLAVE_RING_SIZE);
+	apt_frame_parser_init(&parser, &ring, APT_FRAME_PORT_USB, MAX_REALIGN);
+
+	double start = seconds();
+	for (unsigned long pass = 0; pass < PASSES; ++pass)
+	{
+		apt_frame_t frame;
+		cdc_open(&source, stream, LENGTH);
+		while (ring_next(&parser, &source, &frame))
+		{
+			ring_dispatch(&parser, &frame, &message);
+			sink += message.extended_data_buf[data_length - 1];
+		}
+	}
+	const double RING = seconds() - start;
+
+	Builder builder;
+	builder_init(&builder);
+
+	start = seconds();
+	for (unsigned long pass = 0; pass < PASSES; ++pass)
+	{
+		cdc_open(&source, stream, LENGTH);
+		while (builder_next(&builder, &source, &message))
+		{
+			/* apt_parse() copied a slot-bound message into the pooled one.*/
+			const USB_Slave_Message *p_handled = &message;
+			if (TO_SLOT)
+			{
+				pooled = message;
+				p_handled = &pooled;
+			}
+			sink += p_handled->extended_data_buf[data_length - 1];
+		}
+	}
+	const double BUILDER = seconds() - start;
+
+	const double COMMANDS = (double) PASSES * STREAM_COMMANDS;
+	printf("%3u-byte long-form commands to the %s: %.2f M/s (builder %.2f M/s,"
+			" x%.2f)\n", data_length, TO_SLOT ? "slots" : "board",
+			COMMANDS / RING * 1e-6, COMMANDS / BUILDER * 1e-6, BUILDER / RING);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+int main(int argc, char **argv)
+{
+	const bool TIMING = !(argc > 1 && strcmp(argv[1], "--no-timing") == 0);
+
+	srand(0xA97);
+
+	test_wrapped_frames();
+	test_realignment();
+	test_overflow_skip();
+	test_matches_builder();
+
+	if (failures != 0)
+	{
+		printf("%u check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All APT framing checks passed\n");
+
+	if (TIMING)
+	{
+		static const uint16_t LENGTHS[] =
+		{ 16, 64, BUILDER_MAX_DATA };
+
+		for (size_t i = 0; i < sizeof(LENGTHS) / sizeof(LENGTHS[0]); ++i)
+		{
+			time_frames(LENGTHS[i], SLOT_1_DEST);
+			time_frames(LENGTHS[i], MOTHERBOARD_DEST);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,28 @@
+/**
+ * @file FreeRTOS.h
+ *
+ * @brief The FreeRTOS types and macros used by the host tests.  See
+ * freertos_sim.cc.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FreeRTOSConfig.h"
+#include "portmacro.h"
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE  ((BaseType_t)1)
+#define pdPASS  (pdTRUE)
+#define pdFAIL  (pdFALSE)
+
+#define configASSERT(x)                                                   \
+    do {                                                                  \
+        if (!(x)) {                                                       \
+            fprintf(stderr, "%s:%d: assert %s\n", __FILE__, __LINE__, #x); \
+            abort();                                                      \
+        }                                                                 \
+    } while (0)
@@ -0,0 +1,11 @@
+/**
+ * @file FreeRTOSConfig.h
+ *
+ * @brief Host test configuration.  Ticks only advance when every simulated
+ * task is blocked, see freertos_sim.cc.
+ */
+
+#pragma once
+
+#define configTICK_RATE_HZ                 1000
+#define INCLUDE_xSemaphoreGetMutexHolder   1
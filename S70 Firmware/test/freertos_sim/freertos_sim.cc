@@ -0,0 +1,312 @@
+/**
+ * @file freertos_sim.cc
+ *
+ * @brief A single-processor simulation of the FreeRTOS calls used by
+ * sync::rw_lock, for host tests and benchmarks.  See freertos_sim.hh.
+ */
+
+#include "freertos_sim.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "semphr.h"
+#include "task.h"
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+struct sim_mutex;
+
+struct sim_task {
+    std::function<void()> function;
+    std::condition_variable cv;
+    std::thread thread;
+
+    enum { READY, BLOCKED, DONE } state = READY;
+
+    /// Tick the block times out at, or portMAX_DELAY.
+    TickType_t wake = portMAX_DELAY;
+
+    /// Set while blocked on a notification.
+    bool wants_notify = false;
+
+    /// Set while blocked on a mutex.
+    sim_mutex* p_waiting_on = nullptr;
+
+    uint32_t notify = 0;
+};
+
+struct sim_mutex {
+    sim_task* p_owner = nullptr;
+    std::deque<sim_task*> waiters;
+};
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+static std::mutex s_cpu;
+static std::condition_variable s_done;
+static sim_task* s_p_running;
+static std::deque<sim_task*> s_ready;
+static std::vector<std::unique_ptr<sim_task>> s_tasks;
+static size_t s_live;
+static TickType_t s_tick;
+static uint32_t s_suspended;
+static sim::counters s_counters;
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+static void make_ready(sim_task* p_task) {
+    p_task->state        = sim_task::READY;
+    p_task->wake         = portMAX_DELAY;
+    p_task->wants_notify = false;
+    p_task->p_waiting_on = nullptr;
+    s_ready.push_back(p_task);
+}
+
+/// \brief Jumps the tick to the first timeout and readies the tasks it wakes.
+static void advance_tick() {
+    TickType_t first = portMAX_DELAY;
+    for (const auto& p_task : s_tasks) {
+        if (p_task->state == sim_task::BLOCKED && p_task->wake < first) {
+            first = p_task->wake;
+        }
+    }
+    if (first == portMAX_DELAY) {
+        fprintf(stderr, "sim: every task is blocked forever\n");
+        abort();
+    }
+
+    s_tick = first;
+    for (const auto& p_task : s_tasks) {
+        if (p_task->state == sim_task::BLOCKED && p_task->wake <= s_tick) {
+            if (p_task->p_waiting_on != nullptr) {
+                auto& waiters = p_task->p_waiting_on->waiters;
+                waiters.erase(
+                    std::find(waiters.begin(), waiters.end(), p_task.get()));
+            }
+            make_ready(p_task.get());
+        }
+    }
+}
+
+/// \brief Switches to the next ready task, and waits to be switched back in
+///        unless p_self has finished.
+static void switch_out(std::unique_lock<std::mutex>& cpu, sim_task* p_self) {
+    if (s_live == 0) {
+        s_p_running = nullptr;
+        s_done.notify_all();
+        return;
+    }
+    if (s_ready.empty()) {
+        advance_tick();
+    }
+
+    sim_task* const p_next = s_ready.front();
+    s_ready.pop_front();
+    if (p_next != p_self) {
+        ++s_counters.context_switches;
+        s_p_running = p_next;
+        p_next->cv.notify_one();
+    }
+
+    if (p_self != nullptr && p_self->state != sim_task::DONE) {
+        p_self->cv.wait(cpu, [p_self] { return s_p_running == p_self; });
+    }
+}
+
+static void block(std::unique_lock<std::mutex>& cpu, TickType_t timeout) {
+    configASSERT(s_suspended == 0);
+
+    sim_task* const p_self = s_p_running;
+    p_self->state          = sim_task::BLOCKED;
+    p_self->wake = timeout == portMAX_DELAY ? portMAX_DELAY : s_tick + timeout;
+    switch_out(cpu, p_self);
+}
+
+static void task_entry(sim_task* p_self) {
+    {
+        std::unique_lock cpu(s_cpu);
+        p_self->cv.wait(cpu, [p_self] { return s_p_running == p_self; });
+    }
+
+    p_self->function();
+
+    std::unique_lock cpu(s_cpu);
+    p_self->state = sim_task::DONE;
+    --s_live;
+    switch_out(cpu, p_self);
+}
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+void sim::run(const std::vector<std::function<void()>>& tasks) {
+    std::unique_lock cpu(s_cpu);
+    s_tick      = 0;
+    s_suspended = 0;
+    s_live      = tasks.size();
+    for (const auto& function : tasks) {
+        auto p_task      = std::make_unique<sim_task>();
+        p_task->function = function;
+        s_ready.push_back(p_task.get());
+        s_tasks.push_back(std::move(p_task));
+    }
+    for (const auto& p_task : s_tasks) {
+        p_task->thread = std::thread(task_entry, p_task.get());
+    }
+
+    switch_out(cpu, nullptr);
+    s_done.wait(cpu, [] { return s_live == 0; });
+    cpu.unlock();
+
+    for (const auto& p_task : s_tasks) {
+        p_task->thread.join();
+    }
+    s_tasks.clear();
+}
+
+sim::counters sim::get_counters() {
+    std::unique_lock cpu(s_cpu);
+    return s_counters;
+}
+
+void sim::reset_counters() {
+    std::unique_lock cpu(s_cpu);
+    s_counters = {};
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return s_p_running; }
+
+TickType_t xTaskGetTickCount(void) { return s_tick; }
+
+void vTaskSuspendAll(void) {
+    ++s_counters.kernel_calls;
+    ++s_suspended;
+}
+
+BaseType_t xTaskResumeAll(void) {
+    configASSERT(s_suspended != 0);
+    ++s_counters.kernel_calls;
+    --s_suspended;
+    return pdFALSE;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    ++s_counters.kernel_calls;
+    std::unique_lock cpu(s_cpu);
+    if (ticks == 0) {
+        s_ready.push_back(s_p_running);
+        switch_out(cpu, s_p_running);
+    } else {
+        block(cpu, ticks);
+    }
+}
+
+void sim_task_yield(void) {
+    configASSERT(s_suspended == 0);
+    std::unique_lock cpu(s_cpu);
+    s_ready.push_back(s_p_running);
+    switch_out(cpu, s_p_running);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    ++s_counters.kernel_calls;
+    std::unique_lock cpu(s_cpu);
+    ++task->notify;
+    if (task->state == sim_task::BLOCKED && task->wants_notify) {
+        make_ready(task);
+    }
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+    ++s_counters.kernel_calls;
+    std::unique_lock cpu(s_cpu);
+    sim_task* const p_self = s_p_running;
+    if (p_self->notify == 0 && timeout != 0) {
+        p_self->wants_notify = true;
+        block(cpu, timeout);
+    }
+
+    const uint32_t VALUE = p_self->notify;
+    if (VALUE != 0) {
+        p_self->notify = clear_on_exit ? 0 : VALUE - 1;
+    }
+    return VALUE;
+}
+
+void vTaskSetTimeOutState(TimeOut_t* time_out) {
+    ++s_counters.kernel_calls;
+    time_out->xTimeOnEntering = s_tick;
+}
+
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* time_out, TickType_t* remaining) {
+    ++s_counters.kernel_calls;
+    if (*remaining == portMAX_DELAY) {
+        return pdFALSE;
+    }
+
+    const TickType_t ELAPSED = s_tick - time_out->xTimeOnEntering;
+    if (ELAPSED < *remaining) {
+        *remaining -= ELAPSED;
+        time_out->xTimeOnEntering = s_tick;
+        return pdFALSE;
+    }
+
+    *remaining = 0;
+    return pdTRUE;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return new sim_mutex; }
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+    configASSERT(mutex->waiters.empty());
+    delete mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t timeout) {
+    ++s_counters.kernel_calls;
+    std::unique_lock cpu(s_cpu);
+    sim_task* const p_self = s_p_running;
+    if (mutex->p_owner == nullptr) {
+        mutex->p_owner = p_self;
+        return pdTRUE;
+    }
+    if (timeout == 0) {
+        return pdFALSE;
+    }
+
+    mutex->waiters.push_back(p_self);
+    p_self->p_waiting_on = mutex;
+    block(cpu, timeout);
+    return mutex->p_owner == p_self ? pdTRUE : pdFALSE;
+}
+
+// Unlike a FreeRTOS mutex, any task may give it, as the two-mutex rw_lock
+// this stands in for did.  The first waiter is handed the mutex.
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    ++s_counters.kernel_calls;
+    std::unique_lock cpu(s_cpu);
+    if (mutex->waiters.empty()) {
+        mutex->p_owner = nullptr;
+    } else {
+        mutex->p_owner = mutex->waiters.front();
+        mutex->waiters.pop_front();
+        make_ready(mutex->p_owner);
+    }
+    return pdTRUE;
+}
+
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t mutex) {
+    std::unique_lock cpu(s_cpu);
+    return mutex->p_owner;
+}
+
+// EOF
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace sim {
+
+/// Kernel activity since the last reset_counters().
+struct counters {
+    /// Calls into the kernel API, not counting taskYIELD(),
+    /// xTaskGetCurrentTaskHandle() and xTaskGetTickCount().
+    uint64_t kernel_calls;
+
+    /// Times a different task was switched in.
+    uint64_t context_switches;
+};
+
+/**
+ * Runs the tasks, at one priority, until all have returned.
+ *
+ * Each task is a host thread, but only one runs at a time, as on the
+ * single-core target.  A task only gives up the processor when it blocks or
+ * yields, so tasks interleave wherever the code under test calls into the
+ * kernel, or the test calls taskYIELD().  Readied tasks run round-robin.
+ * Time stands still while a task is ready; when all are blocked the tick
+ * jumps to the first timeout.
+ */
+void run(const std::vector<std::function<void()>>& tasks);
+
+counters get_counters();
+void reset_counters();
+
+}  // namespace sim
@@ -0,0 +1,18 @@
+/**
+ * @file portmacro.h
+ *
+ * @brief Host test port types.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+
+#define pdMS_TO_TICKS(ms) \
+    ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000))
@@ -0,0 +1,27 @@
+/**
+ * @file semphr.h
+ *
+ * @brief The mutex API of the simulated kernel.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sim_mutex* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+void vSemaphoreDelete(SemaphoreHandle_t mutex);
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t mutex);
+
+#ifdef __cplusplus
+}
+#endif
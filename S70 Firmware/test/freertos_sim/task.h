@@ -0,0 +1,44 @@
+/**
+ * @file task.h
+ *
+ * @brief The task API of the simulated kernel.
+ */
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sim_task* TaskHandle_t;
+
+typedef struct {
+    TickType_t xTimeOnEntering;
+} TimeOut_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+TickType_t xTaskGetTickCount(void);
+
+void vTaskSuspendAll(void);
+BaseType_t xTaskResumeAll(void);
+
+/* Tasks only switch where they block or yield, so a critical section has
+ * nothing to exclude. */
+#define taskENTER_CRITICAL() ((void)0)
+#define taskEXIT_CRITICAL()  ((void)0)
+
+void vTaskDelay(TickType_t ticks);
+void sim_task_yield(void);
+#define taskYIELD() sim_task_yield()
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout);
+
+void vTaskSetTimeOutState(TimeOut_t* time_out);
+BaseType_t xTaskCheckForTimeOut(TimeOut_t* time_out, TickType_t* remaining);
+
+#ifdef __cplusplus
+}
+#endif
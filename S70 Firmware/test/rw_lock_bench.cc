@@ -0,0 +1,303 @@
+/**
+ * @file rw_lock_bench.cc
+ *
+ * @brief Host test and benchmark of sync::rw_lock against the two-mutex lock
+ * it replaced, on the simulated kernel in freertos_sim/.
+ *
+ * Checks that writers exclude everyone, that readers share the lock, that a
+ * timed-out writer lets the readers queued behind it through, and that no
+ * task notifications are left over.  Then counts the kernel calls and
+ * context switches per lock/unlock, and times them.  The host times stand in
+ * for kernel calls with host mutexes and threads, so only compare them
+ * between the two locks; the kernel call counts carry over to the target.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#include "freertos_sim.hh"
+#include "rw-lock.hh"
+#include "semphr.h"
+#include "task.h"
+
+/*****************************************************************************
+ * Constants
+ *****************************************************************************/
+static constexpr uint32_t UNCONTENDED_PAIRS = 1000000;
+static constexpr uint32_t CONTENDED_ROUNDS  = 20000;
+static constexpr uint32_t CHECK_ROUNDS      = 2000;
+
+// Tasks of the contended run, as the HID IN pipeline's slot queues are
+// read by the slot and USB tasks while registration writes.
+static constexpr uint32_t READERS = 3;
+static constexpr uint32_t WRITERS = 1;
+
+/*****************************************************************************
+ * Data Types
+ *****************************************************************************/
+namespace {
+
+/// \brief The rw_lock before it was rebuilt on an atomic state word.
+class two_mutex_lock {
+   public:
+    two_mutex_lock()
+        : _write_lock(xSemaphoreCreateMutex())
+        , _read_lock(xSemaphoreCreateMutex())
+        , _readers(0) {}
+
+    ~two_mutex_lock() {
+        vSemaphoreDelete(_write_lock);
+        vSemaphoreDelete(_read_lock);
+    }
+
+    void lock_reader() {
+        xSemaphoreTake(_read_lock, portMAX_DELAY);
+        if (++_readers == 1) {
+            xSemaphoreTake(_write_lock, portMAX_DELAY);
+        }
+        xSemaphoreGive(_read_lock);
+    }
+
+    void lock_writer() { xSemaphoreTake(_write_lock, portMAX_DELAY); }
+
+    void unlock_reader() {
+        xSemaphoreTake(_read_lock, portMAX_DELAY);
+        if (--_readers == 0) {
+            xSemaphoreGive(_write_lock);
+        }
+        xSemaphoreGive(_read_lock);
+    }
+
+    void unlock_writer() { xSemaphoreGive(_write_lock); }
+
+   private:
+    SemaphoreHandle_t _write_lock;
+    SemaphoreHandle_t _read_lock;
+    std::size_t _readers;
+};
+
+struct result {
+    double ns_per_pair;
+    double kernel_calls_per_pair;
+    double switches_per_pair;
+};
+
+}  // namespace
+
+/*****************************************************************************
+ * Static Data
+ *****************************************************************************/
+static unsigned s_failures;
+
+// Holders of the lock under test.
+static uint32_t s_readers_in;
+static uint32_t s_writers_in;
+static uint32_t s_max_readers_in;
+
+/*****************************************************************************
+ * Private Functions
+ *****************************************************************************/
+static void check(bool passed, const char* what) {
+    if (!passed) {
+        ++s_failures;
+        printf("FAIL %s\n", what);
+    }
+}
+
+static double seconds() {
+    return std::chrono::duration<double>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static result measure(const std::vector<std::function<void()>>& tasks,
+                      uint64_t pairs) {
+    sim::reset_counters();
+    const double START = seconds();
+    sim::run(tasks);
+    const double ELAPSED = seconds() - START;
+
+    const sim::counters COUNTERS = sim::get_counters();
+    return {ELAPSED * 1e9 / pairs, double(COUNTERS.kernel_calls) / pairs,
+            double(COUNTERS.context_switches) / pairs};
+}
+
+/// \brief One task locking and unlocking as a reader, then as a writer.
+template <typename Lock>
+static result uncontended(uint32_t pairs) {
+    Lock lock;
+    return measure({[&] {
+                       for (uint32_t i = 0; i < pairs; ++i) {
+                           lock.lock_reader();
+                           lock.unlock_reader();
+                           lock.lock_writer();
+                           lock.unlock_writer();
+                       }
+                   }},
+                   2ULL * pairs);
+}
+
+static void enter(bool writer) {
+    if (writer) {
+        check(s_readers_in == 0 && s_writers_in == 0, "writer excludes all");
+        ++s_writers_in;
+    } else {
+        check(s_writers_in == 0, "reader excludes writers");
+        ++s_readers_in;
+        if (s_readers_in > s_max_readers_in) {
+            s_max_readers_in = s_readers_in;
+        }
+    }
+}
+
+static void leave(bool writer) {
+    if (writer) {
+        --s_writers_in;
+    } else {
+        --s_readers_in;
+    }
+}
+
+/**
+ * Readers and writers each holding the lock across a yield, so every
+ * lock finds it held or waited on.  A yield before taking the lock again
+ * stands in for the work between.
+ */
+template <typename Lock>
+static result contended(uint32_t rounds) {
+    Lock lock;
+    std::vector<std::function<void()>> tasks;
+
+    s_readers_in     = 0;
+    s_writers_in     = 0;
+    s_max_readers_in = 0;
+    for (uint32_t t = 0; t < READERS + WRITERS; ++t) {
+        const bool WRITER = t >= READERS;
+        tasks.push_back([&lock, rounds, WRITER] {
+            for (uint32_t i = 0; i < rounds; ++i) {
+                if (WRITER) {
+                    lock.lock_writer();
+                } else {
+                    lock.lock_reader();
+                }
+                enter(WRITER);
+                taskYIELD();
+                leave(WRITER);
+                if (WRITER) {
+                    lock.unlock_writer();
+                } else {
+                    lock.unlock_reader();
+                }
+                taskYIELD();
+            }
+        });
+    }
+
+    const result RESULT =
+        measure(tasks, uint64_t(READERS + WRITERS) * rounds);
+    check(s_max_readers_in > 1, "readers share the lock");
+    return RESULT;
+}
+
+/// \brief Checks that contended waits leave no task notifications behind.
+static void test_notifications() {
+    sync::rw_lock lock;
+    std::vector<std::function<void()>> tasks;
+    for (uint32_t t = 0; t < READERS + WRITERS; ++t) {
+        const bool WRITER = t >= READERS;
+        tasks.push_back([&lock, WRITER] {
+            // One notification from another source, which must survive.
+            xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+            for (uint32_t i = 0; i < CHECK_ROUNDS; ++i) {
+                if (WRITER) {
+                    lock.lock_writer();
+                    taskYIELD();
+                    lock.unlock_writer();
+                } else {
+                    lock.lock_reader();
+                    taskYIELD();
+                    lock.unlock_reader();
+                }
+                taskYIELD();
+            }
+            check(ulTaskNotifyTake(pdTRUE, 0) == 1, "notifications kept");
+        });
+    }
+    sim::run(tasks);
+}
+
+/// \brief A writer timing out behind a reader lets the reader queued behind
+///        it through.
+static void test_writer_timeout() {
+    sync::rw_lock lock;
+    bool writer_timed_out = false;
+    bool late_reader_in   = false;
+
+    sim::run({
+        // Holds the lock as a reader for 10 ticks.
+        [&] {
+            lock.lock_reader();
+            vTaskDelay(10);
+            check(late_reader_in, "reader let through after writer timeout");
+            lock.unlock_reader();
+        },
+        // Waits 5 ticks as a writer.
+        [&] {
+            writer_timed_out = !lock.try_lock_writer(5);
+            check(xTaskGetTickCount() == 5, "writer timeout length");
+        },
+        // Queues behind the writer.
+        [&] {
+            taskYIELD();
+            check(lock.try_lock_reader(portMAX_DELAY), "late reader");
+            late_reader_in = true;
+            lock.unlock_reader();
+        },
+    });
+    check(writer_timed_out, "writer timed out");
+}
+
+static void print_result(const char* name, const result& NEW,
+                         const result& OLD, bool timing) {
+    printf("%s: kernel calls %.2f (two-mutex %.2f), context switches %.2f "
+           "(two-mutex %.2f)",
+           name, NEW.kernel_calls_per_pair, OLD.kernel_calls_per_pair,
+           NEW.switches_per_pair, OLD.switches_per_pair);
+    if (timing) {
+        printf(", %.1f ns (two-mutex %.1f, x%.1f)", NEW.ns_per_pair,
+               OLD.ns_per_pair, OLD.ns_per_pair / NEW.ns_per_pair);
+    }
+    printf(" per lock/unlock\n");
+}
+
+/*****************************************************************************
+ * Public Functions
+ *****************************************************************************/
+int main(int argc, char** argv) {
+    const bool TIMING = !(argc > 1 && strcmp(argv[1], "--no-timing") == 0);
+    const uint32_t UNCONTENDED = TIMING ? UNCONTENDED_PAIRS : CHECK_ROUNDS;
+    const uint32_t CONTENDED   = TIMING ? CONTENDED_ROUNDS : CHECK_ROUNDS;
+
+    test_notifications();
+    test_writer_timeout();
+
+    const result NEW_UNCONTENDED = uncontended<sync::rw_lock>(UNCONTENDED);
+    const result OLD_UNCONTENDED = uncontended<two_mutex_lock>(UNCONTENDED);
+    const result NEW_CONTENDED   = contended<sync::rw_lock>(CONTENDED);
+    const result OLD_CONTENDED   = contended<two_mutex_lock>(CONTENDED);
+
+    if (s_failures != 0) {
+        printf("%u check(s) failed\n", s_failures);
+        return 1;
+    }
+    printf("All rw_lock checks passed\n");
+
+    print_result("uncontended", NEW_UNCONTENDED, OLD_UNCONTENDED, TIMING);
+    print_result("contended", NEW_CONTENDED, OLD_CONTENDED, TIMING);
+    return 0;
+}
+
+// EOF
@@ -0,0 +1,241 @@
+/**
+ * @file spi_bridge_crc_test.c
+ *
+ * @brief Host test of the SPI bridge CRCs.  Checks the table-driven
+ * CRC-16/CCITT and CRC-32 against bitwise reference implementations on known
+ * vectors and random buffers, including CRCs continued across split buffers,
+ * then times both on block- and sector-sized buffers.
+ *
+ * Built once against each tree's copy of spi_bridge_crc.c, see the Makefile.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spi_bridge_crc.h"
+
+/****************************************************************************
+ * Defines
+ ****************************************************************************/
+#define RANDOM_BUFFERS		2000
+#define MAX_BUFFER_LENGTH	4096
+
+/* Largest SPI bridge block, header and payload.*/
+#define BLOCK_LENGTH		66
+
+/* An RT1064 firmware update sector.*/
+#define SECTOR_LENGTH		4096
+
+/* Bytes each timing loop runs over.*/
+#define TIMING_BYTES		(64UL * 1024 * 1024)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+static uint8_t buffer[MAX_BUFFER_LENGTH];
+static unsigned failures;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+static uint16_t reference_crc16(uint16_t crc, const uint8_t *p_data,
+		uint32_t length)
+{
+	for (uint32_t i = 0; i < length; ++i)
+	{
+		crc ^= (uint16_t)(p_data[i] << 8);
+		for (int bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021)
+					: (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+static uint32_t reference_crc32(uint32_t crc, const uint8_t *p_data,
+		uint32_t length)
+{
+	for (uint32_t i = 0; i < length; ++i)
+	{
+		crc ^= p_data[i];
+		for (int bit = 0; bit < 8; ++bit)
+		{
+			crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+		}
+	}
+
+	return crc;
+}
+
+static void check(bool passed, const char *what, uint32_t length,
+		uint32_t expected, uint32_t got)
+{
+	if (!passed)
+	{
+		++failures;
+		printf("FAIL %s, length %u: expected 0x%08X, got 0x%08X\n", what,
+				(unsigned)length, (unsigned)expected, (unsigned)got);
+	}
+}
+
+static void fill_random(uint8_t *p_data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; ++i)
+	{
+		p_data[i] = (uint8_t)rand();
+	}
+}
+
+static void test_known_vectors(void)
+{
+	static const uint8_t CHECK[] = "123456789";
+	const uint32_t LENGTH = sizeof(CHECK) - 1;
+
+	/* CRC-16/CCITT-FALSE check value.*/
+	uint16_t crc16 = spi_bridge_crc16(SPI_BRIDGE_CRC16_INIT, CHECK, LENGTH);
+	check(crc16 == 0x29B1, "crc16 check value", LENGTH, 0x29B1, crc16);
+
+	/* The CRC-32 check value 0xCBF43926 before its final xor.*/
+	uint32_t crc32 = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT, CHECK, LENGTH);
+	check(crc32 == 0x340BC6D9UL, "crc32 check value", LENGTH, 0x340BC6D9UL,
+			crc32);
+
+	/* Nothing to checksum leaves the initial value.*/
+	crc16 = spi_bridge_crc16(SPI_BRIDGE_CRC16_INIT, CHECK, 0);
+	check(crc16 == SPI_BRIDGE_CRC16_INIT, "crc16 empty", 0,
+			SPI_BRIDGE_CRC16_INIT, crc16);
+	crc32 = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT, CHECK, 0);
+	check(crc32 == SPI_BRIDGE_CRC32_INIT, "crc32 empty", 0,
+			SPI_BRIDGE_CRC32_INIT, crc32);
+
+	/* Every single byte value, which walks every table entry.*/
+	for (uint32_t value = 0; value < 256; ++value)
+	{
+		const uint8_t BYTE = (uint8_t)value;
+
+		crc16 = spi_bridge_crc16(SPI_BRIDGE_CRC16_INIT, &BYTE, 1);
+		const uint16_t REF16 = reference_crc16(SPI_BRIDGE_CRC16_INIT, &BYTE, 1);
+		check(crc16 == REF16, "crc16 single byte", 1, REF16, crc16);
+
+		crc32 = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT, &BYTE, 1);
+		const uint32_t REF32 = reference_crc32(SPI_BRIDGE_CRC32_INIT, &BYTE, 1);
+		check(crc32 == REF32, "crc32 single byte", 1, REF32, crc32);
+	}
+}
+
+static void test_random_buffers(void)
+{
+	for (int n = 0; n < RANDOM_BUFFERS; ++n)
+	{
+		/* Mostly bridge-block sized, some up to a sector.*/
+		const uint32_t LENGTH = (n % 4) ? (uint32_t)rand() % (BLOCK_LENGTH + 1)
+				: (uint32_t)rand() % (MAX_BUFFER_LENGTH + 1);
+		fill_random(buffer, LENGTH);
+
+		const uint16_t REF16 = reference_crc16(SPI_BRIDGE_CRC16_INIT, buffer,
+				LENGTH);
+		const uint32_t REF32 = reference_crc32(SPI_BRIDGE_CRC32_INIT, buffer,
+				LENGTH);
+
+		uint16_t crc16 = spi_bridge_crc16(SPI_BRIDGE_CRC16_INIT, buffer, LENGTH);
+		check(crc16 == REF16, "crc16 random", LENGTH, REF16, crc16);
+
+		uint32_t crc32 = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT, buffer, LENGTH);
+		check(crc32 == REF32, "crc32 random", LENGTH, REF32, crc32);
+
+		/* Continued over two pieces, as the bridge feeds header then payload.*/
+		const uint32_t SPLIT = LENGTH ? (uint32_t)rand() % (LENGTH + 1) : 0;
+		crc16 = spi_bridge_crc16(SPI_BRIDGE_CRC16_INIT, buffer, SPLIT);
+		crc16 = spi_bridge_crc16(crc16, buffer + SPLIT, LENGTH - SPLIT);
+		check(crc16 == REF16, "crc16 split", LENGTH, REF16, crc16);
+
+		crc32 = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT, buffer, SPLIT);
+		crc32 = spi_bridge_crc32(crc32, buffer + SPLIT, LENGTH - SPLIT);
+		check(crc32 == REF32, "crc32 split", LENGTH, REF32, crc32);
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* The sink keeps the compiler from dropping the timed calls.*/
+static volatile uint32_t sink;
+
+static void time_crcs(uint32_t length)
+{
+	const uint32_t PASSES = TIMING_BYTES / length;
+	fill_random(buffer, length);
+
+	double start = seconds();
+	for (uint32_t i = 0; i < PASSES; ++i)
+	{
+		sink = spi_bridge_crc16(SPI_BRIDGE_CRC16_INIT, buffer, length);
+	}
+	const double TABLE16 = seconds() - start;
+
+	start = seconds();
+	for (uint32_t i = 0; i < PASSES; ++i)
+	{
+		sink = reference_crc16(SPI_BRIDGE_CRC16_INIT, buffer, length);
+	}
+	const double BITWISE16 = seconds() - start;
+
+	start = seconds();
+	for (uint32_t i = 0; i < PASSES; ++i)
+	{
+		sink = spi_bridge_crc32(SPI_BRIDGE_CRC32_INIT, buffer, length);
+	}
+	const double TABLE32 = seconds() - start;
+
+	start = seconds();
+	for (uint32_t i = 0; i < PASSES; ++i)
+	{
+		sink = reference_crc32(SPI_BRIDGE_CRC32_INIT, buffer, length);
+	}
+	const double BITWISE32 = seconds() - start;
+
+	const double BYTES = (double)PASSES * length;
+	printf("%5u-byte buffers: crc16 %.2f ns/byte (bitwise %.2f, x%.1f), "
+			"crc32 %.2f ns/byte (bitwise %.2f, x%.1f)\n", (unsigned)length,
+			TABLE16 * 1e9 / BYTES, BITWISE16 * 1e9 / BYTES,
+			BITWISE16 / TABLE16, TABLE32 * 1e9 / BYTES,
+			BITWISE32 * 1e9 / BYTES, BITWISE32 / TABLE32);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+int main(int argc, char **argv)
+{
+	const bool TIMING = !(argc > 1 && strcmp(argv[1], "--no-timing") == 0);
+
+	srand(0x5B1);
+
+	test_known_vectors();
+	test_random_buffers();
+
+	if (failures != 0)
+	{
+		printf("%u check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All CRC checks passed\n");
+
+	if (TIMING)
+	{
+		time_crcs(BLOCK_LENGTH);
+		time_crcs(SECTOR_LENGTH);
+	}
+
+	return 0;
+}
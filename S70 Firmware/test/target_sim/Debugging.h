@@ -0,0 +1,9 @@
+/**
+ * @file Debugging.h
+ *
+ * @brief The host tests build without debug prints.
+ */
+
+#pragma once
+
+#define debug_print(...) ((void)0)
@@ -0,0 +1,10 @@
+/**
+ * @file apt.h
+ *
+ * @brief The APT protocol constants used by the host tests.
+ */
+
+#pragma once
+
+#define APT_COMMAND_SIZE 6
+#define HOST_ID          0x01
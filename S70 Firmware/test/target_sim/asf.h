@@ -0,0 +1,23 @@
+/**
+ * @file asf.h
+ *
+ * @brief The ASF and CMSIS pieces used by the host tests.  The DWT cycle
+ * counter reads 0.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "FreeRTOS.h"
+#include "compiler.h"
+#include "task.h"
+
+#define __DMB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+typedef struct {
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+extern DWT_Type sim_dwt;
+#define DWT (&sim_dwt)
@@ -0,0 +1,16 @@
+/**
+ * @file compiler.h
+ *
+ * @brief The ASF compiler.h helpers used by the host tests.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef size_t iram_size_t;
+
+#define Min(a, b) (((a) < (b)) ? (a) : (b))
+#define Max(a, b) (((a) > (b)) ? (a) : (b))
@@ -0,0 +1,244 @@
+/*
+ * Streamed firmware update
+ *
+ * The SPI bridge task owns the bus and only fills and submits buffers; the
+ * worker task owns the flash. A buffer is Free, Receiving while the bridge
+ * clocks a sector into it, or Queued until the worker has verified it.
+ */
+#include "rt_update_stream.h"
+
+#include "FreeRTOS.h"
+#include "fsl_common.h"
+#include "queue.h"
+#include "rt_update_flash.h"
+#include "spi_bridge_crc.h"
+#include "task.h"
+
+#include <string.h>
+
+#define RT_UPDATE_STREAM_ADDR_MIN (0x70000000UL)
+#define RT_UPDATE_STREAM_ADDR_MAX (0x70400000UL)
+
+typedef enum _rt_update_stream_state
+{
+    kRT_UpdateStreamFree = 0U,
+    kRT_UpdateStreamReceiving,
+    kRT_UpdateStreamQueued,
+} rt_update_stream_state_t;
+
+typedef struct _rt_update_stream_sector
+{
+    volatile rt_update_stream_state_t state;
+    uint32_t address;
+    uint16_t length;
+    uint32_t crc;
+} rt_update_stream_sector_t;
+
+/* Written by the LPSPI1 RX DMA, so kept out of the data cache. */
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_sectorData[RT_UPDATE_STREAM_BUFFERS][RT_UPDATE_SECTOR_SIZE], 4);
+
+static rt_update_stream_sector_t s_sectors[RT_UPDATE_STREAM_BUFFERS];
+static QueueHandle_t s_sectorQueue;
+static TaskHandle_t s_workerTask;
+
+static volatile uint16_t s_sectorsDone;
+static volatile uint8_t s_error;
+static volatile uint32_t s_errorAddress;
+
+static bool RT_UpdateStreamErased(const uint8_t *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; ++i)
+    {
+        if (data[i] != 0xFFU)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t RT_UpdateStreamWrite(uint8_t index)
+{
+    const rt_update_stream_sector_t *sector = &s_sectors[index];
+    const uint8_t *data                     = s_sectorData[index];
+    uint8_t page[RT_UPDATE_STREAM_PAGE_SIZE];
+    uint32_t crc = SPI_BRIDGE_CRC32_INIT;
+
+    if (!RT_UpdateFlashEraseSector(sector->address))
+    {
+        return RT_UPDATE_STATUS_ERR_ERASE;
+    }
+
+    /* Pages left at 0xFF already read back as erased. */
+    for (uint16_t offset = 0; offset < sector->length; offset += RT_UPDATE_STREAM_PAGE_SIZE)
+    {
+        uint16_t chunk = (uint16_t)MIN(RT_UPDATE_STREAM_PAGE_SIZE, sector->length - offset);
+
+        if (!RT_UpdateStreamErased(&data[offset], chunk) &&
+            !RT_UpdateFlashProgramPage(sector->address + offset, &data[offset], chunk))
+        {
+            return RT_UPDATE_STATUS_ERR_PROGRAM;
+        }
+    }
+
+    for (uint16_t offset = 0; offset < sector->length; offset += RT_UPDATE_STREAM_PAGE_SIZE)
+    {
+        uint16_t chunk = (uint16_t)MIN(RT_UPDATE_STREAM_PAGE_SIZE, sector->length - offset);
+
+        if (!RT_UpdateFlashRead(sector->address + offset, page, chunk))
+        {
+            return RT_UPDATE_STATUS_ERR_VERIFY;
+        }
+        crc = spi_bridge_crc32(crc, page, chunk);
+    }
+
+    return (crc == sector->crc) ? RT_UPDATE_STATUS_OK : RT_UPDATE_STATUS_ERR_VERIFY;
+}
+
+static void RT_UpdateStreamTask(void *param)
+{
+    (void)param;
+
+    while (1)
+    {
+        uint8_t index;
+
+        (void)xQueueReceive(s_sectorQueue, &index, portMAX_DELAY);
+
+        uint8_t result = RT_UpdateStreamWrite(index);
+
+        taskENTER_CRITICAL();
+        if ((result != RT_UPDATE_STATUS_OK) && (s_error == RT_UPDATE_STATUS_OK))
+        {
+            s_error        = result;
+            s_errorAddress = s_sectors[index].address;
+        }
+        ++s_sectorsDone;
+        s_sectors[index].state = kRT_UpdateStreamFree;
+        taskEXIT_CRITICAL();
+    }
+}
+
+bool RT_UpdateStreamStart(void)
+{
+    if (!RT_UpdateStreamIdle())
+    {
+        return false;
+    }
+
+    if (s_sectorQueue == NULL)
+    {
+        s_sectorQueue = xQueueCreate(RT_UPDATE_STREAM_BUFFERS, sizeof(uint8_t));
+        if (s_sectorQueue == NULL)
+        {
+            return false;
+        }
+    }
+
+    if ((s_workerTask == NULL) &&
+        (xTaskCreate(RT_UpdateStreamTask, "rt update", 1024L / sizeof(portSTACK_TYPE), NULL,
+                     RT_UPDATE_STREAM_TASK_PRIORITY, &s_workerTask) != pdPASS))
+    {
+        s_workerTask = NULL;
+        return false;
+    }
+
+    for (uint8_t i = 0; i < RT_UPDATE_STREAM_BUFFERS; ++i)
+    {
+        s_sectors[i].state = kRT_UpdateStreamFree;
+    }
+    s_sectorsDone  = 0U;
+    s_error        = RT_UPDATE_STATUS_OK;
+    s_errorAddress = 0U;
+
+    return true;
+}
+
+uint8_t *RT_UpdateStreamAcquire(void)
+{
+    if (s_workerTask == NULL)
+    {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < RT_UPDATE_STREAM_BUFFERS; ++i)
+    {
+        if (s_sectors[i].state == kRT_UpdateStreamFree)
+        {
+            s_sectors[i].state = kRT_UpdateStreamReceiving;
+            return s_sectorData[i];
+        }
+    }
+
+    return NULL;
+}
+
+void RT_UpdateStreamRelease(uint8_t *buffer)
+{
+    for (uint8_t i = 0; i < RT_UPDATE_STREAM_BUFFERS; ++i)
+    {
+        if (buffer == s_sectorData[i])
+        {
+            s_sectors[i].state = kRT_UpdateStreamFree;
+        }
+    }
+}
+
+uint8_t RT_UpdateStreamSubmit(uint8_t *buffer, uint32_t address, uint16_t length, uint32_t crc)
+{
+    uint8_t index = 0U;
+
+    while ((index < RT_UPDATE_STREAM_BUFFERS) && (buffer != s_sectorData[index]))
+    {
+        ++index;
+    }
+
+    if ((index == RT_UPDATE_STREAM_BUFFERS) || (length == 0U) || (length > RT_UPDATE_SECTOR_SIZE) ||
+        ((address % RT_UPDATE_SECTOR_SIZE) != 0U) || (address < RT_UPDATE_STREAM_ADDR_MIN) ||
+        (address >= RT_UPDATE_STREAM_ADDR_MAX))
+    {
+        RT_UpdateStreamRelease(buffer);
+        return RT_UPDATE_STATUS_ERR_BAD_ADDR;
+    }
+
+    s_sectors[index].address = address;
+    s_sectors[index].length  = length;
+    s_sectors[index].crc     = crc;
+    s_sectors[index].state   = kRT_UpdateStreamQueued;
+
+    /* The queue holds every buffer, so this never waits. */
+    (void)xQueueSend(s_sectorQueue, &index, 0U);
+
+    return RT_UPDATE_STATUS_OK;
+}
+
+void RT_UpdateStreamQuery(rt_update_stream_status_t *status)
+{
+    uint8_t freeBuffers = 0U;
+
+    taskENTER_CRITICAL();
+    for (uint8_t i = 0; i < RT_UPDATE_STREAM_BUFFERS; ++i)
+    {
+        if (s_sectors[i].state == kRT_UpdateStreamFree)
+        {
+            ++freeBuffers;
+        }
+    }
+    status->freeBuffers  = freeBuffers;
+    status->sectorsDone  = s_sectorsDone;
+    status->error        = s_error;
+    status->errorAddress = s_errorAddress;
+    taskEXIT_CRITICAL();
+}
+
+bool RT_UpdateStreamIdle(void)
+{
+    for (uint8_t i = 0; i < RT_UPDATE_STREAM_BUFFERS; ++i)
+    {
+        if (s_sectors[i].state == kRT_UpdateStreamQueued)
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Streamed firmware update
+ *
+ * Sectors sent with RT_UPDATE_CMD_WRITE_SECTOR are clocked by the SPI bridge
+ * task straight into one of two sector buffers, then handed to a worker task
+ * that erases, programs and verifies them. While the worker writes one sector
+ * the master streams the next into the other buffer, so the bus and the flash
+ * are busy at the same time.
+ */
+#ifndef RT_UPDATE_STREAM_H_
+#define RT_UPDATE_STREAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "spi_bridge_protocol.h"
+
+#define RT_UPDATE_STREAM_BUFFERS (2U)
+
+#define RT_UPDATE_STREAM_PAGE_SIZE (256U)
+
+#ifndef RT_UPDATE_STREAM_TASK_PRIORITY
+#define RT_UPDATE_STREAM_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+#endif
+
+typedef struct _rt_update_stream_status
+{
+    uint8_t freeBuffers;
+    uint16_t sectorsDone;
+    uint8_t error;        /* RT_UPDATE_STATUS_* of the first failed sector. */
+    uint32_t errorAddress;
+} rt_update_stream_status_t;
+
+/*!
+ * @brief Starts a streamed update, creating the worker task on first use.
+ *
+ * @return false if the worker could not be created or sectors are still being written.
+ */
+bool RT_UpdateStreamStart(void);
+
+/*!
+ * @brief Takes a free sector buffer for the bridge to receive into.
+ *
+ * @return NULL while both buffers are queued or being written.
+ */
+uint8_t *RT_UpdateStreamAcquire(void);
+
+/*!
+ * @brief Returns a buffer taken by @ref RT_UpdateStreamAcquire without writing it.
+ */
+void RT_UpdateStreamRelease(uint8_t *buffer);
+
+/*!
+ * @brief Queues a received sector for the worker.
+ *
+ * @return RT_UPDATE_STATUS_OK, or RT_UPDATE_STATUS_ERR_BAD_ADDR with the buffer released.
+ */
+uint8_t RT_UpdateStreamSubmit(uint8_t *buffer, uint32_t address, uint16_t length, uint32_t crc);
+
+/*!
+ * @brief Reads the progress of the update.
+ */
+void RT_UpdateStreamQuery(rt_update_stream_status_t *status);
+
+/*!
+ * @brief Returns whether every queued sector has been written.
+ */
+bool RT_UpdateStreamIdle(void);
+
+#endif /* RT_UPDATE_STREAM_H_ */
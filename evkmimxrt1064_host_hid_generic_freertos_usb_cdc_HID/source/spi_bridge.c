@@ -17,6 +17,26 @@
  * (1-byte header, 63-byte payload, 2-byte CRC) but transfers only
  * 1 + LEN + 2 bytes on the wire so the master avoids clocking the entire
  * register image on every poll.
+ *
+ * Bytes the slave has to decode before it knows what comes next (the command,
+ * a set mask or bitmap, a WRITE_BLOCK header) are exchanged by the task a
+ * byte at a time. Everything else is moved by an eDMA TX/RX channel pair on
+ * LPSPI1: every readable block is kept serialized with its CRC in a
+ * non-cacheable shadow image that is refreshed whenever the block changes, so
+ * a READ_BLOCK only has to arm the DMA and the data phase runs at the
+ * master's SCK without the CPU.
+ *
+ * READ_BLOCK and WRITE_BLOCK addressed to SPI_BRIDGE_EN_SET move several
+ * endpoints in one transaction:
+ *   - READ_DIRTY_SET: the master sends a mask of the ENs it wants, the slave
+ *     answers with the dirty bitmap (dirty & mask) and its complement, then
+ *     the block windows of those ENs in ascending order. The answer is one
+ *     DMA transfer, so the master only has to give the slave time to build
+ *     it after the mask.
+ *   - WRITE_SET: the master sends a bitmap of OUT ENs followed by their block
+ *     windows in ascending order.
+ * The hub status block carries the protocol version after the connected
+ * table so masters only use these commands with firmware that has them.
  */
 #include "spi_bridge.h"
 
@@ -26,15 +46,38 @@
 #include "fsl_clock.h"
 #include "pin_mux.h"
 #include "rt_update_flash.h"
+#include "rt_update_stream.h"
+#include "spi_bridge_crc.h"
 #include "spi_bridge_protocol.h"
 
 #include "semphr.h"
+#include "task.h"
 
 #include <stdio.h>
 #include <string.h>
 
 #define SPI_BRIDGE_SPI_TIMEOUT (1000000U)
 
+/* eDMA channels for the block windows. Channels 0 and 16 share the
+ * DMA0_DMA16 vector, which only the RX channel's major loop raises. */
+#define SPI_BRIDGE_DMA_RX_CHANNEL (0U)
+#define SPI_BRIDGE_DMA_TX_CHANNEL (1U)
+#define SPI_BRIDGE_DMA_IRQn       DMA0_DMA16_IRQn
+
+/* The master clocks a whole window in well under a tick; a window still open
+ * after this was abandoned mid-transfer. */
+#define SPI_BRIDGE_DMA_TIMEOUT pdMS_TO_TICKS(2U)
+
+/* The master reads a READ_DIRTY_SET answer one block at a time. */
+#define SPI_BRIDGE_SET_DMA_TIMEOUT pdMS_TO_TICKS(10U)
+
+/* A WRITE_SECTOR data phase is clocked in chunks by the master. */
+#define SPI_BRIDGE_SECTOR_DMA_TIMEOUT pdMS_TO_TICKS(50U)
+
+/* TX DMA refills while this many bytes are still queued, so the FIFO does not
+ * run dry between requests at full SCK. */
+#define SPI_BRIDGE_TX_WATERMARK (3U)
+
 #ifndef SPI_BRIDGE_SPI_BASE
 #define SPI_BRIDGE_SPI_BASE LPSPI1
 #endif
@@ -53,6 +96,12 @@ typedef enum _spi_bridge_command
 
 #define SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS (SPI_BRIDGE_MAX_DEVICES + 2U)
 
+/* Hub status payload: connected table (device slots + CDC), then the version. */
+#define SPI_BRIDGE_HUB_VERSION_INDEX (SPI_BRIDGE_MAX_DEVICES + 1U)
+#define SPI_BRIDGE_HUB_PAYLOAD_LENGTH (SPI_BRIDGE_HUB_VERSION_INDEX + 1U)
+
+_Static_assert(SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS <= 8U, "set command bitmaps are one byte");
+
 _Static_assert(SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS == (SPI_BRIDGE_MAX_DEVICES + 2U),
                "EN count must be hub + device slots + CDC endpoint");
 
@@ -93,6 +142,31 @@ static spi_bridge_block_t s_lastLoggedCdcOutBlock;
 static void SPI_BridgeLogState(bool force);
 static bool s_stateTraceEnabled = (SPI_BRIDGE_ENABLE_STATE_TRACE != 0U);
 static SemaphoreHandle_t s_spiBridgeSemaphore;
+static SemaphoreHandle_t s_spiBridgeDmaSemaphore;
+/* Woken when the V70 reads the CDC IN block or writes the CDC OUT block. */
+static TaskHandle_t s_cdcNotifyTask;
+
+/* Wire images (header + LEN payload + CRC) of the readable blocks, two per EN.
+ * A publish writes the image that is not at the front and then flips, so a
+ * window being sent is never rewritten by a single update. A second update
+ * during the same window can tear it; the CRC fails on the master and DIRTY
+ * stays set because the block no longer matches what was sent. */
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_shadowImages[SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS][2][SPI_BRIDGE_BLOCK_SIZE], 4);
+static volatile uint8_t s_shadowFront[SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS];
+
+/* DMA target for WRITE_BLOCK windows, the idle fill byte and an empty window
+ * for ENs without a block. */
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_dmaRxWindow[SPI_BRIDGE_BLOCK_SIZE], 4);
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_dmaFill, 4);
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_emptyWindow[3], 4);
+
+/* A READ_DIRTY_SET answer: the bitmap, its complement and a copy of each
+ * dirty window, sent as one DMA transfer. */
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_dmaSetWindow[2U + SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS * SPI_BRIDGE_BLOCK_SIZE], 4);
+
+/* DMA target for update command payloads (a page plus its address) and the
+ * source of their replies. */
+AT_NONCACHEABLE_SECTION_ALIGN(static uint8_t s_updatePayload[4U + RT_UPDATE_STREAM_PAGE_SIZE], 4);
 
 #define SPI_BRIDGE_TRACE(reason)                                                                                \
     do                                                                                                          \
@@ -147,47 +221,54 @@ static uint8_t SPI_BridgeMakeHeader(bool dirty, uint8_t type, uint8_t length)
                      ((length << SPI_BRIDGE_HEADER_LENGTH_SHIFT) & SPI_BRIDGE_HEADER_LENGTH_MASK));
 }
 
-static uint16_t SPI_BridgeCrcUpdate(uint16_t crc, uint8_t data)
+static uint16_t SPI_BridgeComputeBlockCrc(const uint8_t *block)
 {
-    crc ^= (uint16_t)data << 8U;
-    for (int i = 0; i < 8; ++i)
-    {
-        if ((crc & 0x8000U) != 0U)
-        {
-            crc = (uint16_t)((crc << 1U) ^ SPI_BRIDGE_CRC_POLY);
-        }
-        else
-        {
-            crc <<= 1U;
-        }
-    }
-    return crc;
+    uint8_t length = SPI_BridgeExtractLength(block[0]);
+
+    /* CRC covers the header and the active payload bytes. */
+    return spi_bridge_crc16(SPI_BRIDGE_CRC_INIT, block, 1U + length);
 }
 
-static uint16_t SPI_BridgeComputeBlockCrc(const uint8_t *block)
+static uint8_t SPI_BridgeSerializeBlockWindow(const spi_bridge_block_t *block, uint8_t *output);
+
+static uint8_t SPI_BridgeMapBlockToEn(const spi_bridge_block_t *block)
 {
-    uint8_t header = block[0];
-    uint8_t length = SPI_BridgeExtractLength(header);
-    uint16_t crc   = SPI_BRIDGE_CRC_INIT;
+    if (block == &s_hubStatus)
+    {
+        return 0U;
+    }
 
-    /* CRC covers the header and the active payload bytes. */
-    crc = SPI_BridgeCrcUpdate(crc, header);
-    for (uint8_t i = 0; i < length; ++i)
+    if (block == &s_cdcInBlock)
+    {
+        return SPI_BRIDGE_CDC_ENDPOINT_INDEX;
+    }
+
+    if ((block >= &s_inBlocks[0]) && (block < &s_inBlocks[SPI_BRIDGE_MAX_DEVICES]))
     {
-        crc = SPI_BridgeCrcUpdate(crc, block[1U + i]);
+        return (uint8_t)(1U + (block - &s_inBlocks[0]));
     }
 
-    return crc;
+    /* OUT blocks are only written by the master. */
+    return SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS;
 }
 
 static void SPI_BridgeUpdateBlockCrc(spi_bridge_block_t *block)
 {
-    uint8_t raw[SPI_BRIDGE_BLOCK_SIZE];
+    /* Header then the active payload bytes, in wire order. */
+    uint16_t crc = spi_bridge_crc16(SPI_BRIDGE_CRC_INIT, &block->header, 1U);
+    block->crc   = spi_bridge_crc16(crc, block->payload, SPI_BridgeExtractLength(block->header));
+
+    /* Every change to a readable block lands here, so its shadow image is
+     * rebuilt and published for the next READ_BLOCK. */
+    uint8_t en = SPI_BridgeMapBlockToEn(block);
+    if (en < SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS)
+    {
+        uint8_t back = (uint8_t)(s_shadowFront[en] ^ 1U);
 
-    /* Serialize to the raw wire format before recomputing CRC. */
-    raw[0] = block->header;
-    (void)memcpy(&raw[1], block->payload, SPI_BRIDGE_MAX_PAYLOAD_LENGTH);
-    block->crc = SPI_BridgeComputeBlockCrc(raw);
+        (void)SPI_BridgeSerializeBlockWindow(block, s_shadowImages[en][back]);
+        __DMB();
+        s_shadowFront[en] = back;
+    }
 }
 
 static void SPI_BridgeSerializeBlock(const spi_bridge_block_t *block, uint8_t *output)
@@ -230,11 +311,6 @@ static void SPI_BridgeMarkDirty(spi_bridge_block_t *block, bool dirty)
     SPI_BridgeUpdateBlockCrc(block);
 }
 
-static uint8_t SPI_BridgeGetWireLength(const spi_bridge_block_t *block)
-{
-    return (uint8_t)(SPI_BridgeExtractLength(block->header) + 3U);
-}
-
 static spi_bridge_block_t *SPI_BridgeMapEnToBlock(uint8_t en, bool writeDirection)
 {
     if (en >= SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS)
@@ -505,13 +581,14 @@ static void SPI_BridgeLogState(bool force)
 
 static void SPI_BridgeRebuildHubStatus(void)
 {
-    uint8_t payloadLength            = SPI_BRIDGE_MAX_DEVICES + 1U;
+    uint8_t payloadLength            = SPI_BRIDGE_HUB_PAYLOAD_LENGTH;
     uint8_t cleanHeader              = SPI_BridgeMakeHeader(false, 0U, payloadLength);
     s_connectedTable[SPI_BRIDGE_MAX_DEVICES] = 1U; /* CDC endpoint is always available. */
 
     /* Populate the hub bitmap payload then flag it dirty so the host reads it. */
     s_hubStatus.header = cleanHeader;
-    (void)memcpy(s_hubStatus.payload, s_connectedTable, payloadLength);
+    (void)memcpy(s_hubStatus.payload, s_connectedTable, sizeof(s_connectedTable));
+    s_hubStatus.payload[SPI_BRIDGE_HUB_VERSION_INDEX] = SPI_BRIDGE_PROTOCOL_VERSION;
     if (payloadLength < SPI_BRIDGE_MAX_PAYLOAD_LENGTH)
     {
         (void)memset(&s_hubStatus.payload[payloadLength], 0, SPI_BRIDGE_MAX_PAYLOAD_LENGTH - payloadLength);
@@ -558,6 +635,87 @@ static status_t SPI_BridgeTransferByte(LPSPI_Type *base, uint8_t txData, uint8_t
     return kStatus_Success;
 }
 
+static status_t SPI_BridgeDmaTransferTimeout(const uint8_t *txData,
+                                             uint8_t *rxData,
+                                             uint16_t length,
+                                             TickType_t timeout)
+{
+    LPSPI_Type *base = SPI_BRIDGE_SPI_BASE;
+
+    if (length == 0U)
+    {
+        return kStatus_Success;
+    }
+
+    /* TX: memory to TDR, or the fill byte repeated when there is nothing to send. */
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].SADDR         = (uint32_t)((txData != NULL) ? txData : &s_dmaFill);
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].SOFF          = (txData != NULL) ? 1U : 0U;
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].ATTR          = DMA_ATTR_SSIZE(0U) | DMA_ATTR_DSIZE(0U);
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].NBYTES_MLNO   = 1U;
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].SLAST         = 0;
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].DADDR         = (uint32_t)&base->TDR;
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].DOFF          = 0U;
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(length);
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(length);
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].DLAST_SGA     = 0;
+    DMA0->TCD[SPI_BRIDGE_DMA_TX_CHANNEL].CSR           = DMA_CSR_DREQ_MASK;
+
+    /* RX: RDR to memory, or into the fill byte to keep the FIFO drained. */
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].SADDR         = (uint32_t)&base->RDR;
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].SOFF          = 0U;
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].ATTR          = DMA_ATTR_SSIZE(0U) | DMA_ATTR_DSIZE(0U);
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].NBYTES_MLNO   = 1U;
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].SLAST         = 0;
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].DADDR         = (uint32_t)((rxData != NULL) ? rxData : &s_dmaFill);
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].DOFF          = (rxData != NULL) ? 1U : 0U;
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(length);
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(length);
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].DLAST_SGA     = 0;
+    DMA0->TCD[SPI_BRIDGE_DMA_RX_CHANNEL].CSR           = DMA_CSR_DREQ_MASK | DMA_CSR_INTMAJOR_MASK;
+
+    /* Drop a completion left over from an abandoned window. */
+    (void)xSemaphoreTake(s_spiBridgeDmaSemaphore, 0U);
+
+    DMA0->SERQ = SPI_BRIDGE_DMA_RX_CHANNEL;
+    DMA0->SERQ = SPI_BRIDGE_DMA_TX_CHANNEL;
+    base->DER  = LPSPI_DER_TDDE_MASK | LPSPI_DER_RDDE_MASK;
+
+    /* RX completes once the master has clocked the last byte. */
+    bool done = (xSemaphoreTake(s_spiBridgeDmaSemaphore, timeout) == pdTRUE);
+
+    base->DER  = 0U;
+    DMA0->CERQ = SPI_BRIDGE_DMA_TX_CHANNEL;
+    DMA0->CERQ = SPI_BRIDGE_DMA_RX_CHANNEL;
+
+    if (!done)
+    {
+        /* Bytes queued for the abandoned window must not lead the next one. */
+        base->CR |= LPSPI_CR_RTF_MASK | LPSPI_CR_RRF_MASK;
+        return kStatus_Fail;
+    }
+
+    return kStatus_Success;
+}
+
+static status_t SPI_BridgeDmaTransfer(const uint8_t *txData, uint8_t *rxData, uint16_t length)
+{
+    return SPI_BridgeDmaTransferTimeout(txData, rxData, length, SPI_BRIDGE_DMA_TIMEOUT);
+}
+
+void DMA0_DMA16_IRQHandler(void)
+{
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+
+    DMA0->CINT = SPI_BRIDGE_DMA_RX_CHANNEL;
+
+    if (s_spiBridgeDmaSemaphore != NULL)
+    {
+        (void)xSemaphoreGiveFromISR(s_spiBridgeDmaSemaphore, &higherPriorityTaskWoken);
+    }
+
+    portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
 static bool SPI_BridgeMasterRequestPending(void)
 {
     uint32_t status = SPI_BRIDGE_SPI_BASE->SR;
@@ -603,23 +761,30 @@ void LPSPI1_IRQHandler(void)
     portYIELD_FROM_ISR(higherPriorityTaskWoken);
 }
 
-static status_t SPI_BridgeHandleReadBlock(uint8_t en)
+/* Clears DIRTY once a block's window has been clocked out, unless the block was
+ * republished while it was being sent, so the new contents are read on the
+ * next poll. */
+static void SPI_BridgeWindowSent(spi_bridge_block_t *block, const uint8_t *window)
 {
-    spi_bridge_block_t *block = SPI_BridgeMapEnToBlock(en, false);
-    uint8_t serialized[SPI_BRIDGE_BLOCK_SIZE];
-    uint8_t length = 3U;
+    uint8_t length = (uint8_t)(SPI_BridgeExtractLength(window[0]) + 3U);
 
-    if (block != NULL)
-    {
-        length = SPI_BridgeGetWireLength(block);
-        (void)SPI_BridgeSerializeBlockWindow(block, serialized);
-    }
-    else
+    if ((block->header == window[0]) &&
+        (block->crc == (uint16_t)(window[length - 2U] | (window[length - 1U] << 8U))))
     {
-        (void)memset(serialized, 0, sizeof(serialized));
+        SPI_BridgeMarkDirty(block, false);
+
+        if ((block == &s_cdcInBlock) && (s_cdcNotifyTask != NULL))
+        {
+            (void)xTaskNotifyGive(s_cdcNotifyTask);
+        }
     }
+}
 
-    status_t status = kStatus_Success;
+static status_t SPI_BridgeHandleReadBlock(uint8_t en)
+{
+    spi_bridge_block_t *block = SPI_BridgeMapEnToBlock(en, false);
+    const uint8_t *window     = (block != NULL) ? s_shadowImages[en][s_shadowFront[en]] : s_emptyWindow;
+    uint8_t length            = (uint8_t)(SPI_BridgeExtractLength(window[0]) + 3U);
 
     /*
      * The master must clock exactly (1 + LEN + 2) bytes after issuing
@@ -627,19 +792,62 @@ static status_t SPI_BridgeHandleReadBlock(uint8_t en)
      * slave and should be ignored by the host if it chooses to send more than
      * the requested window.
      */
-    for (uint8_t i = 0; i < length; ++i)
+    status_t status = SPI_BridgeDmaTransfer(window, NULL, length);
+
+    if ((status == kStatus_Success) && (block != NULL))
+    {
+        SPI_BridgeWindowSent(block, window);
+    }
+
+    return status;
+}
+
+static status_t SPI_BridgeHandleReadDirtySet(void)
+{
+    uint8_t mask    = 0U;
+    status_t status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, 0U, &mask);
+
+    if (status != kStatus_Success)
     {
-        uint8_t rx;
-        status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, serialized[i], &rx);
-        if (status != kStatus_Success)
+        return status;
+    }
+
+    /* Snapshot the bitmap and windows first; blocks that turn dirty after it
+     * are left for the next poll so the master's byte count stays in step. */
+    uint8_t bitmap  = 0U;
+    uint16_t length = 2U;
+    for (uint8_t en = 0; en < SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS; ++en)
+    {
+        spi_bridge_block_t *block = SPI_BridgeMapEnToBlock(en, false);
+
+        if ((block != NULL) && ((mask & (1U << en)) != 0U) &&
+            ((block->header & SPI_BRIDGE_HEADER_DIRTY_MASK) != 0U))
         {
-            break;
+            const uint8_t *window = s_shadowImages[en][s_shadowFront[en]];
+            uint8_t size          = (uint8_t)(SPI_BridgeExtractLength(window[0]) + 3U);
+
+            bitmap |= (uint8_t)(1U << en);
+            (void)memcpy(&s_dmaSetWindow[length], window, size);
+            length = (uint16_t)(length + size);
         }
     }
 
-    if ((status == kStatus_Success) && (block != NULL))
+    /* The complement lets the master tell an idle bridge from a silent bus. */
+    s_dmaSetWindow[0] = bitmap;
+    s_dmaSetWindow[1] = (uint8_t)~bitmap;
+
+    /* One transfer, so the master only has to wait for the slave after the
+     * mask and can clock the answer through without gaps. */
+    status = SPI_BridgeDmaTransferTimeout(s_dmaSetWindow, NULL, length, SPI_BRIDGE_SET_DMA_TIMEOUT);
+
+    const uint8_t *window = &s_dmaSetWindow[2];
+    for (uint8_t en = 0; (status == kStatus_Success) && (en < SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS); ++en)
     {
-        SPI_BridgeMarkDirty(block, false);
+        if ((bitmap & (1U << en)) != 0U)
+        {
+            SPI_BridgeWindowSent(SPI_BridgeMapEnToBlock(en, false), window);
+            window += SPI_BridgeExtractLength(window[0]) + 3U;
+        }
     }
 
     return status;
@@ -652,7 +860,7 @@ static status_t SPI_BridgeHandleWriteBlock(uint8_t en, bool *activityOut)
         *activityOut = false;
     }
 
-    uint8_t raw[SPI_BRIDGE_BLOCK_SIZE];
+    uint8_t *raw    = s_dmaRxWindow;
     status_t status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, 0U, &raw[0]);
 
     if (status != kStatus_Success)
@@ -673,13 +881,10 @@ static status_t SPI_BridgeHandleWriteBlock(uint8_t en, bool *activityOut)
      * clocks would leave data queued in the RX FIFO and corrupt subsequent
      * commands.
      */
-    for (uint8_t i = 1U; i < total; ++i)
+    status = SPI_BridgeDmaTransfer(NULL, &raw[1], (uint8_t)(total - 1U));
+    if (status != kStatus_Success)
     {
-        status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, 0U, &raw[i]);
-        if (status != kStatus_Success)
-        {
-            return status;
-        }
+        return status;
     }
 
     spi_bridge_block_t *block = SPI_BridgeMapEnToBlock(en, true);
@@ -699,6 +904,11 @@ static status_t SPI_BridgeHandleWriteBlock(uint8_t en, bool *activityOut)
         SPI_BridgeLogHexBuffer(block->payload, length);
         SPI_BridgeLogOut(deviceId, false, true);
 
+        if ((block == &s_cdcOutBlock) && (s_cdcNotifyTask != NULL))
+        {
+            (void)xTaskNotifyGive(s_cdcNotifyTask);
+        }
+
         if (activityOut != NULL)
         {
             *activityOut = true;
@@ -708,13 +918,39 @@ static status_t SPI_BridgeHandleWriteBlock(uint8_t en, bool *activityOut)
     return status;
 }
 
+static status_t SPI_BridgeHandleWriteSet(bool *activityOut)
+{
+    uint8_t bitmap  = 0U;
+    status_t status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, 0U, &bitmap);
+
+    if (activityOut != NULL)
+    {
+        *activityOut = false;
+    }
+
+    for (uint8_t en = 0; (status == kStatus_Success) && (en < SPI_BRIDGE_MAX_LOGICAL_ENDPOINTS); ++en)
+    {
+        if ((bitmap & (1U << en)) != 0U)
+        {
+            bool blockActivity = false;
+            status             = SPI_BridgeHandleWriteBlock(en, &blockActivity);
+            if (activityOut != NULL)
+            {
+                *activityOut |= blockActivity;
+            }
+        }
+    }
+
+    return status;
+}
+
 static status_t SPI_BridgeHandleUpdateCommand(void)
 {
     status_t status;
-    uint8_t command = 0U;
+    uint8_t command        = 0U;
     uint8_t payload_length = 0U;
-    uint8_t payload[260];
-    uint8_t sink = 0U;
+    uint8_t *payload       = s_updatePayload;
+    uint8_t sink           = 0U;
 
     status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, 0U, &command);
     if (status != kStatus_Success)
@@ -728,34 +964,32 @@ static status_t SPI_BridgeHandleUpdateCommand(void)
         return status;
     }
 
-    if (payload_length > sizeof(payload))
+    if (payload_length > sizeof(s_updatePayload))
     {
         payload_length = 0U;
     }
 
-    for (uint8_t i = 0; i < payload_length; ++i)
+    status = SPI_BridgeDmaTransfer(NULL, payload, payload_length);
+    if (status != kStatus_Success)
     {
-        status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, 0U, &payload[i]);
-        if (status != kStatus_Success)
-        {
-            return status;
-        }
+        return status;
     }
 
+    /* Replies after the status byte are sent from the payload buffer once the
+     * payload has been used. */
     uint8_t reply_status = RT_UPDATE_STATUS_ERR_PROGRAM;
-    uint8_t read_length = 0U;
-    uint8_t read_buffer[256];
+    uint16_t reply_length = 0U;
+    uint32_t address;
     bool ok = false;
 
     switch (command)
     {
         case RT_UPDATE_CMD_ENTER_UPDATE_MODE:
-            ok = RT_UpdateFlashEnter();
+            ok = RT_UpdateFlashEnter() && RT_UpdateStreamStart();
             break;
         case RT_UPDATE_CMD_ERASE_SECTOR:
             if (payload_length == 4U)
             {
-                uint32_t address;
                 memcpy(&address, payload, sizeof(address));
                 ok = RT_UpdateFlashEraseSector(address);
             }
@@ -763,7 +997,6 @@ static status_t SPI_BridgeHandleUpdateCommand(void)
         case RT_UPDATE_CMD_PROGRAM_PAGE:
             if (payload_length >= 4U)
             {
-                uint32_t address;
                 memcpy(&address, payload, sizeof(address));
                 ok = RT_UpdateFlashProgramPage(address, payload + 4U, payload_length - 4U);
             }
@@ -771,23 +1004,79 @@ static status_t SPI_BridgeHandleUpdateCommand(void)
         case RT_UPDATE_CMD_READ_BACK:
             if (payload_length == 6U)
             {
-                uint32_t address;
                 uint16_t length;
                 memcpy(&address, payload, sizeof(address));
                 memcpy(&length, payload + 4U, sizeof(length));
-                read_length = (length > sizeof(read_buffer)) ? sizeof(read_buffer) : (uint8_t)length;
-                ok = RT_UpdateFlashRead(address, read_buffer, read_length);
+                reply_length = MIN(length, RT_UPDATE_STREAM_PAGE_SIZE);
+                ok           = RT_UpdateFlashRead(address, payload, reply_length);
+                if (!ok)
+                {
+                    (void)memset(payload, 0, reply_length);
+                }
             }
             break;
         case RT_UPDATE_CMD_FINALIZE_AND_REBOOT:
+            if (!RT_UpdateStreamIdle())
+            {
+                reply_status = RT_UPDATE_STATUS_ERR_BUSY;
+                break;
+            }
             ok = RT_UpdateFlashFinalize();
             break;
+        case RT_UPDATE_CMD_WRITE_SECTOR:
+            if (payload_length == RT_UPDATE_SECTOR_HEADER_LENGTH)
+            {
+                uint16_t length;
+                uint32_t crc;
+                memcpy(&address, payload, sizeof(address));
+                memcpy(&length, payload + 4U, sizeof(length));
+                memcpy(&crc, payload + 6U, sizeof(crc));
+
+                /* Without a free buffer the data is still clocked in, into the
+                 * fill byte, so the master stays in step and retries. */
+                uint8_t *sector = (length <= RT_UPDATE_SECTOR_SIZE) ? RT_UpdateStreamAcquire() : NULL;
+
+                status = SPI_BridgeDmaTransferTimeout(NULL, sector, length, SPI_BRIDGE_SECTOR_DMA_TIMEOUT);
+                if (status != kStatus_Success)
+                {
+                    if (sector != NULL)
+                    {
+                        RT_UpdateStreamRelease(sector);
+                    }
+                    return status;
+                }
+
+                if (sector != NULL)
+                {
+                    reply_status = RT_UpdateStreamSubmit(sector, address, length, crc);
+                }
+                else
+                {
+                    reply_status = (length <= RT_UPDATE_SECTOR_SIZE) ? RT_UPDATE_STATUS_ERR_BUSY
+                                                                     : RT_UPDATE_STATUS_ERR_BAD_ADDR;
+                }
+            }
+            break;
+        case RT_UPDATE_CMD_QUERY:
+        {
+            rt_update_stream_status_t progress;
+            RT_UpdateStreamQuery(&progress);
+
+            reply_status = progress.error;
+            payload[0]   = progress.freeBuffers;
+            memcpy(&payload[1], &progress.sectorsDone, sizeof(progress.sectorsDone));
+            memcpy(&payload[3], &progress.errorAddress, sizeof(progress.errorAddress));
+            reply_length = RT_UPDATE_QUERY_REPLY_LENGTH;
+            break;
+        }
         default:
-            ok = false;
             break;
     }
 
-    reply_status = ok ? RT_UPDATE_STATUS_OK : RT_UPDATE_STATUS_ERR_PROGRAM;
+    if (ok)
+    {
+        reply_status = RT_UPDATE_STATUS_OK;
+    }
 
     status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, reply_status, &sink);
     if (status != kStatus_Success)
@@ -795,20 +1084,7 @@ static status_t SPI_BridgeHandleUpdateCommand(void)
         return status;
     }
 
-    if (command == RT_UPDATE_CMD_READ_BACK)
-    {
-        for (uint8_t i = 0; i < read_length; ++i)
-        {
-            uint8_t value = ok ? read_buffer[i] : 0x00U;
-            status = SPI_BridgeTransferByte(SPI_BRIDGE_SPI_BASE, value, &sink);
-            if (status != kStatus_Success)
-            {
-                return status;
-            }
-        }
-    }
-
-    return kStatus_Success;
+    return SPI_BridgeDmaTransfer(payload, NULL, reply_length);
 }
 
 static bool SPI_BridgeHandleCommand(void)
@@ -837,6 +1113,12 @@ static bool SPI_BridgeHandleCommand(void)
             (void)SPI_BridgeHandleReadHeader(en);
             break;
         case kSPI_BridgeCommandReadBlock:
+            if (en == SPI_BRIDGE_EN_SET)
+            {
+                status   = SPI_BridgeHandleReadDirtySet();
+                activity = (status == kStatus_Success);
+                break;
+            }
             block  = SPI_BridgeMapEnToBlock(en, false);
             dirtyBefore = (block != NULL) && ((block->header & SPI_BRIDGE_HEADER_DIRTY_MASK) != 0U);
             status = SPI_BridgeHandleReadBlock(en);
@@ -848,7 +1130,8 @@ static bool SPI_BridgeHandleCommand(void)
         case kSPI_BridgeCommandWriteBlock:
         {
             bool writeActivity = false;
-            status            = SPI_BridgeHandleWriteBlock(en, &writeActivity);
+            status            = (en == SPI_BRIDGE_EN_SET) ? SPI_BridgeHandleWriteSet(&writeActivity)
+                                                          : SPI_BridgeHandleWriteBlock(en, &writeActivity);
             activity |= writeActivity;
             break;
         }
@@ -872,15 +1155,17 @@ static bool SPI_BridgeHandleCommand(void)
 status_t SPI_BridgeInit(void)
 {
     SPI_BRIDGE_LOG("SPI_BridgeInit: starting\r\n");
-    /* Configure LPSPI1 as an 8-bit slave before any transfers occur. */
+    /* Configure LPSPI1 as an 8-bit slave before any transfers occur. The
+     * slave samples SCK with its functional clock, PLL3 PFD0 (261.8 MHz) / 4
+     * = 65.5 MHz, over four times the master's 15 MHz set command clock. */
     CLOCK_SetMux(kCLOCK_LpspiMux, 1U);
-    CLOCK_SetDiv(kCLOCK_LpspiDiv, 7U);
+    CLOCK_SetDiv(kCLOCK_LpspiDiv, 3U);
     CLOCK_EnableClock(kCLOCK_Lpspi1);
 
     SPI_BRIDGE_SPI_BASE->CR = LPSPI_CR_RST_MASK;
     SPI_BRIDGE_SPI_BASE->CR = 0U;
     SPI_BRIDGE_SPI_BASE->CFGR1 = LPSPI_CFGR1_MASTER(0U) | LPSPI_CFGR1_NOSTALL(1U);
-    SPI_BRIDGE_SPI_BASE->FCR   = LPSPI_FCR_TXWATER(0U) | LPSPI_FCR_RXWATER(0U);
+    SPI_BRIDGE_SPI_BASE->FCR   = LPSPI_FCR_TXWATER(SPI_BRIDGE_TX_WATERMARK) | LPSPI_FCR_RXWATER(0U);
     SPI_BRIDGE_SPI_BASE->TCR   = LPSPI_TCR_FRAMESZ(7U) | LPSPI_TCR_PCS(0U) | LPSPI_TCR_CPHA(0U) |
                                LPSPI_TCR_CPOL(0U);
     SPI_BRIDGE_SPI_BASE->CR    = LPSPI_CR_MEN_MASK;
@@ -894,6 +1179,24 @@ status_t SPI_BridgeInit(void)
     NVIC_SetPriority(LPSPI1_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
     NVIC_EnableIRQ(LPSPI1_IRQn);
 
+    /* Route the LPSPI1 DMA requests to the window channels. */
+    s_spiBridgeDmaSemaphore = xSemaphoreCreateBinary();
+    if (s_spiBridgeDmaSemaphore == NULL)
+    {
+        return kStatus_Fail;
+    }
+
+    CLOCK_EnableClock(kCLOCK_Dma);
+    DMA0->CERQ = SPI_BRIDGE_DMA_RX_CHANNEL;
+    DMA0->CERQ = SPI_BRIDGE_DMA_TX_CHANNEL;
+    DMAMUX->CHCFG[SPI_BRIDGE_DMA_RX_CHANNEL] =
+        DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(kDmaRequestMuxLPSPI1Rx);
+    DMAMUX->CHCFG[SPI_BRIDGE_DMA_TX_CHANNEL] =
+        DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(kDmaRequestMuxLPSPI1Tx);
+
+    NVIC_SetPriority(SPI_BRIDGE_DMA_IRQn, configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY);
+    NVIC_EnableIRQ(SPI_BRIDGE_DMA_IRQn);
+
     (void)memset(&s_hubStatus, 0, sizeof(s_hubStatus));
     (void)memset(s_inBlocks, 0, sizeof(s_inBlocks));
     (void)memset(s_outBlocks, 0, sizeof(s_outBlocks));
@@ -912,6 +1215,18 @@ status_t SPI_BridgeInit(void)
     (void)memset(&s_lastLoggedCdcOutBlock, 0, sizeof(s_lastLoggedCdcOutBlock));
     s_lastHubLoggedHeader = 0U;
 
+    /* The non-cacheable section is not zeroed at startup. Publish the empty
+     * blocks so every EN has a valid window before the first READ_BLOCK. */
+    (void)memset(s_shadowImages, 0, sizeof(s_shadowImages));
+    (void)memset((void *)s_shadowFront, 0, sizeof(s_shadowFront));
+    (void)memset(s_emptyWindow, 0, sizeof(s_emptyWindow));
+    s_dmaFill = 0U;
+    for (uint8_t deviceId = 0; deviceId < SPI_BRIDGE_MAX_DEVICES; ++deviceId)
+    {
+        SPI_BridgeUpdateBlockCrc(&s_inBlocks[deviceId]);
+    }
+    SPI_BridgeUpdateBlockCrc(&s_cdcInBlock);
+
     SPI_BridgeRebuildHubStatus();
 
     SPI_BRIDGE_LOG("SPI_BridgeInit: done\r\n");
@@ -1000,6 +1315,7 @@ status_t SPI_BridgeRemoveDevice(uint8_t deviceId)
     s_connectedTable[deviceId] = 0U;
     (void)memset(&s_inBlocks[deviceId], 0, sizeof(s_inBlocks[deviceId]));
     (void)memset(&s_outBlocks[deviceId], 0, sizeof(s_outBlocks[deviceId]));
+    SPI_BridgeUpdateBlockCrc(&s_inBlocks[deviceId]);
 
     SPI_BridgeRebuildHubStatus();
 
@@ -1148,3 +1464,13 @@ status_t SPI_BridgeClearCdcOut(void)
     SPI_BRIDGE_TRACE("host consumed CDC OUT payload");
     return kStatus_Success;
 }
+
+bool SPI_BridgeCdcInPending(void)
+{
+    return (s_cdcInBlock.header & SPI_BRIDGE_HEADER_DIRTY_MASK) != 0U;
+}
+
+void SPI_BridgeSetCdcNotifyTask(TaskHandle_t task)
+{
+    s_cdcNotifyTask = task;
+}
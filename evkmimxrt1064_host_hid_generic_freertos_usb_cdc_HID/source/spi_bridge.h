@@ -19,6 +19,9 @@
 
 #include "fsl_common.h"
 
+#include "FreeRTOS.h"
+#include "task.h"
+
 #ifndef SPI_BRIDGE_ENABLE_DEBUG
 #define SPI_BRIDGE_ENABLE_DEBUG (1U)
 #endif
@@ -135,6 +138,18 @@ bool SPI_BridgeGetCdcOut(uint8_t *typeOut, uint8_t *payloadOut, uint8_t *lengthO
  */
 status_t SPI_BridgeClearCdcOut(void);
 
+/*!
+ * @brief Returns whether the CDC IN block still holds data the V70 has not read.
+ */
+bool SPI_BridgeCdcInPending(void);
+
+/*!
+ * @brief Sets the task notified when the V70 reads the CDC IN block or writes the CDC OUT block.
+ *
+ * The notification is given from the SPI bridge task. Pass NULL to stop notifying.
+ */
+void SPI_BridgeSetCdcNotifyTask(TaskHandle_t task);
+
 /*!
  * @brief Enables or disables state-change logging at runtime.
  *
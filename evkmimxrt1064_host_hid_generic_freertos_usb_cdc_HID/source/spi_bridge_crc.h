@@ -0,0 +1,34 @@
+#ifndef SPI_BRIDGE_CRC_H_
+#define SPI_BRIDGE_CRC_H_
+
+#include <stdint.h>
+
+/* CRC-16/CCITT (poly 0x1021, no reflection, no final xor) used by the SPI
+ * bridge blocks. This file is kept identical on the RT1064 and the S70. */
+#define SPI_BRIDGE_CRC16_INIT 0xFFFFU
+
+/* CRC-32 (reflected poly 0xEDB88320, no final xor) of a firmware update
+ * sector, checked against the flash after it is programmed. */
+#define SPI_BRIDGE_CRC32_INIT 0xFFFFFFFFUL
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Continues a CRC over length bytes. Start a block with SPI_BRIDGE_CRC16_INIT
+ * and feed the header and payload in wire order.
+ */
+uint16_t spi_bridge_crc16(uint16_t crc, const uint8_t *p_data, uint32_t length);
+
+/*
+ * Continues a CRC-32 over length bytes. Start with SPI_BRIDGE_CRC32_INIT.
+ */
+uint32_t spi_bridge_crc32(uint32_t crc, const uint8_t *p_data, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPI_BRIDGE_CRC_H_ */
@@ -3,11 +3,43 @@
 
 #include <stdint.h>
 
+/* Multi-endpoint commands, sent as READ_BLOCK / WRITE_BLOCK to a reserved EN.
+ * The master only uses them once the hub status block reports a protocol
+ * version of at least SPI_BRIDGE_VERSION_SET_COMMANDS.  From
+ * SPI_BRIDGE_VERSION_FAST_SETS the slave sends the whole READ_DIRTY_SET answer
+ * as one DMA transfer, so the master only waits for it after the mask and may
+ * clock set commands faster. */
+#define SPI_BRIDGE_EN_SET               0x3FU
+#define SPI_BRIDGE_PROTOCOL_VERSION     3U
+#define SPI_BRIDGE_VERSION_SET_COMMANDS 1U
+#define SPI_BRIDGE_VERSION_STREAM_UPDATE 2U
+#define SPI_BRIDGE_VERSION_FAST_SETS    3U
+
 #define RT_UPDATE_CMD_ENTER_UPDATE_MODE   0x01U
 #define RT_UPDATE_CMD_ERASE_SECTOR        0x02U
 #define RT_UPDATE_CMD_PROGRAM_PAGE        0x03U
 #define RT_UPDATE_CMD_READ_BACK           0x04U
 #define RT_UPDATE_CMD_FINALIZE_AND_REBOOT 0x05U
+#define RT_UPDATE_CMD_WRITE_SECTOR       0x06U
+#define RT_UPDATE_CMD_QUERY               0x07U
+
+/* Update commands are sent after SPI_BRIDGE_OP_UPDATE as the command, a
+ * payload length, the payload, then a status byte clocked back from the
+ * RT1064 (plus any reply bytes).
+ *
+ * WRITE_SECTOR carries the sector header (address, data length, CRC-32 of the
+ * data; little endian) as its payload, and the data follows the payload
+ * before the status byte.  The RT1064 answers OK once the sector is queued,
+ * or ERR_BUSY while both of its sector buffers are in use.  Each queued sector
+ * is erased, programmed and read back against the CRC-32 while the next one
+ * is being clocked in.
+ *
+ * QUERY replies with the free sector buffers, the sectors finished (u16) and
+ * the address of the first sector that failed (u32).  Its status is the
+ * first failure, or OK. */
+#define RT_UPDATE_SECTOR_SIZE             4096U
+#define RT_UPDATE_SECTOR_HEADER_LENGTH    10U
+#define RT_UPDATE_QUERY_REPLY_LENGTH      7U
 
 #define RT_UPDATE_STATUS_OK           0x00U
 #define RT_UPDATE_STATUS_ERR_BAD_ADDR 0x01U
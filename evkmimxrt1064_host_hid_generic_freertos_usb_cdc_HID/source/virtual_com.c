@@ -43,6 +43,12 @@ extern uint8_t USB_EnterLowpowerMode(void);
 #define CDC_APP_TASK_STACK_SIZE 5000L
 #endif
 
+#define CDC_VCOM_RX_RING_MASK (CDC_VCOM_RX_RING_SIZE - 1U)
+
+#if ((CDC_VCOM_RX_RING_SIZE & CDC_VCOM_RX_RING_MASK) != 0U) || (CDC_VCOM_RX_RING_SIZE < (2U * CDC_DATA_BUFF_SIZE))
+#error "CDC_VCOM_RX_RING_SIZE must be a power of 2 of at least two bulk OUT packets"
+#endif
+
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
@@ -62,6 +68,9 @@ usb_status_t USB_DeviceCdcVcomCallback(class_handle_t handle, uint32_t event, vo
 usb_status_t USB_DeviceCallback(usb_device_handle handle, uint32_t event, void *param);
 usb_status_t USB_DeviceCdcVcomInit(void);
 void USB_DeviceCdcVcomIsr(void);
+static void CDC_VCOM_FreeRTOSEnterCritical(uint32_t *sr);
+static void CDC_VCOM_FreeRTOSExitCritical(uint32_t sr);
+static void USB_DeviceCdcVcomPrimeRecv(void);
 
 /*******************************************************************************
  * Variables
@@ -99,8 +108,17 @@ USB_DMA_NONINIT_DATA_ALIGN(USB_DATA_ALIGN_SIZE) static usb_cdc_acm_info_t s_usbC
 /* Data buffer for receiving and sending*/
 USB_DMA_NONINIT_DATA_ALIGN(USB_DATA_ALIGN_SIZE) static uint8_t s_currRecvBuf[CDC_DATA_BUFF_SIZE];
 USB_DMA_NONINIT_DATA_ALIGN(USB_DATA_ALIGN_SIZE) static uint8_t s_currSendBuf[CDC_DATA_BUFF_SIZE];
-volatile static uint32_t s_recvSize = 0;
-volatile static uint32_t s_sendSize = 0;
+/* Host to V70 bytes. The bulk OUT callback (USB device task) writes at the head,
+ * the app task moves them out as CDC IN bridge blocks from the tail. Both are
+ * free running. */
+static uint8_t s_rxRing[CDC_VCOM_RX_RING_SIZE];
+volatile static uint32_t s_rxHead = 0;
+volatile static uint32_t s_rxTail = 0;
+/* Set while a receive is scheduled on the bulk OUT endpoint. With none
+ * scheduled the controller NAKs the host, which is how a full ring pushes back. */
+volatile static uint8_t s_recvPrimed = 0;
+/* Set from a bulk IN send until its completion. */
+volatile static uint8_t s_sendBusy = 0;
 
 /* USB device class information */
 static usb_device_class_config_struct_t s_cdcAcmConfig[1] = {{
@@ -128,14 +146,11 @@ volatile static uint8_t s_comOpen            = 0;
 /*!
  * @brief CDC class specific callback function.
  *
- * This function handles the CDC class specific requests. For the current case, device is waiting for data from host.
- * Once device receives data, kUSB_DeviceCdcEventRecvResponse event will be asserted. In kUSB_DeviceCdcEventRecvResponse
- * event, the received data lenght is saved to s_recvSize. If s_recvSize is 0, device will call USB_DeviceCdcAcmRecv to
- * schedule buffer for next receiving event directly and it means there is no data to echo to host. If s_recvSize is not
- * 0, USB_DeviceCdcVcomTask will copy the received data into s_currSendBuf then send back to host. Once data is echoed
- * back completely, USB_DeviceCdcAcmRecv is called in kUSB_DeviceCdcEventSendResponse event to be ready to receive the
- * next data from host. Instead, USB_DeviceCdcAcmRecv also can be called in kUSB_DeviceCdcEventRecvResponse event as
- * long as the received data is handled completely.
+ * This function handles the CDC class specific requests. Once device receives data,
+ * kUSB_DeviceCdcEventRecvResponse event will be asserted. The received packet is copied into s_rxRing and the next
+ * receive is scheduled right away if the ring can take another full packet; otherwise it is scheduled by the app task
+ * once it has drained the ring. kUSB_DeviceCdcEventSendResponse frees the bulk IN endpoint for the next CDC OUT
+ * block. Both wake the app task.
  *
  * @param handle          The CDC ACM class handle.
  * @param event           The CDC ACM class event type.
@@ -173,13 +188,10 @@ usb_status_t USB_DeviceCdcVcomCallback(class_handle_t handle, uint32_t event, vo
             {
                 if ((epCbParam->buffer != NULL) || ((epCbParam->buffer == NULL) && (epCbParam->length == 0)))
                 {
-                    /* User: add your own code for send complete event */
-                    /* In this case, the received data has been sent back to host, then now schedule buffer for next
-                       receiving event. Note that USB_DeviceCdcAcmRecv also can be called in
-                       kUSB_DeviceCdcEventRecvResponse as long as we make sure the received data can be handled properly
-                     */
-                    error = USB_DeviceCdcAcmRecv(handle, USB_CDC_VCOM_BULK_OUT_ENDPOINT, s_currRecvBuf,
-                                                 g_UsbDeviceCdcVcomDicEndpoints[1].maxPacketSize);
+                    /* The CDC OUT block has been sent to the host, the next one can go. */
+                    s_sendBusy = 0U;
+                    error      = kStatus_USB_Success;
+                    (void)xTaskNotifyGive(s_cdcVcom.applicationTaskHandle);
 #if defined(FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED) && (FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED > 0U) && \
     defined(USB_DEVICE_CONFIG_KEEP_ALIVE_MODE) && (USB_DEVICE_CONFIG_KEEP_ALIVE_MODE > 0U) &&             \
     defined(FSL_FEATURE_USB_KHCI_USB_RAM) && (FSL_FEATURE_USB_KHCI_USB_RAM > 0U)
@@ -197,12 +209,28 @@ usb_status_t USB_DeviceCdcVcomCallback(class_handle_t handle, uint32_t event, vo
         {
             if ((1U == s_cdcVcom.attach) && (1U == s_cdcVcom.startTransactions))
             {
-                /* Save the received data length, the data will be handled in USB_DeviceCdcVcomTask. Certainly, the
-                   received data also can be handled by any other user's application. Meanwhile, once complete handling
-                   the received data then we can also call USB_DeviceCdcAcmRecv here to be ready to receive the next
-                   data.  */
-                s_recvSize = epCbParam->length;
-                error      = kStatus_USB_Success;
+                /* The receive was only scheduled with a full packet free in the ring, so the packet always fits.
+                   The endpoint callback length is USB_CANCELLED_TRANSFER_LENGTH when the transfer is canceled. */
+                uint32_t length = epCbParam->length;
+                s_recvPrimed    = 0U;
+                error           = kStatus_USB_Success;
+
+                if ((0U != length) && (USB_CANCELLED_TRANSFER_LENGTH != length))
+                {
+                    uint32_t head  = s_rxHead;
+                    uint32_t index = head & CDC_VCOM_RX_RING_MASK;
+                    uint32_t first = CDC_VCOM_RX_RING_SIZE - index;
+
+                    if (first > length)
+                    {
+                        first = length;
+                    }
+                    (void)memcpy(&s_rxRing[index], s_currRecvBuf, first);
+                    (void)memcpy(&s_rxRing[0], &s_currRecvBuf[first], length - first);
+                    s_rxHead = head + length;
+
+                    (void)xTaskNotifyGive(s_cdcVcom.applicationTaskHandle);
+                }
 
 #if defined(FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED) && (FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED > 0U) && \
     defined(USB_DEVICE_CONFIG_KEEP_ALIVE_MODE) && (USB_DEVICE_CONFIG_KEEP_ALIVE_MODE > 0U) &&             \
@@ -210,12 +238,9 @@ usb_status_t USB_DeviceCdcVcomCallback(class_handle_t handle, uint32_t event, vo
                 s_waitForDataReceive = 0;
                 USB0->INTEN |= USB_INTEN_SOFTOKEN_MASK;
 #endif
-                /* There is no data to echo to host (host sends 0 length data packet), now directly schedule buffer for
-                 * next receiving event */
-                if (0U == s_recvSize)
+                if (USB_CANCELLED_TRANSFER_LENGTH != length)
                 {
-                    error = USB_DeviceCdcAcmRecv(handle, USB_CDC_VCOM_BULK_OUT_ENDPOINT, s_currRecvBuf,
-                                                 g_UsbDeviceCdcVcomDicEndpoints[1].maxPacketSize);
+                    USB_DeviceCdcVcomPrimeRecv();
 #if defined(FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED) && (FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED > 0U) && \
     defined(USB_DEVICE_CONFIG_KEEP_ALIVE_MODE) && (USB_DEVICE_CONFIG_KEEP_ALIVE_MODE > 0U) &&             \
     defined(FSL_FEATURE_USB_KHCI_USB_RAM) && (FSL_FEATURE_USB_KHCI_USB_RAM > 0U)
@@ -462,9 +487,11 @@ usb_status_t USB_DeviceCallback(usb_device_handle handle, uint32_t event, void *
                 s_cdcVcom.attach               = 1;
                 s_cdcVcom.currentConfiguration = *temp8;
                 error                          = kStatus_USB_Success;
-                /* Schedule buffer for receive */
-                USB_DeviceCdcAcmRecv(s_cdcVcom.cdcAcmHandle, USB_CDC_VCOM_BULK_OUT_ENDPOINT, s_currRecvBuf,
-                                     g_UsbDeviceCdcVcomDicEndpoints[1].maxPacketSize);
+                /* Start from an empty ring and schedule buffer for receive */
+                s_rxTail     = s_rxHead;
+                s_recvPrimed = 0U;
+                s_sendBusy   = 0U;
+                USB_DeviceCdcVcomPrimeRecv();
             }
             else
             {
@@ -557,6 +584,60 @@ static void CDC_VCOM_FreeRTOSExitCritical(uint32_t sr)
     EnableGlobalIRQ(sr);
 }
 
+/*!
+ * @brief Schedules the next bulk OUT receive if none is scheduled and the ring can take a full packet.
+ *
+ * Called by the USB device task after each packet and by the app task after it drains the ring.
+ */
+static void USB_DeviceCdcVcomPrimeRecv(void)
+{
+    uint32_t usbOsaCurrentSr;
+    uint32_t maxPacketSize = g_UsbDeviceCdcVcomDicEndpoints[1].maxPacketSize;
+    bool prime;
+
+    CDC_VCOM_FreeRTOSEnterCritical(&usbOsaCurrentSr);
+    prime = (0U == s_recvPrimed) && ((CDC_VCOM_RX_RING_SIZE - (s_rxHead - s_rxTail)) >= maxPacketSize);
+    if (prime)
+    {
+        s_recvPrimed = 1U;
+    }
+    CDC_VCOM_FreeRTOSExitCritical(usbOsaCurrentSr);
+
+    if (prime && (kStatus_USB_Success !=
+                  USB_DeviceCdcAcmRecv(s_cdcVcom.cdcAcmHandle, USB_CDC_VCOM_BULK_OUT_ENDPOINT, s_currRecvBuf,
+                                       maxPacketSize)))
+    {
+        s_recvPrimed = 0U;
+    }
+}
+
+/*!
+ * @brief Moves up to one bridge block of host data from the ring.
+ *
+ * @return The number of bytes copied to block.
+ */
+static uint8_t USB_DeviceCdcVcomPopBlock(uint8_t *block)
+{
+    uint32_t tail   = s_rxTail;
+    uint32_t length = s_rxHead - tail;
+    uint32_t index  = tail & CDC_VCOM_RX_RING_MASK;
+    uint32_t first  = CDC_VCOM_RX_RING_SIZE - index;
+
+    if (length > SPI_BRIDGE_MAX_PAYLOAD_LENGTH)
+    {
+        length = SPI_BRIDGE_MAX_PAYLOAD_LENGTH;
+    }
+    if (first > length)
+    {
+        first = length;
+    }
+    (void)memcpy(block, &s_rxRing[index], first);
+    (void)memcpy(&block[first], &s_rxRing[0], length - first);
+    s_rxTail = tail + length;
+
+    return (uint8_t)length;
+}
+
 /*!
  * @brief Application initialization function.
  *
@@ -620,7 +701,6 @@ void USB_DeviceCdcVcomTask(void *handle)
 static void USB_DeviceCdcVcomAppTask(void *handle)
 {
     usb_status_t error = kStatus_USB_Error;
-    uint32_t usbOsaCurrentSr;
 
     USB_DeviceCdcVcomApplicationInit();
 
@@ -641,43 +721,38 @@ static void USB_DeviceCdcVcomAppTask(void *handle)
     }
 #endif
 
+    /* Woken by the USB callbacks and by the SPI bridge when the V70 reads the CDC IN block or writes the CDC OUT
+     * block. */
+    SPI_BridgeSetCdcNotifyTask(xTaskGetCurrentTaskHandle());
+
     while (1)
     {
+        (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
         if ((1U == s_cdcVcom.attach) && (1U == s_cdcVcom.startTransactions))
         {
-            /* Enter critical can not be added here because of the loop */
-            /* endpoint callback length is USB_CANCELLED_TRANSFER_LENGTH (0xFFFFFFFFU) when transfer is canceled */
-            if ((0 != s_recvSize) && (USB_CANCELLED_TRANSFER_LENGTH != s_recvSize))
+            /* Host to V70: the next block goes once the V70 has read the last one, so nothing is overwritten. */
+            if (!SPI_BridgeCdcInPending() && (s_rxHead != s_rxTail))
             {
-                CDC_VCOM_FreeRTOSEnterCritical(&usbOsaCurrentSr);
-                if ((0U != s_recvSize) && (USB_CANCELLED_TRANSFER_LENGTH != s_recvSize))
-                {
-                    uint32_t mirroredLength = (s_recvSize > SPI_BRIDGE_MAX_PAYLOAD_LENGTH) ? SPI_BRIDGE_MAX_PAYLOAD_LENGTH : s_recvSize;
-                    (void)SPI_BridgeSendCdcIn(s_currRecvBuf, (uint8_t)mirroredLength);
-                    s_recvSize = 0;
-                }
-                CDC_VCOM_FreeRTOSExitCritical(usbOsaCurrentSr);
+                uint8_t block[SPI_BRIDGE_MAX_PAYLOAD_LENGTH];
+                uint8_t length = USB_DeviceCdcVcomPopBlock(block);
+
+                (void)SPI_BridgeSendCdcIn(block, length);
+                USB_DeviceCdcVcomPrimeRecv();
             }
 
-            uint8_t cdcOutPayload[SPI_BRIDGE_MAX_PAYLOAD_LENGTH];
+            /* V70 to host: the CDC OUT block is only taken while the bulk IN endpoint is free. */
             uint8_t cdcOutLength = 0U;
-            if (SPI_BridgeGetCdcOut(NULL, cdcOutPayload, &cdcOutLength))
+            if ((0U == s_sendBusy) && SPI_BridgeGetCdcOut(NULL, s_currSendBuf, &cdcOutLength))
             {
-                memcpy(s_currSendBuf, cdcOutPayload, cdcOutLength);
-                s_sendSize = cdcOutLength;
                 (void)SPI_BridgeClearCdcOut();
-            }
-
-            if (0U != s_sendSize)
-            {
-                uint32_t size = s_sendSize;
-                s_sendSize    = 0;
+                s_sendBusy = 1U;
 
-                error =
-                    USB_DeviceCdcAcmSend(s_cdcVcom.cdcAcmHandle, USB_CDC_VCOM_BULK_IN_ENDPOINT, s_currSendBuf, size);
+                error = USB_DeviceCdcAcmSend(s_cdcVcom.cdcAcmHandle, USB_CDC_VCOM_BULK_IN_ENDPOINT, s_currSendBuf,
+                                             cdcOutLength);
                 if (error != kStatus_USB_Success)
                 {
-                    /* Failure to send Data Handling code here */
+                    s_sendBusy = 0U;
                 }
             }
 #if defined(FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED) && (FSL_FEATURE_USB_KHCI_KEEP_ALIVE_ENABLED > 0U) && \
@@ -24,6 +24,13 @@
  ******************************************************************************/
 
 #define CDC_DATA_BUFF_SIZE HS_CDC_VCOM_BULK_OUT_PACKET_SIZE
+
+/* Host to V70 bytes waiting for the CDC IN bridge block. Must be a power of 2. While less than a bulk OUT packet
+ * is free the OUT endpoint is left unscheduled, so the host is NAKed instead of data being dropped. */
+#ifndef CDC_VCOM_RX_RING_SIZE
+#define CDC_VCOM_RX_RING_SIZE (4096U)
+#endif
+
 #if (USB_CDC_EHCI_INSTANCE == 0U)
 #define CDC_CONTROLLER_ID kUSB_ControllerEhci0
 #else